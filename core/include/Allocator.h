@@ -0,0 +1,396 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * Subsystems whose allocations are counted separately
+ */
+enum class MemoryTag : uint8_t
+{
+	Frame, // Per-frame arena of the renderer
+	Scratch, // Thread-local scratch arenas
+	Nodes, // Scene graph node pools
+	Geometry, // Vertex arrays of geometries
+	Count
+};
+
+/**
+ * Allocation counters of one subsystem
+ */
+struct MemoryStats
+{
+	uint64_t	uAllocations; // Allocations made since start
+	uint64_t	uFrees; // Allocations freed, arenas free all of theirs at once
+	size_t		uBytes; // Bytes currently allocated
+	size_t		uPeakBytes; // Highest value of uBytes seen
+};
+
+/**
+ * Counts allocations per subsystem. Counters are atomic, so any thread may
+ * allocate, and reading them gives a consistent enough picture for profiling.
+ * Arenas report their allocations in bulk when they are released, to keep
+ * atomics out of the bump path.
+ */
+class MemoryTracker
+{
+public:
+	/**
+	 * Count an allocation
+	 * @param tag subsystem allocating
+	 * @param bytes size of the allocation
+	 * @param count number of allocations made
+	 */
+	static void Allocated(MemoryTag tag, size_t bytes, uint64_t count = 1);
+
+	/**
+	 * Count a free
+	 * @param tag subsystem freeing
+	 * @param bytes size of the freed memory
+	 * @param count number of allocations freed
+	 */
+	static void Freed(MemoryTag tag, size_t bytes, uint64_t count = 1);
+
+	/**
+	 * Get counters of a subsystem
+	 * @param tag subsystem
+	 * @return current counters
+	 */
+	static MemoryStats GetStats(MemoryTag tag);
+
+	/**
+	 * Get name of a subsystem for printing
+	 * @param tag subsystem
+	 * @return name
+	 */
+	static const char* GetName(MemoryTag tag);
+
+private:
+	struct COUNTERS
+	{
+		std::atomic<uint64_t>	allocations;
+		std::atomic<uint64_t>	frees;
+		std::atomic<size_t>		bytes;
+		std::atomic<size_t>		peakBytes;
+	};
+
+	static COUNTERS	s_arrCounters[(size_t)MemoryTag::Count];
+};
+
+/**
+ * Statistics of a linear arena
+ */
+struct LinearArenaStats
+{
+	size_t		uUsedBytes; // Bytes allocated since the last reset
+	size_t		uPeakBytes; // Highest value of uUsedBytes seen
+	size_t		uCapacityBytes; // Bytes reserved from the heap
+	size_t		uBlocks; // Heap blocks backing the arena
+};
+
+/**
+ * Bump allocator. Allocating moves a pointer forward and nothing is freed
+ * individually; everything is released at once by Reset, or back to a
+ * marker by Rewind. When a block runs out another one is added, and Reset
+ * merges the blocks into one, so after the first frames the arena does not
+ * touch the heap at all. Not thread-safe, use one arena per thread.
+ */
+class LinearArena
+{
+public:
+	// Position in the arena to rewind to
+	struct Marker
+	{
+		size_t		uBlock;
+		size_t		uOffset;
+		size_t		uUsedBytes;
+		uint64_t	uAllocations;
+	};
+
+	/**
+	 * Create arena, memory is reserved on first allocation
+	 * @param tag subsystem the allocations are counted for
+	 * @param blockSize size of the first block in bytes
+	 */
+	LinearArena(MemoryTag tag, size_t blockSize = 64 * 1024);
+	~LinearArena();
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	/**
+	 * Allocate memory valid until the next Reset or Rewind past it
+	 * @param bytes size to allocate
+	 * @param alignment power of two alignment
+	 * @return pointer to the memory, never null
+	 */
+	void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	/**
+	 * Allocate an uninitialized array
+	 * @param count number of elements
+	 * @return pointer to the first element
+	 */
+	template<typename T>
+	inline T* Allocate(size_t count) { return (T*)Allocate(count * sizeof(T), alignof(T)); }
+
+	/**
+	 * Release all allocations and merge the blocks into one
+	 */
+	void Reset();
+
+	/**
+	 * Get current position for Rewind
+	 * @return marker of the current position
+	 */
+	inline Marker GetMarker() const { return { m_uBlock, m_uOffset, m_uUsedBytes, m_uAllocations }; }
+
+	/**
+	 * Release allocations made after the marker. Rewinding to an empty
+	 * arena merges the blocks like Reset.
+	 * @param marker position returned by GetMarker
+	 */
+	void Rewind(const Marker& marker);
+
+	/**
+	 * Get statistics
+	 * @return current statistics
+	 */
+	LinearArenaStats GetStats() const;
+
+	/**
+	 * Get the scratch arena of the calling thread, for temporaries of a
+	 * single function. Use ArenaScope to release them.
+	 * @return arena of the calling thread
+	 */
+	static LinearArena& GetScratch();
+
+private:
+	struct BLOCK
+	{
+		uint8_t*	data;
+		size_t		size;
+	};
+
+	void Release(const Marker& marker);
+	void AddBlock(size_t minSize);
+	void FreeBlocks();
+
+	MemoryTag				m_eTag;
+	size_t					m_uBlockSize;
+	std::vector<BLOCK>		m_arrBlocks;
+	size_t					m_uBlock; // Block being allocated from
+	size_t					m_uOffset; // Position in the block
+	size_t					m_uUsedBytes;
+	size_t					m_uPeakBytes;
+	uint64_t				m_uAllocations; // Allocations since the last reset
+};
+
+/**
+ * Releases allocations made in a scope from an arena, the scratch arena of
+ * the calling thread by default
+ */
+class ArenaScope
+{
+public:
+	ArenaScope(LinearArena& arena = LinearArena::GetScratch()) : m_Arena(arena), m_Marker(arena.GetMarker()) {}
+	~ArenaScope() { m_Arena.Rewind(m_Marker); }
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+	inline LinearArena& GetArena() { return m_Arena; }
+
+private:
+	LinearArena&			m_Arena;
+	LinearArena::Marker		m_Marker;
+};
+
+/**
+ * Standard allocator allocating from a linear arena. Deallocation does
+ * nothing, so reserve containers up front to avoid leaving the buffers of
+ * earlier growth behind in the arena.
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+
+	ArenaAllocator(LinearArena& arena) : m_pArena(&arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_pArena(other.GetArena()) {}
+
+	inline T* allocate(size_t count) { return m_pArena->Allocate<T>(count); }
+	inline void deallocate(T*, size_t) {}
+
+	inline LinearArena* GetArena() const { return m_pArena; }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return m_pArena == other.GetArena(); }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return m_pArena != other.GetArena(); }
+
+private:
+	LinearArena*	m_pArena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/**
+ * Free list of fixed size elements carved out of larger chunks. Chunks are
+ * kept until the pool is destroyed, so long running sessions reuse the same
+ * memory instead of fragmenting the heap.
+ */
+class FixedPool
+{
+public:
+	/**
+	 * Create pool, chunks are allocated on demand
+	 * @param elementSize size of one element
+	 * @param alignment alignment of the elements
+	 * @param tag subsystem the allocations are counted for
+	 * @param elementsPerChunk number of elements allocated from the heap at once
+	 */
+	FixedPool(size_t elementSize, size_t alignment, MemoryTag tag, size_t elementsPerChunk = 256);
+	~FixedPool();
+
+	FixedPool(const FixedPool&) = delete;
+	FixedPool& operator=(const FixedPool&) = delete;
+
+	/**
+	 * Take an element from the pool
+	 * @return uninitialized memory of the element size
+	 */
+	void* Allocate();
+
+	/**
+	 * Return an element to the pool
+	 * @param element element returned by Allocate
+	 */
+	void Free(void* element);
+
+	/**
+	 * Get number of elements allocated and not freed
+	 * @return live element count
+	 */
+	size_t GetLiveCount() const;
+
+private:
+	struct FREENODE
+	{
+		FREENODE*	next;
+	};
+
+	void AddChunk();
+
+	mutable std::mutex		m_Mutex;
+	FREENODE*				m_pFree;
+	std::vector<void*>		m_arrChunks;
+	size_t					m_uElementSize;
+	size_t					m_uAlignment;
+	size_t					m_uElementsPerChunk;
+	size_t					m_uLiveCount;
+	MemoryTag				m_eTag;
+};
+
+/**
+ * Standard allocator taking single objects from a pool shared by all
+ * objects of the same type, e.g. with std::allocate_shared. Arrays go to
+ * the heap. The pools are never destroyed, so objects may outlive statics.
+ */
+template<typename T, MemoryTag Tag>
+class PoolAllocator
+{
+public:
+	using value_type = T;
+
+	template<typename U>
+	struct rebind
+	{
+		using other = PoolAllocator<U, Tag>;
+	};
+
+	PoolAllocator() {}
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U, Tag>&) {}
+
+	inline T* allocate(size_t count)
+	{
+		if (count == 1)
+		{
+			return (T*)GetPool().Allocate();
+		}
+		MemoryTracker::Allocated(Tag, count * sizeof(T));
+		return (T*)::operator new(count * sizeof(T), std::align_val_t(alignof(T)));
+	}
+
+	inline void deallocate(T* p, size_t count)
+	{
+		if (count == 1)
+		{
+			GetPool().Free(p);
+			return;
+		}
+		MemoryTracker::Freed(Tag, count * sizeof(T));
+		::operator delete(p, std::align_val_t(alignof(T)));
+	}
+
+	/**
+	 * Get the pool of this type
+	 * @return pool, created on first use
+	 */
+	static FixedPool& GetPool()
+	{
+		static FixedPool* pool = new FixedPool(sizeof(T), alignof(T), Tag);
+		return *pool;
+	}
+
+	template<typename U>
+	bool operator==(const PoolAllocator<U, Tag>&) const { return true; }
+	template<typename U>
+	bool operator!=(const PoolAllocator<U, Tag>&) const { return false; }
+};
+
+/**
+ * Standard allocator using the heap and counting the allocations for a subsystem
+ */
+template<typename T, MemoryTag Tag>
+class TrackingAllocator
+{
+public:
+	using value_type = T;
+
+	template<typename U>
+	struct rebind
+	{
+		using other = TrackingAllocator<U, Tag>;
+	};
+
+	TrackingAllocator() {}
+	template<typename U>
+	TrackingAllocator(const TrackingAllocator<U, Tag>&) {}
+
+	inline T* allocate(size_t count)
+	{
+		MemoryTracker::Allocated(Tag, count * sizeof(T));
+		return std::allocator<T>().allocate(count);
+	}
+
+	inline void deallocate(T* p, size_t count)
+	{
+		MemoryTracker::Freed(Tag, count * sizeof(T));
+		std::allocator<T>().deallocate(p, count);
+	}
+
+	template<typename U>
+	bool operator==(const TrackingAllocator<U, Tag>&) const { return true; }
+	template<typename U>
+	bool operator!=(const TrackingAllocator<U, Tag>&) const { return false; }
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+#include "../include/JobPool.h"
+
+#include <memory>
+
+// Forward declarations
+class CameraNode;
+
+/**
+ * Point light of the clustered lighting
+ */
+struct PointLight
+{
+	glm::vec3		vPosition; // World space
+	float			fRadius; // Light has no effect beyond this distance
+	glm::vec3		cColor; // Color multiplied with intensity
+};
+
+/**
+ * Statistics of the last binned frame
+ */
+struct ClusterStats
+{
+	size_t		uLights; // Lights added
+	size_t		uVisibleLights; // Lights touching at least one depth slice
+	size_t		uLightIndices; // Entries in all cluster lists
+	size_t		uOverflow; // Entries dropped from full clusters
+	float		fBinSeconds; // Time spent binning on the CPU
+};
+
+/**
+ * Clustered forward lighting. The view frustum is divided into a grid of
+ * screen tiles and exponential depth slices, and point lights are binned into
+ * the clusters they touch with SSE sphere against box tests, one depth slice
+ * per job across worker threads. Lights, per-cluster ranges and light indices
+ * are uploaded into texture buffers that shaders iterate with the code of
+ * GetShaderSource. Needs OpenGL 3.1.
+ */
+class ClusteredLighting
+{
+public:
+	/**
+	 * Create clustered lighting
+	 * @param renderer renderer used for uploading
+	 * @param jobPool worker threads that bin depth slices, usually IApplication::GetJobPool
+	 * @param tilesX, tilesY number of screen tiles
+	 * @param slices number of depth slices
+	 */
+	ClusteredLighting(OpenGLRenderer& renderer, JobPool& jobPool, uint32_t tilesX = 16, uint32_t tilesY = 9, uint32_t slices = 24);
+	~ClusteredLighting();
+
+	ClusteredLighting(const ClusteredLighting&) = delete;
+	ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+	/**
+	 * Create the texture buffers
+	 * @return true if successful
+	 */
+	bool Create();
+
+	/**
+	 * Delete the texture buffers
+	 */
+	void Release();
+
+	/**
+	 * Remove all lights
+	 */
+	inline void ClearLights() { m_arrLights.clear(); }
+
+	/**
+	 * Add a light for the next Update
+	 * @param light light to add
+	 */
+	inline void AddLight(const PointLight& light) { m_arrLights.push_back(light); }
+
+	/**
+	 * Get the lights, which can be changed directly before the next Update
+	 * @return reference to the lights
+	 */
+	inline std::vector<PointLight>& GetLights() { return m_arrLights; }
+
+	/**
+	 * Bin the lights into the clusters of a camera and upload the result
+	 * @param camera camera the frame is rendered with
+	 * @param viewportSize size of the viewport in pixels
+	 */
+	void Update(const CameraNode& camera, const glm::ivec2& viewportSize);
+
+	/**
+	 * Bind the texture buffers and set the uniforms of GetShaderSource to a program
+	 * @param program program including GetShaderSource
+	 * @param firstSlot first of the three texture slots used
+	 */
+	void Apply(GLuint program, int32_t firstSlot) const;
+
+	inline const ClusterStats& GetStats() const { return m_Stats; }
+
+	/**
+	 * Check if the context supports texture buffers
+	 * @return true if the functions were loaded
+	 */
+	static bool IsSupported();
+
+	/**
+	 * Get GLSL declarations for fragment shaders. GetClusteredLighting(worldPosition,
+	 * normal, viewDepth) returns the summed diffuse light of the cluster of the
+	 * fragment, GetClusterRange and GetClusterLight allow custom lighting models.
+	 * Needs #version 330.
+	 * @return shader source code to include
+	 */
+	static const char* GetShaderSource();
+
+	// Lights per cluster, the rest are dropped and counted in ClusterStats::uOverflow
+	static constexpr uint32_t kMaxLightsPerCluster = 256;
+
+private:
+	// Light in view space, prepared for binning
+	struct VIEWLIGHT
+	{
+		glm::vec4		vSphere; // Center and radius
+		uint32_t		uLight; // Index into the lights
+		uint32_t		uFirstSlice;
+		uint32_t		uLastSlice;
+	};
+
+	void UpdateClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane);
+	void BinSlices();
+	void BinSlice(uint32_t slice);
+
+	OpenGLRenderer&							m_Renderer;
+	uint32_t								m_uTilesX;
+	uint32_t								m_uTilesY;
+	uint32_t								m_uSlices;
+	uint32_t								m_uSliceStride; // Tiles per slice rounded up to a multiple of 4
+
+	std::vector<PointLight>					m_arrLights;
+	std::vector<VIEWLIGHT>					m_arrViewLights;
+
+	// View space bounds of the tiles in each slice, SoA for SSE
+	std::vector<float>						m_arrMinX;
+	std::vector<float>						m_arrMaxX;
+	std::vector<float>						m_arrMinY;
+	std::vector<float>						m_arrMaxY;
+	std::vector<float>						m_arrSliceDepths; // Slice boundaries, m_uSlices + 1 values
+	glm::mat4								m_mBoundsProjection; // Projection the bounds were built for
+
+	// Binning results, each cluster is written by the thread of its slice
+	std::vector<std::vector<uint32_t>>		m_arrClusterLights;
+	std::vector<size_t>						m_arrSliceOverflow;
+
+	// Upload data
+	std::vector<glm::vec4>					m_arrLightData; // Two texels per light
+	std::vector<glm::uvec2>					m_arrGrid; // Offset and count per cluster
+	std::vector<uint32_t>					m_arrIndices;
+
+	GLuint									m_LightBuffer;
+	GLuint									m_GridBuffer;
+	GLuint									m_IndexBuffer;
+	GLuint									m_LightTexture;
+	GLuint									m_GridTexture;
+	GLuint									m_IndexTexture;
+	glm::vec2								m_vDepthParams; // Slice from log depth, scale and bias
+	glm::vec2								m_vViewportSize;
+
+	// Worker threads bin depth slices
+	JobPool&								m_JobPool;
+
+	ClusterStats							m_Stats;
+};
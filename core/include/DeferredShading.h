@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+#include "../include/ClusteredLighting.h"
+#include "../include/GpuTimer.h"
+
+// Forward declarations
+class Node;
+
+/**
+ * Statistics of the last deferred frame, GPU times lag a few frames behind
+ */
+struct DeferredStats
+{
+	size_t		uLights; // Point lights drawn as light volumes
+	size_t		uLightPixels; // Pixels covered by the light volumes, main light not included
+	float		fGeometrySeconds; // GPU time of the geometry pass
+	float		fLightingSeconds; // GPU time of the lighting passes
+};
+
+/**
+ * Deferred shading path of the OpenGLRenderer, created when the application
+ * asks for ShadingPath::Deferred. The geometry pass draws a node hierarchy
+ * with its own program into a compact G-buffer: albedo and specular intensity
+ * in RGBA8, octahedral normal and specular power in RGBA16, and depth from
+ * which positions are reconstructed. Ambient and emissive light go straight
+ * into a light accumulation buffer. Lighting is then added with one
+ * full-screen pass for the renderer's main light and one screen-space quad per
+ * point light, so its cost follows the lit pixels instead of the objects.
+ */
+class DeferredShading
+{
+public:
+	DeferredShading(OpenGLRenderer& renderer);
+	~DeferredShading();
+
+	DeferredShading(const DeferredShading&) = delete;
+	DeferredShading& operator=(const DeferredShading&) = delete;
+
+	/**
+	 * Compile the programs and create the G-buffer
+	 * @param width, height size of the G-buffer in pixels
+	 * @return true if successful
+	 */
+	bool Create(int32_t width, int32_t height);
+
+	/**
+	 * Delete programs and framebuffers
+	 */
+	void Release();
+
+	/**
+	 * Resize the G-buffer, does nothing if the size is the same
+	 * @param width, height new size in pixels
+	 * @return true if successful
+	 */
+	bool Resize(int32_t width, int32_t height);
+
+	/**
+	 * Run all passes and draw the lit image into the current framebuffer.
+	 * View and projection are taken from the renderer. Called by
+	 * OpenGLRenderer::RenderScene when the deferred path is in use.
+	 * @param root hierarchy of opaque geometry nodes
+	 * @param lights point lights, can be empty
+	 */
+	void Render(Node& root, const std::vector<PointLight>& lights);
+
+	/**
+	 * Bind and clear the G-buffer and activate the geometry program.
+	 * Draw the nodes with GetGeometryProgram between Begin and EndGeometryPass.
+	 */
+	void BeginGeometryPass();
+	void EndGeometryPass();
+
+	/**
+	 * Add the main light and the point lights into the light accumulation buffer
+	 * @param lights point lights, can be empty
+	 */
+	void LightingPass(const std::vector<PointLight>& lights);
+
+	/**
+	 * Copy the light accumulation buffer into the framebuffer that was bound
+	 * before BeginGeometryPass
+	 */
+	void Present();
+
+	inline GLuint GetGeometryProgram() const { return m_GeometryProgram; }
+	inline GLuint GetAlbedoTexture() const { return m_AlbedoTexture; }
+	inline GLuint GetNormalTexture() const { return m_NormalTexture; }
+	inline GLuint GetDepthTexture() const { return m_DepthTexture; }
+	inline const DeferredStats& GetStats() const { return m_Stats; }
+
+	/**
+	 * Check if the context supports multiple render targets
+	 * @return true if the functions were loaded
+	 */
+	static bool IsSupported();
+
+private:
+	// Corner of a light quad, all lights are drawn with one call
+	struct LIGHTVERTEX
+	{
+		glm::vec2		vCorner; // Normalized device coordinates
+		glm::vec4		vLight; // View space position and radius
+		glm::vec3		cColor;
+	};
+
+	bool CreateTargets(int32_t width, int32_t height);
+	void ReleaseTargets();
+	bool AddLightQuad(const glm::vec3& viewPosition, float radius, const glm::vec3& color);
+	void DrawLightQuads();
+
+	OpenGLRenderer&				m_Renderer;
+	int32_t						m_iWidth;
+	int32_t						m_iHeight;
+
+	GLuint						m_GeometryProgram;
+	GLuint						m_LightProgram;
+	GLuint						m_PresentProgram;
+
+	// G-buffer and light accumulation
+	GLuint						m_GeometryFramebuffer;
+	GLuint						m_LightFramebuffer; // Light accumulation only
+	GLuint						m_AlbedoTexture;
+	GLuint						m_NormalTexture;
+	GLuint						m_LightTexture;
+	GLuint						m_DepthTexture;
+	GLint						m_iPrevFramebuffer; // Framebuffer bound before the geometry pass
+
+	std::vector<LIGHTVERTEX>	m_arrLightVertices;
+	GpuTimer					m_GeometryTimer;
+	GpuTimer					m_LightingTimer;
+	DeferredStats				m_Stats;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+// Forward declarations
+class Node;
+class GeometryNode;
+
+/**
+ * Statistics of the last rendered frame, overdraw lags a few frames behind
+ */
+struct DepthPrepassStats
+{
+	size_t		uOpaque; // Opaque geometry nodes drawn
+	size_t		uTransparent; // Transparent geometry nodes drawn
+	float		fDepthOverdraw; // Fragments passing the depth test per pixel in the pre-pass, the cost of shading without it
+	float		fShadedOverdraw; // Fragments shaded per pixel in the opaque shading pass
+	bool		bPrepass; // Depth pre-pass was used
+};
+
+/**
+ * Renders a node hierarchy in an early-Z friendly order. Opaque geometry nodes
+ * are sorted front to back by view depth and first drawn with a depth-only
+ * program, then shaded with GL_EQUAL depth testing so that every pixel runs
+ * the expensive fragment shader once. Nodes with diffuse alpha below one go
+ * into a separate bucket drawn back to front with blending after the opaque
+ * ones. Samples passed queries measure the overdraw of both passes.
+ *
+ * GL_EQUAL needs both passes to produce bit-identical depths: shading programs
+ * should compute gl_Position as modelViewProjectionMatrix * vec4(position, 1.0)
+ * and declare it invariant, or a matching depth program can be set.
+ */
+class DepthPrepass
+{
+public:
+	DepthPrepass(OpenGLRenderer& renderer);
+	~DepthPrepass();
+
+	DepthPrepass(const DepthPrepass&) = delete;
+	DepthPrepass& operator=(const DepthPrepass&) = delete;
+
+	/**
+	 * Compile the depth-only program
+	 * @return true if successful
+	 */
+	bool Create();
+
+	/**
+	 * Delete the program and the queries
+	 */
+	void Release();
+
+	/**
+	 * Draw a node hierarchy, opaque nodes first and transparent nodes last.
+	 * View and projection are taken from the renderer.
+	 * @param root root of the hierarchy
+	 * @param program shading program
+	 */
+	void Render(Node& root, GLuint program);
+
+	/**
+	 * Turn the depth pre-pass on or off. Without it opaque nodes are still
+	 * sorted but shaded with GL_LESS, which gives the overdraw to compare with.
+	 * @param enabled true to draw depth first
+	 */
+	inline void SetEnabled(bool enabled) { m_bEnabled = enabled; }
+	inline bool IsEnabled() const { return m_bEnabled; }
+
+	/**
+	 * Replace the built-in depth-only program, for shading programs that
+	 * transform positions differently
+	 * @param program program writing the same depths as the shading program, 0 for the built-in one
+	 */
+	inline void SetDepthProgram(GLuint program) { m_CustomDepthProgram = program; }
+
+	inline const DepthPrepassStats& GetStats() const { return m_Stats; }
+
+private:
+	// Frames that can be in flight before a result is waited for
+	static constexpr uint32_t kQueryCount = 4;
+
+	struct DRAWITEM
+	{
+		const GeometryNode*		pNode;
+		glm::mat4				mWorld;
+		float					fDepth; // Distance along the view direction
+	};
+
+	void Collect(const Node& node, const glm::mat4& parentWorld, const glm::mat4& view);
+	void DrawItems(const std::vector<DRAWITEM>& items, GLuint program, bool material);
+	void CollectQueries(bool wait);
+
+	OpenGLRenderer&				m_Renderer;
+	GLuint						m_DepthProgram;
+	GLuint						m_CustomDepthProgram;
+	bool						m_bEnabled;
+
+	std::vector<DRAWITEM>		m_arrOpaque;
+	std::vector<DRAWITEM>		m_arrTransparent;
+
+	// Samples passed in the pre-pass and in the shading pass
+	GLuint						m_arrQueries[kQueryCount][2];
+	bool						m_arrPending[kQueryCount];
+	bool						m_arrPrepass[kQueryCount];
+	float						m_arrPixels[kQueryCount];
+	uint32_t					m_uCurrent;
+	uint32_t					m_uOldest;
+
+	DepthPrepassStats			m_Stats;
+};
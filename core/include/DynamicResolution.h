@@ -0,0 +1,121 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+#include "../include/GpuTimer.h"
+
+/**
+ * Statistics of the dynamic resolution controller
+ */
+struct DynamicResolutionStats
+{
+	float		fScale; // Render size relative to the window on both axes
+	float		fSceneSeconds; // Latest GPU time of the scene
+	int32_t		iWidth; // Render width in pixels
+	int32_t		iHeight; // Render height in pixels
+	uint32_t	uScaleChanges; // Times the render size has changed
+};
+
+/**
+ * Renders the 3D scene into an offscreen target whose size follows the GPU
+ * load. The scene's GPU time is measured with timestamp queries and every few
+ * frames a PI controller moves the resolution scale towards the frame time
+ * target. The scale only rises once there is clear headroom, and changes are
+ * accumulated until they exceed a dead band, so that the size does not
+ * flicker between two values. The target is allocated at the window size
+ * and only its viewport shrinks, so scaling never reallocates.
+ *
+ * Present upscales the scene into the window with a contrast adaptive
+ * sharpening filter. Draw UI after Present so that it stays at native
+ * resolution:
+ *
+ *	dynamicResolution.BeginScene();
+ *	// draw the scene
+ *	dynamicResolution.EndScene();
+ *	dynamicResolution.Present();
+ *	// draw the UI
+ */
+class DynamicResolution
+{
+public:
+	DynamicResolution(OpenGLRenderer& renderer);
+	~DynamicResolution();
+
+	DynamicResolution(const DynamicResolution&) = delete;
+	DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+	/**
+	 * Compile the upscale program and create the scene target at the window size
+	 * @return true if successful
+	 */
+	bool Create();
+
+	/**
+	 * Delete the program and the scene target
+	 */
+	void Release();
+
+	/**
+	 * Set GPU time budget of the scene, leave room for the UI and the upscale
+	 * @param seconds target time, e.g. a bit under 1/60 for 60 Hz
+	 */
+	inline void SetTargetTime(float seconds) { m_fTargetSeconds = seconds; }
+
+	/**
+	 * Limit the resolution scale
+	 * @param minScale, maxScale lowest and highest scale, 1 is the window size
+	 */
+	void SetScaleRange(float minScale, float maxScale);
+
+	/**
+	 * Set strength of the sharpening filter
+	 * @param sharpness 0 for plain bilinear upscale, 1 for the strongest
+	 */
+	inline void SetSharpness(float sharpness) { m_fSharpness = sharpness; }
+
+	/**
+	 * Bind the scene target with a viewport of the current render size and
+	 * start timing. Clears color and depth.
+	 */
+	void BeginScene();
+
+	/**
+	 * Stop timing and bind the framebuffer that was bound before BeginScene
+	 */
+	void EndScene();
+
+	/**
+	 * Upscale the scene into the window
+	 */
+	void Present();
+
+	inline float GetScale() const { return m_fScale; }
+	inline GLuint GetSceneTexture() const { return m_ColorTexture; }
+	inline const DynamicResolutionStats& GetStats() const { return m_Stats; }
+
+private:
+	bool CreateTarget(int32_t width, int32_t height);
+	void ReleaseTarget();
+	void UpdateScale();
+
+	OpenGLRenderer&				m_Renderer;
+	GLuint						m_UpscaleProgram;
+	GLuint						m_Framebuffer;
+	GLuint						m_ColorTexture;
+	GLuint						m_DepthRenderbuffer;
+	GLint						m_iPrevFramebuffer;
+	int32_t						m_iTargetWidth; // Allocated size, same as the window
+	int32_t						m_iTargetHeight;
+
+	// Controller
+	GpuTimer					m_SceneTimer;
+	float						m_fTargetSeconds;
+	float						m_fMinScale;
+	float						m_fMaxScale;
+	float						m_fScale;
+	float						m_fPrevError;
+	float						m_fPendingChange; // Accumulated change not yet over the dead band
+	float						m_fSharpness;
+	uint32_t					m_uFrame;
+
+	DynamicResolutionStats		m_Stats;
+};
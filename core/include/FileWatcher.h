@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined (_WIN32)
+#include <filesystem>
+#endif
+
+/**
+ * Watches a set of files for modifications without blocking.
+ * Linux uses inotify on the parent directories so that editors which
+ * save through a temporary file and rename are detected too.
+ * Other platforms compare modification times.
+ */
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	/**
+	 * Start watching a file
+	 * @param filename file to watch
+	 * @return true if the file is watched
+	 */
+	bool AddFile(const std::string_view& filename);
+
+	/**
+	 * Stop watching all files
+	 */
+	void Clear();
+
+	/**
+	 * Get files modified since the previous call. Never blocks.
+	 * @return modified files, each reported once
+	 */
+	std::vector<std::string> Poll();
+
+private:
+	static std::string GetDirectory(const std::string_view& filename);
+
+	std::unordered_set<std::string>						m_setFiles;
+
+#if defined (_LINUX)
+	int													m_iInotify;
+	std::unordered_map<int, std::string>				m_mapWatches; // Watch descriptor to directory
+	std::unordered_map<std::string, int>				m_mapDirectories; // Directory to watch descriptor
+#endif
+
+#if defined (_WIN32)
+	std::unordered_map<std::string, std::filesystem::file_time_type>	m_mapWriteTimes;
+#endif
+};
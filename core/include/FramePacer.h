@@ -0,0 +1,121 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <atomic>
+
+/**
+ * How buffer swaps are synchronized with the display
+ */
+enum class VSync
+{
+	Off, // Swap immediately, may tear
+	On, // Wait for vertical blank
+	Adaptive // Wait for vertical blank, tear instead of waiting when a frame is late
+};
+
+/**
+ * Statistics of the latest paced frame
+ */
+struct FramePacerStats
+{
+	float		fSleepSeconds; // Time slept by the frame limiter
+	float		fSpinSeconds; // Time spun after sleeping to hit the deadline exactly
+	float		fFenceWaitSeconds; // Time waited for the GPU before sampling input
+	float		fTargetFrameSeconds; // Frame period being paced to, 0 when unlimited
+	bool		bThrottled; // Frame was limited to the inactive frame rate
+	VSync		eVSync; // Mode the driver accepted, On if adaptive is not supported
+};
+
+/**
+ * Paces the main loop. Limits the frame rate by sleeping until shortly before
+ * the next frame is due and spinning for the rest, so the deadline is hit
+ * without the oversleep of a plain sleep. Windows that are not active are
+ * limited to a low frame rate so an idle app does not keep a core busy.
+ * Vsync is controlled with the EXT_swap_control extensions. In low latency
+ * mode the loop waits for the GPU to finish the previous frame before input
+ * is sampled, so the driver cannot queue frames ahead of the display.
+ */
+class FramePacer
+{
+public:
+	FramePacer();
+	~FramePacer();
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	/**
+	 * Set vsync mode, applied on the thread owning the context before its next flip
+	 * @param mode vsync mode, adaptive falls back to on without EXT_swap_control_tear
+	 */
+	void SetVSync(VSync mode);
+	inline VSync GetVSync() const { return m_eVSync.load(std::memory_order_relaxed); }
+
+	/**
+	 * Limit the frame rate while the window is active
+	 * @param framesPerSecond frame rate cap, or 0 to run unlimited
+	 */
+	void SetFrameRateLimit(float framesPerSecond);
+
+	/**
+	 * Limit the frame rate while the window is inactive or minimized
+	 * @param framesPerSecond frame rate cap, or 0 to not throttle
+	 */
+	void SetInactiveFrameRate(float framesPerSecond);
+
+	/**
+	 * Wait for the GPU to finish the previous frame before sampling input.
+	 * Costs some throughput but removes the frames the driver would buffer.
+	 * Has no effect with threaded rendering, where the render thread already
+	 * keeps the GPU at most a frame behind.
+	 * @param enabled true to wait
+	 */
+	inline void SetLowLatency(bool enabled) { m_bLowLatency = enabled; }
+	inline bool IsLowLatency() const { return m_bLowLatency; }
+
+	/**
+	 * Wait until the next frame is due, call on the update thread before input is read
+	 * @param active false if the window is inactive or minimized
+	 * @param ownsContext true if the calling thread owns the context, required for the latency fence
+	 */
+	void WaitForFrame(bool active, bool ownsContext);
+
+	/**
+	 * Apply a pending vsync change, call on the thread owning the context before flipping
+	 * @param renderer renderer whose swap interval is set
+	 */
+	void ApplySwapInterval(IRenderer& renderer);
+
+	/**
+	 * Insert the latency fence after the flip, call on the thread owning the context
+	 */
+	void EndFrame();
+
+	/**
+	 * Delete the latency fence, call on the thread owning the context before it is destroyed
+	 */
+	void Release();
+
+	/**
+	 * Get statistics of the latest frame
+	 * @return frame statistics
+	 */
+	inline const FramePacerStats& GetStats() const { return m_Stats; }
+
+private:
+	void SleepUntil(uint64_t deadline);
+
+	std::atomic<VSync>		m_eVSync;
+	std::atomic<bool>		m_bSwapIntervalDirty; // Set on any thread, applied by the context thread
+	float					m_fFrameRateLimit;
+	float					m_fInactiveFrameRate;
+	bool					m_bLowLatency;
+
+	uint64_t				m_uTickFrequency;
+	uint64_t				m_uNextFrame; // Tick when the next frame is due, 0 when not pacing
+	uint64_t				m_uSpinTicks; // Time before a deadline spent spinning instead of sleeping
+	GLsync					m_Fence; // Fence after the previous flip
+
+	FramePacerStats			m_Stats;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../include/IRenderer.h"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Forward declarations
+class Node;
+class World;
+class Geometry;
+struct Material;
+
+/**
+ * Everything the render thread needs to draw one frame, built by the update
+ * thread and not changed after it has been submitted. Geometries and
+ * materials are shared, so they must not be modified while a packet using
+ * them is in flight.
+ */
+struct FramePacket
+{
+	// One object to draw with its per-object constants
+	struct Draw
+	{
+		std::shared_ptr<Geometry>	pGeometry;
+		std::shared_ptr<Material>	pMaterial;
+		glm::mat4					mModel; // World matrix
+		float						fDepth; // Distance along the view direction
+	};
+
+	/**
+	 * Remove the draws and reset the camera, keeps the allocated memory
+	 */
+	void Clear();
+
+	/**
+	 * Add draws of all visible geometry nodes in a node hierarchy, with
+	 * transforms interpolated by fInterpolation. Call after the view matrix has been set.
+	 * @param root root of the hierarchy
+	 */
+	void AddNode(const Node& root);
+
+	/**
+	 * Add draws of all renderable entities in a world, using the world
+	 * matrices of the last transform update. Call after the view matrix has been set.
+	 * @param world world to draw
+	 */
+	void AddWorld(const World& world);
+
+	/**
+	 * Sort draws by material to save state changes and front to back within a material
+	 */
+	void Sort();
+
+	/**
+	 * Draw the packet with its program, camera and light. The camera and
+	 * light are set into the renderer, so call on the thread owning the context.
+	 * @param renderer renderer owning the current context
+	 */
+	void Submit(IRenderer& renderer) const;
+
+	uint64_t				uFrame; // Running number of the packet
+	float					fFrameTime; // Update delta time in seconds
+	float					fInterpolation; // Blend between the last two fixed steps, used by AddNode
+	uint32_t				uProgram; // Program used by Submit
+	glm::mat4				mView;
+	glm::mat4				mProjection;
+	glm::vec3				vLightPosition;
+	std::vector<Draw>		arrDraws;
+
+private:
+	void AddNode(const Node& node, const glm::mat4& parentWorld);
+};
@@ -137,6 +137,18 @@ typedef void (APIENTRYP PFNGLCLEARDEPTHFPROC) (GLclampf depth);
 typedef void (APIENTRYP PFNGLGENERATEMIPMAPPROC) (GLenum target);
 
 typedef void (APIENTRYP PFNGLCOMPRESSEDTEXIMAGE2D) (GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid* data);
+
+// Not present in older glext.h versions
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_KHR_parallel_shader_compile 1
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR          0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) (GLuint count);
+#endif
+
+// glext.h versions disagree on the type of the indirect offset, declare it as the byte offset it is
+typedef void (APIENTRYP PFNMYGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC) (GLenum mode, GLenum type, GLintptr indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride);
+
 //FUNCTIONS BELOW THIS LINE ARE IMPLEMENTED
 
 #if defined (_WINDOWS)
@@ -216,8 +228,68 @@ extern PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus;
 extern PFNGLCLEARDEPTHFPROC glClearDepthf;
 extern PFNGLGENERATEMIPMAPPROC glGenerateMipmap;
 
+// Program binary
+extern PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+
+// Parallel shader compile
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR;
+extern PFNGLGETSTRINGIPROC glGetStringi;
+
+// Uniform buffers
+extern PFNGLBUFFERSUBDATAPROC glBufferSubData;
+extern PFNGLGETBUFFERSUBDATAPROC glGetBufferSubData;
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+extern PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+extern PFNGLBUFFERSTORAGEPROC glBufferStorage;
+extern PFNGLBINDBUFFERBASEPROC glBindBufferBase;
+extern PFNGLBINDBUFFERRANGEPROC glBindBufferRange;
+extern PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex;
+extern PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding;
+
+// Indirect drawing
+extern PFNGLCOPYBUFFERSUBDATAPROC glCopyBufferSubData;
+extern PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor;
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect;
+
+// Compute shaders
+extern PFNGLDISPATCHCOMPUTEPROC glDispatchCompute;
+extern PFNGLMEMORYBARRIERPROC glMemoryBarrier;
+extern PFNGLBINDIMAGETEXTUREPROC glBindImageTexture;
+extern PFNGLCLEARBUFFERDATAPROC glClearBufferData;
+extern PFNMYGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC glMultiDrawElementsIndirectCountARB;
+
+// Shadow maps
+extern PFNGLFRAMEBUFFERTEXTURELAYERPROC glFramebufferTextureLayer;
+extern PFNGLCOPYIMAGESUBDATAPROC glCopyImageSubData;
+
+// Texture buffers
+extern PFNGLTEXBUFFERPROC glTexBuffer;
+
+// Deferred shading
+extern PFNGLDRAWBUFFERSPROC glDrawBuffers;
+
+// Timer queries
+extern PFNGLGENQUERIESPROC glGenQueries;
+extern PFNGLDELETEQUERIESPROC glDeleteQueries;
+extern PFNGLQUERYCOUNTERPROC glQueryCounter;
+extern PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv;
+extern PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
+
+// Occlusion queries
+extern PFNGLBEGINQUERYPROC glBeginQuery;
+extern PFNGLENDQUERYPROC glEndQuery;
+extern PFNGLGETQUERYOBJECTUIVPROC glGetQueryObjectuiv;
+
+// Fence sync
+extern PFNGLFENCESYNCPROC glFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+extern PFNGLDELETESYNCPROC glDeleteSync;
+
 #if defined (_WINDOWS)
 extern PFNGLCOMPRESSEDTEXIMAGE2D glCompressedTexImage2D;
+extern PFNGLTEXIMAGE3DPROC glTexImage3D;
 #endif
 
 #endif
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
 #include "../include/OpenGLRenderer.h"
+#include "../include/Allocator.h"
 
 
 class Geometry
@@ -41,11 +43,15 @@ public:
 		float	tu, tv;
 	};
 
+	// Vertex storage, counted under MemoryTag::Geometry
+	using VertexArray = std::vector<VERTEX, TrackingAllocator<VERTEX, MemoryTag::Geometry>>;
+
 	Geometry();
 	~Geometry();
 
 	/**
-	 * Clear of the vertices so they can be regenerated
+	 * Clear of the vertices so they can be regenerated. The geometry gets
+	 * a new generation, so caches of the old contents stop matching.
 	 */
 	void Clear();
 
@@ -105,29 +111,49 @@ public:
 	 */
 	void DisableAttribs(GLuint program) const;
 
+	/**
+	 * Get the geometry as an indexed triangle list. Index buffer is read
+	 * back from OpenGL, strips and unindexed lists get generated indices.
+	 * @param indices receives the indices
+	 * @return true if successful, false if the geometry is not made of triangles
+	 */
+	bool GetTriangleIndices(std::vector<GLuint>& indices) const;
+
 	/**
 	* Draw the geometry
 	*/
 	void Draw(IRenderer& renderer) const;
 
-	// Get vector of vertices for specified geometry
-	static std::vector<Geometry::VERTEX> GenSphereVertices(const glm::vec3& radius, const glm::vec3& offset, uint32_t rings, uint32_t segments);
-	static std::vector<Geometry::VERTEX> GenCubeVertices(const glm::vec3& size, const glm::vec3& offset, GLuint& indexBuffer, size_t& indexCount);
-	static std::vector<Geometry::VERTEX> GenQuadVertices(const glm::vec2& size, const glm::vec3& offset);
-	static std::vector<Geometry::VERTEX> GenTorusVertices(uint32_t segments, float radius, float fatness, GLuint& indexBuffer, size_t& indexCount);
-	static std::vector<Geometry::VERTEX> GenKnotVertices(uint32_t slices, uint32_t stacks, float radius, GLuint& indexBuffer, size_t& indexCount);
+	// Get vector of vertices for specified geometry. Vertices are reserved
+	// up front and indices are staged in the scratch arena of the calling thread.
+	static VertexArray GenSphereVertices(const glm::vec3& radius, const glm::vec3& offset, uint32_t rings, uint32_t segments);
+	static VertexArray GenCubeVertices(const glm::vec3& size, const glm::vec3& offset, GLuint& indexBuffer, size_t& indexCount);
+	static VertexArray GenQuadVertices(const glm::vec2& size, const glm::vec3& offset);
+	static VertexArray GenTorusVertices(uint32_t segments, float radius, float fatness, GLuint& indexBuffer, size_t& indexCount);
+	static VertexArray GenKnotVertices(uint32_t slices, uint32_t stacks, float radius, GLuint& indexBuffer, size_t& indexCount);
 
 	inline VERTEX* GetData() { return m_arrVertices.data(); }
 	inline const VERTEX* GetData() const { return m_arrVertices.data(); }
 	inline size_t GetVertexCount() const { return m_arrVertices.size(); }
 	inline GLuint GetIndexBuffer() const { return m_IndexBuffer; }
 	inline size_t GetIndexCount() const { return m_uIndexCount; }
+	inline GLenum GetDrawMode() const { return m_eDrawMode; }
+
+	/**
+	 * Get id of the current contents, unique across all geometries and
+	 * changed whenever the vertices are cleared or regenerated
+	 * @return generation, never 0
+	 */
+	inline uint64_t GetGeneration() const { return m_uGeneration; }
 
 private:
 	static glm::vec3 EvaluateTrefoil(float s, float t);
 
-	std::vector<VERTEX>			m_arrVertices;
+	VertexArray					m_arrVertices;
 	GLenum						m_eDrawMode;
 	GLuint						m_IndexBuffer; // Array of numbers that are the order to reference into the vertex data
 	size_t						m_uIndexCount;
+	uint64_t					m_uGeneration;
+
+	static std::atomic<uint64_t>	m_uNextGeneration;
 };
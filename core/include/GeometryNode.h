@@ -29,12 +29,14 @@ public:
 	 * @param geometry geometry to be set to the geometry node
 	 */
 	void SetGeometry(const std::shared_ptr<Geometry>& geometry) { m_pGeometry = geometry; }
+	inline const std::shared_ptr<Geometry>& GetGeometry() const { return m_pGeometry; }
 
 	/**
 	 * Set, switch or disable material
 	 * @param material material to be set to the geometry node
 	 */
 	void SetMaterial(const std::shared_ptr<Material>& material) { m_pMaterial = material; }
+	inline const std::shared_ptr<Material>& GetMaterial() const { return m_pMaterial; }
 
 protected:
 	std::shared_ptr<Geometry>		m_pGeometry;
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+/**
+ * Frustum and hierarchical-Z occlusion culling in a compute shader.
+ * Instances are tested against the camera frustum and against a depth pyramid
+ * built from the previous frame, and the survivors are compacted into indirect
+ * draw commands with atomic counters. Used by MultiDrawBatch, needs OpenGL 4.3.
+ */
+class GpuCulling
+{
+public:
+	/**
+	 * Per-instance input, std430 layout
+	 */
+	struct INSTANCE
+	{
+		glm::mat4		mModel;
+		glm::vec4		vBoundingSphere; // Center and radius in model space
+		GLuint			uIndexCount;
+		GLuint			uFirstIndex;
+		GLint			iBaseVertex;
+		GLuint			uBucket; // Counter to increment
+		GLuint			uBucketFirst; // First command of the bucket
+		GLuint			uPadding[3];
+	};
+
+	GpuCulling(OpenGLRenderer& renderer);
+	~GpuCulling();
+
+	GpuCulling(const GpuCulling&) = delete;
+	GpuCulling& operator=(const GpuCulling&) = delete;
+
+	/**
+	 * Compile the compute shaders
+	 * @return true if successful
+	 */
+	bool Create();
+
+	/**
+	 * Delete programs and textures
+	 */
+	void Release();
+
+	/**
+	 * Build the depth pyramid from a depth texture after the frame has been drawn.
+	 * The current view and projection are stored for testing the next frame.
+	 * @param depthTexture single-sampled depth texture
+	 * @param width, height size of the depth texture
+	 */
+	void UpdateHiZ(GLuint depthTexture, int32_t width, int32_t height);
+
+	/**
+	 * Copy depth of the current read framebuffer and build the depth pyramid from it.
+	 * The framebuffer must be single-sampled.
+	 * @param width, height size of the framebuffer
+	 */
+	void UpdateHiZFromFramebuffer(int32_t width, int32_t height);
+
+	/**
+	 * Enable or disable the occlusion test, frustum test is always done
+	 * @param enable true to test against the depth pyramid
+	 */
+	inline void SetOcclusionEnabled(bool enable) { m_bOcclusionEnabled = enable; }
+	inline bool IsOcclusionEnabled() const { return m_bOcclusionEnabled; }
+
+	/**
+	 * Test instances and write the survivors into the command and transform buffers.
+	 * Commands and counters must be zeroed before the call.
+	 * @param instanceBuffer buffer of INSTANCEs
+	 * @param instanceCount number of instances
+	 * @param commandBuffer receives DrawElementsIndirectCommands, compacted per bucket
+	 * @param transformBuffer receives world matrices in the same order as commands
+	 * @param counterBuffer receives number of commands per bucket
+	 */
+	void Cull(GLuint instanceBuffer, size_t instanceCount, GLuint commandBuffer, GLuint transformBuffer, GLuint counterBuffer);
+
+	/**
+	 * Check if the context supports compute culling
+	 * @return true if the functions were loaded
+	 */
+	static bool IsSupported();
+
+private:
+	bool CreatePyramid(int32_t width, int32_t height);
+
+	OpenGLRenderer&		m_Renderer;
+	GLuint				m_CullProgram;
+	GLuint				m_DownsampleProgram;
+	GLuint				m_DepthTexture; // Copy of the framebuffer depth
+	GLuint				m_HiZTexture; // R32F, max depth per texel
+	glm::ivec2			m_vDepthSize;
+	glm::ivec2			m_vHiZSize;
+	int32_t				m_iHiZLevels;
+	glm::mat4			m_mHiZViewProjection; // Camera the pyramid was built with
+	bool				m_bHiZValid;
+	bool				m_bOcclusionEnabled;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+/**
+ * Measures GPU time between two points of the command stream with timestamp
+ * queries. Results are read a few frames later so that the CPU never waits
+ * for the GPU. Timers can overlap, unlike GL_TIME_ELAPSED queries.
+ */
+class GpuTimer
+{
+public:
+	GpuTimer();
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	/**
+	 * Record the start timestamp
+	 */
+	void Begin();
+
+	/**
+	 * Record the end timestamp
+	 */
+	void End();
+
+	/**
+	 * Get the latest measurement the GPU has finished
+	 * @return seconds between Begin and End, or 0 if nothing has finished yet
+	 */
+	inline float GetElapsedSeconds() const { return m_fElapsedSeconds; }
+
+	/**
+	 * Check if the context supports timestamp queries
+	 * @return true if the functions were loaded
+	 */
+	static bool IsSupported();
+
+private:
+	// Frames that can be in flight before a result is waited for
+	static constexpr uint32_t kQueryCount = 4;
+
+	void Collect(bool wait);
+
+	GLuint				m_arrQueries[kQueryCount][2]; // Start and end
+	bool				m_arrPending[kQueryCount];
+	uint32_t			m_uCurrent;
+	uint32_t			m_uOldest;
+	float				m_fElapsedSeconds;
+};
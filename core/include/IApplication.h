@@ -23,6 +23,10 @@
 // Include timer component and renderer interface
 #include "Timer.h"
 #include "IRenderer.h"
+#include "FramePacket.h"
+#include "InputQueue.h"
+
+#include <thread>
 
 // Define some common keycodes
 #if defined (_WIN32)
@@ -43,6 +47,13 @@
 
 #endif
 
+// Forward declarations
+class RenderThread;
+class FramePacer;
+class JobPool;
+class InputRecorder;
+class InputReplay;
+
 // Define an interface for Application
 class IApplication
 {
@@ -55,9 +66,10 @@ public:
 	 * @param resX horizontal resolution of the screen in pixels
 	 * @param resY vertical resolution of the screen in pixels
 	 * @param title window title text
+	 * @param shadingPath forward or deferred shading, falls back to forward if not supported
 	 * @return true if successful, false otherwise
 	 */
-	bool Create(int32_t resX, int32_t resY, const std::string& title);
+	bool Create(int32_t resX, int32_t resY, const std::string& title, ShadingPath shadingPath = ShadingPath::Forward);
 
 	/**
 	 * Enter into main loop. Returns when app is terminated
@@ -89,6 +101,62 @@ public:
 	 */
 	virtual void OnDraw(IRenderer& renderer) = 0;
 
+	/**
+	 * Fill the frame packet of the next frame on the update thread, called after
+	 * OnUpdate when rendering is threaded. Must not use the renderer: camera
+	 * and light go into the packet. Applications that do not implement it
+	 * have nothing to put into the packet, so the default implementation
+	 * stops the render thread with a message and frames are drawn with OnDraw.
+	 * @param packet cleared packet to fill
+	 */
+	virtual void OnBuildFrame(FramePacket& packet) { m_bBuildFrameMissing = true; }
+
+	/**
+	 * Draw a frame packet on the render thread when rendering is threaded.
+	 * Default implementation submits the packet's draws.
+	 * @param renderer renderer object, its context is current on the render thread
+	 * @param packet packet built by OnBuildFrame
+	 */
+	virtual void OnRender(IRenderer& renderer, const FramePacket& packet) { packet.Submit(renderer); }
+
+	/**
+	 * Render on a dedicated thread that owns the context, so that updating the
+	 * next frame overlaps with submitting the previous one. OnDraw is then not
+	 * called, OnBuildFrame and OnRender are used instead. Call before Run.
+	 * @param threaded true to use a render thread
+	 */
+	inline void SetThreadedRendering(bool threaded) { m_bThreaded = threaded; }
+	inline bool IsThreadedRendering() const { return m_bThreaded; }
+
+	/**
+	 * Run OnUpdate at a fixed rate, independent of the frame rate. Time left
+	 * over between steps is rendered by interpolating node transforms between
+	 * the last two steps, see GetInterpolation.
+	 * @param stepSeconds simulation step, e.g. 1/60, or 0 to update once per frame with the frame time
+	 * @param maxSteps most steps run per frame, time beyond them is dropped so a slow frame cannot snowball
+	 */
+	void SetFixedTimestep(float stepSeconds, uint32_t maxSteps = 5);
+	inline float GetFixedTimestep() const { return m_fFixedStep; }
+
+	/**
+	 * Get frame pacer controlling vsync, frame rate limits and latency
+	 * @return reference to the frame pacer
+	 */
+	inline FramePacer& GetFramePacer() { return *m_pFramePacer; }
+
+	/**
+	 * Get worker threads shared by the engine subsystems, so that they
+	 * together use one thread per core
+	 * @return reference to the job pool
+	 */
+	inline JobPool& GetJobPool() { return *m_pJobPool; }
+
+	/**
+	 * Get how far rendering is between the last two simulation steps
+	 * @return 0 at the previous step, 1 at the latest step or when the timestep is not fixed
+	 */
+	inline float GetInterpolation() const { return m_fInterpolation; }
+
 	/**
 	 * Check if app is active
 	 * @return true if app is active, false otherwise
@@ -116,7 +184,9 @@ public:
 	/**
 	 * Get the renderer currently in use.
 	 * Do not store the return value of this function!
-	 * Only use it locally on a function you call it with
+	 * Only use it locally on a function you call it with.
+	 * With threaded rendering the renderer belongs to the render thread,
+	 * use it only from OnRender.
 	 * @return pointer to current renderer
 	 */
 	inline IRenderer* GetRenderer() { return m_pRenderer.get(); }
@@ -151,6 +221,33 @@ public:
 	 */
 	static bool IsKeyDown(uint32_t osKeyCode);
 
+	/**
+	 * Read window system events on a dedicated thread, so that input keeps
+	 * flowing while a frame is being updated. Events are still delivered to
+	 * the On* handlers on the update thread, once per frame. Only the X11
+	 * backend has an input thread. Call before Run.
+	 * @param enabled true to use an input thread
+	 */
+	inline void SetInputThread(bool enabled) { m_bInputThread = enabled; }
+
+	/**
+	 * Record the input events dispatched to the On* handlers and the frame
+	 * time of every frame, for replaying the session later. Call before Run.
+	 * @param filename log file to write
+	 * @return true if the log was created
+	 */
+	bool StartInputRecording(const std::string_view& filename);
+
+	/**
+	 * Replay a recorded session instead of reading input from the window.
+	 * The app closes when the recording ends. Call before Run.
+	 * @param filename log written by StartInputRecording
+	 * @param fixedFrameTime frame time passed to OnUpdate, or 0 to use the recorded ones
+	 * @param timingFilename file receiving the measured time of every frame, or empty for none
+	 * @return true if the log was opened
+	 */
+	bool StartInputReplay(const std::string_view& filename, float fixedFrameTime = 0.0f, const std::string_view& timingFilename = {});
+
 	/**
 	 * Get window handle
 	 * @return window handle
@@ -228,6 +325,31 @@ protected:
 #endif
 
 private:
+	/**
+	 * Wait until the frame pacer lets the next frame start
+	 */
+	void PaceFrame();
+
+	/**
+	 * Update and draw one frame, or hand it to the render thread
+	 */
+	void RunFrame();
+
+	/**
+	 * Deliver an input event from the window to the handlers, recording it if
+	 * recording. Ignored while replaying.
+	 * @param event input event
+	 */
+	void DispatchInput(const InputEvent& event);
+	void HandleInput(const InputEvent& event);
+
+	/**
+	 * Feed the next recorded frame's events, close the app when the recording ends
+	 * @param frametime receives the frame time to update with
+	 * @return false if the replay has ended
+	 */
+	bool ReplayFrame(float& frametime);
+
 #if defined (_WIN32)
 	static HWND MakeWindow(int32_t width, int32_t height, const std::string& title);
 	static long WINAPI WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
@@ -238,15 +360,37 @@ private:
 
 #if defined (_LINUX)
 	static Window MakeWindow(int32_t width, int32_t height, const char* title);
-	static bool ProcessEvents(XEvent* evnt);
 	static KeySym PreprocessKeyEvent(XEvent* evnt);
 
+	/**
+	 * Convert all pending X events into the input queue. Consecutive motion
+	 * events are merged into the last one. Runs on the input thread if there
+	 * is one, otherwise on the update thread.
+	 */
+	void ReadEvents();
+	void TranslateEvent(XEvent* evnt, uint64_t timestamp);
+	void FlushMotion();
+	void InputThreadMain();
+
+	/**
+	 * Deliver queued events to the handlers on the update thread
+	 */
+	void DispatchEvents();
+
+	static void SetKeyDown(uint32_t osKeyCode, bool down);
+
 	static Display* m_pDisplay;
 	static int32_t					m_iScreen;
 	static Window					m_Window;
 	static XSetWindowAttributes		m_WindowAttributes;
 	static Atom						m_CloseAtom;
-	static uint8_t                  m_uKeyboard[65536];
+	static std::atomic<uint64_t>	m_arrKeyboard[65536 / 64]; // One bit per key
+
+	InputQueue						m_InputQueue;
+	InputEvent						m_PendingMotion; // Latest motion event not yet queued
+	bool							m_bPendingMotion;
+	std::thread						m_InputThread;
+	std::atomic<bool>				m_bInputQuit;
 #endif
 	// Pointer to the class itself so static functions can access it
 	static IApplication*			m_pApp;
@@ -258,5 +402,27 @@ private:
 	int32_t							m_iWidth;
 	int32_t							m_iHeight;
 
+	// Declared before the renderer so that it outlives the subsystems using it
+	std::unique_ptr<JobPool>		m_pJobPool;
 	std::unique_ptr<IRenderer>		m_pRenderer;
+
+	// Threaded rendering
+	bool							m_bThreaded;
+	bool							m_bBuildFrameMissing; // Set by the default OnBuildFrame
+	std::unique_ptr<RenderThread>	m_pRenderThread;
+
+	bool							m_bInputThread;
+
+	std::unique_ptr<FramePacer>		m_pFramePacer;
+
+	// Input recording and replay
+	std::unique_ptr<InputRecorder>	m_pInputRecorder;
+	std::unique_ptr<InputReplay>	m_pInputReplay;
+	std::string						m_strReplayTimings;
+
+	// Fixed timestep
+	float							m_fFixedStep;
+	uint32_t						m_uMaxSteps;
+	float							m_fAccumulator;
+	float							m_fInterpolation;
 };
@@ -6,13 +6,27 @@
 #include "../glm-master/glm/gtc/random.hpp"
 #include <string_view>
 
+// Forward declarations
+struct Material;
+
+/**
+ * How lighting is computed, chosen when the application is created
+ */
+enum class ShadingPath
+{
+	Forward, // Objects are lit by their own shaders
+	Deferred // Objects write a G-buffer that is lit in screen space
+};
+
 class IRenderer
 {
 public:
 	IRenderer() :
+		m_eShadingPath(ShadingPath::Forward),
 		m_mView(1.0f),
 		m_mProjection(1.0f),
-		m_vLightPosition(0.0f, 1.0f, 0.0f)
+		m_vLightPosition(0.0f, 1.0f, 0.0f),
+		m_fInterpolation(1.0f)
 	{
 		m_mShadowBias = glm::mat4(
 			0.5, 0.0, 0.0, 0.0,
@@ -35,6 +49,22 @@ public:
 	 */
 	virtual void Flip() = 0;
 
+	/**
+	 * Pure virtual method to move the rendering context between threads.
+	 * Unbind it on the old thread before binding it on the new one.
+	 * @param current true to bind the context on the calling thread, false to unbind it
+	 * @return true if successful
+	 */
+	virtual bool MakeCurrent(bool current) = 0;
+
+	/**
+	 * Pure virtual method to set how many vertical blanks Flip waits for.
+	 * Call on the thread owning the context.
+	 * @param interval 0 for no vsync, 1 for vsync, -1 for adaptive vsync
+	 * @return false if the interval is not supported
+	 */
+	virtual bool SetSwapInterval(int32_t interval) = 0;
+
 	/**
 	 * Clear the color buffer, depth buffer and stencil
 	 */
@@ -60,6 +90,31 @@ public:
 	 */
 	virtual bool SetTexture(uint32_t program, uint32_t texture, int32_t slot, const std::string_view& uniformName) = 0;
 
+	/**
+	 * Set transformation of the object drawn next
+	 * @param program program used to draw the object
+	 * @param modelMatrix world matrix of the object
+	 */
+	virtual void SetObjectTransform(uint32_t program, const glm::mat4& modelMatrix) = 0;
+
+	/**
+	 * Set material of the object drawn next
+	 * @param program program used to draw the object
+	 * @param material material properties for lighting
+	 */
+	virtual void SetMaterial(uint32_t program, const Material& material) = 0;
+
+	/**
+	 * Get the shading path in use. Can be Forward even if Deferred was
+	 * asked for, when the context does not support it.
+	 * @return shading path
+	 */
+	inline ShadingPath GetShadingPath() const { return m_eShadingPath; }
+
+	// Camera, light and interpolation below are state of the thread that owns the
+	// context. With threaded rendering only the render thread reads or writes
+	// them, FramePacket::Submit sets them from the packet the update thread built.
+
 	// Access to view and projection matrices
 	glm::mat4& GetViewMatrix() { return m_mView; }
 	glm::mat4& GetProjectionMatrix() { return m_mProjection; }
@@ -77,8 +132,14 @@ public:
 	void SetLightPos(const glm::vec3& lightPos) { m_vLightPosition = lightPos; }
 	void SetLightPos(float x, float y, float z) { m_vLightPosition = glm::vec3(x, y, z); }
 
+	// Blend factor between the last two fixed simulation steps, used by nodes when drawn
+	float GetInterpolation() const { return m_fInterpolation; }
+	void SetInterpolation(float alpha) { m_fInterpolation = alpha; }
+
 
 protected:
+	ShadingPath		m_eShadingPath;
+
 	// View and perpective projection matrices
 	glm::mat4		m_mView;
 	glm::mat4		m_mProjection;
@@ -86,4 +147,6 @@ protected:
 	// Lights & shadows
 	glm::mat4		m_mShadowBias;
 	glm::vec3		m_vLightPosition;
+
+	float			m_fInterpolation;
 };
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "IRenderer.h"
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Window system event converted to a platform independent form
+ */
+struct InputEvent
+{
+	enum class Type : uint8_t
+	{
+		MouseBegin,
+		MouseEnd,
+		MouseDrag,
+		KeyDown,
+		KeyUp,
+		Activate,
+		Deactivate,
+		Resize,
+		Close
+	};
+
+	Type		eType;
+	int32_t		iButton; // Mouse button index, 0 based
+	uint32_t	uKey; // Key code
+	glm::vec2	vPoint; // Mouse position in pixels, or new window size
+	uint64_t	uTimestamp; // Timer::GetTicks when the event was received
+};
+
+/**
+ * Lock-free single producer, single consumer ring of input events. The
+ * producer is the thread reading window system events, the consumer the
+ * update thread, which drains it once per frame. When both are the same
+ * thread no synchronization is paid beyond the atomic loads.
+ */
+class InputQueue
+{
+public:
+	// Events the queue can hold, a power of two
+	static constexpr uint32_t kCapacity = 1024;
+
+	InputQueue();
+
+	/**
+	 * Add an event, producer thread only
+	 * @param event event to add
+	 * @return false if the queue is full and the event was dropped
+	 */
+	bool Push(const InputEvent& event);
+
+	/**
+	 * Remove the oldest event, consumer thread only
+	 * @param event receives the event
+	 * @return false if the queue is empty
+	 */
+	bool Pop(InputEvent& event);
+
+	/**
+	 * Get the number of events dropped because the consumer fell behind
+	 * @return dropped events since creation
+	 */
+	inline uint32_t GetDropped() const { return m_uDropped.load(std::memory_order_relaxed); }
+
+private:
+	// Head and tail on separate cache lines so the two threads do not share one
+	alignas(64) std::atomic<uint32_t>	m_uHead; // Next event to pop, written by the consumer
+	alignas(64) std::atomic<uint32_t>	m_uTail; // Next free slot, written by the producer
+	alignas(64) std::atomic<uint32_t>	m_uDropped;
+	InputEvent							m_arrEvents[kCapacity];
+};
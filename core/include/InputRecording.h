@@ -0,0 +1,135 @@
+#pragma once
+
+#include "InputQueue.h"
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Writes the input events dispatched to the application and the frame time
+ * of every frame to a binary log, so that a session can be replayed with
+ * InputReplay. The log is in native byte order.
+ */
+class InputRecorder
+{
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	/**
+	 * Create the log file
+	 * @param filename file to write
+	 * @return true if the file was created
+	 */
+	bool Open(const std::string_view& filename);
+
+	/**
+	 * Add an event dispatched during the current frame
+	 * @param event dispatched event
+	 */
+	void AddEvent(const InputEvent& event);
+
+	/**
+	 * Write the current frame with its events
+	 * @param frametime frame time passed to OnUpdate
+	 */
+	void WriteFrame(float frametime);
+
+	/**
+	 * Get the number of frames written
+	 * @return frame count
+	 */
+	inline uint32_t GetFrameCount() const { return m_uFrames; }
+
+private:
+	std::ofstream				m_File;
+	std::vector<InputEvent>		m_arrEvents; // Events of the current frame
+	uint64_t					m_uStartTicks;
+	uint64_t					m_uTickFrequency;
+	uint32_t					m_uFrames;
+};
+
+/**
+ * Timing of a replayed session
+ */
+struct InputReplayStats
+{
+	uint32_t	uFrames; // Frames replayed
+	float		fMeanSeconds; // Measured frame time, not the replayed one
+	float		fMedianSeconds;
+	float		fP95Seconds;
+	float		fP99Seconds;
+	float		fMaxSeconds;
+};
+
+/**
+ * Plays back a log written by InputRecorder. Every frame gets the events
+ * recorded for it and the recorded frame time, or a fixed one, so the
+ * simulation follows the recorded session exactly. The time each replayed
+ * frame actually took is measured for comparing builds.
+ */
+class InputReplay
+{
+public:
+	InputReplay();
+
+	/**
+	 * Open a log for replay
+	 * @param filename log written by InputRecorder
+	 * @param fixedFrameTime frame time to replay with, or 0 to use the recorded frame times
+	 * @return true if the log was opened
+	 */
+	bool Open(const std::string_view& filename, float fixedFrameTime = 0.0f);
+
+	/**
+	 * Read the next frame, its events are then returned by GetEvents
+	 * @param measuredFrameTime time the previous frame actually took
+	 * @param frametime receives the frame time to pass to OnUpdate
+	 * @return false when the log has ended
+	 */
+	bool ReadFrame(float measuredFrameTime, float& frametime);
+
+	/**
+	 * Get the events of the frame read last
+	 * @return events in dispatch order
+	 */
+	inline const std::vector<InputEvent>& GetEvents() const { return m_arrEvents; }
+
+	/**
+	 * Update key state with a replayed event
+	 * @param event replayed event
+	 */
+	void TrackKeys(const InputEvent& event);
+
+	/**
+	 * Check if a key is down in the replayed session
+	 * @param osKeyCode os-dependent key code
+	 * @return true if the key is down
+	 */
+	bool IsKeyDown(uint32_t osKeyCode) const;
+
+	/**
+	 * Write the measured frame times, one per line, followed by a summary
+	 * @param filename file to write
+	 * @return true if successful
+	 */
+	bool WriteTimings(const std::string_view& filename) const;
+
+	/**
+	 * Get statistics of the measured frame times
+	 * @return frame time distribution
+	 */
+	InputReplayStats GetStats() const;
+
+private:
+	std::ifstream				m_File;
+	std::vector<InputEvent>		m_arrEvents; // Events of the current frame
+	std::vector<float>			m_arrFrameTimes; // Measured time of every replayed frame
+	std::vector<uint32_t>		m_arrKeysDown;
+	float						m_fFixedFrameTime;
+	uint64_t					m_uStartTicks;
+	uint64_t					m_uTickFrequency;
+	uint32_t					m_uFrames;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * Worker threads that run a job over a range of indices. The calling thread
+ * takes indices too, and Run returns once every index has been done. Used by
+ * the subsystems that split their frame work into bands, slices or chunks.
+ * The application owns one pool that they all share, see IApplication::GetJobPool.
+ */
+class JobPool
+{
+public:
+	using JobFunction = std::function<void(uint32_t index)>;
+
+	/**
+	 * Create pool
+	 * @param threadCount worker threads in addition to the calling thread, 0 runs everything on the caller
+	 */
+	JobPool(uint32_t threadCount);
+	~JobPool();
+
+	JobPool(const JobPool&) = delete;
+	JobPool& operator=(const JobPool&) = delete;
+
+	/**
+	 * Call job once for every index from 0 to count - 1, in any order and on
+	 * any thread. Threads may call Run at the same time, a call made while the
+	 * workers are busy with another runs all its indices on the calling thread.
+	 * @param count number of indices
+	 * @param job function called with each index
+	 */
+	void Run(uint32_t count, const JobFunction& job);
+
+	inline uint32_t GetThreadCount() const { return (uint32_t)m_arrThreads.size(); }
+
+	/**
+	 * Get worker count that leaves one core for the calling thread
+	 * @return one less than the cores, at least 0
+	 */
+	static uint32_t GetDefaultThreadCount();
+
+private:
+	void RunJobs();
+	void WorkerThread();
+
+	// Work of the current Run
+	const JobFunction*				m_pJob;
+	uint32_t						m_uCount;
+
+	std::vector<std::thread>		m_arrThreads;
+	std::mutex						m_RunMutex; // Held by the thread whose Run the workers serve
+	std::mutex						m_Mutex;
+	std::condition_variable			m_WorkCondition;
+	std::condition_variable			m_DoneCondition;
+	uint64_t						m_uGeneration; // Incremented for every Run that wakes the workers
+	std::atomic<uint32_t>			m_uNextIndex;
+	std::atomic<uint32_t>			m_uIndicesDone;
+	uint32_t						m_uActiveWorkers; // Workers inside RunJobs
+	bool							m_bQuit;
+};
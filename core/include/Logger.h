@@ -0,0 +1,329 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Messages below this level are compiled out, define LOG_MIN_LEVEL to override
+#if !defined (LOG_MIN_LEVEL)
+#if defined (_DEBUG)
+#define LOG_MIN_LEVEL 0
+#else
+#define LOG_MIN_LEVEL 2
+#endif
+#endif
+
+/**
+ * Severity of a log message
+ */
+enum class LogLevel : uint8_t
+{
+	Trace,
+	Debug,
+	Info,
+	Warning,
+	Error
+};
+
+/**
+ * Destination of formatted log text, written by the logger thread only
+ */
+class LogSink
+{
+public:
+	virtual ~LogSink() {}
+
+	/**
+	 * Write a batch of messages
+	 * @param text formatted messages
+	 */
+	virtual void Write(const std::string_view& text) = 0;
+
+	/**
+	 * Push written text to the device, called once per batch
+	 */
+	virtual void Flush() {}
+};
+
+/**
+ * Writes to stdout or stderr
+ */
+class ConsoleLogSink : public LogSink
+{
+public:
+	/**
+	 * @param stream stdout or stderr
+	 */
+	ConsoleLogSink(FILE* stream = stderr) : m_pStream(stream) {}
+
+	void Write(const std::string_view& text) override;
+	void Flush() override;
+
+private:
+	FILE*		m_pStream;
+};
+
+/**
+ * Appends to a file
+ */
+class FileLogSink : public LogSink
+{
+public:
+	FileLogSink();
+	~FileLogSink();
+
+	/**
+	 * Open the log file
+	 * @param filename file to write
+	 * @param append true to keep the old contents
+	 * @return true if the file was opened
+	 */
+	bool Open(const std::string_view& filename, bool append = false);
+
+	void Write(const std::string_view& text) override;
+	void Flush() override;
+
+private:
+	FILE*		m_pFile;
+};
+
+#if defined (_WIN32)
+/**
+ * Writes to the debugger output window
+ */
+class DebugOutputLogSink : public LogSink
+{
+public:
+	void Write(const std::string_view& text) override;
+};
+#endif
+
+/**
+ * Statistics of the logger
+ */
+struct LoggerStats
+{
+	uint64_t	uWritten; // Messages written to the sinks
+	uint64_t	uDropped; // Messages lost because a thread's ring was full
+	uint64_t	uSuppressed; // Repeats held back by rate limiting
+};
+
+/**
+ * Asynchronous logger. Every thread writes to its own lock-free ring, so
+ * logging costs the calling thread a copy of its arguments and nothing
+ * else; it never blocks, and drops the message if its ring is full.
+ * Format strings must be literals or otherwise outlive the message, since
+ * printf style formatting happens later on the logger thread. String
+ * arguments are copied. The logger thread merges the rings in time order,
+ * rate limits messages repeated too often and writes them to the sinks in
+ * batches.
+ */
+class Logger
+{
+public:
+	/**
+	 * Get the logger, created and started on first use
+	 * @return the logger
+	 */
+	static Logger& Get();
+
+	~Logger();
+
+	Logger(const Logger&) = delete;
+	Logger& operator=(const Logger&) = delete;
+
+	/**
+	 * Log a message, compiled out below LOG_MIN_LEVEL
+	 * @param format printf style format string, must outlive the message
+	 * @param args numbers, strings or pointers
+	 */
+	template<LogLevel Level, typename... Args>
+	static void Write(const char* format, const Args&... args)
+	{
+		if constexpr ((int)Level >= LOG_MIN_LEVEL)
+		{
+			Logger& logger = Get();
+			if (Level >= logger.m_eLevel.load(std::memory_order_relaxed))
+			{
+				const ARG arr[] = { MakeArg(args)..., ARG() };
+				logger.Push(Level, format, arr, sizeof...(Args));
+			}
+		}
+	}
+
+	template<typename... Args> static void Trace(const char* format, const Args&... args) { Write<LogLevel::Trace>(format, args...); }
+	template<typename... Args> static void Debug(const char* format, const Args&... args) { Write<LogLevel::Debug>(format, args...); }
+	template<typename... Args> static void Info(const char* format, const Args&... args) { Write<LogLevel::Info>(format, args...); }
+	template<typename... Args> static void Warning(const char* format, const Args&... args) { Write<LogLevel::Warning>(format, args...); }
+	template<typename... Args> static void Error(const char* format, const Args&... args) { Write<LogLevel::Error>(format, args...); }
+
+	/**
+	 * Set the lowest level logged at runtime, levels below LOG_MIN_LEVEL are always compiled out
+	 * @param level lowest level to log
+	 */
+	inline void SetLevel(LogLevel level) { m_eLevel.store(level, std::memory_order_relaxed); }
+
+	/**
+	 * Add a destination for the messages
+	 * @param sink sink to add
+	 */
+	void AddSink(std::unique_ptr<LogSink> sink);
+
+	/**
+	 * Remove all sinks, including the default console or debugger sink
+	 */
+	void ClearSinks();
+
+	/**
+	 * Block until all messages logged before the call have been written
+	 */
+	void Flush();
+
+	/**
+	 * Get statistics
+	 * @return message counts since start
+	 */
+	LoggerStats GetStats() const;
+
+private:
+	enum class ArgType : uint8_t
+	{
+		Empty,
+		Int,
+		Uint,
+		Double,
+		Pointer,
+		String
+	};
+
+	// Argument captured on the calling thread
+	struct ARG
+	{
+		ArgType				type = ArgType::Empty;
+		union
+		{
+			int64_t			i;
+			uint64_t		u;
+			double			d;
+			const void*		p;
+		};
+		std::string_view	str;
+
+		ARG() : u(0) {}
+	};
+
+	template<typename T>
+	static ARG MakeArg(const T& value)
+	{
+		ARG arg;
+		if constexpr (std::is_enum_v<T>)
+		{
+			return MakeArg((std::underlying_type_t<T>)value);
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			arg.type = ArgType::Double;
+			arg.d = (double)value;
+		}
+		else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+		{
+			arg.type = ArgType::Int;
+			arg.i = (int64_t)value;
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			arg.type = ArgType::Uint;
+			arg.u = (uint64_t)value;
+		}
+		else if constexpr (std::is_pointer_v<std::decay_t<T>> && std::is_convertible_v<std::decay_t<T>, const char*>)
+		{
+			arg.type = ArgType::String;
+			arg.str = value ? std::string_view(value) : std::string_view("(null)");
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			arg.type = ArgType::String;
+			arg.str = value;
+		}
+		else
+		{
+			static_assert(std::is_pointer_v<T> || std::is_null_pointer_v<T>, "Logger: unsupported argument type");
+			arg.type = ArgType::Pointer;
+			arg.p = (const void*)value;
+		}
+		return arg;
+	}
+
+	// Lock-free ring of variable sized records, written by one thread and read by the logger thread
+	struct THREADBUFFER
+	{
+		std::vector<uint8_t>		data;
+		alignas(64) std::atomic<uint64_t>	head; // Bytes read, written by the logger thread
+		alignas(64) std::atomic<uint64_t>	tail; // Bytes written, written by the owning thread
+		std::atomic<uint64_t>		dropped;
+		std::atomic<bool>			owned; // A thread is writing to the buffer
+	};
+
+	// Unwritten message, merged from all rings before writing
+	struct MESSAGE
+	{
+		uint64_t		timestamp;
+		LogLevel		level;
+		std::string		text;
+	};
+
+	// Repeat count of a message within the rate limit window
+	struct REPEAT
+	{
+		uint64_t		windowStart;
+		uint32_t		count;
+		uint32_t		suppressed;
+	};
+
+	Logger();
+
+	void Push(LogLevel level, const char* format, const ARG* args, uint32_t argCount);
+	THREADBUFFER* GetThreadBuffer();
+	void ThreadMain();
+	void Drain();
+	void ReadBuffer(THREADBUFFER& buffer);
+	void Format(const uint8_t* record, std::string& text) const;
+	bool RateLimit(const std::string& text, uint64_t now);
+	void WriteBatch(uint64_t now);
+
+	std::atomic<LogLevel>						m_eLevel;
+
+	// Rings of all threads that have logged, reused when a thread exits
+	mutable std::mutex							m_BufferMutex;
+	std::vector<std::unique_ptr<THREADBUFFER>>	m_arrBuffers;
+
+	std::mutex									m_SinkMutex;
+	std::vector<std::unique_ptr<LogSink>>		m_arrSinks;
+
+	// Logger thread
+	std::thread									m_Thread;
+	std::mutex									m_Mutex;
+	std::condition_variable						m_WakeCondition;
+	std::condition_variable						m_FlushCondition;
+	bool										m_bQuit;
+	uint64_t									m_uFlushRequest; // Incremented by Flush
+	uint64_t									m_uFlushDone; // Last request completed by the logger thread
+
+	// Logger thread only
+	std::vector<MESSAGE>						m_arrMessages;
+	std::unordered_map<size_t, REPEAT>			m_mapRepeats;
+	std::string									m_Batch;
+	uint64_t									m_uTickFrequency;
+
+	std::atomic<uint64_t>						m_uWritten;
+	std::atomic<uint64_t>						m_uSuppressed;
+};
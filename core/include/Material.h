@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../include/OpenGLRenderer.h"
+#include "../include/UniformBuffer.h"
 
 struct Material
 {
@@ -9,7 +10,14 @@ struct Material
 	/**
 	 * Set material properties for lighting to OpenGL shader program
 	 */
-	void SetToProgram(GLuint program);
+	void SetToProgram(GLuint program) const;
+
+	/**
+	 * Get uniform buffer holding the material block. The block is baked
+	 * again only when the material properties have changed.
+	 * @return uniform buffer, or null if uniform buffers are not supported
+	 */
+	const UniformBuffer* GetUniformBuffer() const;
 
 	glm::vec4			m_cAmbient; // A base color that is not affected by lighting
 	glm::vec4			m_cDiffuse; // A color that is affected by lighting
@@ -17,4 +25,9 @@ struct Material
 	glm::vec4			m_cEmissive; // A color that is emitted by the material
 
 	float				m_fSpecularPower; // Sharpness of highlight
+
+private:
+	// Baked material block, shared by copies until one of them changes
+	mutable std::shared_ptr<UniformBuffer>	m_pUniformBuffer;
+	mutable MaterialUniforms				m_BakedUniforms;
 };
\ No newline at end of file
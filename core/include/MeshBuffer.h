@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../include/Geometry.h"
+
+#include <unordered_map>
+
+/**
+ * Location of one mesh inside the shared buffers
+ */
+struct MeshRange
+{
+	uint32_t		uFirstIndex; // First index in the shared index buffer
+	uint32_t		uIndexCount;
+	int32_t			iBaseVertex; // Added to each index
+	glm::vec4		vBoundingSphere; // Center and radius in model space
+};
+
+/**
+ * Shared vertex and index buffer that static geometries are sub-allocated from,
+ * so that any number of meshes can be drawn without rebinding buffers.
+ * Meshes are stored as indexed triangle lists. Buffers grow when they are full.
+ */
+class MeshBuffer
+{
+public:
+	MeshBuffer();
+	~MeshBuffer();
+
+	MeshBuffer(const MeshBuffer&) = delete;
+	MeshBuffer& operator=(const MeshBuffer&) = delete;
+
+	/**
+	 * Copy geometry into the shared buffers, if it has not been added already.
+	 * Meshes are found by Geometry::GetGeneration, so a regenerated geometry
+	 * or a new one at the same address is copied again instead of drawing
+	 * the old range. Vertices must not be edited in place after adding.
+	 * @param geometry geometry to add
+	 * @return range of the mesh, or null if failed
+	 */
+	const MeshRange* Add(const Geometry& geometry);
+
+	/**
+	 * Find range of a geometry added earlier
+	 * @param geometry geometry to find
+	 * @return range of the mesh, or null if not added
+	 */
+	const MeshRange* Find(const Geometry& geometry) const;
+
+	/**
+	 * Forget the current contents of a geometry. Ranges of destroyed or
+	 * regenerated geometries are never found again, but their space is
+	 * reclaimed only when the buffer is cleared.
+	 * @param geometry geometry to forget
+	 */
+	void Remove(const Geometry& geometry);
+
+	/**
+	 * Delete the buffers and all meshes
+	 */
+	void Clear();
+
+	/**
+	 * Bind buffers and vertex attributes of the program
+	 * @param program program with position, normal and uv attributes
+	 */
+	void Bind(GLuint program) const;
+
+	/**
+	 * Disable vertex attributes and unbind the buffers, so that client side
+	 * vertex arrays work again
+	 * @param program program passed to Bind
+	 */
+	void Unbind(GLuint program) const;
+
+	inline size_t GetVertexCount() const { return m_uVertexCount; }
+	inline size_t GetIndexCount() const { return m_uIndexCount; }
+
+	/**
+	 * Check if the context supports the shared buffers
+	 * @return true if the functions were loaded
+	 */
+	static bool IsSupported();
+
+private:
+	static bool Reserve(GLuint& buffer, size_t& capacity, size_t used, size_t required, size_t elementSize, size_t initialCapacity);
+
+	GLuint											m_VertexBuffer;
+	GLuint											m_IndexBuffer;
+	size_t											m_uVertexCount;
+	size_t											m_uVertexCapacity; // In vertices
+	size_t											m_uIndexCount;
+	size_t											m_uIndexCapacity; // In indices
+	std::unordered_map<uint64_t, MeshRange>			m_mapMeshes; // By Geometry::GetGeneration
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../include/MeshBuffer.h"
+#include "../include/Material.h"
+#include "../include/GpuCulling.h"
+
+// Forward declarations
+class Node;
+
+/**
+ * Statistics of the last submitted batch
+ */
+struct MultiDrawStats
+{
+	size_t		uDraws; // Meshes drawn
+	size_t		uMultiDrawCalls; // glMultiDrawElementsIndirect calls, one per material
+	size_t		uSkippedDraws; // Geometries that could not be added to the mesh buffer
+	bool		bGpuCulled; // Visibility was tested on the GPU, uDraws counts the instances tested
+};
+
+/**
+ * Collects draws of static geometries into per-material buckets and submits each
+ * bucket with a single glMultiDrawElementsIndirect from the renderer's mesh buffer.
+ * Vertex shaders fetch the world matrix of each draw with GetDrawModelMatrix(),
+ * see GetShaderSource. Needs OpenGL 4.3.
+ */
+class MultiDrawBatch
+{
+public:
+	/**
+	 * Create batch
+	 * @param renderer renderer whose mesh buffer and uniform blocks are used
+	 */
+	MultiDrawBatch(OpenGLRenderer& renderer);
+	~MultiDrawBatch();
+
+	MultiDrawBatch(const MultiDrawBatch&) = delete;
+	MultiDrawBatch& operator=(const MultiDrawBatch&) = delete;
+
+	/**
+	 * Remove all draws, call before collecting the next frame
+	 */
+	void Clear();
+
+	/**
+	 * Add draw of a geometry. Geometry is added to the mesh buffer on first use.
+	 * Material must stay alive until the batch is drawn.
+	 * @param geometry geometry to draw
+	 * @param material material of the draw, can be null
+	 * @param modelMatrix world matrix of the draw
+	 * @return true if added
+	 */
+	bool Add(const Geometry& geometry, const Material* material, const glm::mat4& modelMatrix);
+
+	/**
+	 * Add draws of all geometry nodes in a node hierarchy
+	 * @param node root of the hierarchy
+	 */
+	void AddNode(const Node& node);
+
+	/**
+	 * Test visibility of the draws on the GPU before drawing them.
+	 * Commands are then written by the culling shader and the CPU never sees
+	 * which draws were visible. The culling object must outlive the batch.
+	 * @param culling created culling object, or null to draw everything
+	 */
+	inline void SetCulling(GpuCulling* culling) { m_pCulling = culling; }
+
+	/**
+	 * Upload commands and world matrices and draw all buckets
+	 * @param program program declaring the blocks of GetShaderSource
+	 */
+	void Draw(GLuint program);
+
+	inline const MultiDrawStats& GetStats() const { return m_Stats; }
+
+	/**
+	 * Check if the context supports indirect multi-draw
+	 * @return true if the functions were loaded
+	 */
+	static bool IsSupported();
+
+	/**
+	 * Get GLSL declarations for vertex shaders drawn by the batch. Uses gl_DrawID
+	 * when GLSL 4.60 or GL_ARB_shader_draw_parameters is available, otherwise
+	 * an instanced drawIndex attribute. Needs #version 430.
+	 * @return shader source code to include
+	 */
+	static const char* GetShaderSource();
+
+	// Shader storage binding point of the world matrices
+	static constexpr GLuint kDrawBlockBinding = 0;
+
+private:
+	// Same layout as DrawElementsIndirectCommand
+	struct DRAWCOMMAND
+	{
+		GLuint		count;
+		GLuint		instanceCount;
+		GLuint		firstIndex;
+		GLint		baseVertex;
+		GLuint		baseInstance;
+	};
+
+	struct BUCKET
+	{
+		const Material*				pMaterial;
+		std::vector<DRAWCOMMAND>	arrCommands;
+		std::vector<glm::mat4>		arrTransforms;
+		std::vector<glm::vec4>		arrSpheres; // Bounding spheres for culling
+	};
+
+	void Reserve(size_t drawCount);
+	void Submit(GLuint program, bool culled);
+
+	OpenGLRenderer&								m_Renderer;
+	std::vector<BUCKET>							m_arrBuckets; // Kept between frames to reuse memory
+	std::unordered_map<const Material*, size_t>	m_mapBuckets; // Material to bucket index
+
+	// Whole frame, uploaded with one call each
+	std::vector<DRAWCOMMAND>					m_arrCommands;
+	std::vector<glm::mat4>						m_arrTransforms;
+
+	std::vector<GpuCulling::INSTANCE>			m_arrInstances; // Culling input
+	GpuCulling*									m_pCulling;
+
+	GLuint										m_CommandBuffer;
+	GLuint										m_TransformBuffer;
+	GLuint										m_DrawIndexBuffer; // 0, 1, 2... for the drawIndex attribute
+	size_t										m_uDrawIndexCapacity;
+	GLuint										m_InstanceBuffer;
+	GLuint										m_CounterBuffer; // Visible draws per bucket
+	MultiDrawStats								m_Stats;
+};
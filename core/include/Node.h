@@ -1,14 +1,31 @@
 #pragma once
 
 #include "../include/OpenGLRenderer.h"
+#include "../include/Allocator.h"
 
 class Node
 {
+	// Reads and writes the transform state of whole hierarchies at once
+	friend class TransformBatch;
+
 public:
 	Node();
 	Node(const std::string_view& name);
 	virtual ~Node();
 
+	/**
+	 * Create a node from the pool of its type. The node and its reference
+	 * count share one pooled element, so scenes that add and remove nodes
+	 * all the time do not fragment the heap.
+	 * @param args arguments passed to the constructor of T
+	 * @return the new node
+	 */
+	template<typename T = Node, typename... Args>
+	static std::shared_ptr<T> Create(Args&&... args)
+	{
+		return std::allocate_shared<T>(PoolAllocator<T, MemoryTag::Nodes>(), std::forward<Args>(args)...);
+	}
+
 	/*
 	 * Update a node and all of its children
 	 * @param frametime frame delta time
@@ -75,6 +92,7 @@ public:
 	 * @return a reference to the local model matrix of the node
 	 */
 	inline auto& GetMatrix() { return m_mModel; }
+	inline const auto& GetMatrix() const { return m_mModel; }
 
 	/**
 	 * Set model matrix to the node.
@@ -83,6 +101,24 @@ public:
 	inline void SetMatrix(const glm::mat4& m) { m_mModel = m; }
 
 
+	/**
+	 * Get local model matrix blended between the previous and the latest
+	 * update, for rendering between fixed simulation steps
+	 * @param alpha 0 for the previous update, 1 for the latest
+	 * @return interpolated local model matrix
+	 */
+	glm::mat4 GetInterpolatedMatrix(float alpha) const;
+
+	/**
+	 * Get interpolated matrix in world coordinates, see GetInterpolatedMatrix
+	 * @param alpha 0 for the previous update, 1 for the latest
+	 * @return interpolated model matrix combined with parent's interpolated matrix
+	 */
+	inline glm::mat4 GetInterpolatedWorldMatrix(float alpha) const
+	{
+		return (m_pParent) ? m_pParent->GetInterpolatedWorldMatrix(alpha) * GetInterpolatedMatrix(alpha) : GetInterpolatedMatrix(alpha);
+	}
+
 	 /**
 	 * Get absolute matrix in world coordinates by multiplying node's parent's
 	 * model matrix with node's own model matrix if there is a parent,
@@ -95,13 +131,13 @@ public:
 	 * Get velocity of the node
 	 * @return reference to node's velocity vector
 	 */
-	inline auto& GetVelocity() { return m_vVelocity; }
+	inline auto& GetVelocity() { return m_Motion.velocity; }
 
 	/**
 	 * Set the node's velocity vector
 	 * @param velocity new velocity
 	 */
-	inline void SetVelocity(const glm::vec3& velocity) { m_vVelocity = velocity; }
+	inline void SetVelocity(const glm::vec3& velocity) { m_Motion.velocity = velocity; }
 
 	/**
 	 * Rotate object per axis and angle by applying a rotation matrix to it.
@@ -110,11 +146,11 @@ public:
 	 */
 	inline void RotateAxisAngle(const glm::vec3& axis, float angle)
 	{
-		m_vRotationAxis = glm::normalize(axis);
-		m_fRotationAngle = angle;
+		m_Motion.axis = glm::normalize(axis);
+		m_Motion.angle = angle;
 
 		auto pos = GetPos();
-		m_mModel = glm::rotate(glm::mat4(1.0f), m_fRotationAngle, m_vRotationAxis);
+		m_mModel = glm::rotate(glm::mat4(1.0f), m_Motion.angle, m_Motion.axis);
 		SetPos(pos);
 	}
 
@@ -122,7 +158,7 @@ public:
 	 * Get node's rotation axis
 	 * @return reference to current rotation axis
 	 */
-	inline auto& GetRotationAxis() { return m_vRotationAxis; }
+	inline auto& GetRotationAxis() { return m_Motion.axis; }
 
 	/**
 	 * Set node's rotation axis by calling the RotateAxisAngle
@@ -130,14 +166,14 @@ public:
 	 */
 	inline void SetRotationAxis(const glm::vec3& axis)
 	{
-		RotateAxisAngle(axis, m_fRotationAngle);
+		RotateAxisAngle(axis, m_Motion.angle);
 	}
 
 	/**
 	 * Get node's rotation angle
 	 * @return current rotation angle in radians
 	 */
-	inline float GetRotationAngle() const { return m_fRotationAngle; }
+	inline float GetRotationAngle() const { return m_Motion.angle; }
 
 	/**
 	 * Set node's rotation angle by calling RotateAxisAngle
@@ -145,20 +181,20 @@ public:
 	 */
 	inline void SetRotationAngle(float angle)
 	{
-		RotateAxisAngle(m_vRotationAxis, angle);
+		RotateAxisAngle(m_Motion.axis, angle);
 	}
 
 	/**
 	 * Get node's rotation speed
 	 * @return current rotation speed in radians per second
 	 */
-	inline float GetRotationSpeed() const { return m_fRotationSpeed; }
+	inline float GetRotationSpeed() const { return m_Motion.speed; }
 
 	/**
 	 * Set node's rotation speed
 	 * @param speed rotation speed in radians per second
 	 */
-	inline void SetRotationSpeed(float speed) { m_fRotationSpeed = speed; }
+	inline void SetRotationSpeed(float speed) { m_Motion.speed = speed; }
 
 	/**
 	 * Get node's radius
@@ -172,6 +208,22 @@ public:
 	 */
 	inline void SetRadius(float radius) { m_fRadius = radius; }
 
+	/**
+	 * Mark node as an occluder, so that software occlusion culling
+	 * rasterizes its geometry into the occlusion depth buffer
+	 * @param occluder true if the node hides what is behind it
+	 */
+	inline void SetOccluder(bool occluder) { m_bOccluder = occluder; }
+	inline bool IsOccluder() const { return m_bOccluder; }
+
+	/**
+	 * Set by occlusion culling when the node is hidden. Culled nodes are not
+	 * drawn, but their children are still visited.
+	 * @param culled true to skip drawing the node
+	 */
+	inline void SetCulled(bool culled) { m_bCulled = culled; }
+	inline bool IsCulled() const { return m_bCulled; }
+
 	/**
 	 * Get node's name
 	 * @return a name of a single node
@@ -195,19 +247,28 @@ public:
 
 protected:
 	glm::mat4									m_mModel;
+	glm::mat4									m_mPrevModel; // Model matrix before the latest update
+	bool										m_bPrevModelValid;
 	Node* m_pParent;
 	std::vector<std::shared_ptr<Node>>			m_arrNodes;
 
-	// Velocity and rotations
-	glm::vec3									m_vVelocity;
-
-	glm::vec3									m_vRotationAxis;
-	float										m_fRotationAngle;
-	float										m_fRotationSpeed;
+	// Velocity and rotation in one packed block, TransformBatch loads it as 8 floats
+	struct MOTION
+	{
+		glm::vec3	velocity;
+		glm::vec3	axis; // Normalized
+		float		angle; // Radians
+		float		speed; // Radians per second
+	};
+	MOTION										m_Motion;
 
 	// Size
 	float										m_fRadius;
 
+	// Occlusion culling
+	bool										m_bOccluder;
+	bool										m_bCulled;
+
 private:
 	std::string									m_strName;
 };
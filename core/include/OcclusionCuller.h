@@ -0,0 +1,130 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+#include "../include/JobPool.h"
+
+#include <memory>
+#include <unordered_map>
+
+// Forward declarations
+class Node;
+class Geometry;
+
+/**
+ * Statistics of the last culled frame
+ */
+struct OcclusionStats
+{
+	size_t		uOccluders; // Occluder nodes rasterized
+	size_t		uOccluderTriangles; // Triangles rasterized after near plane clipping
+	size_t		uOccludees; // Geometry nodes tested
+	size_t		uOccluded; // Nodes hidden behind occluders
+	size_t		uOutsideFrustum; // Nodes outside of the screen
+	float		fRasterizeSeconds; // Time spent building the depth buffer
+	float		fTestSeconds; // Time spent testing the bounding boxes
+};
+
+/**
+ * CPU occlusion culling for targets without compute shaders. Occluder nodes
+ * are rasterized into a small depth buffer with SSE, split into bands of rows
+ * across worker threads. Bounding boxes of the geometry nodes are then tested
+ * against it and hidden nodes are marked culled, so that they are skipped
+ * when the scene is rendered.
+ */
+class OcclusionCuller
+{
+public:
+	/**
+	 * Create culler
+	 * @param jobPool worker threads that rasterize bands of rows, usually IApplication::GetJobPool
+	 * @param width, height resolution of the depth buffer, width is rounded up to a multiple of 4
+	 */
+	OcclusionCuller(JobPool& jobPool, int32_t width = 256, int32_t height = 128);
+	~OcclusionCuller();
+
+	OcclusionCuller(const OcclusionCuller&) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+	/**
+	 * Rasterize the occluders of a node hierarchy and mark hidden geometry nodes culled
+	 * @param root root of the hierarchy
+	 * @param viewProjection camera used to render the frame
+	 */
+	void Cull(Node& root, const glm::mat4& viewProjection);
+
+	/**
+	 * Clear culled flags of a node hierarchy, for example when culling is turned off
+	 * @param root root of the hierarchy
+	 */
+	static void ClearCulled(Node& root);
+
+	/**
+	 * Forget cached triangles and bounds of a geometry to free them. Changed
+	 * geometry and geometry created at the address of a destroyed one are
+	 * found by Geometry::GetGeneration and rebuilt without this.
+	 * @param geometry geometry to forget
+	 */
+	void Forget(const Geometry& geometry);
+
+	/**
+	 * Upload the depth buffer into a texture for debug display.
+	 * Near depths are dark, empty areas white.
+	 * @return OpenGL texture handle, owned by the culler
+	 */
+	GLuint UpdateDebugTexture();
+
+	inline const OcclusionStats& GetStats() const { return m_Stats; }
+	inline const float* GetDepthBuffer() const { return m_arrDepth.data(); }
+	inline int32_t GetWidth() const { return m_iWidth; }
+	inline int32_t GetHeight() const { return m_iHeight; }
+
+private:
+	struct MESH
+	{
+		std::vector<glm::vec3>	arrPositions;
+		std::vector<GLuint>		arrIndices; // Empty until the geometry is used as an occluder
+		glm::vec3				vMin;
+		glm::vec3				vMax;
+		uint64_t				uGeneration; // Geometry::GetGeneration the mesh was built from
+	};
+
+	// Screen space triangle prepared for rasterization
+	struct TRIANGLE
+	{
+		float		edge[3][3]; // A, B, C of the edge functions, inside when all are >= 0
+		float		depth[3]; // z = depth[0] * x + depth[1] * y + depth[2]
+		int32_t		iMinX, iMaxX, iMinY, iMaxY;
+	};
+
+	enum class Visibility
+	{
+		Visible,
+		Occluded,
+		Outside
+	};
+
+	MESH* GetMesh(const Geometry& geometry, bool occluder);
+	void CollectOccluders(Node& node, const glm::mat4& viewProjection);
+	void AddOccluderTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	void SetupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+	void TestOccludees(Node& node, const glm::mat4& viewProjection);
+	Visibility Classify(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelViewProjection) const;
+
+	void RasterizeBands();
+	void RasterizeBand(uint32_t band);
+
+	int32_t										m_iWidth;
+	int32_t										m_iHeight;
+	int32_t										m_iBandHeight;
+	uint32_t									m_uBandCount;
+	std::vector<float>							m_arrDepth; // Nearest depth per pixel, 1 is empty
+	std::vector<TRIANGLE>						m_arrTriangles;
+	std::unordered_map<const Geometry*, MESH>	m_mapMeshes; // Rebuilt when the generation differs
+
+	// Worker threads rasterize bands of rows
+	JobPool&									m_JobPool;
+
+	GLuint										m_DebugTexture;
+	std::vector<uint8_t>						m_arrDebugPixels;
+	OcclusionStats								m_Stats;
+};
@@ -9,11 +9,31 @@
 #endif
 #include "./GL/myGL.h" // Declare newer OpenGL functions
 
+#include <vector>
+#include <unordered_map>
+
+// Forward declarations
+class Node;
+struct PointLight;
+class GpuTimer;
+class TextureManager;
+class ShaderManager;
+class MeshBuffer;
+class UniformBuffer;
+class StreamingUniformBuffer;
+struct FrameUniforms;
+class DeferredShading;
+class ResourceWorker;
+class LinearArena;
 
 class OpenGLRenderer : public IRenderer
 {
 public:
-	OpenGLRenderer();
+	/**
+	 * Create renderer
+	 * @param shadingPath shading path to use if the context supports it
+	 */
+	OpenGLRenderer(ShadingPath shadingPath = ShadingPath::Forward);
 	~OpenGLRenderer();
 
 	/**
@@ -28,6 +48,19 @@ public:
 	 */
 	void Flip() override;
 
+	/**
+	 * MakeCurrent method from IRenderer.
+	 * Bind or unbind the OpenGL context on the calling thread
+	 */
+	bool MakeCurrent(bool current) override;
+
+	/**
+	 * SetSwapInterval method from IRenderer.
+	 * Uses WGL_EXT_swap_control or GLX_EXT_swap_control, negative intervals
+	 * need the swap_control_tear extension
+	 */
+	bool SetSwapInterval(int32_t interval) override;
+
 	/**
 	 * Clear the color, depth and stencil buffers
 	 */
@@ -49,6 +82,43 @@ public:
 	 */
 	bool SetTexture(GLuint program, GLuint texture, int32_t slot, const std::string_view& uniformName) override;
 
+	/**
+	 * Set transformation of the object drawn next. Programs declaring ObjectBlock
+	 * get it from the streaming uniform buffer, others through plain uniforms.
+	 * @param program program used to draw the object
+	 * @param modelMatrix world matrix of the object
+	 */
+	void SetObjectTransform(GLuint program, const glm::mat4& modelMatrix) override;
+
+	/**
+	 * Set material of the object drawn next. Programs declaring MaterialBlock
+	 * get the uniform buffer baked by the material, others plain uniforms.
+	 * @param program program used to draw the object
+	 * @param material material properties for lighting
+	 */
+	void SetMaterial(GLuint program, const Material& material) override;
+
+	/**
+	 * Upload the per-frame block if view, projection, shadow bias or light
+	 * have changed since the previous upload. Called automatically when
+	 * objects are drawn.
+	 */
+	void UpdateFrameUniforms();
+
+	/**
+	 * Get shared uniform blocks used by the program. Blocks are bound to their
+	 * binding points the first time the program is seen.
+	 * @param program linked program
+	 * @return bit mask of 1 << UniformBlock values
+	 */
+	uint32_t GetUniformBlocks(GLuint program);
+
+	/**
+	 * Delete program and forget the uniform blocks found from it
+	 * @param program program to delete
+	 */
+	void ReleaseProgram(GLuint program);
+
 	/**
 	 * SetUniformXXX helpers to set uniforms into shader program
 	 * @param program program to set the uniform into
@@ -66,6 +136,26 @@ public:
 		return location != -1;
 	}
 
+	static inline bool SetUniformInt(GLuint program, const char* name, int32_t v)
+	{
+		const GLint location = glGetUniformLocation(program, name);
+		if (location != -1)
+		{
+			glUniform1i(location, v);
+		}
+		return location != -1;
+	}
+
+	static inline bool SetUniformVec2(GLuint program, const char* name, const glm::vec2& v)
+	{
+		const GLint location = glGetUniformLocation(program, name);
+		if (location != -1)
+		{
+			glUniform2fv(location, 1, &v.x);
+		}
+		return location != -1;
+	}
+
 	static inline bool SetUniformVec3(GLuint program, const char* name, const glm::vec3& v)
 	{
 		const GLint location = glGetUniformLocation(program, name);
@@ -107,12 +197,36 @@ public:
 	}
 
 	/**
-	 * Create OpenGL texture handle from image file
+	 * Create OpenGL texture handle from image file.
+	 * Textures are tracked by the texture manager and shared by filename.
 	 * @param filename file to load
 	 * @return OpenGL texture handle, or 0 if failed
 	 */
 	GLuint CreateTexture(const std::string_view& filename);
 
+	/**
+	 * Release texture created with CreateTexture.
+	 * Texture is deleted when all references to it are released.
+	 * @param texture texture handle
+	 */
+	void ReleaseTexture(GLuint texture);
+
+	/**
+	 * Get texture manager tracking the textures of this renderer
+	 * @return reference to the texture manager
+	 */
+	inline TextureManager& GetTextureManager() { return *m_pTextureManager; }
+
+	/**
+	 * Load image file into memory as premultiplied RGBA8 pixels.
+	 * Does not use OpenGL, so it can be called from any thread.
+	 * @param filename file to load
+	 * @param pixels receives the pixel data
+	 * @param width, height receive the size of the image
+	 * @return true if successful
+	 */
+	static bool LoadImageData(const std::string_view& filename, std::vector<uint8_t>& pixels, int32_t& width, int32_t& height);
+
 	/**
 	 * Create OpenGL vertex shader from text
 	 * @param vertexShader shader source code
@@ -145,9 +259,99 @@ public:
 	 * Link OpenGL program from vertex and fragment shader
 	 * @param vertexShader
 	 * @param fragmentShader
+	 * @param retrievableBinary true to allow reading the linked binary with glGetProgramBinary
 	 * @return OpenGL program handle, or 0 if failed
 	 */
-	GLuint CreateProgram(GLuint vertexShader, GLuint fragmentShader);
+	GLuint CreateProgram(GLuint vertexShader, GLuint fragmentShader, bool retrievableBinary = false);
+
+	/**
+	 * Compile and link compute shader program, needs OpenGL 4.3
+	 * @param computeShader shader source code
+	 * @return OpenGL program handle, or 0 if failed or not supported
+	 */
+	GLuint CreateComputeProgram(const char* computeShader);
+
+	/**
+	 * Create shader and start compiling it without waiting for the result.
+	 * Query GL_COMPILE_STATUS only when the result is needed.
+	 * @param type GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
+	 * @param source shader source code
+	 * @return OpenGL shader handle
+	 */
+	GLuint SubmitShader(GLenum type, const char* source);
+
+	/**
+	 * Create program and start linking it without waiting for the result.
+	 * Query GL_LINK_STATUS only when IsProgramCompleted returns true.
+	 * @param vertexShader
+	 * @param fragmentShader
+	 * @param retrievableBinary true to allow reading the linked binary with glGetProgramBinary
+	 * @return OpenGL program handle
+	 */
+	GLuint SubmitProgram(GLuint vertexShader, GLuint fragmentShader, bool retrievableBinary = false);
+
+	/**
+	 * Check without blocking if the driver has finished compiling and linking the program.
+	 * Always true when GL_KHR_parallel_shader_compile is not supported.
+	 * @param program program returned by SubmitProgram
+	 * @return true if status queries will not block
+	 */
+	bool IsProgramCompleted(GLuint program) const;
+
+	/**
+	 * Check if GL_KHR_parallel_shader_compile is in use
+	 * @return true if the driver compiles shaders in the background
+	 */
+	inline bool HasParallelShaderCompile() const { return m_bParallelShaderCompile; }
+
+	/**
+	 * Check if OpenGL extension is supported by the current context
+	 * @param name extension name
+	 * @return true if supported
+	 */
+	static bool HasExtension(const char* name);
+
+	/**
+	 * Get shader manager handling preprocessing and caching of programs
+	 * @return reference to the shader manager
+	 */
+	inline ShaderManager& GetShaderManager() { return *m_pShaderManager; }
+
+	/**
+	 * Get shared vertex and index buffer for indirect drawing of static geometry
+	 * @return reference to the mesh buffer
+	 */
+	inline MeshBuffer& GetMeshBuffer() { return *m_pMeshBuffer; }
+
+	/**
+	 * Get the G-buffer and lighting passes of the deferred shading path
+	 * @return deferred shading, or null when shading forward
+	 */
+	inline DeferredShading* GetDeferredShading() { return m_pDeferredShading.get(); }
+
+	/**
+	 * Draw a node hierarchy with the shading path in use. Forward draws the
+	 * nodes with the given program, deferred runs the G-buffer and lighting
+	 * passes. Both are timed with the same GPU timer, see GetSceneSeconds.
+	 * @param root hierarchy of opaque geometry nodes
+	 * @param program program of the forward path, lit by itself
+	 * @param lights point lights of the deferred path, can be empty
+	 */
+	void RenderScene(Node& root, GLuint program, const std::vector<PointLight>& lights);
+
+	/**
+	 * Get GPU time of RenderScene, a few frames behind
+	 * @return seconds, or 0 if no measurement has finished yet
+	 */
+	float GetSceneSeconds() const;
+
+	/**
+	 * Load whole text file into a string
+	 * @param filename file to load
+	 * @param text receives the contents of the file
+	 * @return true if successful
+	 */
+	static bool LoadTextFile(const std::string_view& filename, std::string& text);
 
 	/**
 	 * Print detailed information of shader errors
@@ -161,6 +365,53 @@ public:
 	 */
 	void PrintProgramError(GLuint program);
 
+	/**
+	 * Get arena for data that lives until the end of the frame. Reset at
+	 * Flip, use only on the thread owning the context.
+	 * @return reference to the frame arena
+	 */
+	inline LinearArena& GetFrameArena() { return *m_pFrameArena; }
+
+	/**
+	 * Context sharing objects with the renderer's context, for creating
+	 * resources on other threads. Opaque, defined by the platform.
+	 */
+	struct SharedContext;
+
+	/**
+	 * Create a context sharing textures, buffers and programs with the
+	 * renderer's context. Call on the thread owning the renderer's context.
+	 * @return new context, or null if failed
+	 */
+	SharedContext* CreateSharedContext();
+
+	/**
+	 * Bind a shared context on the calling thread
+	 * @param context context to bind, or null to unbind the current one
+	 * @return true if successful
+	 */
+	bool MakeSharedContextCurrent(SharedContext* context);
+
+	/**
+	 * Destroy a shared context, it must not be current on any thread
+	 * @param context context to destroy
+	 */
+	void DestroySharedContext(SharedContext* context);
+
+	/**
+	 * Start worker threads creating resources in shared contexts. The texture
+	 * manager then decodes and uploads new textures on the workers.
+	 * @param threadCount number of worker threads
+	 * @return true if started, false if shared contexts or fence sync are not supported
+	 */
+	bool StartResourceWorkers(uint32_t threadCount = 1);
+
+	/**
+	 * Get resource workers for submitting own jobs, e.g. Geometry generation
+	 * @return resource workers, or null if not started
+	 */
+	inline ResourceWorker* GetResourceWorker() { return m_pResourceWorker.get(); }
+
 	/**
 	 * Static helper to get OpenGL function pointers from OpenGL dll after
 	 * context has been created
@@ -181,4 +432,21 @@ private:
 #if defined (_LINUX)
 	void* m_Context;
 #endif
+
+	std::unique_ptr<TextureManager>	m_pTextureManager;
+	std::unique_ptr<ShaderManager>	m_pShaderManager;
+	std::unique_ptr<MeshBuffer>		m_pMeshBuffer;
+	std::unique_ptr<DeferredShading>	m_pDeferredShading;
+	std::unique_ptr<ResourceWorker>	m_pResourceWorker;
+	std::unique_ptr<LinearArena>	m_pFrameArena;
+	std::unique_ptr<GpuTimer>		m_pSceneTimer;
+
+	bool							m_bParallelShaderCompile;
+
+	// Shared uniform blocks, null if not supported
+	std::unique_ptr<UniformBuffer>			m_pFrameUniforms;
+	std::unique_ptr<StreamingUniformBuffer>	m_pObjectUniforms;
+	std::unique_ptr<FrameUniforms>			m_pFrameData; // Last uploaded per-frame block
+	bool									m_bFrameUniformsValid;
+	std::unordered_map<GLuint, uint32_t>	m_mapProgramBlocks; // Program to used blocks
 };
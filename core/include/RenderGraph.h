@@ -0,0 +1,216 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <functional>
+#include <map>
+
+/**
+ * Size and format of a render target
+ */
+struct RenderTargetDesc
+{
+	int32_t		iWidth;
+	int32_t		iHeight;
+	GLenum		eFormat; // Sized internal format, e.g. GL_RGBA16F or GL_DEPTH_COMPONENT24
+	bool		bRenderbuffer; // Attachment only, cannot be sampled
+
+	bool operator==(const RenderTargetDesc& other) const
+	{
+		return iWidth == other.iWidth && iHeight == other.iHeight && eFormat == other.eFormat && bRenderbuffer == other.bRenderbuffer;
+	}
+};
+
+/**
+ * Statistics of the last compiled and executed graph
+ */
+struct RenderGraphStats
+{
+	size_t		uPasses; // Passes executed
+	size_t		uCulledPasses; // Passes whose outputs nobody used
+	size_t		uTransientTargets; // Transient render targets declared
+	size_t		uPhysicalTargets; // Textures and renderbuffers backing them after aliasing
+	size_t		uTransientBytes; // Memory of the physical targets
+	size_t		uUnaliasedBytes; // Memory the transient targets would need without aliasing
+	size_t		uFramebufferBinds; // glBindFramebuffer calls made while executing
+};
+
+/**
+ * Declarative frame graph over the OpenGLRenderer. Each frame the application
+ * declares render targets and passes, and which targets every pass reads and
+ * writes. Compile culls passes whose outputs never reach an imported target
+ * or a pass with side effects, orders the rest by their dependencies, keeping
+ * passes that write the same targets next to each other, and assigns
+ * transient targets whose lifetimes do not overlap to the same texture.
+ * Textures and framebuffers are pooled across frames and released after a few
+ * frames without use.
+ *
+ * Transient targets have undefined contents when first written, passes must
+ * clear or overwrite them.
+ */
+class RenderGraph
+{
+public:
+	using ExecuteFunction = std::function<void(RenderGraph& graph)>;
+
+	RenderGraph(OpenGLRenderer& renderer);
+	~RenderGraph();
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	/**
+	 * Remove all passes and targets of the previous frame. Pooled textures are kept.
+	 */
+	void Reset();
+
+	/**
+	 * Declare a transient render target that lives only inside the graph
+	 * @param name name for debug output
+	 * @param desc size and format
+	 * @return target id
+	 */
+	uint32_t CreateTarget(const std::string_view& name, const RenderTargetDesc& desc);
+
+	/**
+	 * Declare a texture owned by the application. Passes writing it are never culled.
+	 * @param name name for debug output
+	 * @param texture texture handle
+	 * @param desc size and format of the texture
+	 * @return target id
+	 */
+	uint32_t ImportTexture(const std::string_view& name, GLuint texture, const RenderTargetDesc& desc);
+
+	/**
+	 * Declare the default framebuffer. Passes writing it are never culled.
+	 * @param width, height size of the window
+	 * @return target id
+	 */
+	uint32_t ImportBackbuffer(int32_t width, int32_t height);
+
+	/**
+	 * Add a pass, then declare its inputs and outputs with Read and Write
+	 * @param name name for debug output
+	 * @param execute called with the outputs bound as the framebuffer
+	 * @return pass id
+	 */
+	uint32_t AddPass(const std::string_view& name, ExecuteFunction execute);
+
+	/**
+	 * Declare that a pass samples a target
+	 * @param pass pass id
+	 * @param target target id
+	 */
+	void Read(uint32_t pass, uint32_t target);
+
+	/**
+	 * Declare that a pass renders into a target. Color targets are attached in
+	 * the order they are declared, a depth target becomes the depth attachment.
+	 * @param pass pass id
+	 * @param target target id
+	 */
+	void Write(uint32_t pass, uint32_t target);
+
+	/**
+	 * Keep a pass even if nothing reads its outputs, e.g. a pass reading back data
+	 * @param pass pass id
+	 */
+	void SetSideEffect(uint32_t pass);
+
+	/**
+	 * Cull, order and allocate targets
+	 * @return true if successful, false if a transient target is read before it is written
+	 */
+	bool Compile();
+
+	/**
+	 * Run the compiled passes in order
+	 */
+	void Execute();
+
+	/**
+	 * Get the texture backing a target, valid while the graph executes
+	 * @param target target id
+	 * @return texture handle, renderbuffer handle for renderbuffer targets
+	 */
+	GLuint GetTexture(uint32_t target) const;
+
+	inline const RenderTargetDesc& GetDesc(uint32_t target) const { return m_arrTargets[target].desc; }
+	inline OpenGLRenderer& GetRenderer() { return m_Renderer; }
+	inline const RenderGraphStats& GetStats() const { return m_Stats; }
+
+	/**
+	 * Delete all pooled textures and framebuffers
+	 */
+	void Release();
+
+private:
+	// Frames a pooled texture is kept without use
+	static constexpr uint32_t kPoolFrames = 3;
+
+	struct TARGET
+	{
+		std::string					strName;
+		RenderTargetDesc			desc;
+		GLuint						handle;
+		bool						bImported;
+		bool						bBackbuffer;
+		std::vector<uint32_t>		arrWriters;
+		std::vector<uint32_t>		arrReaders;
+		uint32_t					uRefCount;
+		uint32_t					uFirstUse; // Index in the execution order
+		uint32_t					uLastUse;
+		int32_t						iPhysical; // Index of the aliased physical target
+	};
+
+	struct PASS
+	{
+		std::string					strName;
+		ExecuteFunction				execute;
+		std::vector<uint32_t>		arrReads;
+		std::vector<uint32_t>		arrWrites;
+		uint32_t					uRefCount;
+		bool						bSideEffect;
+		bool						bCulled;
+	};
+
+	struct PHYSICAL
+	{
+		RenderTargetDesc			desc;
+		uint32_t					uLastUse;
+		GLuint						handle;
+	};
+
+	struct POOLTARGET
+	{
+		RenderTargetDesc			desc;
+		GLuint						handle;
+		uint64_t					uLastFrame;
+		bool						bInUse;
+	};
+
+	void CullPasses();
+	bool SortPasses();
+	void AliasTargets();
+	GLuint AcquireTarget(const RenderTargetDesc& desc);
+	void ReleaseUnusedTargets();
+	bool BindOutputs(const PASS& pass);
+	GLuint GetFramebuffer(const std::vector<uint32_t>& targets);
+
+	static bool IsDepthFormat(GLenum format);
+	static size_t GetPixelSize(GLenum format);
+
+	OpenGLRenderer&							m_Renderer;
+	std::vector<TARGET>						m_arrTargets;
+	std::vector<PASS>						m_arrPasses;
+	std::vector<uint32_t>					m_arrOrder; // Pass ids in execution order
+	std::vector<PHYSICAL>					m_arrPhysical;
+	bool									m_bCompiled;
+
+	std::vector<POOLTARGET>					m_arrPool;
+	std::map<std::vector<GLuint>, GLuint>	m_mapFramebuffers; // Attachments to framebuffer
+	GLuint									m_BoundFramebuffer;
+	uint64_t								m_uFrame;
+
+	RenderGraphStats						m_Stats;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+#include "../include/FramePacket.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Statistics of the threaded frame loop
+ */
+struct RenderThreadStats
+{
+	uint64_t	uFrames; // Packets rendered
+	float		fUpdateWaitSeconds; // Time the update thread last waited for a free packet
+	float		fRenderWaitSeconds; // Time the render thread last waited for a packet
+	float		fGpuWaitSeconds; // Time the render thread last waited for the GPU to finish the previous frame
+};
+
+/**
+ * Runs rendering on a dedicated thread that owns the renderer's context.
+ * The update thread fills a frame packet from a ring of two or three slots and
+ * submits it; the render thread draws it with IApplication::OnRender and
+ * flips. The update thread can run at most one packet ahead per extra slot,
+ * and a fence after every flip keeps the GPU at most one frame behind the
+ * render thread, so input latency stays bounded.
+ */
+class RenderThread
+{
+public:
+	/**
+	 * Create render thread, call Start to move the context over
+	 * @param app application whose OnRender draws the packets
+	 * @param renderer renderer whose context the thread takes
+	 * @param slotCount packets in the ring, 2 or 3
+	 */
+	RenderThread(IApplication& app, IRenderer& renderer, uint32_t slotCount = 2);
+	~RenderThread();
+
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	/**
+	 * Unbind the context from the calling thread and start the render thread
+	 * @return true if the render thread got the context
+	 */
+	bool Start();
+
+	/**
+	 * Stop the render thread and bind the context back to the calling thread.
+	 * Packets that have not been drawn are dropped.
+	 */
+	void Stop();
+
+	/**
+	 * Get the next free packet, waits while all slots are in use
+	 * @return cleared packet to fill
+	 */
+	FramePacket& BeginFrame();
+
+	/**
+	 * Hand the packet returned by BeginFrame to the render thread
+	 */
+	void SubmitFrame();
+
+	/**
+	 * Get a copy of the statistics, safe to call from the update thread
+	 * @return statistics
+	 */
+	RenderThreadStats GetStats();
+
+private:
+	// Longest wait for the GPU fence, in nanoseconds
+	static constexpr uint64_t kFenceTimeout = 1000000000;
+
+	enum class State
+	{
+		Stopped,
+		Starting,
+		Running,
+		Failed
+	};
+
+	void ThreadMain();
+	void WaitForGpu();
+
+	IApplication&					m_App;
+	IRenderer&						m_Renderer;
+	std::vector<FramePacket>		m_arrPackets;
+
+	std::thread						m_Thread;
+	std::mutex						m_Mutex;
+	std::condition_variable			m_SubmitCondition; // Signaled when a packet is submitted
+	std::condition_variable			m_FreeCondition; // Signaled when a packet has been drawn
+	State							m_eState;
+	bool							m_bQuit;
+	uint64_t						m_uSubmitted; // Packets submitted by the update thread
+	uint64_t						m_uRendered; // Packets the render thread has finished with
+
+	GLsync							m_Fence; // Fence of the previous frame, render thread only
+	RenderThreadStats				m_Stats;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * Statistics of the resource workers
+ */
+struct ResourceWorkerStats
+{
+	uint32_t	uThreads; // Worker threads running
+	size_t		uQueued; // Jobs waiting for a worker
+	size_t		uInFlight; // Jobs run whose GPU commands have not finished
+	uint64_t	uCompleted; // Jobs handed off to the render context
+};
+
+/**
+ * Creates OpenGL resources in the background. Every worker thread has its
+ * own context sharing objects with the renderer's context, so jobs can
+ * create and fill textures and buffers while the render thread keeps
+ * drawing. A fence is placed after every job, and the job's ready callback
+ * runs on the thread owning the renderer's context once the GPU has passed
+ * the fence. Only then may the resources be used for drawing.
+ */
+class ResourceWorker
+{
+public:
+	using Job = std::function<void()>;
+
+	/**
+	 * Create workers, call Start to create the contexts and threads
+	 * @param renderer renderer whose context the workers share
+	 */
+	ResourceWorker(OpenGLRenderer& renderer);
+	~ResourceWorker();
+
+	/**
+	 * Create shared contexts and start the threads. Call on the thread owning the renderer's context.
+	 * Waits until every thread has made its context current, and removes those that failed.
+	 * @param threadCount number of worker threads
+	 * @return true if at least one worker was started
+	 */
+	bool Start(uint32_t threadCount = 1);
+
+	/**
+	 * Stop the threads, dropping queued jobs, and destroy their contexts.
+	 * Call on the thread owning the renderer's context.
+	 */
+	void Stop();
+
+	/**
+	 * Run a job on a worker thread
+	 * @param job job creating resources, runs with a shared context current
+	 * @param onReady called on the thread owning the renderer's context when the job's resources can be used
+	 */
+	void Submit(Job job, Job onReady = nullptr);
+
+	/**
+	 * Call ready callbacks of jobs the GPU has finished, never blocks.
+	 * Called by OpenGLRenderer::Flip.
+	 */
+	void Update();
+
+	/**
+	 * Block until all submitted jobs have finished and their callbacks have run.
+	 * Without running workers the queued jobs are run on the calling thread,
+	 * which must own the renderer's context.
+	 */
+	void WaitIdle();
+
+	/**
+	 * Get statistics
+	 * @return current statistics
+	 */
+	ResourceWorkerStats GetStats() const;
+
+	/**
+	 * Check if workers are running
+	 * @return true if started
+	 */
+	inline bool IsRunning() const { return !m_arrThreads.empty(); }
+
+private:
+	struct TASK
+	{
+		Job			job;
+		Job			onReady;
+	};
+
+	// Job run by a worker, waiting for the GPU
+	struct HANDOFF
+	{
+		GLsync		fence;
+		Job			onReady;
+	};
+
+	enum class WorkerState : uint8_t
+	{
+		Starting,
+		Running,
+		Failed
+	};
+
+	void ThreadMain(OpenGLRenderer::SharedContext* context, size_t index);
+
+	OpenGLRenderer&								m_Renderer;
+	std::vector<std::thread>					m_arrThreads;
+	std::vector<OpenGLRenderer::SharedContext*>	m_arrContexts;
+	std::vector<WorkerState>					m_arrStates; // Reported by each thread once its context is current
+
+	mutable std::mutex							m_Mutex;
+	std::condition_variable						m_Condition;
+	std::condition_variable						m_IdleCondition;
+	std::deque<TASK>							m_arrTasks;
+	std::deque<HANDOFF>							m_arrHandoffs;
+	uint32_t									m_uRunning; // Jobs being run by workers
+	bool										m_bQuit;
+	uint64_t									m_uCompleted;
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+#include "../include/FileWatcher.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * Statistics of the shader manager
+ */
+struct ShaderStats
+{
+	size_t		uPrograms; // Unique programs in memory
+	size_t		uShaders; // Unique compiled shaders in memory
+	size_t		uProgramRequests; // Total calls to GetProgram
+	size_t		uBinaryCacheHits; // Programs loaded from the binary cache
+	size_t		uBinaryCacheMisses; // Programs compiled from source
+	size_t		uPendingPrograms; // Submitted programs the driver is still compiling
+	size_t		uFailedPrograms; // Total number of programs that failed to compile or link
+	size_t		uReloads; // Programs swapped after their source files changed
+	size_t		uFailedReloads; // Reloads that failed and kept the previous program
+	float		fCompileSeconds; // Time spent compiling and linking from source
+	float		fBinaryLoadSeconds; // Time spent loading binaries
+};
+
+/**
+ * Handle to a program that is compiled in the background.
+ * Poll it each frame and draw with the program once it is ready.
+ */
+class ProgramFuture
+{
+public:
+	enum class State
+	{
+		Pending,
+		Ready,
+		Failed
+	};
+
+	ProgramFuture() :
+		m_eState(State::Pending),
+		m_Program(0)
+	{
+	}
+
+	inline State GetState() const { return m_eState; }
+	inline bool IsPending() const { return m_eState == State::Pending; }
+	inline bool IsReady() const { return m_eState == State::Ready; }
+	inline bool IsFailed() const { return m_eState == State::Failed; }
+
+	/**
+	 * Get the program
+	 * @return OpenGL program handle, or 0 if it is not ready
+	 */
+	inline GLuint GetProgram() const { return IsReady() ? m_Program : 0; }
+
+private:
+	friend class ShaderManager;
+
+	State		m_eState;
+	GLuint		m_Program;
+};
+
+class ShaderManager
+{
+public:
+	/**
+	 * Create shader manager
+	 * @param renderer renderer used to compile and link shaders
+	 */
+	ShaderManager(OpenGLRenderer& renderer);
+	~ShaderManager();
+
+	/**
+	 * Set directory where linked program binaries are stored.
+	 * Binary caching is disabled while the directory is empty.
+	 * @param directory cache directory, created if it does not exist
+	 */
+	void SetCacheDirectory(const std::string_view& directory);
+	inline const std::string& GetCacheDirectory() const { return m_strCacheDirectory; }
+
+	/**
+	 * Get program built from shader files. Sources are preprocessed for
+	 * #include directives and the defines are inserted after the #version line.
+	 * Programs with identical preprocessed sources are shared. The program
+	 * stays valid until Clear and is not updated by hot reload, use
+	 * SubmitProgram for programs that should follow their files.
+	 * @param vertexFile vertex shader file
+	 * @param fragmentFile fragment shader file
+	 * @param defines permutation defines, "NAME" or "NAME=VALUE"
+	 * @return OpenGL program handle, or 0 if failed
+	 */
+	GLuint GetProgram(const std::string_view& vertexFile, const std::string_view& fragmentFile, const std::vector<std::string>& defines = {});
+
+	/**
+	 * Get program built from shader sources
+	 * @param vertexSource vertex shader source code
+	 * @param fragmentSource fragment shader source code
+	 * @param defines permutation defines, "NAME" or "NAME=VALUE"
+	 * @return OpenGL program handle, or 0 if failed
+	 */
+	GLuint GetProgramFromSource(const std::string_view& vertexSource, const std::string_view& fragmentSource, const std::vector<std::string>& defines = {});
+
+	/**
+	 * Submit program from shader files for compilation without waiting for it.
+	 * Submit the whole batch first, the driver compiles in parallel when
+	 * GL_KHR_parallel_shader_compile is available. Errors are reported when
+	 * the program is resolved in Update or Finish.
+	 * The same files and defines always return the same handle, which
+	 * receives the new program when hot reload is enabled. The replaced
+	 * program is deleted once no other handle refers to it, so read the
+	 * program from the handle every time.
+	 * @param vertexFile vertex shader file
+	 * @param fragmentFile fragment shader file
+	 * @param defines permutation defines, "NAME" or "NAME=VALUE"
+	 * @return handle to poll, already failed if the files could not be read
+	 */
+	std::shared_ptr<const ProgramFuture> SubmitProgram(const std::string_view& vertexFile, const std::string_view& fragmentFile, const std::vector<std::string>& defines = {});
+
+	/**
+	 * Submit program from shader sources for compilation without waiting for it.
+	 * @param vertexSource vertex shader source code
+	 * @param fragmentSource fragment shader source code
+	 * @param defines permutation defines, "NAME" or "NAME=VALUE"
+	 * @return handle to poll
+	 */
+	std::shared_ptr<const ProgramFuture> SubmitProgramFromSource(const std::string_view& vertexSource, const std::string_view& fragmentSource, const std::vector<std::string>& defines = {});
+
+	/**
+	 * Resolve submitted programs the driver has finished, without blocking.
+	 * With hot reload, also recompiles programs whose files have changed
+	 * and swaps them into their handles. Called by the renderer every frame,
+	 * so programs change only at frame boundaries.
+	 */
+	void Update();
+
+	/**
+	 * Watch source files and includes of programs created with SubmitProgram
+	 * and recompile them in the background when they change. If the new
+	 * version fails to compile, the previous program is kept.
+	 * @param enable true to enable, false to disable
+	 */
+	void EnableHotReload(bool enable);
+	inline bool IsHotReloadEnabled() const { return m_pWatcher != nullptr; }
+
+	/**
+	 * Resolve all submitted programs, blocking until the driver has finished them
+	 */
+	void Finish();
+
+	/**
+	 * Delete all programs and shaders owned by the manager
+	 */
+	void Clear();
+
+	/**
+	 * Expand #include directives and insert defines into shader source
+	 * @param source shader source code
+	 * @param directory directory where included files are searched from
+	 * @param defines permutation defines, "NAME" or "NAME=VALUE"
+	 * @param dependencies receives the files that were included, can be null
+	 * @return preprocessed source code
+	 */
+	static std::string Preprocess(const std::string_view& source, const std::string_view& directory, const std::vector<std::string>& defines, std::vector<std::string>* dependencies = nullptr);
+
+	/**
+	 * 64 bit FNV-1a hash
+	 * @param data bytes to hash
+	 * @param hash previous hash to continue from
+	 * @return hash of the data
+	 */
+	static uint64_t Hash(const std::string_view& data, uint64_t hash = 0xcbf29ce484222325ull);
+
+	/**
+	 * Get statistics
+	 * @return current statistics
+	 */
+	inline const ShaderStats& GetStats() const { return m_Stats; }
+
+private:
+	static bool ExpandIncludes(const std::string_view& source, const std::string& directory, std::string& output, std::unordered_set<std::string>& included, std::vector<std::string>* dependencies);
+	static std::string GetDirectory(const std::string_view& filename);
+
+	struct PENDINGPROGRAM
+	{
+		std::shared_ptr<ProgramFuture>	pFuture;
+		uint64_t						uKey;
+		GLuint							vertexShader;
+		GLuint							fragmentShader;
+		bool							bCacheEnabled;
+		uint32_t						uWaitedFrames; // Updates since submission
+	};
+
+	struct RELOADABLE
+	{
+		std::string						strVertexFile;
+		std::string						strFragmentFile;
+		std::vector<std::string>		arrDefines;
+		std::vector<std::string>		arrDependencies; // Source files and their includes
+		std::shared_ptr<ProgramFuture>	pFuture;
+		bool							bChanged; // Waiting to be recompiled
+		uint64_t						uNewKey; // Recompiled program, while in flight
+		GLuint							newProgram;
+		GLuint							newVertexShader;
+		GLuint							newFragmentShader;
+		uint32_t						uWaitedFrames; // Updates since the reload was submitted
+	};
+
+	static uint64_t GetProgramKey(const std::string& vertexSource, const std::string& fragmentSource);
+	GLuint BuildProgram(const std::string& vertexSource, const std::string& fragmentSource);
+	std::shared_ptr<ProgramFuture> SubmitSources(const std::string& vertexSource, const std::string& fragmentSource);
+	void StartReload(RELOADABLE& reloadable);
+	void FinishReload(RELOADABLE& reloadable);
+	GLuint SubmitShader(GLenum type, const std::string& source);
+	void Resolve(PENDINGPROGRAM& pending);
+	bool IsLinkFinished(GLuint program, uint32_t& waitedFrames) const;
+	std::shared_ptr<ProgramFuture> TrackFuture(std::shared_ptr<ProgramFuture> future);
+	GLuint PinProgram(GLuint program);
+	void ReleaseReplacedProgram(GLuint program);
+	void ReleaseRetiredPrograms();
+	void ReleaseFailedShader(GLuint shader);
+	GLuint GetShader(GLenum type, const std::string& source);
+	GLuint LoadBinary(uint64_t key);
+	void SaveBinary(uint64_t key, GLuint program);
+	std::string GetBinaryFilename(uint64_t key) const;
+	uint64_t GetDriverHash();
+
+	OpenGLRenderer&								m_Renderer;
+	std::string									m_strCacheDirectory;
+	uint64_t									m_uDriverHash;
+
+	std::unordered_map<uint64_t, GLuint>		m_mapPrograms; // Combined source hash to program
+	std::unordered_map<uint64_t, GLuint>		m_mapShaders; // Source hash to compiled shader
+	std::vector<PENDINGPROGRAM>					m_arrPending; // Programs in submission order
+	std::unordered_map<std::string, RELOADABLE>	m_mapReloadables; // Files and defines to program
+	std::unordered_set<GLuint>					m_setPinnedPrograms; // Returned as plain handles, kept until Clear
+	std::vector<std::weak_ptr<ProgramFuture>>	m_arrFutures; // Handles given out, to find who still uses a program
+	std::vector<GLuint>							m_arrRetiredPrograms; // Replaced by reloads, deleted once unused
+	std::unique_ptr<FileWatcher>				m_pWatcher;
+	ShaderStats									m_Stats;
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+// Forward declarations
+class Node;
+class Geometry;
+class CameraNode;
+
+/**
+ * Statistics of the last rendered shadow frame
+ */
+struct ShadowStats
+{
+	size_t		uCascadesRendered; // Cascades whose depth was drawn this frame
+	size_t		uCascadesCached; // Cascades reused from earlier frames
+	size_t		uStaticDraws; // Static caster draws, only when a static layer was refreshed
+	size_t		uDynamicDraws; // Dynamic caster draws over all cascades
+	size_t		uCulledDraws; // Casters outside of a cascade
+};
+
+/**
+ * Shadow maps for a directional light with cascades fitted to the camera
+ * frustum, or for a spot light with a single perspective map. Casters are
+ * drawn depth-only from a position-only vertex stream without materials.
+ * Static casters are drawn into a separate cache that is refreshed only when
+ * the light, the static casters or the snapped cascade changes; dynamic
+ * casters are drawn on top of a copy of it every frame.
+ */
+class ShadowMap
+{
+public:
+	ShadowMap(OpenGLRenderer& renderer);
+	~ShadowMap();
+
+	ShadowMap(const ShadowMap&) = delete;
+	ShadowMap& operator=(const ShadowMap&) = delete;
+
+	/**
+	 * Create depth textures and the depth-only program
+	 * @param size width and height of each cascade in texels
+	 * @param cascadeCount number of cascades, 1 to kMaxCascades
+	 * @return true if successful
+	 */
+	bool Create(int32_t size = 2048, uint32_t cascadeCount = 4);
+
+	/**
+	 * Delete textures, buffers and the program
+	 */
+	void Release();
+
+	/**
+	 * Use a directional light with cascades
+	 * @param direction direction the light travels to
+	 */
+	void SetDirectionalLight(const glm::vec3& direction);
+
+	/**
+	 * Use a spot light with a single shadow map
+	 * @param position position of the light
+	 * @param direction direction the light points to
+	 * @param angle cone angle from the center in radians
+	 * @param range distance the light reaches
+	 */
+	void SetSpotLight(const glm::vec3& position, const glm::vec3& direction, float angle, float range);
+
+	/**
+	 * Set how far from the camera shadows are drawn, cascades split this range
+	 * @param distance view distance, clamped to the far plane of the camera
+	 */
+	inline void SetShadowDistance(float distance) { m_fShadowDistance = distance; }
+
+	/**
+	 * Set distribution of the cascade splits
+	 * @param lambda 0 for uniform splits, 1 for logarithmic
+	 */
+	inline void SetSplitLambda(float lambda) { m_fSplitLambda = lambda; }
+
+	/**
+	 * Set polygon offset applied when casters are drawn
+	 * @param slope slope scaled bias
+	 * @param constant constant bias in depth units
+	 */
+	inline void SetDepthBias(float slope, float constant) { m_fSlopeBias = slope; m_fConstantBias = constant; }
+
+	/**
+	 * Refresh static cascades on the next render, call when static casters change
+	 */
+	void InvalidateStatic();
+
+	/**
+	 * Refresh only the static cascades a static caster was drawn into or now
+	 * overlaps. Call after moving a static caster or changing its geometry.
+	 * @param caster moved or changed node, its children are included
+	 */
+	void InvalidateStatic(const Node& caster);
+
+	/**
+	 * Forget the position stream of a geometry to stop finding it by address.
+	 * Changed geometry is found by Geometry::GetGeneration and copied again
+	 * without this. Space is reclaimed only when the shadow map is released.
+	 * @param geometry geometry to forget
+	 */
+	void Forget(const Geometry& geometry);
+
+	/**
+	 * Fit the cascades to the camera and draw the casters that are needed.
+	 * Restores the framebuffer, viewport and program when done.
+	 * @param camera camera the frame is rendered with
+	 * @param staticCasters hierarchy of casters that do not move, can be null
+	 * @param dynamicCasters hierarchy of casters drawn every frame, can be null
+	 * @return true if the shadow map is ready for sampling
+	 */
+	bool Render(const CameraNode& camera, const Node* staticCasters, const Node* dynamicCasters);
+
+	/**
+	 * Bind the shadow map and set the uniforms of GetShaderSource to a program
+	 * @param program program including GetShaderSource
+	 * @param slot texture slot to bind the depth texture to
+	 */
+	void Apply(GLuint program, int32_t slot) const;
+
+	inline GLuint GetTexture() const { return m_DepthTexture; }
+	inline uint32_t GetCascadeCount() const { return m_bSpotLight ? 1 : m_uCascadeCount; }
+	inline const glm::mat4& GetCascadeMatrix(uint32_t cascade) const { return m_arrCascades[cascade].mViewProjection; }
+	inline float GetSplitDistance(uint32_t cascade) const { return m_arrCascades[cascade].fSplitFar; }
+	inline const ShadowStats& GetStats() const { return m_Stats; }
+
+	/**
+	 * Get GLSL declarations for sampling the shadow map in fragment shaders.
+	 * GetShadow(worldPosition, viewDepth) returns 0 in shadow and 1 in light,
+	 * with viewDepth being the positive distance along the view direction.
+	 * Needs #version 330.
+	 * @return shader source code to include
+	 */
+	static const char* GetShaderSource();
+
+	static constexpr uint32_t kMaxCascades = 4;
+
+private:
+	// Position-only copy of a geometry in the depth stream
+	struct CASTER_MESH
+	{
+		uint32_t		uFirstIndex;
+		uint32_t		uIndexCount;
+		glm::vec4		vBoundingSphere; // Center and radius in model space
+		uint64_t		uGeneration; // Geometry::GetGeneration the copy was made from
+	};
+
+	struct CASCADE
+	{
+		glm::mat4		mViewProjection;
+		glm::mat4		mStaticViewProjection; // Matrix the static layer was drawn with
+		glm::vec4		arrPlanes[6]; // Frustum planes of the light, for culling casters
+		float			fSplitFar; // View depth where the cascade ends
+		bool			bStaticValid;
+		bool			bHadDynamic; // Dynamic casters were drawn into the layer last frame
+		std::unordered_set<const Node*>	setStaticCasters; // Nodes drawn into the static layer
+	};
+
+	struct DRAW
+	{
+		const CASTER_MESH*	pMesh;
+		const Node*			pNode;
+		glm::mat4			mModel;
+	};
+
+	void UpdateCascades(const CameraNode& camera);
+	const CASTER_MESH* GetMesh(const Geometry& geometry);
+	void UploadStream();
+	bool IsInside(const CASTER_MESH& mesh, const glm::mat4& model, const CASCADE& cascade) const;
+	void CollectDraws(const Node& node, const CASCADE& cascade, std::vector<DRAW>& draws);
+	void DrawLayer(GLuint texture, uint32_t layer, const CASCADE& cascade, const std::vector<DRAW>& draws, bool clear);
+
+	OpenGLRenderer&									m_Renderer;
+	int32_t											m_iSize;
+	uint32_t										m_uCascadeCount;
+
+	// Light
+	bool											m_bSpotLight;
+	glm::vec3										m_vLightDirection;
+	glm::vec3										m_vLightPosition;
+	float											m_fSpotAngle;
+	float											m_fSpotRange;
+
+	float											m_fShadowDistance;
+	float											m_fSplitLambda;
+	float											m_fSlopeBias;
+	float											m_fConstantBias;
+
+	GLuint											m_DepthTexture; // Array of cascades sampled by shaders
+	GLuint											m_StaticTexture; // Static casters only, null without glCopyImageSubData
+	GLuint											m_Framebuffer;
+	GLuint											m_Program;
+	GLint											m_iPositionLocation;
+	GLint											m_iMatrixLocation;
+
+	// Depth stream shared by all casters
+	GLuint											m_PositionBuffer;
+	GLuint											m_IndexBuffer;
+	std::vector<glm::vec3>							m_arrPositions;
+	std::vector<GLuint>								m_arrIndices; // Absolute, no base vertex needed
+	bool											m_bStreamDirty;
+	std::unordered_map<const Geometry*, CASTER_MESH>	m_mapMeshes;
+
+	CASCADE											m_arrCascades[kMaxCascades];
+	std::vector<DRAW>								m_arrStaticDraws;
+	std::vector<DRAW>								m_arrDynamicDraws;
+	ShadowStats										m_Stats;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../include/World.h"
+#include "../include/JobPool.h"
+
+#include <string>
+
+/**
+ * Time spent in one system during the last Run
+ */
+struct SystemTiming
+{
+	std::string		strName;
+	size_t			uChunks; // Chunks the system ran on
+	size_t			uEntities; // Entities in those chunks
+	float			fSeconds;
+};
+
+/**
+ * Runs systems over the chunks of a World. Systems run in the order they
+ * were added, with a barrier between them; each one runs on all matching
+ * chunks in parallel, split across worker threads and the calling thread.
+ * A system must only write to the chunk it is given.
+ */
+class SystemScheduler
+{
+public:
+	using SystemFunction = std::function<void(World& world, WorldChunk& chunk, float frametime)>;
+
+	/**
+	 * Create scheduler
+	 * @param jobPool worker threads that take chunks, usually IApplication::GetJobPool
+	 */
+	SystemScheduler(JobPool& jobPool);
+	~SystemScheduler();
+
+	SystemScheduler(const SystemScheduler&) = delete;
+	SystemScheduler& operator=(const SystemScheduler&) = delete;
+
+	/**
+	 * Add a system to run after the ones added before
+	 * @param name name shown in the timings
+	 * @param mask components a chunk must have, ComponentBit values
+	 * @param function system run on every matching chunk
+	 */
+	void AddSystem(const std::string_view& name, uint32_t mask, SystemFunction function);
+
+	/**
+	 * Add the systems that replace Node::Update: velocity and rotation
+	 * integration followed by the local and world transforms
+	 */
+	void AddDefaultSystems();
+
+	/**
+	 * Run all systems once
+	 * @param world world to update
+	 * @param frametime frame delta time
+	 */
+	void Run(World& world, float frametime);
+
+	/**
+	 * Get timings of the last Run
+	 * @return one entry per system, in run order
+	 */
+	inline const std::vector<SystemTiming>& GetTimings() const { return m_arrTimings; }
+
+private:
+	struct SYSTEM
+	{
+		std::string			name;
+		uint32_t			mask;
+		SystemFunction		function;
+	};
+
+	void RunSystem(const SYSTEM& system, World& world, float frametime);
+
+	std::vector<SYSTEM>							m_arrSystems;
+	std::vector<SystemTiming>					m_arrTimings;
+	std::vector<WorldChunk*>					m_arrChunks; // Chunks of the system being run
+
+	// Worker threads take chunks until none are left
+	JobPool&									m_JobPool;
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <list>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <condition_variable>
+
+class ResourceWorker;
+
+/**
+ * Residency and memory statistics of the texture manager
+ */
+struct TextureStats
+{
+	size_t		uTextureCount; // Number of tracked textures
+	size_t		uResidentCount; // Textures that have at least one mip level in GPU memory
+	size_t		uEvictedCount; // Textures that are fully evicted and waiting for reload
+	size_t		uPendingLoads; // Background loads that have not been uploaded yet
+	size_t		uResidentBytes; // GPU memory used by all textures, including mip levels
+	size_t		uPeakBytes; // Highest value of uResidentBytes seen
+	size_t		uBudgetBytes; // Memory budget given to the manager
+	size_t		uPendingFreeBytes; // Bytes freed once queued mip drops have been uploaded
+	size_t		uMipDrops; // Total number of top mip levels dropped
+	size_t		uEvictions; // Total number of textures fully evicted
+	size_t		uReloads; // Total number of textures reloaded from disk
+};
+
+class TextureManager
+{
+public:
+	/**
+	 * Create texture manager
+	 * @param budgetBytes maximum amount of GPU memory textures may use, 0 for unlimited
+	 */
+	TextureManager(size_t budgetBytes = 0);
+	~TextureManager();
+
+	/**
+	 * Load texture from image file or return the already loaded texture of the same file.
+	 * Every successful call increases the reference count of the texture.
+	 * @param filename file to load
+	 * @return OpenGL texture handle, or 0 if failed
+	 */
+	GLuint Acquire(const std::string_view& filename);
+
+	/**
+	 * Decode and upload new textures on resource workers. Acquire then
+	 * returns the handle at once, and the texture samples as incomplete
+	 * until its upload has been handed off to the render context.
+	 * @param worker resource workers, or null to load synchronously
+	 */
+	inline void SetResourceWorker(ResourceWorker* worker) { m_pResourceWorker = worker; }
+
+	/**
+	 * Decrease reference count of the texture and delete it when it is no longer referenced
+	 * @param texture texture handle returned by Acquire
+	 */
+	void Release(GLuint texture);
+
+	/**
+	 * Mark texture used in the current frame. Fully evicted textures are queued
+	 * for background reload and restored at the next Update.
+	 * @param texture texture handle
+	 */
+	void Touch(GLuint texture);
+
+	/**
+	 * Per frame update. Uploads textures loaded in the background and
+	 * evicts least recently used textures while over the budget.
+	 * Must be called from the thread owning the OpenGL context.
+	 */
+	void Update();
+
+	/**
+	 * Set memory budget and evict immediately if it is exceeded
+	 * @param budgetBytes maximum amount of GPU memory textures may use, 0 for unlimited
+	 */
+	void SetBudget(size_t budgetBytes);
+	inline size_t GetBudget() const { return m_uBudgetBytes; }
+
+	/**
+	 * Check if texture has its full resolution in GPU memory
+	 * @param texture texture handle
+	 * @return true if all mip levels are resident
+	 */
+	bool IsFullyResident(GLuint texture) const;
+
+	/**
+	 * Get residency and memory statistics
+	 * @return current statistics
+	 */
+	TextureStats GetStats() const;
+
+	/**
+	 * Calculate the memory size of RGBA8 texture with full mip chain
+	 * @param width, height size of the top mip level
+	 * @return size in bytes
+	 */
+	static size_t CalculateSize(int32_t width, int32_t height);
+
+private:
+	struct TEXTURE
+	{
+		std::string		strFilename;
+		GLuint			handle;
+		int32_t			iWidth; // Size of the full resolution image
+		int32_t			iHeight;
+		int32_t			iDroppedLevels; // Number of top mip levels currently dropped
+		int32_t			iTargetDroppedLevels; // Levels dropped once the queued shrink is uploaded
+		size_t			uPendingFreeBytes; // Bytes the queued shrink frees
+		uint32_t		uRefCount;
+		uint64_t		uLastUsedFrame;
+		size_t			uBytes; // Bytes currently in GPU memory
+		bool			bEvicted;
+		bool			bLoading;
+		bool			bUploading; // Created on a resource worker, not handed off yet
+	};
+
+	struct LOADREQUEST
+	{
+		GLuint					handle;
+		std::string				strFilename;
+		std::vector<uint8_t>	arrPixels; // Source image downsampled by iDroppedLevels
+		int32_t					iWidth; // Size of the source image
+		int32_t					iHeight;
+		int32_t					iDroppedLevels; // Top mip levels to leave out
+	};
+
+	void Upload(TEXTURE& texture, const uint8_t* pixels, int32_t width, int32_t height);
+	static void UploadPixels(GLuint handle, const uint8_t* pixels, int32_t width, int32_t height);
+	GLuint AcquireAsync(const std::string& filename);
+	void UploadReady(GLuint handle, const std::string& filename, int32_t width, int32_t height);
+	void MarkUsed(TEXTURE& texture);
+	void EnforceBudget();
+	bool DropTopLevel(TEXTURE& texture);
+	void CancelDrop(TEXTURE& texture);
+	void Evict(TEXTURE& texture);
+	void QueueLoad(TEXTURE& texture);
+	void LoaderThread();
+	static void Downsample(std::vector<uint8_t>& pixels, int32_t& width, int32_t& height);
+
+	std::unordered_map<GLuint, TEXTURE>						m_mapTextures;
+	std::unordered_map<std::string, GLuint>					m_mapFilenames;
+
+	// Least recently used textures are at the front of the list
+	std::list<GLuint>										m_listLRU;
+	std::unordered_map<GLuint, std::list<GLuint>::iterator>	m_mapLRU;
+
+	size_t													m_uBudgetBytes;
+	size_t													m_uResidentBytes;
+	size_t													m_uPeakBytes;
+	size_t													m_uPendingFreeBytes; // Sum of uPendingFreeBytes of all textures
+	size_t													m_uMipDrops;
+	size_t													m_uEvictions;
+	size_t													m_uReloads;
+	uint64_t												m_uFrame;
+
+	// Uploads on resource workers
+	ResourceWorker*											m_pResourceWorker;
+	std::vector<GLuint>										m_arrOrphans; // Released while uploading
+
+	// Background loading
+	std::thread												m_LoaderThread;
+	mutable std::mutex										m_Mutex;
+	std::condition_variable									m_Condition;
+	std::deque<LOADREQUEST>									m_arrRequests;
+	std::deque<LOADREQUEST>									m_arrCompleted;
+	bool													m_bRunning;
+};
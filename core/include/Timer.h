@@ -29,6 +29,12 @@ public:
 	 */
 	static uint64_t GetTicks();
 
+	/**
+	 * Get the rate of GetTicks
+	 * @return ticks per second
+	 */
+	static uint64_t GetTickFrequency();
+
 private:
 	double		m_dRateToSeconds;
 	uint64_t	m_uTickFrequency;
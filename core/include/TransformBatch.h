@@ -0,0 +1,118 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <vector>
+
+// Forward declarations
+class Node;
+
+/**
+ * Statistics of the last batched update
+ */
+struct TransformBatchStats
+{
+	size_t		uNodes; // Nodes updated
+	size_t		uRotating; // Nodes with a rotation speed
+	float		fGatherSeconds; // Time spent reading the nodes into the batch
+	float		fIntegrateSeconds; // Time spent in the integration kernel
+	float		fScatterSeconds; // Time spent writing the matrices back
+};
+
+/**
+ * Result of TransformBatch::Benchmark
+ */
+struct TransformBenchmark
+{
+	size_t		uNodes; // Nodes in the test scene
+	uint32_t	uIterations; // Updates timed per path
+	float		fNodeSeconds; // Total time of Node::Update on the root
+	float		fBatchSeconds; // Total time of TransformBatch::Update
+	float		fMaxError; // Largest difference between matrices of the two paths
+	bool		bSimd; // True if the kernel was built with SSE
+};
+
+/**
+ * Updates the nodes of a hierarchy in one batch instead of one by one in
+ * Node::Update. Positions, velocities and rotations are gathered into
+ * arrays, integrated four nodes at a time with SSE (plain loops when SSE is
+ * not available) and the model matrices are written back. The result is the
+ * same as calling Update on the root. Subclasses overriding Node::Update
+ * are updated as plain nodes, so keep those out of batched hierarchies.
+ */
+class TransformBatch
+{
+public:
+	TransformBatch();
+	~TransformBatch();
+
+	TransformBatch(const TransformBatch&) = delete;
+	TransformBatch& operator=(const TransformBatch&) = delete;
+
+	/**
+	 * Collect the nodes of a hierarchy, call again when nodes are added or removed
+	 * @param root root of the hierarchy, updated along with its children
+	 */
+	void Build(Node& root);
+
+	/**
+	 * Update all collected nodes, replaces root->Update(frametime)
+	 * @param frametime frame delta time
+	 */
+	void Update(float frametime);
+
+	/**
+	 * Get number of collected nodes
+	 * @return node count
+	 */
+	inline size_t GetNodeCount() const { return m_arrNodes.size(); }
+
+	inline const TransformBatchStats& GetStats() const { return m_Stats; }
+
+	/**
+	 * Time the batched path against Node::Update on a generated flat scene of
+	 * moving and spinning nodes, both starting from the same state
+	 * @param nodeCount nodes in the test scene
+	 * @param iterations updates timed per path
+	 * @return timings and the largest matrix difference between the paths
+	 */
+	static TransformBenchmark Benchmark(size_t nodeCount, uint32_t iterations);
+
+	/**
+	 * Integration kernel on arrays of nodes. Moves positions by velocity,
+	 * builds the rotation of every node from its angle and axis, then
+	 * advances and wraps the angle, in the same order as Node::Update.
+	 * Rotations and angles of nodes with zero speed are left undefined, the
+	 * caller keeps their matrices. Arrays hold count elements rounded up to
+	 * a multiple of 4 and must be 16 byte aligned. Position and velocity may
+	 * both be null to only rotate.
+	 * @param count number of nodes
+	 * @param frametime frame delta time
+	 * @param position x, y and z arrays, updated, or null
+	 * @param velocity x, y and z arrays, or null
+	 * @param axis x, y and z arrays, normalized by the kernel
+	 * @param angle rotation angles in radians, updated
+	 * @param speed rotation speeds in radians per second
+	 * @param rotation nine arrays receiving the 3x3 rotation, column major
+	 */
+	static void Integrate(size_t count, float frametime, float* const position[3], const float* const velocity[3], const float* const axis[3], float* angle, const float* speed, float* const rotation[9]);
+
+private:
+	// Nodes gathered into the arrays at a time
+	static constexpr size_t kBlockSize = 256;
+
+	void Gather(Node* const* nodes, size_t count);
+	size_t Scatter(Node* const* nodes, size_t count); // Returns rotating nodes
+
+	std::vector<Node*>				m_arrNodes;
+
+	// Structure of arrays for one block
+	alignas(16) float				m_arrPosition[3][kBlockSize];
+	alignas(16) float				m_arrVelocity[3][kBlockSize];
+	alignas(16) float				m_arrAxis[3][kBlockSize];
+	alignas(16) float				m_arrAngle[kBlockSize];
+	alignas(16) float				m_arrSpeed[kBlockSize];
+	alignas(16) float				m_arrRotation[9][kBlockSize];
+
+	TransformBatchStats				m_Stats;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+/**
+ * Binding points of the shared uniform blocks. Programs get their blocks
+ * bound to these once, so switching programs does not rebind buffers.
+ */
+enum class UniformBlock : GLuint
+{
+	Frame = 0,
+	Material = 1,
+	Object = 2,
+	Count
+};
+
+/**
+ * Per-frame block, std140 layout. Uploaded when the camera or light changes.
+ */
+struct FrameUniforms
+{
+	glm::mat4		mView;
+	glm::mat4		mProjection;
+	glm::mat4		mViewProjection;
+	glm::mat4		mShadowBias;
+	glm::vec4		vLightPosition; // w is unused
+};
+
+/**
+ * Per-material block, std140 layout. Baked once per material.
+ */
+struct MaterialUniforms
+{
+	glm::vec4		cAmbient;
+	glm::vec4		cDiffuse;
+	glm::vec4		cSpecular;
+	glm::vec4		cEmissive;
+	float			fSpecularPower;
+	float			fPadding[3]; // std140 rounds the block up to vec4 size
+};
+
+/**
+ * Per-object block, std140 layout. Streamed for every draw.
+ */
+struct ObjectUniforms
+{
+	glm::mat4		mModel;
+	glm::mat4		mModelViewProjection;
+};
+
+/**
+ * OpenGL uniform buffer object
+ */
+class UniformBuffer
+{
+public:
+	UniformBuffer();
+	~UniformBuffer();
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	/**
+	 * Create buffer storage
+	 * @param size size of the buffer in bytes
+	 * @param data initial contents, can be null
+	 * @param usage GL_STATIC_DRAW for data that rarely changes, GL_DYNAMIC_DRAW otherwise
+	 * @return true if successful
+	 */
+	bool Create(size_t size, const void* data = nullptr, GLenum usage = GL_DYNAMIC_DRAW);
+
+	/**
+	 * Delete the buffer
+	 */
+	void Release();
+
+	/**
+	 * Update part of the buffer
+	 * @param data data to copy
+	 * @param size size of the data in bytes
+	 * @param offset offset into the buffer in bytes
+	 */
+	void SetData(const void* data, size_t size, size_t offset = 0);
+
+	/**
+	 * Bind whole buffer to a uniform block binding point
+	 * @param block binding point
+	 */
+	void Bind(UniformBlock block) const;
+
+	/**
+	 * Bind part of the buffer to a uniform block binding point
+	 * @param block binding point
+	 * @param offset offset in bytes, multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	 * @param size size of the range in bytes
+	 */
+	void BindRange(UniformBlock block, size_t offset, size_t size) const;
+
+	inline GLuint GetHandle() const { return m_Buffer; }
+	inline size_t GetSize() const { return m_uSize; }
+
+	/**
+	 * Check if the context supports uniform buffers
+	 * @return true if the functions were loaded
+	 */
+	static bool IsSupported();
+
+	/**
+	 * Get GLSL declarations of the shared uniform blocks. Member names match
+	 * the plain uniforms used before, so shaders only swap declarations.
+	 * Needs #version 140 or GL_ARB_uniform_buffer_object.
+	 * @return shader source code to include
+	 */
+	static const char* GetShaderSource();
+
+private:
+	GLuint			m_Buffer;
+	size_t			m_uSize;
+};
+
+/**
+ * Large uniform buffer that small blocks are sub-allocated from, one after
+ * another. With GL_ARB_buffer_storage the buffer is mapped once and stays
+ * mapped: it is split into one region per frame in flight, a push only copies
+ * and bumps the offset, and a fence keeps a region from being reused before
+ * the GPU has drawn its frame. Without it every push maps its own range and
+ * the storage is orphaned when full, so writes never wait for the GPU.
+ */
+class StreamingUniformBuffer
+{
+public:
+	StreamingUniformBuffer();
+	~StreamingUniformBuffer();
+
+	StreamingUniformBuffer(const StreamingUniformBuffer&) = delete;
+	StreamingUniformBuffer& operator=(const StreamingUniformBuffer&) = delete;
+
+	/**
+	 * Create buffer storage
+	 * @param size size of the buffer in bytes
+	 * @return true if successful
+	 */
+	bool Create(size_t size);
+
+	/**
+	 * Delete the buffer
+	 */
+	void Release();
+
+	/**
+	 * Copy data into the buffer and bind it to a uniform block binding point.
+	 * A persistent buffer that runs out of space in the current frame is
+	 * replaced with one twice the size.
+	 * @param block binding point
+	 * @param data data to copy
+	 * @param size size of the data in bytes
+	 * @return true if successful
+	 */
+	bool Push(UniformBlock block, const void* data, size_t size);
+
+	/**
+	 * Close the blocks of this frame and move to the next region, waiting
+	 * for the GPU if it still draws the frame that used the region. Call
+	 * once per frame after the last draw.
+	 */
+	void NextFrame();
+
+	inline GLuint GetHandle() const { return m_Buffer; }
+	inline size_t GetOrphanCount() const { return m_uOrphans; }
+	inline size_t GetGrowCount() const { return m_uGrowths; }
+	inline size_t GetSize() const { return m_uSize; }
+	inline bool IsPersistent() const { return m_pMapped != nullptr; }
+
+private:
+	// Frames the persistent buffer is split into
+	static constexpr size_t kRegionCount = 3;
+
+	bool CreatePersistent(size_t size);
+
+	GLuint			m_Buffer;
+	size_t			m_uSize;
+	size_t			m_uOffset; // Next free byte
+	size_t			m_uAlignment; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	size_t			m_uOrphans; // Times the buffer has wrapped around
+	size_t			m_uGrowths; // Times the persistent buffer was replaced with a larger one
+	uint8_t*		m_pMapped; // Persistent mapping or nullptr
+	size_t			m_uRegion; // Region used by the current frame
+	size_t			m_uRegionSize;
+	GLsync			m_arrFences[kRegionCount]; // Frames still drawing from each region
+};
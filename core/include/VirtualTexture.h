@@ -0,0 +1,222 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <functional>
+#include <unordered_set>
+#include <condition_variable>
+
+/**
+ * Statistics of the virtual texture page cache
+ */
+struct VirtualTextureStats
+{
+	size_t		uRequestedPages; // Unique pages seen in the last feedback pass
+	size_t		uResidentPages; // Pages currently in the physical cache
+	size_t		uPendingPages; // Pages waiting to be read from the page file
+	size_t		uUploadedPages; // Total number of pages uploaded
+	size_t		uEvictedPages; // Total number of pages replaced in the cache
+};
+
+/**
+ * Virtual texture streams tiles of a very large mip pyramid from a page file
+ * into a fixed size physical cache texture. Visible pages are found by rendering
+ * the scene into a low resolution feedback buffer which is read back on the CPU.
+ * Only OpenGL 3.x functionality is used.
+ */
+class VirtualTexture
+{
+public:
+	VirtualTexture();
+	~VirtualTexture();
+
+	/**
+	 * Reads one row of RGBA8 source pixels into row, rows are asked for in increasing order
+	 */
+	using RowReader = std::function<bool(int32_t y, uint8_t* row)>;
+
+	/**
+	 * Cut an image into a mip pyramided page file. Binary PPM (P6) and PAM (P7)
+	 * images are streamed a row at a time, so they may be larger than memory.
+	 * Other formats are decoded whole.
+	 * @param imageFile source image to load
+	 * @param pageFile page file to write
+	 * @param pageSize size of a page in pixels, without borders
+	 * @param border number of border pixels around each page for filtering
+	 * @return true if successful
+	 */
+	static bool BuildPageFile(const std::string_view& imageFile, const std::string_view& pageFile, int32_t pageSize = 128, int32_t border = 1);
+
+	/**
+	 * Cut RGBA8 pixels into a mip pyramided page file
+	 * @param pixels source image pixels
+	 * @param width, height size of the source image
+	 * @param pageFile page file to write
+	 * @param pageSize size of a page in pixels, without borders
+	 * @param border number of border pixels around each page for filtering
+	 * @return true if successful
+	 */
+	static bool BuildPageFile(const uint8_t* pixels, int32_t width, int32_t height, const std::string_view& pageFile, int32_t pageSize = 128, int32_t border = 1);
+
+	/**
+	 * Cut rows of an image into a mip pyramided page file. Only a band of
+	 * rows one page high is kept in memory. Level 0 pages are written as the
+	 * rows arrive and lower levels are filtered from the pages already written.
+	 * @param width, height size of the source image
+	 * @param readRow called for every source row
+	 * @param pageFile page file to write
+	 * @param pageSize size of a page in pixels, without borders
+	 * @param border number of border pixels around each page for filtering
+	 * @return true if successful
+	 */
+	static bool BuildPageFile(int32_t width, int32_t height, const RowReader& readRow, const std::string_view& pageFile, int32_t pageSize = 128, int32_t border = 1);
+
+	/**
+	 * Open page file and create the cache, indirection and feedback resources
+	 * @param pageFile page file created with BuildPageFile
+	 * @param cachePages number of pages per side of the physical cache texture
+	 * @param feedbackWidth, feedbackHeight size of the feedback buffer
+	 * @return true if successful
+	 */
+	bool Create(const std::string_view& pageFile, int32_t cachePages = 16, int32_t feedbackWidth = 160, int32_t feedbackHeight = 90);
+
+	/**
+	 * Release all resources
+	 */
+	void Destroy();
+
+	/**
+	 * Bind feedback buffer as render target. Render the scene with a program that
+	 * writes vtFeedback() to its output after calling this.
+	 */
+	void BeginFeedback();
+
+	/**
+	 * Start reading the feedback buffer back, request the pages seen in the
+	 * feedback of a few frames ago and restore the previous render target.
+	 * Without fences and buffer mapping the feedback is read back at once.
+	 */
+	void EndFeedback();
+
+	/**
+	 * Upload pages loaded in the background and refresh the indirection table.
+	 * Call once per frame from the thread owning the OpenGL context.
+	 */
+	void Update();
+
+	/**
+	 * Bind cache and indirection textures and set the uniforms used by the shader helper
+	 * @param renderer renderer to use
+	 * @param program program including GetShaderSource
+	 * @param slot first texture slot to use, two slots are taken
+	 * @param feedback true when rendering into the feedback buffer
+	 */
+	void SetToProgram(IRenderer& renderer, GLuint program, int32_t slot, bool feedback) const;
+
+	/**
+	 * GLSL 1.30 helper functions vtSample(uv) and vtFeedback(uv).
+	 * Paste after the #version line of fragment shaders that use the virtual texture.
+	 * @return shader source code
+	 */
+	static const char* GetShaderSource();
+
+	/**
+	 * Page grid is padded into a power of two square. Scale image uv with this to
+	 * get virtual texture uv.
+	 * @return uv scale of the source image inside the virtual texture
+	 */
+	inline glm::vec2 GetImageScale() const { return m_vImageScale; }
+
+	/**
+	 * Get cache statistics
+	 * @return current statistics
+	 */
+	VirtualTextureStats GetStats() const;
+
+private:
+	// Feedback is read into a ring of buffers, each mapped when the ring comes around to it again
+	static constexpr uint32_t kFeedbackBuffers = 3;
+
+	struct HEADER
+	{
+		uint32_t	uMagic;
+		uint32_t	uVersion;
+		int32_t		iWidth; // Source image size
+		int32_t		iHeight;
+		int32_t		iPageSize;
+		int32_t		iBorder;
+		int32_t		iPages; // Pages per side at level 0
+		int32_t		iLevels;
+	};
+
+	struct PAGE
+	{
+		uint32_t				uKey;
+		std::vector<uint8_t>	arrPixels;
+	};
+
+	struct SLOT
+	{
+		uint32_t	uKey; // Page in the slot, or kInvalidKey
+		uint64_t	uLastUsedFrame;
+	};
+
+	static inline uint32_t MakeKey(int32_t x, int32_t y, int32_t level) { return ((uint32_t)level << 24) | ((uint32_t)y << 12) | (uint32_t)x; }
+	static inline int32_t KeyX(uint32_t key) { return key & 0xfff; }
+	static inline int32_t KeyY(uint32_t key) { return (key >> 12) & 0xfff; }
+	static inline int32_t KeyLevel(uint32_t key) { return key >> 24; }
+	inline int32_t GetPageCount(int32_t level) const { return glm::max(m_Header.iPages >> level, 1); }
+	inline int32_t GetPaddedPageSize() const { return m_Header.iPageSize + m_Header.iBorder * 2; }
+
+	size_t GetPageOffset(uint32_t key) const;
+	static bool ReadNetpbmHeader(std::istream& f, int32_t& width, int32_t& height, int32_t& channels);
+	void ReadFeedback(const uint8_t* pixels);
+	void RequestPage(uint32_t key);
+	int32_t FindFreeSlot();
+	void UpdateIndirection();
+	void LoaderThread();
+
+	HEADER										m_Header;
+	std::string									m_strPageFile;
+	glm::vec2									m_vImageScale;
+
+	// OpenGL resources
+	GLuint										m_CacheTexture;
+	GLuint										m_IndirectionTexture;
+	GLuint										m_FeedbackFramebuffer;
+	GLuint										m_FeedbackColor;
+	GLuint										m_FeedbackDepth;
+	int32_t										m_iCachePages;
+	int32_t										m_iFeedbackWidth;
+	int32_t										m_iFeedbackHeight;
+	GLuint										m_arrFeedbackBuffers[kFeedbackBuffers]; // Pixel pack buffers read back in turn
+	GLsync										m_arrFeedbackFences[kFeedbackBuffers]; // Read into the buffer has finished
+	uint32_t									m_uFeedbackBuffer; // Buffer the next feedback is read into
+	GLint										m_PrevFramebuffer;
+	GLint										m_PrevViewport[4];
+
+	// Physical cache
+	std::vector<SLOT>							m_arrSlots;
+	std::unordered_map<uint32_t, int32_t>		m_mapResident;
+	std::unordered_set<uint32_t>				m_setPending;
+	std::vector<uint8_t>						m_arrFeedback; // Used when pixel pack buffers are not available
+	std::vector<uint32_t>						m_arrVisiblePages; // Seen in the latest feedback read back
+	std::vector<std::vector<uint8_t>>			m_arrIndirection; // Per mip level RGBA8 entries
+	bool										m_bIndirectionDirty;
+	uint64_t									m_uFrame;
+	size_t										m_uRequestedPages;
+	size_t										m_uUploadedPages;
+	size_t										m_uEvictedPages;
+
+	// Background page reading
+	std::thread									m_LoaderThread;
+	mutable std::mutex							m_Mutex;
+	std::condition_variable						m_Condition;
+	std::deque<uint32_t>						m_arrRequests;
+	std::deque<PAGE>							m_arrCompleted;
+	bool										m_bRunning;
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "../include/OpenGLRenderer.h"
+
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+// Forward declarations
+class Node;
+class Geometry;
+struct Material;
+
+/**
+ * Handle of an entity. The generation tells a destroyed entity apart from
+ * a later one reusing its slot.
+ */
+struct Entity
+{
+	uint32_t	uIndex = 0xffffffffu;
+	uint32_t	uGeneration = 0;
+
+	inline bool IsValid() const { return uIndex != 0xffffffffu; }
+	bool operator==(const Entity& other) const { return uIndex == other.uIndex && uGeneration == other.uGeneration; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+/**
+ * Components an entity can have, combined into masks with ComponentBit
+ */
+enum class ComponentType : uint32_t
+{
+	Transform, // Position, local and world matrix
+	Velocity, // Linear velocity in units per second
+	Rotation, // Axis, angle and speed of rotation
+	Bounds, // Bounding sphere radius
+	Renderable, // Geometry and material
+	Parent, // Entity the transform is relative to
+	Count
+};
+
+constexpr uint32_t ComponentBit(ComponentType type) { return 1u << (uint32_t)type; }
+
+/**
+ * Entities of one archetype, up to World::kChunkCapacity of them, stored as
+ * one array per component field. Arrays of components the archetype does
+ * not have are null. Systems work on whole chunks, so loops over the
+ * arrays are linear and vectorize.
+ */
+struct WorldChunk
+{
+	uint32_t					uMask; // Components of the archetype
+	uint32_t					uCount; // Entities in the chunk
+	Entity*						pEntities;
+
+	// Transform
+	float*						pPositionX;
+	float*						pPositionY;
+	float*						pPositionZ;
+	glm::mat4*					pLocal; // Local matrix, translation is taken from the position
+	glm::mat4*					pWorld; // Written by the transform system
+
+	// Velocity
+	float*						pVelocityX;
+	float*						pVelocityY;
+	float*						pVelocityZ;
+
+	// Rotation
+	float*						pRotationAxisX; // Normalized
+	float*						pRotationAxisY;
+	float*						pRotationAxisZ;
+	float*						pRotationAngle; // Radians
+	float*						pRotationSpeed; // Radians per second
+
+	// Bounds
+	float*						pRadius;
+
+	// Renderable
+	std::shared_ptr<Geometry>*	pGeometry;
+	std::shared_ptr<Material>*	pMaterial;
+
+	// Parent
+	Entity*						pParent;
+};
+
+/**
+ * Entity component storage as an alternative to the Node hierarchy.
+ * Entities with the same set of components form an archetype, stored in
+ * fixed size chunks of structure-of-arrays data. Destroying an entity moves
+ * the last one of its archetype into the hole, so chunks stay dense.
+ * Systems run by a SystemScheduler integrate velocity and rotation and build
+ * the world matrices; FramePacket::AddWorld draws the renderables.
+ *
+ * The world is not thread-safe. Systems may write to the chunks they are
+ * given, but entities must not be created or destroyed while they run.
+ */
+class World
+{
+public:
+	// Entities per chunk
+	static constexpr uint32_t kChunkCapacity = 512;
+
+	World();
+	~World();
+
+	World(const World&) = delete;
+	World& operator=(const World&) = delete;
+
+	/**
+	 * Create entity with default components: identity transform, no
+	 * velocity, no rotation, radius 1, no renderable and no parent
+	 * @param mask components of the entity, ComponentBit values
+	 * @return the new entity
+	 */
+	Entity Create(uint32_t mask);
+
+	/**
+	 * Destroy entity, children pointing to it lose their parent on the next update
+	 * @param entity entity to destroy
+	 */
+	void Destroy(Entity entity);
+
+	/**
+	 * Check if entity has not been destroyed
+	 * @param entity entity to check
+	 * @return true if alive
+	 */
+	bool IsAlive(Entity entity) const;
+
+	/**
+	 * Change the components of an entity, moving it to another archetype.
+	 * Components in both sets keep their values.
+	 * @param entity entity to change
+	 * @param mask new components, ComponentBit values
+	 */
+	void SetComponents(Entity entity, uint32_t mask);
+
+	/**
+	 * Get components of an entity
+	 * @param entity entity
+	 * @return mask of ComponentBit values, 0 if not alive
+	 */
+	uint32_t GetComponents(Entity entity) const;
+
+	/**
+	 * Get chunk and row holding an entity, for direct access to its components
+	 * @param entity entity
+	 * @param row receives the index of the entity in the chunk
+	 * @return chunk, or null if not alive
+	 */
+	WorldChunk* GetChunk(Entity entity, uint32_t& row);
+	const WorldChunk* GetChunk(Entity entity, uint32_t& row) const;
+
+	/**
+	 * Component setters, ignored if the entity lacks the component
+	 */
+	void SetPosition(Entity entity, const glm::vec3& position);
+	void SetLocalMatrix(Entity entity, const glm::mat4& matrix);
+	void SetVelocity(Entity entity, const glm::vec3& velocity);
+	void SetRotation(Entity entity, const glm::vec3& axis, float angle, float speed);
+	void SetRadius(Entity entity, float radius);
+	void SetRenderable(Entity entity, const std::shared_ptr<Geometry>& geometry, const std::shared_ptr<Material>& material);
+	void SetParent(Entity entity, Entity parent);
+
+	/**
+	 * Get world matrix written by the last transform update
+	 * @param entity entity with a transform
+	 * @return world matrix, identity if the entity has no transform
+	 */
+	glm::mat4 GetWorldMatrix(Entity entity) const;
+
+	/**
+	 * Get local matrix of an entity combined with the local matrices of its
+	 * parents. Reads only local matrices, so chunks can be resolved in parallel.
+	 * @param chunk chunk of the entity
+	 * @param row index of the entity in the chunk
+	 * @return world matrix
+	 */
+	glm::mat4 ResolveWorldMatrix(const WorldChunk& chunk, uint32_t row) const;
+
+	/**
+	 * Call a function for every chunk that has all the given components
+	 * @param mask required components, ComponentBit values
+	 * @param function called for each non-empty chunk
+	 */
+	void ForEachChunk(uint32_t mask, const std::function<void(WorldChunk&)>& function);
+	void ForEachChunk(uint32_t mask, const std::function<void(const WorldChunk&)>& function) const;
+
+	/**
+	 * Collect chunks that have all the given components
+	 * @param mask required components, ComponentBit values
+	 * @param chunks receives the non-empty chunks
+	 */
+	void GetChunks(uint32_t mask, std::vector<WorldChunk*>& chunks);
+
+	/**
+	 * Import a Node hierarchy, every node becomes an entity parented to the
+	 * entity of its parent node. Geometry nodes get a renderable. Names and
+	 * occlusion flags are not imported.
+	 * @param root root node of the hierarchy
+	 * @param parent entity to parent the root to, or invalid for none
+	 * @return entity of the root node
+	 */
+	Entity Import(Node& root, Entity parent = Entity());
+
+	/**
+	 * Get number of live entities
+	 * @return entity count
+	 */
+	inline size_t GetEntityCount() const { return m_uEntityCount; }
+
+	/**
+	 * Get number of archetypes created
+	 * @return archetype count
+	 */
+	inline size_t GetArchetypeCount() const { return m_arrArchetypes.size(); }
+
+	/**
+	 * Default systems, see SystemScheduler::AddDefaultSystems. Integrate
+	 * moves positions by velocity, Rotate builds rotation matrices and
+	 * advances angles like Node::Update, LocalTransform puts the positions
+	 * into the local matrices and WorldTransform combines them with parents.
+	 */
+	static void IntegrateSystem(World& world, WorldChunk& chunk, float frametime);
+	static void RotateSystem(World& world, WorldChunk& chunk, float frametime);
+	static void LocalTransformSystem(World& world, WorldChunk& chunk, float frametime);
+	static void WorldTransformSystem(World& world, WorldChunk& chunk, float frametime);
+
+private:
+	struct CHUNK : public WorldChunk
+	{
+		CHUNK(uint32_t mask);
+		~CHUNK();
+
+		uint8_t*			memory;
+	};
+
+	struct ARCHETYPE
+	{
+		uint32_t							mask;
+		std::vector<std::unique_ptr<CHUNK>>	chunks; // All full except the last used one
+		size_t								count; // Entities in the archetype
+	};
+
+	// Where an entity lives
+	struct RECORD
+	{
+		uint32_t		generation;
+		uint32_t		archetype;
+		uint32_t		chunk;
+		uint32_t		row;
+		bool			alive;
+	};
+
+	ARCHETYPE& GetArchetype(uint32_t mask, uint32_t& index);
+	void AddRow(uint32_t archetype, Entity entity);
+	void RemoveRow(RECORD& record);
+	static void InitRow(WorldChunk& chunk, uint32_t row);
+	static void CopyRow(const WorldChunk& source, uint32_t sourceRow, WorldChunk& target, uint32_t targetRow);
+
+	std::vector<std::unique_ptr<ARCHETYPE>>		m_arrArchetypes;
+	std::unordered_map<uint32_t, uint32_t>		m_mapArchetypes; // Mask to archetype
+	std::vector<RECORD>							m_arrRecords;
+	std::vector<uint32_t>						m_arrFreeRecords;
+	size_t										m_uEntityCount;
+};
@@ -0,0 +1,237 @@
+#include "../include/Allocator.h"
+
+#include <algorithm>
+
+MemoryTracker::COUNTERS MemoryTracker::s_arrCounters[(size_t)MemoryTag::Count];
+
+void MemoryTracker::Allocated(MemoryTag tag, size_t bytes, uint64_t count)
+{
+	COUNTERS& counters = s_arrCounters[(size_t)tag];
+	counters.allocations.fetch_add(count, std::memory_order_relaxed);
+	const size_t total = counters.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+	size_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+	while (total > peak && !counters.peakBytes.compare_exchange_weak(peak, total, std::memory_order_relaxed))
+	{
+	}
+}
+
+void MemoryTracker::Freed(MemoryTag tag, size_t bytes, uint64_t count)
+{
+	COUNTERS& counters = s_arrCounters[(size_t)tag];
+	counters.frees.fetch_add(count, std::memory_order_relaxed);
+	counters.bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+MemoryStats MemoryTracker::GetStats(MemoryTag tag)
+{
+	const COUNTERS& counters = s_arrCounters[(size_t)tag];
+	MemoryStats stats = {};
+	stats.uAllocations = counters.allocations.load(std::memory_order_relaxed);
+	stats.uFrees = counters.frees.load(std::memory_order_relaxed);
+	stats.uBytes = counters.bytes.load(std::memory_order_relaxed);
+	stats.uPeakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+const char* MemoryTracker::GetName(MemoryTag tag)
+{
+	switch (tag)
+	{
+	case MemoryTag::Frame: return "Frame";
+	case MemoryTag::Scratch: return "Scratch";
+	case MemoryTag::Nodes: return "Nodes";
+	case MemoryTag::Geometry: return "Geometry";
+	default: return "Unknown";
+	}
+}
+
+LinearArena::LinearArena(MemoryTag tag, size_t blockSize) :
+	m_eTag(tag),
+	m_uBlockSize(blockSize),
+	m_uBlock(0),
+	m_uOffset(0),
+	m_uUsedBytes(0),
+	m_uPeakBytes(0),
+	m_uAllocations(0)
+{
+}
+
+LinearArena::~LinearArena()
+{
+	Release({ 0, 0, 0, 0 });
+	FreeBlocks();
+}
+
+void* LinearArena::Allocate(size_t bytes, size_t alignment)
+{
+	for (;;)
+	{
+		if (m_uBlock < m_arrBlocks.size())
+		{
+			const BLOCK& block = m_arrBlocks[m_uBlock];
+			const size_t start = (m_uOffset + alignment - 1) & ~(alignment - 1);
+			if (start + bytes <= block.size)
+			{
+				m_uOffset = start + bytes;
+				m_uUsedBytes += bytes;
+				m_uPeakBytes = std::max(m_uPeakBytes, m_uUsedBytes);
+				++m_uAllocations;
+				return block.data + start;
+			}
+
+			// Skip to the next block, blocks left over from earlier frames are reused
+			++m_uBlock;
+			m_uOffset = 0;
+			continue;
+		}
+
+		AddBlock(bytes + alignment);
+	}
+}
+
+void LinearArena::Reset()
+{
+	Rewind({ 0, 0, 0, 0 });
+}
+
+void LinearArena::Rewind(const Marker& marker)
+{
+	Release(marker);
+
+	// Empty again, replace the blocks with one that held everything so the next round fits in a single block
+	if (marker.uBlock == 0 && marker.uOffset == 0 && m_arrBlocks.size() > 1)
+	{
+		size_t total = 0;
+		for (const auto& block : m_arrBlocks)
+		{
+			total += block.size;
+		}
+		FreeBlocks();
+		m_uBlockSize = std::max(m_uBlockSize, total);
+		AddBlock(m_uBlockSize);
+	}
+}
+
+LinearArenaStats LinearArena::GetStats() const
+{
+	LinearArenaStats stats = {};
+	stats.uUsedBytes = m_uUsedBytes;
+	stats.uPeakBytes = m_uPeakBytes;
+	stats.uBlocks = m_arrBlocks.size();
+	for (const auto& block : m_arrBlocks)
+	{
+		stats.uCapacityBytes += block.size;
+	}
+	return stats;
+}
+
+LinearArena& LinearArena::GetScratch()
+{
+	thread_local LinearArena arena(MemoryTag::Scratch);
+	return arena;
+}
+
+void LinearArena::Release(const Marker& marker)
+{
+	if (m_uAllocations > marker.uAllocations)
+	{
+		const size_t bytes = m_uUsedBytes - marker.uUsedBytes;
+		const uint64_t count = m_uAllocations - marker.uAllocations;
+		MemoryTracker::Allocated(m_eTag, bytes, count);
+		MemoryTracker::Freed(m_eTag, bytes, count);
+	}
+	m_uBlock = marker.uBlock;
+	m_uOffset = marker.uOffset;
+	m_uUsedBytes = marker.uUsedBytes;
+	m_uAllocations = marker.uAllocations;
+}
+
+void LinearArena::AddBlock(size_t minSize)
+{
+	// Grow geometrically so that a burst does not add many small blocks
+	const size_t size = std::max({ minSize, m_uBlockSize, m_arrBlocks.empty() ? 0 : m_arrBlocks.back().size * 2 });
+	m_arrBlocks.push_back({ (uint8_t*)::operator new(size), size });
+}
+
+void LinearArena::FreeBlocks()
+{
+	for (const auto& block : m_arrBlocks)
+	{
+		::operator delete(block.data);
+	}
+	m_arrBlocks.clear();
+	m_uBlock = 0;
+	m_uOffset = 0;
+}
+
+FixedPool::FixedPool(size_t elementSize, size_t alignment, MemoryTag tag, size_t elementsPerChunk) :
+	m_pFree(nullptr),
+	m_uElementSize(0),
+	m_uAlignment(std::max(alignment, alignof(FREENODE))),
+	m_uElementsPerChunk(std::max(elementsPerChunk, (size_t)1)),
+	m_uLiveCount(0),
+	m_eTag(tag)
+{
+	// Free elements hold the free list link, and every element must stay aligned
+	const size_t size = std::max(elementSize, sizeof(FREENODE));
+	m_uElementSize = (size + m_uAlignment - 1) & ~(m_uAlignment - 1);
+}
+
+FixedPool::~FixedPool()
+{
+	for (void* chunk : m_arrChunks)
+	{
+		::operator delete(chunk, std::align_val_t(m_uAlignment));
+	}
+}
+
+void* FixedPool::Allocate()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!m_pFree)
+	{
+		AddChunk();
+	}
+
+	FREENODE* element = m_pFree;
+	m_pFree = element->next;
+	++m_uLiveCount;
+	MemoryTracker::Allocated(m_eTag, m_uElementSize);
+	return element;
+}
+
+void FixedPool::Free(void* element)
+{
+	if (!element)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	FREENODE* node = (FREENODE*)element;
+	node->next = m_pFree;
+	m_pFree = node;
+	--m_uLiveCount;
+	MemoryTracker::Freed(m_eTag, m_uElementSize);
+}
+
+size_t FixedPool::GetLiveCount() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_uLiveCount;
+}
+
+void FixedPool::AddChunk()
+{
+	uint8_t* chunk = (uint8_t*)::operator new(m_uElementSize * m_uElementsPerChunk, std::align_val_t(m_uAlignment));
+	m_arrChunks.push_back(chunk);
+
+	// Link the new elements in address order
+	for (size_t i = m_uElementsPerChunk; i-- > 0;)
+	{
+		FREENODE* node = (FREENODE*)(chunk + i * m_uElementSize);
+		node->next = m_pFree;
+		m_pFree = node;
+	}
+}
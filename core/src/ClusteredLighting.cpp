@@ -0,0 +1,404 @@
+#include "../include/ClusteredLighting.h"
+#include "../include/CameraNode.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLUSTER_SSE
+#endif
+
+ClusteredLighting::ClusteredLighting(OpenGLRenderer& renderer, JobPool& jobPool, uint32_t tilesX, uint32_t tilesY, uint32_t slices) :
+	m_Renderer(renderer),
+	m_uTilesX(std::max(tilesX, 1u)),
+	m_uTilesY(std::max(tilesY, 1u)),
+	m_uSlices(std::max(slices, 1u)),
+	m_uSliceStride(0),
+	m_mBoundsProjection(0.0f),
+	m_LightBuffer(0),
+	m_GridBuffer(0),
+	m_IndexBuffer(0),
+	m_LightTexture(0),
+	m_GridTexture(0),
+	m_IndexTexture(0),
+	m_vDepthParams(0.0f),
+	m_vViewportSize(1.0f),
+	m_JobPool(jobPool),
+	m_Stats({})
+{
+	m_uSliceStride = (m_uTilesX * m_uTilesY + 3) & ~3u;
+	m_arrClusterLights.resize((size_t)m_uTilesX * m_uTilesY * m_uSlices);
+	m_arrSliceOverflow.resize(m_uSlices);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+	Release();
+}
+
+bool ClusteredLighting::Create()
+{
+	Release();
+	if (!IsSupported())
+	{
+		IApplication::Debug("ClusteredLighting: texture buffers are not supported\n");
+		return false;
+	}
+
+	glGenBuffers(1, &m_LightBuffer);
+	glGenBuffers(1, &m_GridBuffer);
+	glGenBuffers(1, &m_IndexBuffer);
+	glGenTextures(1, &m_LightTexture);
+	glGenTextures(1, &m_GridTexture);
+	glGenTextures(1, &m_IndexTexture);
+
+	// Textures keep referring to the buffers when their storage is reallocated
+	const GLuint buffers[] = { m_LightBuffer, m_GridBuffer, m_IndexBuffer };
+	const GLuint textures[] = { m_LightTexture, m_GridTexture, m_IndexTexture };
+	const GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return true;
+}
+
+void ClusteredLighting::Release()
+{
+	GLuint* buffers[] = { &m_LightBuffer, &m_GridBuffer, &m_IndexBuffer };
+	for (GLuint* buffer : buffers)
+	{
+		if (*buffer)
+		{
+			glDeleteBuffers(1, buffer);
+			*buffer = 0;
+		}
+	}
+
+	GLuint* textures[] = { &m_LightTexture, &m_GridTexture, &m_IndexTexture };
+	for (GLuint* texture : textures)
+	{
+		if (*texture)
+		{
+			glDeleteTextures(1, texture);
+			*texture = 0;
+		}
+	}
+}
+
+void ClusteredLighting::Update(const CameraNode& camera, const glm::ivec2& viewportSize)
+{
+	m_Stats = {};
+	m_Stats.uLights = m_arrLights.size();
+	m_vViewportSize = glm::max(glm::vec2(viewportSize), glm::vec2(1.0f));
+
+	Timer timer;
+	timer.BeginTimer();
+
+	const glm::vec4 parameters = camera.GetProjectionParameters();
+	const float nearPlane = parameters.z;
+	const float farPlane = parameters.w;
+	if (camera.GetProjectionMatrix() != m_mBoundsProjection || m_arrSliceDepths.empty())
+	{
+		UpdateClusterBounds(camera.GetProjectionMatrix(), nearPlane, farPlane);
+	}
+
+	// slice = log(depth) * scale + bias
+	const float logRatio = std::log(farPlane / nearPlane);
+	m_vDepthParams.x = (float)m_uSlices / logRatio;
+	m_vDepthParams.y = -(float)m_uSlices * std::log(nearPlane) / logRatio;
+	auto getSlice = [this](float depth)
+	{
+		const int32_t slice = (int32_t)std::floor(std::log(depth) * m_vDepthParams.x + m_vDepthParams.y);
+		return (uint32_t)std::clamp(slice, 0, (int32_t)m_uSlices - 1);
+	};
+
+	const glm::mat4 view = camera.GetViewMatrix();
+	m_arrViewLights.clear();
+	for (size_t i = 0; i < m_arrLights.size(); ++i)
+	{
+		const PointLight& light = m_arrLights[i];
+		const glm::vec3 center(view * glm::vec4(light.vPosition, 1.0f));
+		const float depth = -center.z;
+		if (light.fRadius <= 0.0f || depth + light.fRadius < nearPlane || depth - light.fRadius > farPlane)
+		{
+			continue;
+		}
+
+		VIEWLIGHT viewLight;
+		viewLight.vSphere = glm::vec4(center, light.fRadius);
+		viewLight.uLight = (uint32_t)i;
+		viewLight.uFirstSlice = getSlice(std::max(depth - light.fRadius, nearPlane));
+		viewLight.uLastSlice = getSlice(std::min(depth + light.fRadius, farPlane));
+		m_arrViewLights.push_back(viewLight);
+	}
+	m_Stats.uVisibleLights = m_arrViewLights.size();
+
+	BinSlices();
+
+	// Concatenate the cluster lists, clusters are ordered by slice, then row, then column
+	m_arrGrid.resize(m_arrClusterLights.size());
+	m_arrIndices.clear();
+	for (size_t c = 0; c < m_arrClusterLights.size(); ++c)
+	{
+		const auto& lights = m_arrClusterLights[c];
+		m_arrGrid[c] = glm::uvec2((uint32_t)m_arrIndices.size(), (uint32_t)lights.size());
+		m_arrIndices.insert(m_arrIndices.end(), lights.begin(), lights.end());
+	}
+	for (size_t overflow : m_arrSliceOverflow)
+	{
+		m_Stats.uOverflow += overflow;
+	}
+	m_Stats.uLightIndices = m_arrIndices.size();
+
+	m_arrLightData.resize(std::max(m_arrLights.size(), (size_t)1) * 2);
+	for (size_t i = 0; i < m_arrLights.size(); ++i)
+	{
+		m_arrLightData[i * 2] = glm::vec4(m_arrLights[i].vPosition, m_arrLights[i].fRadius);
+		m_arrLightData[i * 2 + 1] = glm::vec4(m_arrLights[i].cColor, 0.0f);
+	}
+	if (m_arrIndices.empty())
+	{
+		// Texture buffers cannot be empty
+		m_arrIndices.push_back(0);
+	}
+
+	timer.EndTimer();
+	m_Stats.fBinSeconds = timer.GetElapsedSeconds();
+
+	if (!m_LightBuffer)
+	{
+		return;
+	}
+
+	// Orphan the storage so that the previous frame can still be read by the GPU
+	glBindBuffer(GL_TEXTURE_BUFFER, m_LightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)(m_arrLightData.size() * sizeof(glm::vec4)), m_arrLightData.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_GridBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)(m_arrGrid.size() * sizeof(glm::uvec2)), m_arrGrid.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_IndexBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)(m_arrIndices.size() * sizeof(uint32_t)), m_arrIndices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLighting::Apply(GLuint program, int32_t firstSlot) const
+{
+	const GLuint textures[] = { m_LightTexture, m_GridTexture, m_IndexTexture };
+	const char* names[] = { "clusterLights", "clusterGrid", "clusterIndices" };
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + firstSlot + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		OpenGLRenderer::SetUniformInt(program, names[i], firstSlot + i);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	const GLint counts = glGetUniformLocation(program, "clusterCounts");
+	if (counts != -1)
+	{
+		const glm::ivec3 value((int32_t)m_uTilesX, (int32_t)m_uTilesY, (int32_t)m_uSlices);
+		glUniform3iv(counts, 1, &value.x);
+	}
+	OpenGLRenderer::SetUniformVec2(program, "clusterDepthParams", m_vDepthParams);
+	OpenGLRenderer::SetUniformVec2(program, "clusterViewportSize", m_vViewportSize);
+}
+
+bool ClusteredLighting::IsSupported()
+{
+	return glTexBuffer && glGenBuffers;
+}
+
+const char* ClusteredLighting::GetShaderSource()
+{
+	return R"(
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform ivec3 clusterCounts;
+uniform vec2 clusterDepthParams;
+uniform vec2 clusterViewportSize;
+
+// First index and number of lights of the cluster of a fragment
+uvec2 GetClusterRange(vec2 fragCoord, float viewDepth)
+{
+	ivec2 tile = clamp(ivec2(fragCoord / clusterViewportSize * vec2(clusterCounts.xy)), ivec2(0), clusterCounts.xy - 1);
+	int slice = int(floor(log(viewDepth) * clusterDepthParams.x + clusterDepthParams.y));
+	if (slice < 0 || slice >= clusterCounts.z)
+	{
+		return uvec2(0u);
+	}
+	int cluster = (slice * clusterCounts.y + tile.y) * clusterCounts.x + tile.x;
+	return texelFetch(clusterGrid, cluster).xy;
+}
+
+void GetClusterLight(uint index, out vec3 position, out float radius, out vec3 color)
+{
+	int light = int(texelFetch(clusterIndices, int(index)).x) * 2;
+	vec4 sphere = texelFetch(clusterLights, light);
+	position = sphere.xyz;
+	radius = sphere.w;
+	color = texelFetch(clusterLights, light + 1).rgb;
+}
+
+vec3 GetClusteredLighting(vec3 worldPosition, vec3 normal, float viewDepth)
+{
+	uvec2 range = GetClusterRange(gl_FragCoord.xy, viewDepth);
+	vec3 result = vec3(0.0);
+	for (uint i = range.x; i < range.x + range.y; ++i)
+	{
+		vec3 position;
+		float radius;
+		vec3 color;
+		GetClusterLight(i, position, radius, color);
+
+		vec3 toLight = position - worldPosition;
+		float distance = length(toLight);
+		float falloff = clamp(1.0 - distance / radius, 0.0, 1.0);
+		result += color * max(dot(normal, toLight / max(distance, 0.0001)), 0.0) * falloff * falloff;
+	}
+	return result;
+}
+)";
+}
+
+void ClusteredLighting::UpdateClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane)
+{
+	m_mBoundsProjection = projection;
+
+	m_arrSliceDepths.resize(m_uSlices + 1);
+	for (uint32_t k = 0; k <= m_uSlices; ++k)
+	{
+		m_arrSliceDepths[k] = nearPlane * std::pow(farPlane / nearPlane, (float)k / (float)m_uSlices);
+	}
+
+	// View space direction through each tile corner, scaled to unit depth
+	const glm::mat4 inverse = glm::inverse(projection);
+	std::vector<glm::vec2> directions((size_t)(m_uTilesX + 1) * (m_uTilesY + 1));
+	for (uint32_t y = 0; y <= m_uTilesY; ++y)
+	{
+		for (uint32_t x = 0; x <= m_uTilesX; ++x)
+		{
+			const glm::vec4 point = inverse * glm::vec4(-1.0f + 2.0f * x / m_uTilesX, -1.0f + 2.0f * y / m_uTilesY, -1.0f, 1.0f);
+			const glm::vec3 view = glm::vec3(point) / point.w;
+			directions[(size_t)y * (m_uTilesX + 1) + x] = glm::vec2(view) / -view.z;
+		}
+	}
+
+	// Padding tiles get empty bounds that no sphere touches
+	const size_t count = (size_t)m_uSliceStride * m_uSlices;
+	m_arrMinX.assign(count, FLT_MAX);
+	m_arrMaxX.assign(count, -FLT_MAX);
+	m_arrMinY.assign(count, FLT_MAX);
+	m_arrMaxY.assign(count, -FLT_MAX);
+	for (uint32_t slice = 0; slice < m_uSlices; ++slice)
+	{
+		const float depths[2] = { m_arrSliceDepths[slice], m_arrSliceDepths[slice + 1] };
+		for (uint32_t y = 0; y < m_uTilesY; ++y)
+		{
+			for (uint32_t x = 0; x < m_uTilesX; ++x)
+			{
+				const size_t index = (size_t)slice * m_uSliceStride + (size_t)y * m_uTilesX + x;
+				for (uint32_t corner = 0; corner < 4; ++corner)
+				{
+					const glm::vec2& direction = directions[(size_t)(y + (corner >> 1)) * (m_uTilesX + 1) + x + (corner & 1)];
+					for (float depth : depths)
+					{
+						m_arrMinX[index] = std::min(m_arrMinX[index], direction.x * depth);
+						m_arrMaxX[index] = std::max(m_arrMaxX[index], direction.x * depth);
+						m_arrMinY[index] = std::min(m_arrMinY[index], direction.y * depth);
+						m_arrMaxY[index] = std::max(m_arrMaxY[index], direction.y * depth);
+					}
+				}
+			}
+		}
+	}
+}
+
+void ClusteredLighting::BinSlices()
+{
+	m_JobPool.Run(m_uSlices, [this](uint32_t slice) { BinSlice(slice); });
+}
+
+void ClusteredLighting::BinSlice(uint32_t slice)
+{
+	const uint32_t tiles = m_uTilesX * m_uTilesY;
+	const size_t boundsBase = (size_t)slice * m_uSliceStride;
+	std::vector<uint32_t>* clusters = &m_arrClusterLights[(size_t)slice * tiles];
+	for (uint32_t tile = 0; tile < tiles; ++tile)
+	{
+		clusters[tile].clear();
+	}
+
+	const float sliceNear = m_arrSliceDepths[slice];
+	const float sliceFar = m_arrSliceDepths[slice + 1];
+	size_t overflow = 0;
+
+	for (const auto& light : m_arrViewLights)
+	{
+		if (slice < light.uFirstSlice || slice > light.uLastSlice)
+		{
+			continue;
+		}
+
+		// Distance along depth is the same for every tile of the slice
+		const float depth = -light.vSphere.z;
+		const float dz = std::max({ sliceNear - depth, depth - sliceFar, 0.0f });
+		const float remaining = light.vSphere.w * light.vSphere.w - dz * dz;
+		if (remaining < 0.0f)
+		{
+			continue;
+		}
+
+		auto addLight = [&](uint32_t tile)
+		{
+			if (clusters[tile].size() < kMaxLightsPerCluster)
+			{
+				clusters[tile].push_back(light.uLight);
+			}
+			else
+			{
+				++overflow;
+			}
+		};
+
+#if defined (CLUSTER_SSE)
+		const __m128 centerX = _mm_set1_ps(light.vSphere.x);
+		const __m128 centerY = _mm_set1_ps(light.vSphere.y);
+		const __m128 radius2 = _mm_set1_ps(remaining);
+		const __m128 zero = _mm_setzero_ps();
+		for (uint32_t group = 0; group < m_uSliceStride; group += 4)
+		{
+			const size_t index = boundsBase + group;
+			const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_arrMinX[index]), centerX), _mm_sub_ps(centerX, _mm_loadu_ps(&m_arrMaxX[index]))), zero);
+			const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_arrMinY[index]), centerY), _mm_sub_ps(centerY, _mm_loadu_ps(&m_arrMaxY[index]))), zero);
+			const int32_t mask = _mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), radius2));
+			for (uint32_t bit = 0; mask && bit < 4; ++bit)
+			{
+				if ((mask & (1 << bit)) && group + bit < tiles)
+				{
+					addLight(group + bit);
+				}
+			}
+		}
+#else
+		for (uint32_t tile = 0; tile < tiles; ++tile)
+		{
+			const size_t index = boundsBase + tile;
+			const float dx = std::max({ m_arrMinX[index] - light.vSphere.x, light.vSphere.x - m_arrMaxX[index], 0.0f });
+			const float dy = std::max({ m_arrMinY[index] - light.vSphere.y, light.vSphere.y - m_arrMaxY[index], 0.0f });
+			if (dx * dx + dy * dy <= remaining)
+			{
+				addLight(tile);
+			}
+		}
+#endif
+	}
+
+	m_arrSliceOverflow[slice] = overflow;
+}
@@ -0,0 +1,509 @@
+#include "../include/DeferredShading.h"
+#include "../include/Node.h"
+
+#include <algorithm>
+#include <cfloat>
+
+static const char* kGeometryVertexShader = R"(
+#version 330
+in vec3 position;
+in vec3 normal;
+uniform mat4 modelMatrix;
+uniform mat4 modelViewProjectionMatrix;
+out vec3 worldNormal;
+
+void main()
+{
+	worldNormal = mat3(modelMatrix) * normal;
+	gl_Position = modelViewProjectionMatrix * vec4(position, 1.0);
+}
+)";
+
+static const char* kGeometryFragmentShader = R"(
+#version 330
+in vec3 worldNormal;
+uniform vec4 materialAmbient;
+uniform vec4 materialDiffuse;
+uniform vec4 materialSpecular;
+uniform vec4 materialEmissive;
+uniform float specularPower;
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec4 normalSpecular;
+layout(location = 2) out vec4 light;
+
+vec2 EncodeOctahedral(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	vec2 e = (n.z >= 0.0) ? n.xy : (1.0 - abs(n.yx)) * signs;
+	return e * 0.5 + 0.5;
+}
+
+void main()
+{
+	albedo = vec4(materialDiffuse.rgb, dot(materialSpecular.rgb, vec3(1.0 / 3.0)));
+	normalSpecular = vec4(EncodeOctahedral(normalize(worldNormal)), specularPower / 255.0, 0.0);
+	light = vec4(materialAmbient.rgb + materialEmissive.rgb, 1.0);
+}
+)";
+
+static const char* kLightVertexShader = R"(
+#version 330
+in vec2 corner;
+in vec4 light;
+in vec3 color;
+out vec2 ndc;
+out vec4 lightSphere;
+out vec3 lightColor;
+
+void main()
+{
+	ndc = corner;
+	lightSphere = light;
+	lightColor = color;
+	gl_Position = vec4(corner, 0.0, 1.0);
+}
+)";
+
+static const char* kLightFragmentShader = R"(
+#version 330
+in vec2 ndc;
+in vec4 lightSphere;
+in vec3 lightColor;
+uniform sampler2D albedoTexture;
+uniform sampler2D normalTexture;
+uniform sampler2D depthTexture;
+uniform mat4 inverseProjection;
+uniform mat3 normalViewMatrix;
+out vec4 result;
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(depthTexture, pixel, 0).r;
+	if (depth >= 1.0)
+	{
+		discard;
+	}
+
+	// Position from depth, no position target needed
+	vec4 view = inverseProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+	vec3 position = view.xyz / view.w;
+	vec3 toLight = lightSphere.xyz - position;
+	float distance = length(toLight);
+	if (distance >= lightSphere.w)
+	{
+		discard;
+	}
+
+	vec4 albedo = texelFetch(albedoTexture, pixel, 0);
+	vec4 normalSpecular = texelFetch(normalTexture, pixel, 0);
+	vec3 n = normalize(normalViewMatrix * DecodeOctahedral(normalSpecular.xy));
+	vec3 l = toLight / max(distance, 0.0001);
+	vec3 h = normalize(l - normalize(position));
+
+	float falloff = 1.0 - distance / lightSphere.w;
+	float diffuse = max(dot(n, l), 0.0);
+	float specular = (diffuse > 0.0) ? pow(max(dot(n, h), 0.0), max(normalSpecular.z * 255.0, 1.0)) * albedo.a : 0.0;
+	result = vec4(lightColor * (albedo.rgb * diffuse + specular) * falloff * falloff, 0.0);
+}
+)";
+
+static const char* kPresentVertexShader = R"(
+#version 330
+in vec2 corner;
+out vec2 texCoord;
+
+void main()
+{
+	texCoord = corner * 0.5 + 0.5;
+	gl_Position = vec4(corner, 0.0, 1.0);
+}
+)";
+
+static const char* kPresentFragmentShader = R"(
+#version 330
+in vec2 texCoord;
+uniform sampler2D lightTexture;
+out vec4 result;
+
+void main()
+{
+	result = vec4(texture(lightTexture, texCoord).rgb, 1.0);
+}
+)";
+
+// Two triangles covering the screen
+static const glm::vec2 kScreenCorners[6] =
+{
+	{ -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f },
+	{ -1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f }
+};
+
+// Radius of the main light, which has no falloff
+constexpr float kMainLightRadius = 1e30f;
+
+static GLuint BuildProgram(OpenGLRenderer& renderer, const char* vertexSource, const char* fragmentSource)
+{
+	const GLuint vertexShader = renderer.CreateVertexShader(vertexSource);
+	const GLuint fragmentShader = renderer.CreateFragmentShader(fragmentSource);
+	GLuint program = 0;
+	if (vertexShader && fragmentShader)
+	{
+		program = renderer.CreateProgram(vertexShader, fragmentShader);
+	}
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	return program;
+}
+
+DeferredShading::DeferredShading(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_iWidth(0),
+	m_iHeight(0),
+	m_GeometryProgram(0),
+	m_LightProgram(0),
+	m_PresentProgram(0),
+	m_GeometryFramebuffer(0),
+	m_LightFramebuffer(0),
+	m_AlbedoTexture(0),
+	m_NormalTexture(0),
+	m_LightTexture(0),
+	m_DepthTexture(0),
+	m_iPrevFramebuffer(0),
+	m_Stats({})
+{
+}
+
+DeferredShading::~DeferredShading()
+{
+	Release();
+}
+
+bool DeferredShading::Create(int32_t width, int32_t height)
+{
+	Release();
+	if (!IsSupported())
+	{
+		IApplication::Debug("DeferredShading: multiple render targets are not supported\n");
+		return false;
+	}
+
+	m_GeometryProgram = BuildProgram(m_Renderer, kGeometryVertexShader, kGeometryFragmentShader);
+	m_LightProgram = BuildProgram(m_Renderer, kLightVertexShader, kLightFragmentShader);
+	m_PresentProgram = BuildProgram(m_Renderer, kPresentVertexShader, kPresentFragmentShader);
+	if (!m_GeometryProgram || !m_LightProgram || !m_PresentProgram || !CreateTargets(width, height))
+	{
+		Release();
+		return false;
+	}
+	return true;
+}
+
+void DeferredShading::Release()
+{
+	ReleaseTargets();
+
+	GLuint* programs[] = { &m_GeometryProgram, &m_LightProgram, &m_PresentProgram };
+	for (GLuint* program : programs)
+	{
+		if (*program)
+		{
+			m_Renderer.ReleaseProgram(*program);
+			*program = 0;
+		}
+	}
+}
+
+bool DeferredShading::Resize(int32_t width, int32_t height)
+{
+	if (width == m_iWidth && height == m_iHeight && m_GeometryFramebuffer)
+	{
+		return true;
+	}
+	ReleaseTargets();
+	return CreateTargets(width, height);
+}
+
+void DeferredShading::Render(Node& root, const std::vector<PointLight>& lights)
+{
+	BeginGeometryPass();
+	root.Render(m_Renderer, m_GeometryProgram);
+	EndGeometryPass();
+	LightingPass(lights);
+	Present();
+}
+
+void DeferredShading::BeginGeometryPass()
+{
+	m_Stats.uLights = 0;
+	m_Stats.uLightPixels = 0;
+	m_Stats.fGeometrySeconds = m_GeometryTimer.GetElapsedSeconds();
+	m_Stats.fLightingSeconds = m_LightingTimer.GetElapsedSeconds();
+
+	// Follow the window size
+	IApplication* app = IApplication::GetApp();
+	if (app)
+	{
+		Resize(app->GetWidth(), app->GetHeight());
+	}
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_iPrevFramebuffer);
+	m_GeometryTimer.Begin();
+	glBindFramebuffer(GL_FRAMEBUFFER, m_GeometryFramebuffer);
+	glViewport(0, 0, m_iWidth, m_iHeight);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClearDepthf(1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glUseProgram(m_GeometryProgram);
+}
+
+void DeferredShading::EndGeometryPass()
+{
+	m_GeometryTimer.End();
+}
+
+void DeferredShading::LightingPass(const std::vector<PointLight>& lights)
+{
+	m_LightingTimer.Begin();
+	glBindFramebuffer(GL_FRAMEBUFFER, m_LightFramebuffer);
+	glViewport(0, 0, m_iWidth, m_iHeight);
+	glUseProgram(m_LightProgram);
+
+	const GLuint textures[] = { m_AlbedoTexture, m_NormalTexture, m_DepthTexture };
+	const char* names[] = { "albedoTexture", "normalTexture", "depthTexture" };
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		OpenGLRenderer::SetUniformInt(m_LightProgram, names[i], i);
+	}
+	const glm::mat4& view = m_Renderer.GetViewMatrix();
+	OpenGLRenderer::SetUniformMatrix4(m_LightProgram, "inverseProjection", glm::inverse(m_Renderer.GetProjectionMatrix()));
+	OpenGLRenderer::SetUniformMatrix3(m_LightProgram, "normalViewMatrix", glm::mat3(view));
+
+	// Main light covers the screen, point lights only their projected bounds
+	m_arrLightVertices.clear();
+	const glm::vec4 mainLight(glm::vec3(view * glm::vec4(m_Renderer.GetLightPos(), 1.0f)), kMainLightRadius);
+	for (const auto& corner : kScreenCorners)
+	{
+		m_arrLightVertices.push_back({ corner, mainLight, glm::vec3(1.0f) });
+	}
+	for (const auto& light : lights)
+	{
+		if (AddLightQuad(glm::vec3(view * glm::vec4(light.vPosition, 1.0f)), light.fRadius, light.cColor))
+		{
+			++m_Stats.uLights;
+		}
+	}
+
+	const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	DrawLightQuads();
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	if (depthTest)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	for (int32_t i = 2; i >= 0; --i)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	m_LightingTimer.End();
+}
+
+void DeferredShading::Present()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_iPrevFramebuffer);
+	glViewport(0, 0, m_iWidth, m_iHeight);
+	glUseProgram(m_PresentProgram);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_LightTexture);
+	OpenGLRenderer::SetUniformInt(m_PresentProgram, "lightTexture", 0);
+
+	const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	const GLint corner = glGetAttribLocation(m_PresentProgram, "corner");
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glEnableVertexAttribArray(corner);
+	glVertexAttribPointer(corner, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), kScreenCorners);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glDisableVertexAttribArray(corner);
+	if (depthTest)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool DeferredShading::IsSupported()
+{
+	return glDrawBuffers && glGenFramebuffers && glFramebufferTexture2D;
+}
+
+bool DeferredShading::CreateTargets(int32_t width, int32_t height)
+{
+	m_iWidth = std::max(width, 1);
+	m_iHeight = std::max(height, 1);
+
+	auto createTarget = [this](GLenum internalFormat, GLenum format, GLenum type)
+	{
+		GLuint texture = 0;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, m_iWidth, m_iHeight, 0, format, type, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	};
+
+	m_AlbedoTexture = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+	m_NormalTexture = createTarget(GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT);
+	m_LightTexture = createTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+	m_DepthTexture = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint prevFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glGenFramebuffers(1, &m_GeometryFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_GeometryFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_AlbedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_NormalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_LightTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_DepthTexture, 0);
+	glDrawBuffers(3, drawBuffers);
+	const GLenum geometryStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	glGenFramebuffers(1, &m_LightFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_LightFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_LightTexture, 0);
+	const GLenum lightStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFramebuffer);
+	if (geometryStatus != GL_FRAMEBUFFER_COMPLETE || lightStatus != GL_FRAMEBUFFER_COMPLETE)
+	{
+		IApplication::Debug("DeferredShading: G-buffer is incomplete\n");
+		ReleaseTargets();
+		return false;
+	}
+	return true;
+}
+
+void DeferredShading::ReleaseTargets()
+{
+	GLuint* framebuffers[] = { &m_GeometryFramebuffer, &m_LightFramebuffer };
+	for (GLuint* framebuffer : framebuffers)
+	{
+		if (*framebuffer)
+		{
+			glDeleteFramebuffers(1, framebuffer);
+			*framebuffer = 0;
+		}
+	}
+
+	GLuint* textures[] = { &m_AlbedoTexture, &m_NormalTexture, &m_LightTexture, &m_DepthTexture };
+	for (GLuint* texture : textures)
+	{
+		if (*texture)
+		{
+			glDeleteTextures(1, texture);
+			*texture = 0;
+		}
+	}
+	m_iWidth = 0;
+	m_iHeight = 0;
+}
+
+bool DeferredShading::AddLightQuad(const glm::vec3& viewPosition, float radius, const glm::vec3& color)
+{
+	if (radius <= 0.0f)
+	{
+		return false;
+	}
+
+	const glm::mat4& projection = m_Renderer.GetProjectionMatrix();
+	const float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+	if (viewPosition.z - radius > -nearPlane)
+	{
+		// Completely behind the near plane
+		return false;
+	}
+
+	glm::vec2 boundsMin(-1.0f);
+	glm::vec2 boundsMax(1.0f);
+	if (viewPosition.z + radius < -nearPlane)
+	{
+		// Projected box of the sphere, spheres crossing the near plane cover the screen
+		boundsMin = glm::vec2(FLT_MAX);
+		boundsMax = glm::vec2(-FLT_MAX);
+		for (int32_t i = 0; i < 8; ++i)
+		{
+			const glm::vec3 offset((i & 1) ? radius : -radius, (i & 2) ? radius : -radius, (i & 4) ? radius : -radius);
+			const glm::vec4 clip = projection * glm::vec4(viewPosition + offset, 1.0f);
+			boundsMin = glm::min(boundsMin, glm::vec2(clip) / clip.w);
+			boundsMax = glm::max(boundsMax, glm::vec2(clip) / clip.w);
+		}
+		boundsMin = glm::max(boundsMin, glm::vec2(-1.0f));
+		boundsMax = glm::min(boundsMax, glm::vec2(1.0f));
+		if (boundsMin.x >= boundsMax.x || boundsMin.y >= boundsMax.y)
+		{
+			return false;
+		}
+	}
+
+	const glm::vec4 light(viewPosition, radius);
+	const glm::vec2 corners[4] = { boundsMin, { boundsMax.x, boundsMin.y }, boundsMax, { boundsMin.x, boundsMax.y } };
+	const int32_t order[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int32_t i : order)
+	{
+		m_arrLightVertices.push_back({ corners[i], light, color });
+	}
+
+	const glm::vec2 size = (boundsMax - boundsMin) * 0.5f * glm::vec2(m_iWidth, m_iHeight);
+	m_Stats.uLightPixels += (size_t)(size.x * size.y);
+	return true;
+}
+
+void DeferredShading::DrawLightQuads()
+{
+	const GLint corner = glGetAttribLocation(m_LightProgram, "corner");
+	const GLint light = glGetAttribLocation(m_LightProgram, "light");
+	const GLint color = glGetAttribLocation(m_LightProgram, "color");
+	const LIGHTVERTEX* vertices = m_arrLightVertices.data();
+
+	// Client side arrays like Geometry::SetAttribs
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glEnableVertexAttribArray(corner);
+	glVertexAttribPointer(corner, 2, GL_FLOAT, GL_FALSE, sizeof(LIGHTVERTEX), &vertices->vCorner);
+	glEnableVertexAttribArray(light);
+	glVertexAttribPointer(light, 4, GL_FLOAT, GL_FALSE, sizeof(LIGHTVERTEX), &vertices->vLight);
+	glEnableVertexAttribArray(color);
+	glVertexAttribPointer(color, 3, GL_FLOAT, GL_FALSE, sizeof(LIGHTVERTEX), &vertices->cColor);
+
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)m_arrLightVertices.size());
+
+	glDisableVertexAttribArray(corner);
+	glDisableVertexAttribArray(light);
+	glDisableVertexAttribArray(color);
+}
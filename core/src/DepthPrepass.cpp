@@ -0,0 +1,237 @@
+#include "../include/DepthPrepass.h"
+#include "../include/GeometryNode.h"
+#include "../include/Geometry.h"
+#include "../include/Material.h"
+
+#include <algorithm>
+
+static const char* kDepthVertexShader = R"(
+#version 330
+in vec3 position;
+uniform mat4 modelViewProjectionMatrix;
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = modelViewProjectionMatrix * vec4(position, 1.0);
+}
+)";
+
+static const char* kDepthFragmentShader = R"(
+#version 330
+
+void main()
+{
+}
+)";
+
+DepthPrepass::DepthPrepass(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_DepthProgram(0),
+	m_CustomDepthProgram(0),
+	m_bEnabled(true),
+	m_arrQueries{},
+	m_arrPending{},
+	m_arrPrepass{},
+	m_arrPixels{},
+	m_uCurrent(0),
+	m_uOldest(0),
+	m_Stats({})
+{
+}
+
+DepthPrepass::~DepthPrepass()
+{
+	Release();
+}
+
+bool DepthPrepass::Create()
+{
+	Release();
+
+	const GLuint vertexShader = m_Renderer.CreateVertexShader(kDepthVertexShader);
+	const GLuint fragmentShader = m_Renderer.CreateFragmentShader(kDepthFragmentShader);
+	if (vertexShader && fragmentShader)
+	{
+		m_DepthProgram = m_Renderer.CreateProgram(vertexShader, fragmentShader);
+	}
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	if (!m_DepthProgram)
+	{
+		IApplication::Debug("DepthPrepass: failed to create depth program\n");
+		return false;
+	}
+	return true;
+}
+
+void DepthPrepass::Release()
+{
+	if (m_arrQueries[0][0])
+	{
+		glDeleteQueries(kQueryCount * 2, &m_arrQueries[0][0]);
+		for (uint32_t i = 0; i < kQueryCount; ++i)
+		{
+			m_arrQueries[i][0] = m_arrQueries[i][1] = 0;
+			m_arrPending[i] = false;
+		}
+	}
+	if (m_DepthProgram)
+	{
+		m_Renderer.ReleaseProgram(m_DepthProgram);
+		m_DepthProgram = 0;
+	}
+}
+
+void DepthPrepass::Render(Node& root, GLuint program)
+{
+	m_arrOpaque.clear();
+	m_arrTransparent.clear();
+	Collect(root, glm::mat4(1.0f), m_Renderer.GetViewMatrix());
+
+	// Nearest opaque first so that hidden fragments fail the depth test early,
+	// farthest transparent first so that blending composites correctly
+	std::sort(m_arrOpaque.begin(), m_arrOpaque.end(), [](const DRAWITEM& a, const DRAWITEM& b) { return a.fDepth < b.fDepth; });
+	std::sort(m_arrTransparent.begin(), m_arrTransparent.end(), [](const DRAWITEM& a, const DRAWITEM& b) { return a.fDepth > b.fDepth; });
+	m_Stats.uOpaque = m_arrOpaque.size();
+	m_Stats.uTransparent = m_arrTransparent.size();
+
+	const GLuint depthProgram = m_CustomDepthProgram ? m_CustomDepthProgram : m_DepthProgram;
+	const bool prepass = m_bEnabled && depthProgram;
+	m_Stats.bPrepass = prepass;
+
+	// Overdraw is measured when occlusion queries are available
+	const bool queries = glGenQueries && glBeginQuery && glEndQuery && glGetQueryObjectuiv;
+	if (queries)
+	{
+		if (!m_arrQueries[0][0])
+		{
+			glGenQueries(kQueryCount * 2, &m_arrQueries[0][0]);
+		}
+		CollectQueries(false);
+		if (m_arrPending[m_uCurrent])
+		{
+			CollectQueries(true);
+		}
+
+		GLint viewport[4] = {};
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		m_arrPixels[m_uCurrent] = (float)viewport[2] * (float)viewport[3];
+		m_arrPrepass[m_uCurrent] = prepass;
+	}
+
+	if (prepass)
+	{
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+		glUseProgram(depthProgram);
+		if (queries) glBeginQuery(GL_SAMPLES_PASSED, m_arrQueries[m_uCurrent][0]);
+		DrawItems(m_arrOpaque, depthProgram, false);
+		if (queries) glEndQuery(GL_SAMPLES_PASSED);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		// Depth is final, only the visible fragment of each pixel passes
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_EQUAL);
+	}
+
+	glUseProgram(program);
+	if (queries) glBeginQuery(GL_SAMPLES_PASSED, m_arrQueries[m_uCurrent][1]);
+	DrawItems(m_arrOpaque, program, true);
+	if (queries) glEndQuery(GL_SAMPLES_PASSED);
+	glDepthFunc(GL_LEQUAL);
+
+	if (!m_arrTransparent.empty())
+	{
+		glDepthMask(GL_FALSE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		DrawItems(m_arrTransparent, program, true);
+		glDisable(GL_BLEND);
+	}
+	glDepthMask(GL_TRUE);
+
+	if (queries)
+	{
+		m_arrPending[m_uCurrent] = true;
+		m_uCurrent = (m_uCurrent + 1) % kQueryCount;
+	}
+}
+
+void DepthPrepass::Collect(const Node& node, const glm::mat4& parentWorld, const glm::mat4& view)
+{
+	const glm::mat4 world = parentWorld * node.GetInterpolatedMatrix(m_Renderer.GetInterpolation());
+
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&node);
+	if (geometryNode && geometryNode->GetGeometry() && !node.IsCulled())
+	{
+		const float depth = -(view * world[3]).z;
+		const Material* material = geometryNode->GetMaterial().get();
+		if (material && material->m_cDiffuse.a < 1.0f)
+		{
+			m_arrTransparent.push_back({ geometryNode, world, depth });
+		}
+		else
+		{
+			m_arrOpaque.push_back({ geometryNode, world, depth });
+		}
+	}
+
+	for (const auto& child : node.GetNodes())
+	{
+		Collect(*child, world, view);
+	}
+}
+
+void DepthPrepass::DrawItems(const std::vector<DRAWITEM>& items, GLuint program, bool material)
+{
+	for (const auto& item : items)
+	{
+		const Geometry& geometry = *item.pNode->GetGeometry();
+		geometry.SetAttribs(program);
+		m_Renderer.SetObjectTransform(program, item.mWorld);
+		if (material && item.pNode->GetMaterial())
+		{
+			m_Renderer.SetMaterial(program, *item.pNode->GetMaterial());
+		}
+		geometry.Draw(m_Renderer);
+	}
+}
+
+void DepthPrepass::CollectQueries(bool wait)
+{
+	while (m_arrPending[m_uOldest])
+	{
+		if (!wait)
+		{
+			GLuint available = 0;
+			glGetQueryObjectuiv(m_arrQueries[m_uOldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+			{
+				return;
+			}
+		}
+
+		GLuint depthSamples = 0;
+		GLuint shadedSamples = 0;
+		if (m_arrPrepass[m_uOldest])
+		{
+			glGetQueryObjectuiv(m_arrQueries[m_uOldest][0], GL_QUERY_RESULT, &depthSamples);
+		}
+		glGetQueryObjectuiv(m_arrQueries[m_uOldest][1], GL_QUERY_RESULT, &shadedSamples);
+
+		// Without the pre-pass every fragment passing the depth test is shaded
+		const float pixels = std::max(m_arrPixels[m_uOldest], 1.0f);
+		m_Stats.fShadedOverdraw = (float)shadedSamples / pixels;
+		m_Stats.fDepthOverdraw = m_arrPrepass[m_uOldest] ? (float)depthSamples / pixels : m_Stats.fShadedOverdraw;
+
+		m_arrPending[m_uOldest] = false;
+		m_uOldest = (m_uOldest + 1) % kQueryCount;
+		if (wait)
+		{
+			return;
+		}
+	}
+}
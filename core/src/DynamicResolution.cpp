@@ -0,0 +1,295 @@
+#include "../include/DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const char* kUpscaleVertexShader = R"(
+#version 330
+in vec2 corner;
+out vec2 texCoord;
+
+void main()
+{
+	texCoord = corner * 0.5 + 0.5;
+	gl_Position = vec4(corner, 0.0, 1.0);
+}
+)";
+
+// Bilinear upscale with contrast adaptive sharpening. The sharpening weight
+// drops where the neighborhood already has high contrast, which avoids halos.
+static const char* kUpscaleFragmentShader = R"(
+#version 330
+in vec2 texCoord;
+uniform sampler2D sceneTexture;
+uniform vec2 uvScale;
+uniform vec2 texelSize;
+uniform float sharpness;
+out vec4 result;
+
+void main()
+{
+	vec2 uv = min(texCoord * uvScale, uvScale - texelSize * 0.5);
+	vec3 c = texture(sceneTexture, uv).rgb;
+	vec3 n = texture(sceneTexture, uv - vec2(0.0, texelSize.y)).rgb;
+	vec3 s = texture(sceneTexture, min(uv + vec2(0.0, texelSize.y), uvScale - texelSize * 0.5)).rgb;
+	vec3 w = texture(sceneTexture, uv - vec2(texelSize.x, 0.0)).rgb;
+	vec3 e = texture(sceneTexture, min(uv + vec2(texelSize.x, 0.0), uvScale - texelSize * 0.5)).rgb;
+
+	vec3 minColor = min(c, min(min(n, s), min(w, e)));
+	vec3 maxColor = max(c, max(max(n, s), max(w, e)));
+	vec3 amount = sqrt(clamp(min(minColor, 1.0 - maxColor) / max(maxColor, 0.0001), 0.0, 1.0));
+	vec3 weight = -amount * 0.2 * sharpness;
+
+	vec3 color = (c + (n + s + w + e) * weight) / (1.0 + 4.0 * weight);
+	result = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
+)";
+
+// Two triangles covering the screen
+static const glm::vec2 kScreenCorners[6] =
+{
+	{ -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f },
+	{ -1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f }
+};
+
+// Frames between controller updates, lets timer results catch up with the last change
+constexpr uint32_t kUpdateFrames = 4;
+
+// PI gains, applied to the relative error of the GPU time
+constexpr float kProportionalGain = 0.25f;
+constexpr float kIntegralGain = 0.1f;
+
+// Relative headroom needed before the scale rises
+constexpr float kRaiseHeadroom = 0.1f;
+
+// Smallest scale change applied
+constexpr float kDeadBand = 0.025f;
+
+DynamicResolution::DynamicResolution(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_UpscaleProgram(0),
+	m_Framebuffer(0),
+	m_ColorTexture(0),
+	m_DepthRenderbuffer(0),
+	m_iPrevFramebuffer(0),
+	m_iTargetWidth(0),
+	m_iTargetHeight(0),
+	m_fTargetSeconds(0.014f),
+	m_fMinScale(0.5f),
+	m_fMaxScale(1.0f),
+	m_fScale(1.0f),
+	m_fPrevError(0.0f),
+	m_fPendingChange(0.0f),
+	m_fSharpness(0.5f),
+	m_uFrame(0),
+	m_Stats({})
+{
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	Release();
+}
+
+bool DynamicResolution::Create()
+{
+	Release();
+
+	const GLuint vertexShader = m_Renderer.CreateVertexShader(kUpscaleVertexShader);
+	const GLuint fragmentShader = m_Renderer.CreateFragmentShader(kUpscaleFragmentShader);
+	if (vertexShader && fragmentShader)
+	{
+		m_UpscaleProgram = m_Renderer.CreateProgram(vertexShader, fragmentShader);
+	}
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	if (!m_UpscaleProgram)
+	{
+		IApplication::Debug("DynamicResolution: failed to create upscale program\n");
+		return false;
+	}
+
+	IApplication* app = IApplication::GetApp();
+	if (!app || !CreateTarget(app->GetWidth(), app->GetHeight()))
+	{
+		Release();
+		return false;
+	}
+	if (!GpuTimer::IsSupported())
+	{
+		IApplication::Debug("DynamicResolution: timer queries are not supported, resolution stays fixed\n");
+	}
+	return true;
+}
+
+void DynamicResolution::Release()
+{
+	ReleaseTarget();
+	if (m_UpscaleProgram)
+	{
+		m_Renderer.ReleaseProgram(m_UpscaleProgram);
+		m_UpscaleProgram = 0;
+	}
+}
+
+void DynamicResolution::SetScaleRange(float minScale, float maxScale)
+{
+	m_fMinScale = glm::clamp(minScale, 0.1f, 1.0f);
+	m_fMaxScale = glm::clamp(maxScale, m_fMinScale, 1.0f);
+	m_fScale = glm::clamp(m_fScale, m_fMinScale, m_fMaxScale);
+}
+
+void DynamicResolution::BeginScene()
+{
+	// Follow the window size
+	IApplication* app = IApplication::GetApp();
+	if (app && (app->GetWidth() != m_iTargetWidth || app->GetHeight() != m_iTargetHeight))
+	{
+		ReleaseTarget();
+		CreateTarget(app->GetWidth(), app->GetHeight());
+	}
+
+	UpdateScale();
+	m_Stats.fScale = m_fScale;
+	m_Stats.iWidth = std::max((int32_t)(m_iTargetWidth * m_fScale), 1);
+	m_Stats.iHeight = std::max((int32_t)(m_iTargetHeight * m_fScale), 1);
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_iPrevFramebuffer);
+	m_SceneTimer.Begin();
+	glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+	glViewport(0, 0, m_Stats.iWidth, m_Stats.iHeight);
+
+	// Clear only the rendered area, the rest is never sampled
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, m_Stats.iWidth, m_Stats.iHeight);
+	glDepthMask(GL_TRUE);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+void DynamicResolution::EndScene()
+{
+	m_SceneTimer.End();
+	glBindFramebuffer(GL_FRAMEBUFFER, m_iPrevFramebuffer);
+}
+
+void DynamicResolution::Present()
+{
+	glViewport(0, 0, m_iTargetWidth, m_iTargetHeight);
+	glUseProgram(m_UpscaleProgram);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_ColorTexture);
+	OpenGLRenderer::SetUniformInt(m_UpscaleProgram, "sceneTexture", 0);
+	OpenGLRenderer::SetUniformVec2(m_UpscaleProgram, "uvScale",
+		glm::vec2((float)m_Stats.iWidth / (float)m_iTargetWidth, (float)m_Stats.iHeight / (float)m_iTargetHeight));
+	OpenGLRenderer::SetUniformVec2(m_UpscaleProgram, "texelSize", glm::vec2(1.0f / (float)m_iTargetWidth, 1.0f / (float)m_iTargetHeight));
+	OpenGLRenderer::SetUniformFloat(m_UpscaleProgram, "sharpness", glm::clamp(m_fSharpness, 0.0f, 1.0f));
+
+	const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	const GLint corner = glGetAttribLocation(m_UpscaleProgram, "corner");
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glEnableVertexAttribArray(corner);
+	glVertexAttribPointer(corner, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), kScreenCorners);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glDisableVertexAttribArray(corner);
+	if (depthTest)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool DynamicResolution::CreateTarget(int32_t width, int32_t height)
+{
+	m_iTargetWidth = std::max(width, 1);
+	m_iTargetHeight = std::max(height, 1);
+
+	glGenTextures(1, &m_ColorTexture);
+	glBindTexture(GL_TEXTURE_2D, m_ColorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_iTargetWidth, m_iTargetHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &m_DepthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_DepthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_iTargetWidth, m_iTargetHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLint prevFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+	glGenFramebuffers(1, &m_Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_ColorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_DepthRenderbuffer);
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFramebuffer);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		IApplication::Debug("DynamicResolution: scene target is incomplete\n");
+		ReleaseTarget();
+		return false;
+	}
+	return true;
+}
+
+void DynamicResolution::ReleaseTarget()
+{
+	if (m_Framebuffer)
+	{
+		glDeleteFramebuffers(1, &m_Framebuffer);
+		m_Framebuffer = 0;
+	}
+	if (m_DepthRenderbuffer)
+	{
+		glDeleteRenderbuffers(1, &m_DepthRenderbuffer);
+		m_DepthRenderbuffer = 0;
+	}
+	if (m_ColorTexture)
+	{
+		glDeleteTextures(1, &m_ColorTexture);
+		m_ColorTexture = 0;
+	}
+	m_iTargetWidth = 0;
+	m_iTargetHeight = 0;
+}
+
+void DynamicResolution::UpdateScale()
+{
+	m_Stats.fSceneSeconds = m_SceneTimer.GetElapsedSeconds();
+	if (++m_uFrame % kUpdateFrames != 0 || m_Stats.fSceneSeconds <= 0.0f || m_fTargetSeconds <= 0.0f)
+	{
+		return;
+	}
+
+	// Positive error is headroom. Small headroom is treated as on target so that
+	// the scale does not rise straight back into an overload.
+	float error = (m_fTargetSeconds - m_Stats.fSceneSeconds) / m_fTargetSeconds;
+	if (error > 0.0f)
+	{
+		error = std::max(error - kRaiseHeadroom, 0.0f);
+	}
+
+	// Velocity form PI, a clamped scale cannot wind up the integral term
+	m_fPendingChange += kProportionalGain * (error - m_fPrevError) + kIntegralGain * error;
+	m_fPrevError = error;
+
+	const float scale = glm::clamp(m_fScale + m_fPendingChange, m_fMinScale, m_fMaxScale);
+	if (std::abs(scale - m_fScale) < kDeadBand)
+	{
+		// Nothing to gain by pushing against a limit
+		if (scale == m_fScale)
+		{
+			m_fPendingChange = 0.0f;
+		}
+		return;
+	}
+
+	m_fScale = scale;
+	m_fPendingChange = 0.0f;
+	++m_Stats.uScaleChanges;
+}
@@ -0,0 +1,140 @@
+#include "../include/FileWatcher.h"
+
+#if defined (_LINUX)
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+FileWatcher::FileWatcher()
+{
+#if defined (_LINUX)
+	m_iInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+	Clear();
+
+#if defined (_LINUX)
+	if (m_iInotify >= 0)
+	{
+		close(m_iInotify);
+	}
+#endif
+}
+
+bool FileWatcher::AddFile(const std::string_view& filename)
+{
+	const std::string name(filename);
+	if (m_setFiles.count(name))
+	{
+		return true;
+	}
+
+#if defined (_LINUX)
+	if (m_iInotify < 0)
+	{
+		return false;
+	}
+
+	// Watch the directory, saving often replaces the file instead of writing into it
+	const std::string directory = GetDirectory(name);
+	if (!m_mapDirectories.count(directory))
+	{
+		const int watch = inotify_add_watch(m_iInotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (watch < 0)
+		{
+			return false;
+		}
+		m_mapDirectories[directory] = watch;
+		m_mapWatches[watch] = directory;
+	}
+#endif
+
+#if defined (_WIN32)
+	std::error_code error;
+	m_mapWriteTimes[name] = std::filesystem::last_write_time(name, error);
+#endif
+
+	m_setFiles.insert(name);
+	return true;
+}
+
+void FileWatcher::Clear()
+{
+#if defined (_LINUX)
+	for (auto& it : m_mapWatches)
+	{
+		inotify_rm_watch(m_iInotify, it.first);
+	}
+	m_mapWatches.clear();
+	m_mapDirectories.clear();
+#endif
+
+#if defined (_WIN32)
+	m_mapWriteTimes.clear();
+#endif
+
+	m_setFiles.clear();
+}
+
+std::vector<std::string> FileWatcher::Poll()
+{
+	std::unordered_set<std::string> changed;
+
+#if defined (_LINUX)
+	if (m_iInotify >= 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		for (;;)
+		{
+			const ssize_t length = read(m_iInotify, buffer, sizeof(buffer));
+			if (length <= 0)
+			{
+				// EAGAIN, nothing more to read
+				break;
+			}
+
+			for (ssize_t i = 0; i < length;)
+			{
+				const inotify_event* e = (const inotify_event*)&buffer[i];
+				i += sizeof(inotify_event) + e->len;
+
+				auto watch = m_mapWatches.find(e->wd);
+				if (watch == m_mapWatches.end() || e->len == 0)
+				{
+					continue;
+				}
+
+				const std::string name = (watch->second == ".") ? std::string(e->name) : watch->second + "/" + e->name;
+				if (m_setFiles.count(name))
+				{
+					changed.insert(name);
+				}
+			}
+		}
+	}
+#endif
+
+#if defined (_WIN32)
+	for (auto& it : m_mapWriteTimes)
+	{
+		std::error_code error;
+		const auto writeTime = std::filesystem::last_write_time(it.first, error);
+		if (!error && writeTime != it.second)
+		{
+			it.second = writeTime;
+			changed.insert(it.first);
+		}
+	}
+#endif
+
+	return std::vector<std::string>(changed.begin(), changed.end());
+}
+
+std::string FileWatcher::GetDirectory(const std::string_view& filename)
+{
+	const size_t slash = filename.find_last_of("/\\");
+	return (slash == std::string_view::npos) ? std::string(".") : std::string(filename.substr(0, slash));
+}
@@ -0,0 +1,191 @@
+#include "../include/FramePacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined (_WIN32)
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Frame rate of windows that are not active, low enough to leave the CPU idle
+constexpr float kDefaultInactiveFrameRate = 10.0f;
+// Time spun before a deadline, grows to cover the worst oversleep seen
+constexpr float kMinSpinSeconds = 0.0005f;
+constexpr float kMaxSpinSeconds = 0.004f;
+// Longest wait for the latency fence, in nanoseconds
+constexpr uint64_t kFenceTimeout = 1000000000;
+
+FramePacer::FramePacer() :
+	m_eVSync(VSync::On),
+	m_bSwapIntervalDirty(false),
+	m_fFrameRateLimit(0.0f),
+	m_fInactiveFrameRate(kDefaultInactiveFrameRate),
+	m_bLowLatency(false),
+	m_uTickFrequency(Timer::GetTickFrequency()),
+	m_uNextFrame(0),
+	m_uSpinTicks(0),
+	m_Fence(nullptr),
+	m_Stats({})
+{
+	m_uSpinTicks = (uint64_t)(m_uTickFrequency * kMinSpinSeconds);
+	m_Stats.eVSync = VSync::On;
+#if defined (_WIN32)
+	// Default scheduler period is 15.6 ms, far too coarse for sleeping within a frame
+	timeBeginPeriod(1);
+#endif
+}
+
+FramePacer::~FramePacer()
+{
+#if defined (_WIN32)
+	timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::SetVSync(VSync mode)
+{
+	m_eVSync.store(mode, std::memory_order_relaxed);
+	m_bSwapIntervalDirty.store(true, std::memory_order_release);
+}
+
+void FramePacer::SetFrameRateLimit(float framesPerSecond)
+{
+	m_fFrameRateLimit = std::max(framesPerSecond, 0.0f);
+	m_uNextFrame = 0;
+}
+
+void FramePacer::SetInactiveFrameRate(float framesPerSecond)
+{
+	m_fInactiveFrameRate = std::max(framesPerSecond, 0.0f);
+	m_uNextFrame = 0;
+}
+
+void FramePacer::WaitForFrame(bool active, bool ownsContext)
+{
+	m_Stats.fSleepSeconds = 0.0f;
+	m_Stats.fSpinSeconds = 0.0f;
+	m_Stats.fFenceWaitSeconds = 0.0f;
+
+	const float frameRate = active ? m_fFrameRateLimit : m_fInactiveFrameRate;
+	m_Stats.bThrottled = !active && frameRate > 0.0f;
+	if (frameRate > 0.0f)
+	{
+		const uint64_t period = (uint64_t)(m_uTickFrequency / frameRate);
+		const uint64_t now = Timer::GetTicks();
+		// Start over from now when more than a frame late, rather than rushing to catch up
+		if (m_uNextFrame == 0 || now > m_uNextFrame + period)
+		{
+			m_uNextFrame = now;
+		}
+		SleepUntil(m_uNextFrame);
+		m_uNextFrame += period;
+		m_Stats.fTargetFrameSeconds = 1.0f / frameRate;
+	}
+	else
+	{
+		m_uNextFrame = 0;
+		m_Stats.fTargetFrameSeconds = 0.0f;
+	}
+
+	if (m_bLowLatency && ownsContext && m_Fence)
+	{
+		Timer timer;
+		timer.BeginTimer();
+		glClientWaitSync(m_Fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+		timer.EndTimer();
+		glDeleteSync(m_Fence);
+		m_Fence = nullptr;
+		m_Stats.fFenceWaitSeconds = timer.GetElapsedSeconds();
+	}
+}
+
+void FramePacer::ApplySwapInterval(IRenderer& renderer)
+{
+	if (!m_bSwapIntervalDirty.exchange(false, std::memory_order_acquire))
+	{
+		return;
+	}
+
+	const VSync mode = m_eVSync.load(std::memory_order_relaxed);
+	const int32_t interval = mode == VSync::Off ? 0 : mode == VSync::On ? 1 : -1;
+	if (renderer.SetSwapInterval(interval))
+	{
+		m_Stats.eVSync = mode;
+	}
+	else if (mode == VSync::Adaptive && renderer.SetSwapInterval(1))
+	{
+		IApplication::Debug("FramePacer: adaptive vsync not supported, using vsync\n");
+		m_Stats.eVSync = VSync::On;
+	}
+	else
+	{
+		IApplication::Debug("FramePacer: swap interval control not supported\n");
+	}
+}
+
+void FramePacer::EndFrame()
+{
+	if (!m_bLowLatency || !glFenceSync)
+	{
+		return;
+	}
+
+	if (m_Fence)
+	{
+		glDeleteSync(m_Fence);
+	}
+	m_Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void FramePacer::Release()
+{
+	if (m_Fence)
+	{
+		glDeleteSync(m_Fence);
+		m_Fence = nullptr;
+	}
+}
+
+void FramePacer::SleepUntil(uint64_t deadline)
+{
+	uint64_t now = Timer::GetTicks();
+	if (now >= deadline)
+	{
+		return;
+	}
+
+	// Sleep through most of the wait, the scheduler may wake the thread late
+	if (deadline - now > m_uSpinTicks)
+	{
+		const uint64_t wake = deadline - m_uSpinTicks;
+		const uint64_t sleepStart = now;
+		std::this_thread::sleep_for(std::chrono::duration<double>((double)(wake - now) / (double)m_uTickFrequency));
+
+		now = Timer::GetTicks();
+		m_Stats.fSleepSeconds = (float)((double)(now - sleepStart) / (double)m_uTickFrequency);
+
+		// Widen the spin window to the oversleep, narrow it slowly when sleeps are accurate
+		const uint64_t oversleep = now > wake ? now - wake : 0;
+		const uint64_t minSpin = (uint64_t)(m_uTickFrequency * kMinSpinSeconds);
+		const uint64_t maxSpin = (uint64_t)(m_uTickFrequency * kMaxSpinSeconds);
+		if (oversleep > m_uSpinTicks)
+		{
+			m_uSpinTicks = oversleep;
+		}
+		else
+		{
+			m_uSpinTicks -= (m_uSpinTicks - oversleep) / 16;
+		}
+		m_uSpinTicks = std::clamp(m_uSpinTicks, minSpin, maxSpin);
+	}
+
+	const uint64_t spinStart = now;
+	while (now < deadline)
+	{
+		std::this_thread::yield();
+		now = Timer::GetTicks();
+	}
+	m_Stats.fSpinSeconds = (float)((double)(now - spinStart) / (double)m_uTickFrequency);
+}
@@ -0,0 +1,90 @@
+#include "../include/FramePacket.h"
+#include "../include/OpenGLRenderer.h"
+#include "../include/GeometryNode.h"
+#include "../include/Geometry.h"
+#include "../include/Material.h"
+#include "../include/World.h"
+
+#include <algorithm>
+
+void FramePacket::Clear()
+{
+	uFrame = 0;
+	fFrameTime = 0.0f;
+	fInterpolation = 1.0f;
+	uProgram = 0;
+	mView = glm::mat4(1.0f);
+	mProjection = glm::mat4(1.0f);
+	vLightPosition = glm::vec3(0.0f, 1.0f, 0.0f);
+	arrDraws.clear();
+}
+
+void FramePacket::AddNode(const Node& root)
+{
+	AddNode(root, glm::mat4(1.0f));
+}
+
+void FramePacket::AddNode(const Node& node, const glm::mat4& parentWorld)
+{
+	const glm::mat4 world = parentWorld * node.GetInterpolatedMatrix(fInterpolation);
+
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&node);
+	if (geometryNode && geometryNode->GetGeometry() && !node.IsCulled())
+	{
+		arrDraws.push_back({ geometryNode->GetGeometry(), geometryNode->GetMaterial(), world, -(mView * world[3]).z });
+	}
+
+	for (const auto& child : node.GetNodes())
+	{
+		AddNode(*child, world);
+	}
+}
+
+void FramePacket::AddWorld(const World& world)
+{
+	const uint32_t mask = ComponentBit(ComponentType::Transform) | ComponentBit(ComponentType::Renderable);
+	world.ForEachChunk(mask, [this](const WorldChunk& chunk)
+	{
+		for (uint32_t i = 0; i < chunk.uCount; ++i)
+		{
+			if (chunk.pGeometry[i])
+			{
+				arrDraws.push_back({ chunk.pGeometry[i], chunk.pMaterial[i], chunk.pWorld[i], -(mView * chunk.pWorld[i][3]).z });
+			}
+		}
+	});
+}
+
+void FramePacket::Sort()
+{
+	std::sort(arrDraws.begin(), arrDraws.end(), [](const Draw& a, const Draw& b)
+	{
+		if (a.pMaterial != b.pMaterial)
+		{
+			return a.pMaterial < b.pMaterial;
+		}
+		return a.fDepth < b.fDepth;
+	});
+}
+
+void FramePacket::Submit(IRenderer& renderer) const
+{
+	renderer.SetViewMatrix(mView);
+	renderer.SetProjectionMatrix(mProjection);
+	renderer.SetLightPos(vLightPosition);
+	renderer.SetInterpolation(1.0f);
+
+	glUseProgram(uProgram);
+	const Material* material = nullptr;
+	for (const auto& draw : arrDraws)
+	{
+		draw.pGeometry->SetAttribs(uProgram);
+		renderer.SetObjectTransform(uProgram, draw.mModel);
+		if (draw.pMaterial && draw.pMaterial.get() != material)
+		{
+			renderer.SetMaterial(uProgram, *draw.pMaterial);
+			material = draw.pMaterial.get();
+		}
+		draw.pGeometry->Draw(renderer);
+	}
+}
@@ -4,11 +4,14 @@
 //#define TINYOBJLOADER_USE_MAPBOX_EARCUT
 #include "tiny_obj_loader.h"
 
+std::atomic<uint64_t> Geometry::m_uNextGeneration(1);
+
 
 Geometry::Geometry() :
 	m_IndexBuffer(0),
 	m_uIndexCount(0),
-	m_eDrawMode(GL_TRIANGLES)
+	m_eDrawMode(GL_TRIANGLES),
+	m_uGeneration(m_uNextGeneration++)
 {
 }
 
@@ -28,6 +31,7 @@ void Geometry::Clear()
 		m_IndexBuffer = 0;
 	}
 	m_uIndexCount = 0;
+	m_uGeneration = m_uNextGeneration++;
 }
 
 
@@ -107,6 +111,51 @@ void Geometry::DisableAttribs(GLuint program) const
 }
 
 
+bool Geometry::GetTriangleIndices(std::vector<GLuint>& indices) const
+{
+	const size_t vertexCount = GetVertexCount();
+	indices.clear();
+
+	if (m_IndexBuffer && m_uIndexCount)
+	{
+		if (m_eDrawMode != GL_TRIANGLES || !glGetBufferSubData)
+		{
+			return false;
+		}
+		indices.resize(m_uIndexCount);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_IndexBuffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)(m_uIndexCount * sizeof(GLuint)), indices.data());
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		return true;
+	}
+
+	if (m_eDrawMode == GL_TRIANGLE_STRIP)
+	{
+		indices.reserve((vertexCount > 2) ? (vertexCount - 2) * 3 : 0);
+		for (GLuint i = 0; i + 2 < (GLuint)vertexCount; ++i)
+		{
+			// Every other triangle of a strip has reversed winding
+			indices.push_back((i & 1) ? i + 1 : i);
+			indices.push_back((i & 1) ? i : i + 1);
+			indices.push_back(i + 2);
+		}
+		return true;
+	}
+
+	if (m_eDrawMode == GL_TRIANGLES)
+	{
+		indices.resize(vertexCount);
+		for (GLuint i = 0; i < (GLuint)vertexCount; ++i)
+		{
+			indices[i] = i;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+
 void Geometry::Draw(IRenderer& renderer) const
 {
 	if (m_IndexBuffer && m_uIndexCount)
@@ -122,11 +171,12 @@ void Geometry::Draw(IRenderer& renderer) const
 }
 
 
-std::vector<Geometry::VERTEX> Geometry::GenSphereVertices(const glm::vec3& radius, const glm::vec3& offset, uint32_t rings, uint32_t segments)
+Geometry::VertexArray Geometry::GenSphereVertices(const glm::vec3& radius, const glm::vec3& offset, uint32_t rings, uint32_t segments)
 {
-	std::vector<VERTEX> vertices;
+	VertexArray vertices;
 	const float deltaRingAngle = (glm::pi<float>() / rings); // The angle increment between each ring
 	const float deltaSegAngle = (glm::two_pi<float>() / segments); // The angle increment between each segment
+	vertices.reserve((size_t)rings * (segments + 1) * 2);
 
 	for (uint32_t ring = 0; ring < rings; ++ring)
 	{
@@ -160,10 +210,10 @@ std::vector<Geometry::VERTEX> Geometry::GenSphereVertices(const glm::vec3& radiu
 }
 
 
-std::vector<Geometry::VERTEX> Geometry::GenCubeVertices(const glm::vec3& size, const glm::vec3& offset, GLuint& indexBuffer, size_t& indexCount)
+Geometry::VertexArray Geometry::GenCubeVertices(const glm::vec3& size, const glm::vec3& offset, GLuint& indexBuffer, size_t& indexCount)
 {
 	// Cube normals for sides. With negative values there are six normals.
-	std::vector<VERTEX> vertices;
+	VertexArray vertices;
 	const glm::vec3 nor1(1.0f, 0.0f, 0.0f);
 	const glm::vec3 nor2(0.0f, 1.0f, 0.0f);
 	const glm::vec3 nor3(0.0f, 0.0f, 1.0f);
@@ -172,6 +222,7 @@ std::vector<Geometry::VERTEX> Geometry::GenCubeVertices(const glm::vec3& size, c
 	const float fW = size.x * 0.5f;
 	const float fH = size.y * 0.5f;
 	const float fD = size.z * 0.5f;
+	vertices.reserve(24);
 
 	// Cube corners
 	glm::vec3 p[8];
@@ -244,12 +295,13 @@ std::vector<Geometry::VERTEX> Geometry::GenCubeVertices(const glm::vec3& size, c
 }
 
 
-std::vector<Geometry::VERTEX> Geometry::GenQuadVertices(const glm::vec2& size, const glm::vec3& offset)
+Geometry::VertexArray Geometry::GenQuadVertices(const glm::vec2& size, const glm::vec3& offset)
 {
 	// Quad size
-	std::vector<VERTEX> vertices;
+	VertexArray vertices;
 	const float w = size.x * 0.5f;
 	const float h = size.y * 0.5f;
+	vertices.reserve(6);
 
 	// Quad normal
 	const glm::vec3 normal(0.0f, 0.0f, 1.0f);
@@ -279,13 +331,13 @@ std::vector<Geometry::VERTEX> Geometry::GenQuadVertices(const glm::vec2& size, c
 }
 
 
-std::vector<Geometry::VERTEX> Geometry::GenTorusVertices(uint32_t segments,
+Geometry::VertexArray Geometry::GenTorusVertices(uint32_t segments,
 	float radius,
 	float fatness,
 	GLuint& indexBuffer,
 	size_t& indexCount)
 {
-	std::vector<VERTEX> vertices;
+	VertexArray vertices;
 	const size_t vertexCount = segments * segments;
 	indexCount = (segments - 1) * (segments - 1) * 6;
 	vertices.resize(vertexCount);
@@ -328,8 +380,8 @@ std::vector<Geometry::VERTEX> Geometry::GenTorusVertices(uint32_t segments,
 		}
 	}
 
-	std::vector<uint32_t> indices;
-	indices.resize(indexCount);
+	ArenaScope scratch;
+	uint32_t* indices = scratch.GetArena().Allocate<uint32_t>(indexCount);
 
 	index = 0;
 	for (size_t i = 0; i < segments - 1; i++)
@@ -349,18 +401,18 @@ std::vector<Geometry::VERTEX> Geometry::GenTorusVertices(uint32_t segments,
 
 	glGenBuffers(1, &indexBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * 4, indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * 4, indices, GL_STATIC_DRAW);
 	return vertices;
 }
 
 
-std::vector<Geometry::VERTEX> Geometry::GenKnotVertices(uint32_t slices,
+Geometry::VertexArray Geometry::GenKnotVertices(uint32_t slices,
 	uint32_t stacks,
 	float radius,
 	GLuint& indexBuffer,
 	size_t& indexCount)
 {
-	std::vector<VERTEX> vertices;
+	VertexArray vertices;
 	const size_t vertexCount = slices * stacks;
 	indexCount = vertexCount * 6;
 
@@ -395,9 +447,9 @@ std::vector<Geometry::VERTEX> Geometry::GenKnotVertices(uint32_t slices,
 		}
 	}
 
-	std::vector<uint32_t> indices;
-	indices.resize(indexCount);
-	uint32_t* pIndex = indices.data();
+	ArenaScope scratch;
+	uint32_t* indices = scratch.GetArena().Allocate<uint32_t>(indexCount);
+	uint32_t* pIndex = indices;
 
 	uint32_t n = 0;
 	for (uint32_t i = 0; i < slices; i++)
@@ -417,7 +469,7 @@ std::vector<Geometry::VERTEX> Geometry::GenKnotVertices(uint32_t slices,
 
 	glGenBuffers(1, &indexBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * 4, indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * 4, indices, GL_STATIC_DRAW);
 	return vertices;
 }
 
@@ -5,22 +5,18 @@
 void GeometryNode::Render(IRenderer& renderer, GLuint program)
 {
 	// Check that there is geometry as geometry can be initialized with null pointers
-	if (m_pGeometry)
+	if (m_pGeometry && !m_bCulled)
 	{
 		m_pGeometry->SetAttribs(program);
 
-		// Set model matrix to shader uniform
-		// Use node's and its parent's combined matrixes so the node will move relative to its parent
-		const glm::mat4 worldMatrix(GetWorldMatrix());
-		OpenGLRenderer::SetUniformMatrix4(program, "modelMatrix", worldMatrix);
-
-		// Set model-view-projection matrix to shader uniform
-		const glm::mat4 modelViewProjectionMatrix(renderer.GetProjectionMatrix() * renderer.GetViewMatrix() * worldMatrix);
-		OpenGLRenderer::SetUniformMatrix4(program, "modelViewProjectionMatrix", modelViewProjectionMatrix);
+		// Set model and model-view-projection matrices for the draw
+		// Use node's and its parent's combined matrixes so the node will move relative to its parent,
+		// blended between the last two simulation steps when the timestep is fixed
+		renderer.SetObjectTransform(program, GetInterpolatedWorldMatrix(renderer.GetInterpolation()));
 
 		if (m_pMaterial)
 		{
-			m_pMaterial->SetToProgram(program);
+			renderer.SetMaterial(program, *m_pMaterial);
 		}
 
 		m_pGeometry->Draw(renderer);
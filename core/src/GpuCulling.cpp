@@ -0,0 +1,373 @@
+#include "../include/GpuCulling.h"
+
+#include <algorithm>
+
+// Must match local_size_x of the culling shader
+constexpr GLuint kCullGroupSize = 64;
+// Must match local_size_x and local_size_y of the downsampling shader
+constexpr GLuint kDownsampleGroupSize = 8;
+
+static const char* kCullShader = R"(
+#version 430
+layout(local_size_x = 64) in;
+
+struct Instance
+{
+	mat4 model;
+	vec4 sphere;
+	uint indexCount;
+	uint firstIndex;
+	int baseVertex;
+	uint bucket;
+	uint bucketFirst;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+struct Command
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer InstanceBlock { Instance instances[]; };
+layout(std430, binding = 1) writeonly buffer CommandBlock { Command commands[]; };
+layout(std430, binding = 2) writeonly buffer TransformBlock { mat4 transforms[]; };
+layout(std430, binding = 3) buffer CounterBlock { uint counters[]; };
+
+uniform int instanceCount;
+uniform vec4 frustumPlanes[6];
+uniform mat4 hizViewProjection;
+uniform vec2 hizSize;
+uniform int hizLevels; // 0 when occlusion test is disabled
+uniform sampler2D hizTexture;
+
+bool IsOccluded(vec3 center, float radius)
+{
+	if (hizLevels == 0)
+	{
+		return false;
+	}
+
+	// Screen rectangle and nearest depth of the bounding box with last frame's camera
+	vec3 ndcMin = vec3(1.0);
+	vec3 ndcMax = vec3(-1.0);
+	for (int i = 0; i < 8; ++i)
+	{
+		vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = hizViewProjection * vec4(corner, 1.0);
+		if (clip.w <= 0.0)
+		{
+			// Crosses the near plane
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		ndcMin = min(ndcMin, ndc);
+		ndcMax = max(ndcMax, ndc);
+	}
+
+	vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+	vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+	float nearest = ndcMin.z * 0.5 + 0.5;
+
+	// Level where the rectangle covers at most 2x2 texels
+	vec2 size = (uvMax - uvMin) * hizSize;
+	float level = clamp(ceil(log2(max(max(size.x, size.y), 1.0))), 0.0, float(hizLevels - 1));
+	float farthest = max(
+		max(textureLod(hizTexture, uvMin, level).r, textureLod(hizTexture, vec2(uvMax.x, uvMin.y), level).r),
+		max(textureLod(hizTexture, vec2(uvMin.x, uvMax.y), level).r, textureLod(hizTexture, uvMax, level).r));
+	return nearest > farthest;
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= uint(instanceCount))
+	{
+		return;
+	}
+
+	Instance instance = instances[index];
+	vec3 center = (instance.model * vec4(instance.sphere.xyz, 1.0)).xyz;
+	float scale = max(max(length(instance.model[0].xyz), length(instance.model[1].xyz)), length(instance.model[2].xyz));
+	float radius = instance.sphere.w * scale;
+
+	for (int i = 0; i < 6; ++i)
+	{
+		if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius)
+		{
+			return;
+		}
+	}
+	if (IsOccluded(center, radius))
+	{
+		return;
+	}
+
+	uint slot = instance.bucketFirst + atomicAdd(counters[instance.bucket], 1u);
+	commands[slot] = Command(instance.indexCount, 1u, instance.firstIndex, instance.baseVertex, slot);
+	transforms[slot] = instance.model;
+}
+)";
+
+static const char* kDownsampleShader = R"(
+#version 430
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform int sourceLevel; // -1 copies from the depth texture
+uniform ivec2 sourceSize;
+uniform sampler2D depthTexture;
+layout(r32f) readonly uniform image2D sourceImage;
+layout(r32f) writeonly uniform image2D destImage;
+
+void main()
+{
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 destSize = imageSize(destImage);
+	if (p.x >= destSize.x || p.y >= destSize.y)
+	{
+		return;
+	}
+
+	if (sourceLevel < 0)
+	{
+		imageStore(destImage, p, vec4(texelFetch(depthTexture, p, 0).r));
+		return;
+	}
+
+	// Odd sizes fold the last row and column into the last texel so nothing is missed
+	ivec2 extra = ivec2(
+		((sourceSize.x & 1) != 0 && p.x == destSize.x - 1) ? 2 : 1,
+		((sourceSize.y & 1) != 0 && p.y == destSize.y - 1) ? 2 : 1);
+	float farthest = 0.0;
+	for (int y = 0; y <= extra.y; ++y)
+	{
+		for (int x = 0; x <= extra.x; ++x)
+		{
+			ivec2 s = min(p * 2 + ivec2(x, y), sourceSize - 1);
+			farthest = max(farthest, imageLoad(sourceImage, s).r);
+		}
+	}
+	imageStore(destImage, p, vec4(farthest));
+}
+)";
+
+GpuCulling::GpuCulling(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_CullProgram(0),
+	m_DownsampleProgram(0),
+	m_DepthTexture(0),
+	m_HiZTexture(0),
+	m_vDepthSize(0),
+	m_vHiZSize(0),
+	m_iHiZLevels(0),
+	m_mHiZViewProjection(1.0f),
+	m_bHiZValid(false),
+	m_bOcclusionEnabled(true)
+{
+}
+
+GpuCulling::~GpuCulling()
+{
+	Release();
+}
+
+bool GpuCulling::Create()
+{
+	Release();
+	if (!IsSupported())
+	{
+		return false;
+	}
+
+	m_CullProgram = m_Renderer.CreateComputeProgram(kCullShader);
+	m_DownsampleProgram = m_Renderer.CreateComputeProgram(kDownsampleShader);
+	if (!m_CullProgram || !m_DownsampleProgram)
+	{
+		Release();
+		return false;
+	}
+	return true;
+}
+
+void GpuCulling::Release()
+{
+	if (m_CullProgram)
+	{
+		m_Renderer.ReleaseProgram(m_CullProgram);
+		m_CullProgram = 0;
+	}
+	if (m_DownsampleProgram)
+	{
+		m_Renderer.ReleaseProgram(m_DownsampleProgram);
+		m_DownsampleProgram = 0;
+	}
+	if (m_DepthTexture)
+	{
+		glDeleteTextures(1, &m_DepthTexture);
+		m_DepthTexture = 0;
+		m_vDepthSize = glm::ivec2(0);
+	}
+	if (m_HiZTexture)
+	{
+		glDeleteTextures(1, &m_HiZTexture);
+		m_HiZTexture = 0;
+		m_vHiZSize = glm::ivec2(0);
+		m_iHiZLevels = 0;
+	}
+	m_bHiZValid = false;
+}
+
+void GpuCulling::UpdateHiZ(GLuint depthTexture, int32_t width, int32_t height)
+{
+	if (!m_DownsampleProgram || width <= 0 || height <= 0 || !CreatePyramid(width, height))
+	{
+		m_bHiZValid = false;
+		return;
+	}
+
+	glUseProgram(m_DownsampleProgram);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	OpenGLRenderer::SetUniformInt(m_DownsampleProgram, "depthTexture", 0);
+
+	glm::ivec2 size(width, height);
+	for (int32_t level = 0; level < m_iHiZLevels; ++level)
+	{
+		const glm::ivec2 destSize(std::max(width >> level, 1), std::max(height >> level, 1));
+		OpenGLRenderer::SetUniformInt(m_DownsampleProgram, "sourceLevel", level - 1);
+		glUniform2iv(glGetUniformLocation(m_DownsampleProgram, "sourceSize"), 1, &size.x);
+
+		if (level > 0)
+		{
+			glBindImageTexture(0, m_HiZTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			OpenGLRenderer::SetUniformInt(m_DownsampleProgram, "sourceImage", 0);
+		}
+		glBindImageTexture(1, m_HiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		OpenGLRenderer::SetUniformInt(m_DownsampleProgram, "destImage", 1);
+
+		glDispatchCompute((destSize.x + kDownsampleGroupSize - 1) / kDownsampleGroupSize, (destSize.y + kDownsampleGroupSize - 1) / kDownsampleGroupSize, 1);
+		// Next level reads what this one wrote
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		size = destSize;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+
+	m_mHiZViewProjection = m_Renderer.GetProjectionMatrix() * m_Renderer.GetViewMatrix();
+	m_bHiZValid = true;
+}
+
+void GpuCulling::UpdateHiZFromFramebuffer(int32_t width, int32_t height)
+{
+	if (!m_DownsampleProgram || width <= 0 || height <= 0)
+	{
+		return;
+	}
+
+	if (!m_DepthTexture || m_vDepthSize != glm::ivec2(width, height))
+	{
+		if (!m_DepthTexture)
+		{
+			glGenTextures(1, &m_DepthTexture);
+		}
+		glBindTexture(GL_TEXTURE_2D, m_DepthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		m_vDepthSize = glm::ivec2(width, height);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, m_DepthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	UpdateHiZ(m_DepthTexture, width, height);
+}
+
+void GpuCulling::Cull(GLuint instanceBuffer, size_t instanceCount, GLuint commandBuffer, GLuint transformBuffer, GLuint counterBuffer)
+{
+	if (!m_CullProgram || !instanceCount)
+	{
+		return;
+	}
+
+	glUseProgram(m_CullProgram);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, transformBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer);
+
+	// Frustum planes from the rows of the view-projection matrix, pointing inwards
+	const glm::mat4 viewProjection = m_Renderer.GetProjectionMatrix() * m_Renderer.GetViewMatrix();
+	const glm::mat4 m = glm::transpose(viewProjection);
+	glm::vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+	for (auto& plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	glUniform4fv(glGetUniformLocation(m_CullProgram, "frustumPlanes"), 6, &planes[0].x);
+	OpenGLRenderer::SetUniformInt(m_CullProgram, "instanceCount", (int32_t)instanceCount);
+
+	const bool occlusion = m_bOcclusionEnabled && m_bHiZValid;
+	OpenGLRenderer::SetUniformInt(m_CullProgram, "hizLevels", occlusion ? m_iHiZLevels : 0);
+	if (occlusion)
+	{
+		OpenGLRenderer::SetUniformMatrix4(m_CullProgram, "hizViewProjection", m_mHiZViewProjection);
+		OpenGLRenderer::SetUniformVec2(m_CullProgram, "hizSize", glm::vec2(m_vHiZSize));
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, m_HiZTexture);
+		OpenGLRenderer::SetUniformInt(m_CullProgram, "hizTexture", 0);
+	}
+
+	glDispatchCompute(((GLuint)instanceCount + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+	// Commands are read by indirect draws, transforms by vertex shaders
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
+
+bool GpuCulling::IsSupported()
+{
+	return glDispatchCompute && glMemoryBarrier && glBindImageTexture && glBindBufferBase;
+}
+
+bool GpuCulling::CreatePyramid(int32_t width, int32_t height)
+{
+	if (m_HiZTexture && m_vHiZSize == glm::ivec2(width, height))
+	{
+		return true;
+	}
+
+	if (!m_HiZTexture)
+	{
+		glGenTextures(1, &m_HiZTexture);
+	}
+
+	m_iHiZLevels = 1;
+	while ((std::max(width, height) >> m_iHiZLevels) > 0)
+	{
+		++m_iHiZLevels;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, m_HiZTexture);
+	for (int32_t level = 0; level < m_iHiZLevels; ++level)
+	{
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(width >> level, 1), std::max(height >> level, 1), 0, GL_RED, GL_FLOAT, nullptr);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_iHiZLevels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_vHiZSize = glm::ivec2(width, height);
+	return true;
+}
@@ -0,0 +1,83 @@
+#include "../include/GpuTimer.h"
+
+GpuTimer::GpuTimer() :
+	m_arrQueries{},
+	m_arrPending{},
+	m_uCurrent(0),
+	m_uOldest(0),
+	m_fElapsedSeconds(0.0f)
+{
+}
+
+GpuTimer::~GpuTimer()
+{
+	if (m_arrQueries[0][0])
+	{
+		glDeleteQueries(kQueryCount * 2, &m_arrQueries[0][0]);
+	}
+}
+
+void GpuTimer::Begin()
+{
+	if (!IsSupported())
+	{
+		return;
+	}
+	if (!m_arrQueries[0][0])
+	{
+		glGenQueries(kQueryCount * 2, &m_arrQueries[0][0]);
+	}
+
+	// Read finished results, and wait only when every query is still in flight
+	Collect(false);
+	if (m_arrPending[m_uCurrent])
+	{
+		Collect(true);
+	}
+	glQueryCounter(m_arrQueries[m_uCurrent][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::End()
+{
+	if (!m_arrQueries[0][0])
+	{
+		return;
+	}
+
+	glQueryCounter(m_arrQueries[m_uCurrent][1], GL_TIMESTAMP);
+	m_arrPending[m_uCurrent] = true;
+	m_uCurrent = (m_uCurrent + 1) % kQueryCount;
+}
+
+bool GpuTimer::IsSupported()
+{
+	return glGenQueries && glQueryCounter && glGetQueryObjectiv && glGetQueryObjectui64v;
+}
+
+void GpuTimer::Collect(bool wait)
+{
+	while (m_arrPending[m_uOldest])
+	{
+		if (!wait)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(m_arrQueries[m_uOldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+			{
+				return;
+			}
+		}
+
+		GLuint64 start = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(m_arrQueries[m_uOldest][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(m_arrQueries[m_uOldest][1], GL_QUERY_RESULT, &end);
+		m_fElapsedSeconds = (float)((double)(end - start) * 1e-9);
+		m_arrPending[m_uOldest] = false;
+		m_uOldest = (m_uOldest + 1) % kQueryCount;
+		if (wait)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,178 @@
+#include "../include/IApplication.h"
+
+// Include all your renderers
+#include "../include/OpenGLRenderer.h"
+#include "../include/RenderThread.h"
+#include "../include/FramePacer.h"
+#include "../include/InputRecording.h"
+
+#include <algorithm>
+#include <cmath>
+
+void IApplication::SetFixedTimestep(float stepSeconds, uint32_t maxSteps)
+{
+	m_fFixedStep = std::max(stepSeconds, 0.0f);
+	m_uMaxSteps = std::max(maxSteps, 1u);
+	m_fAccumulator = 0.0f;
+	m_fInterpolation = 1.0f;
+}
+
+bool IApplication::StartInputRecording(const std::string_view& filename)
+{
+	m_pInputRecorder = std::make_unique<InputRecorder>();
+	if (!m_pInputRecorder->Open(filename))
+	{
+		m_pInputRecorder = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool IApplication::StartInputReplay(const std::string_view& filename, float fixedFrameTime, const std::string_view& timingFilename)
+{
+	m_pInputReplay = std::make_unique<InputReplay>();
+	if (!m_pInputReplay->Open(filename, fixedFrameTime))
+	{
+		m_pInputReplay = nullptr;
+		return false;
+	}
+	m_strReplayTimings = timingFilename;
+	return true;
+}
+
+void IApplication::DispatchInput(const InputEvent& event)
+{
+	// The recording drives the app during a replay
+	if (m_pInputReplay)
+	{
+		return;
+	}
+
+	if (m_pInputRecorder)
+	{
+		m_pInputRecorder->AddEvent(event);
+	}
+	HandleInput(event);
+}
+
+void IApplication::HandleInput(const InputEvent& event)
+{
+	switch (event.eType)
+	{
+	case InputEvent::Type::MouseBegin:
+		OnMouseBegin(event.iButton, event.vPoint);
+		break;
+
+	case InputEvent::Type::MouseEnd:
+		OnMouseEnd(event.iButton, event.vPoint);
+		break;
+
+	case InputEvent::Type::MouseDrag:
+		OnMouseDrag(event.iButton, event.vPoint);
+		break;
+
+	case InputEvent::Type::KeyDown:
+		OnKeyDown(event.uKey);
+		break;
+
+	default:
+		break;
+	}
+}
+
+bool IApplication::ReplayFrame(float& frametime)
+{
+	if (!m_pInputReplay->ReadFrame(m_Timer.GetElapsedSeconds(), frametime))
+	{
+		const InputReplayStats stats = m_pInputReplay->GetStats();
+		Debug("IApplication: replay finished, " + std::to_string(stats.uFrames) + " frames, mean " +
+			std::to_string(stats.fMeanSeconds * 1000.0f) + " ms, p95 " + std::to_string(stats.fP95Seconds * 1000.0f) +
+			" ms, p99 " + std::to_string(stats.fP99Seconds * 1000.0f) + " ms\n");
+		if (!m_strReplayTimings.empty())
+		{
+			m_pInputReplay->WriteTimings(m_strReplayTimings);
+		}
+		m_pInputReplay = nullptr;
+		Close();
+		return false;
+	}
+
+	for (const auto& event : m_pInputReplay->GetEvents())
+	{
+		m_pInputReplay->TrackKeys(event);
+		HandleInput(event);
+	}
+	return true;
+}
+
+void IApplication::PaceFrame()
+{
+	// Input is read right after this, so the latency fence wait happens before sampling it.
+	// A replay runs at full rate even when the window is not focused.
+	m_pFramePacer->WaitForFrame(m_bActive || m_pInputReplay, !m_pRenderThread);
+}
+
+void IApplication::RunFrame()
+{
+	float frametime = m_Timer.GetElapsedSeconds();
+	if (m_pInputReplay && !ReplayFrame(frametime))
+	{
+		return;
+	}
+	if (m_pInputRecorder)
+	{
+		m_pInputRecorder->WriteFrame(frametime);
+	}
+
+	if (m_fFixedStep > 0.0f)
+	{
+		// Simulate in fixed steps, leftover time is carried to the next frame
+		m_fAccumulator += frametime;
+		uint32_t steps = 0;
+		while (m_fAccumulator >= m_fFixedStep && steps < m_uMaxSteps)
+		{
+			OnUpdate(m_fFixedStep);
+			m_fAccumulator -= m_fFixedStep;
+			++steps;
+		}
+
+		// Too slow to catch up, drop the time rather than taking more steps next frame
+		if (m_fAccumulator >= m_fFixedStep)
+		{
+			m_fAccumulator = std::fmod(m_fAccumulator, m_fFixedStep);
+		}
+		m_fInterpolation = m_fAccumulator / m_fFixedStep;
+	}
+	else
+	{
+		OnUpdate(frametime);
+		m_fInterpolation = 1.0f;
+	}
+
+	if (m_pRenderThread)
+	{
+		// Render thread draws the previous packet while this one is built
+		FramePacket& packet = m_pRenderThread->BeginFrame();
+		packet.fFrameTime = frametime;
+		packet.fInterpolation = m_fInterpolation;
+		OnBuildFrame(packet);
+		m_pRenderThread->SubmitFrame();
+
+		// An empty packet every frame would only show the clear color
+		if (m_bBuildFrameMissing)
+		{
+			Debug("IApplication: OnBuildFrame is not implemented, stopping the render thread and drawing with OnDraw\n");
+			m_pRenderThread->Stop();
+			m_pRenderThread = nullptr;
+			m_bThreaded = false;
+		}
+	}
+	else
+	{
+		m_pFramePacer->ApplySwapInterval(*m_pRenderer);
+		m_pRenderer->SetInterpolation(m_fInterpolation);
+		OnDraw(*m_pRenderer); // Use reference of renderer so the parameter will not be null
+		m_pRenderer->Flip(); // Display graphics that are produced inside OnDraw
+		m_pFramePacer->EndFrame();
+	}
+}
@@ -2,6 +2,11 @@
 
 // Include all your renderers
 #include "../include/OpenGLRenderer.h"
+#include "../include/RenderThread.h"
+#include "../include/FramePacer.h"
+#include "../include/JobPool.h"
+#include "../include/Logger.h"
+#include "../include/InputRecording.h"
 
 #include <X11/Xlib.h>
 #include <X11/Xos.h>
@@ -11,6 +16,8 @@
 #include <X11/Xatom.h>
 #include <X11/keysym.h>
 
+#include <poll.h>
+
 
 #if defined (_LINUX)
 
@@ -21,17 +28,37 @@ int                      IApplication::m_iScreen;
 Window                   IApplication::m_Window;
 XSetWindowAttributes     IApplication::m_WindowAttributes;
 Atom                     IApplication::m_CloseAtom;
-uint8_t                  IApplication::m_uKeyboard[65536];
+std::atomic<uint64_t>    IApplication::m_arrKeyboard[65536 / 64];
+
+// Longest time the input thread blocks before checking for quit, in milliseconds
+constexpr int kInputPollTimeout = 50;
 
 
 IApplication::IApplication() :
-    m_bActive(false)
+    m_PendingMotion({}),
+    m_bPendingMotion(false),
+    m_bInputQuit(false),
+    m_bActive(false),
+    m_pJobPool(std::make_unique<JobPool>(JobPool::GetDefaultThreadCount())),
+    m_bThreaded(false),
+    m_bBuildFrameMissing(false),
+    m_bInputThread(false),
+    m_pFramePacer(std::make_unique<FramePacer>()),
+    m_fFixedStep(0.0f),
+    m_uMaxSteps(5),
+    m_fAccumulator(0.0f),
+    m_fInterpolation(1.0f)
 {
 	m_pApp = this;
 
+    // Render thread swaps buffers while the main thread reads events
+    XInitThreads();
     m_pDisplay = XOpenDisplay(NULL);
     m_iScreen = DefaultScreen(m_pDisplay);
-	memset(m_uKeyboard, 0, 65536);
+	for (auto& keys : m_arrKeyboard)
+	{
+		keys.store(0, std::memory_order_relaxed);
+	}
 }
 
 
@@ -41,7 +68,7 @@ IApplication::~IApplication()
 }
 
 
-bool IApplication::Create(int resX, int resY, const std::string& title)
+bool IApplication::Create(int resX, int resY, const std::string& title, ShadingPath shadingPath)
 {
 	m_Window = MakeWindow(resX, resY, title.c_str());
 	if (m_Window)
@@ -50,7 +77,7 @@ bool IApplication::Create(int resX, int resY, const std::string& title)
 		m_iHeight = resY;
 
 		// create the renderer
-        m_pRenderer = std::make_unique<OpenGLRenderer>();
+        m_pRenderer = std::make_unique<OpenGLRenderer>(shadingPath);
 		if (!m_pRenderer->Create())
 		{
 			return false;
@@ -74,120 +101,178 @@ bool IApplication::Create(int resX, int resY, const std::string& title)
 }
 
 
-bool IApplication::ProcessEvents(XEvent* evnt)
+void IApplication::ReadEvents()
+{
+    XEvent event;
+    while (XPending(m_pDisplay))
+    {
+        XNextEvent(m_pDisplay, &event);
+        TranslateEvent(&event, Timer::GetTicks());
+    }
+    FlushMotion();
+}
+
+
+void IApplication::TranslateEvent(XEvent* evnt, uint64_t timestamp)
 {
-    IApplication* pApp = IApplication::GetApp();
-    if (!m_Window || !pApp)
+    // Only the latest of consecutive motion events matters, reported for the first mouse button
+    if (evnt->type == MotionNotify)
     {
-        return false;
+        m_PendingMotion = { InputEvent::Type::MouseDrag, 0, 0, glm::vec2(evnt->xmotion.x, evnt->xmotion.y), timestamp };
+        m_bPendingMotion = true;
+        return;
     }
+    FlushMotion();
 
+    InputEvent input = {};
+    input.uTimestamp = timestamp;
     switch (evnt->type)
     {
     case ClientMessage:
-        if (m_CloseAtom && (long unsigned int)evnt->xclient.data.l[0] == m_CloseAtom)
+        if (!m_CloseAtom || (long unsigned int)evnt->xclient.data.l[0] != m_CloseAtom)
         {
-            m_Window = 0;
+            return;
         }
+        input.eType = InputEvent::Type::Close;
         break;
 
     case ButtonPress:
         if (evnt->xbutton.button == 4 || evnt->xbutton.button == 5)
         {
             // Mouse wheel event
+            return;
         }
-        else
-        {
-            // Mouse button event
-            const int touchIndex = evnt->xbutton.button - 1;
-       		pApp->OnMouseBegin(touchIndex, glm::vec2(evnt->xbutton.x, evnt->xbutton.y));
-        }
+        // Mouse button event
+        input.eType = InputEvent::Type::MouseBegin;
+        input.iButton = evnt->xbutton.button - 1;
+        input.vPoint = glm::vec2(evnt->xbutton.x, evnt->xbutton.y);
         break;
 
     case ButtonRelease:
-        if (evnt->xbutton.button < 4)
+        if (evnt->xbutton.button >= 4)
         {
-            const int touchIndex = evnt->xbutton.button - 1;
-       		pApp->OnMouseEnd(touchIndex, glm::vec2(evnt->xbutton.x, evnt->xbutton.y));
+            return;
         }
-        break;
-
-    case MotionNotify:
-        // First mouse button that is held down
-        pApp->OnMouseDrag(0, glm::vec2(evnt->xbutton.x, evnt->xbutton.y));
+        input.eType = InputEvent::Type::MouseEnd;
+        input.iButton = evnt->xbutton.button - 1;
+        input.vPoint = glm::vec2(evnt->xbutton.x, evnt->xbutton.y);
         break;
 
     case KeyPress:
-        {
-            KeySym xkey = PreprocessKeyEvent(evnt);
-           	m_uKeyboard[xkey & 0xffff] = 1;
-
-            pApp->OnKeyDown((uint32_t)xkey);
-        }
+        input.eType = InputEvent::Type::KeyDown;
+        input.uKey = (uint32_t)PreprocessKeyEvent(evnt);
+        // Key state is current as soon as the event is read, before it is dispatched
+        SetKeyDown(input.uKey, true);
         break;
 
     case KeyRelease:
-        {
-            KeySym xkey = PreprocessKeyEvent(evnt);
-           	m_uKeyboard[xkey & 0xffff] = 0;
-        }
+        input.eType = InputEvent::Type::KeyUp;
+        input.uKey = (uint32_t)PreprocessKeyEvent(evnt);
+        SetKeyDown(input.uKey, false);
         break;
 
     case FocusIn:
-        pApp->SetActive(true);
+        input.eType = InputEvent::Type::Activate;
         break;
 
     case FocusOut:
-        pApp->SetActive(false);
+        input.eType = InputEvent::Type::Deactivate;
         break;
 
-    case Expose:
+    case ConfigureNotify:
+        input.eType = InputEvent::Type::Resize;
+        input.vPoint = glm::vec2(evnt->xconfigure.width, evnt->xconfigure.height);
         break;
 
-    case ResizeRequest:
-        break;
+    default:
+        return;
+    }
+
+    m_InputQueue.Push(input);
+}
+
+
+void IApplication::FlushMotion()
+{
+    if (m_bPendingMotion)
+    {
+        m_InputQueue.Push(m_PendingMotion);
+        m_bPendingMotion = false;
+    }
+}
 
-    case VisibilityNotify:
+
+void IApplication::InputThreadMain()
+{
+    pollfd connection = { ConnectionNumber(m_pDisplay), POLLIN, 0 };
+    while (!m_bInputQuit.load(std::memory_order_relaxed))
     {
-        XVisibilityEvent* visibility = (XVisibilityEvent*)evnt;
-        switch (visibility->state)
+        // XPending also reads events the connection has already buffered
+        if (!XPending(m_pDisplay))
         {
-        case VisibilityFullyObscured:
+            poll(&connection, 1, kInputPollTimeout);
+        }
+        ReadEvents();
+    }
+}
+
+
+void IApplication::DispatchEvents()
+{
+    InputEvent input;
+    while (m_InputQueue.Pop(input))
+    {
+        switch (input.eType)
+        {
+        case InputEvent::Type::Close:
+            m_Window = 0;
             break;
 
-        case VisibilityPartiallyObscured:
+        case InputEvent::Type::MouseBegin:
+        case InputEvent::Type::MouseEnd:
+        case InputEvent::Type::MouseDrag:
+        case InputEvent::Type::KeyDown:
+        case InputEvent::Type::KeyUp:
+            DispatchInput(input);
             break;
 
-        case VisibilityUnobscured:
+        case InputEvent::Type::Activate:
+            SetActive(true);
             break;
 
-        default:
+        case InputEvent::Type::Deactivate:
+            SetActive(false);
             break;
-        }
-    }
-    break;
 
-    case ConfigureNotify:
-        if (evnt->xconfigure.width != pApp->m_iWidth || evnt->xconfigure.height != pApp->m_iHeight)
-        {
-            pApp->m_iWidth = evnt->xconfigure.width;
-            pApp->m_iHeight = evnt->xconfigure.height;
-            pApp->m_pRenderer->SetViewport(0, 0, pApp->m_iWidth, pApp->m_iHeight);
-            pApp->OnScreenSizeChanged(pApp->m_iWidth, pApp->m_iHeight);
+        case InputEvent::Type::Resize:
+            if ((int32_t)input.vPoint.x != m_iWidth || (int32_t)input.vPoint.y != m_iHeight)
+            {
+                m_iWidth = (int32_t)input.vPoint.x;
+                m_iHeight = (int32_t)input.vPoint.y;
+                if (!m_pRenderThread)
+                {
+                    m_pRenderer->SetViewport(glm::ivec4(0, 0, m_iWidth, m_iHeight));
+                }
+                OnScreenSizeChanged(m_iWidth, m_iHeight);
+            }
+            break;
         }
-        break;
-
-    case GraphicsExpose:
-        break;
+    }
+}
 
-    case NoExpose:
-        break;
 
-    default:
-        break;
+void IApplication::SetKeyDown(uint32_t osKeyCode, bool down)
+{
+    const uint32_t key = osKeyCode & 0xffff;
+    const uint64_t bit = 1ull << (key & 63);
+    if (down)
+    {
+        m_arrKeyboard[key >> 6].fetch_or(bit, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_arrKeyboard[key >> 6].fetch_and(~bit, std::memory_order_relaxed);
     }
-
-    return true;
 }
 
 
@@ -213,7 +298,10 @@ KeySym IApplication::PreprocessKeyEvent(XEvent* evnt)
 void IApplication::SetActive(bool set)
 {
 	m_bActive = set;
-	memset(m_uKeyboard, 0, 65536);
+	for (auto& keys : m_arrKeyboard)
+	{
+		keys.store(0, std::memory_order_relaxed);
+	}
 
 	m_Timer.BeginTimer();
 }
@@ -228,32 +316,51 @@ void IApplication::Close()
 void IApplication::Run()
 {
     // Run the application
-    XEvent event;
-    bool bGotMsg = false;
-
-    while (m_Window)
+    if (m_bThreaded)
     {
-        bGotMsg = false;
-        if (XPending(m_pDisplay))
+        m_pRenderThread = std::make_unique<RenderThread>(*this, *m_pRenderer);
+        if (!m_pRenderThread->Start())
         {
-            XNextEvent(m_pDisplay, &event);
-            bGotMsg = true;
+            m_pRenderThread = nullptr;
         }
+    }
+
+    if (m_bInputThread)
+    {
+        m_bInputQuit = false;
+        m_InputThread = std::thread(&IApplication::InputThreadMain, this);
+    }
 
-        if (bGotMsg)
+    while (m_Window)
+    {
+        PaceFrame();
+
+        // Handle all events received since the previous frame in one batch
+        if (!m_InputThread.joinable())
         {
-            ProcessEvents(&event);
+            ReadEvents();
         }
-        else
+        DispatchEvents();
+        if (!m_Window)
         {
-			m_Timer.EndTimer();
-			m_Timer.BeginTimer();
-
-			OnUpdate(m_Timer.GetElapsedSeconds());
-			OnDraw(*m_pRenderer);
-			m_pRenderer->Flip();
+            break;
         }
+
+        m_Timer.EndTimer();
+        m_Timer.BeginTimer();
+
+        RunFrame();
     }
+
+    if (m_InputThread.joinable())
+    {
+        m_bInputQuit = true;
+        m_InputThread.join();
+    }
+
+	// Take the context back so that OnDestroy can release resources
+	m_pRenderThread = nullptr;
+	m_pFramePacer->Release();
 	OnDestroy();
     m_pRenderer = nullptr;
 }
@@ -318,19 +425,25 @@ Window IApplication::MakeWindow(int width, int height, const char* title)
 
 void IApplication::Debug(const wchar_t* msg)
 {
-    fwprintf(stderr, L"%s", msg);
+    // Logger works with narrow strings, characters outside ASCII are replaced
+    std::string text;
+    for (const wchar_t* c = msg; *c; ++c)
+    {
+        text += *c < 128 ? (char)*c : '?';
+    }
+    Logger::Info("%s", text);
 }
 
 
 void IApplication::Debug(const std::string& msg)
 {
-    fprintf(stderr, "%s", msg.c_str());
+    Logger::Info("%s", msg);
 }
 
 
 void IApplication::Debug(const char* msg)
 {
-    fprintf(stderr, "%s", msg);
+    Logger::Info("%s", msg);
 }
 
 
@@ -343,7 +456,13 @@ void IApplication::RandSeed()
 
 bool IApplication::IsKeyDown(uint32_t osKeyCode)
 {
-    return m_uKeyboard[osKeyCode & 0xffff];
+    if (m_pApp && m_pApp->m_pInputReplay)
+    {
+        return m_pApp->m_pInputReplay->IsKeyDown(osKeyCode);
+    }
+
+    const uint32_t key = osKeyCode & 0xffff;
+    return (m_arrKeyboard[key >> 6].load(std::memory_order_relaxed) >> (key & 63)) & 1;
 }
 
 #endif	// #if defined (_LINUX)
@@ -2,6 +2,11 @@
 
 // Include all your renderers
 #include "../include/OpenGLRenderer.h"
+#include "../include/RenderThread.h"
+#include "../include/FramePacer.h"
+#include "../include/JobPool.h"
+#include "../include/Logger.h"
+#include "../include/InputRecording.h"
 
 #if defined (_WIN32)
 
@@ -13,7 +18,16 @@ IApplication::IApplication() :
 	m_Window(nullptr),
 	m_bActive(false),
 	m_iWidth(0),
-	m_iHeight(0)
+	m_iHeight(0),
+	m_pJobPool(std::make_unique<JobPool>(JobPool::GetDefaultThreadCount())),
+	m_bThreaded(false),
+	m_bBuildFrameMissing(false),
+	m_bInputThread(false),
+	m_pFramePacer(std::make_unique<FramePacer>()),
+	m_fFixedStep(0.0f),
+	m_uMaxSteps(5),
+	m_fAccumulator(0.0f),
+	m_fInterpolation(1.0f)
 {
 	m_pApp = this;
 }
@@ -23,7 +37,7 @@ IApplication::~IApplication()
 	m_pApp = nullptr;
 }
 
-bool IApplication::Create(int32_t resX, int32_t resY, const std::string& title)
+bool IApplication::Create(int32_t resX, int32_t resY, const std::string& title, ShadingPath shadingPath)
 {
 	m_Window = MakeWindow(resX, resY, title);
 	if (m_Window)
@@ -32,7 +46,7 @@ bool IApplication::Create(int32_t resX, int32_t resY, const std::string& title)
 		m_iHeight = resY;
 
 		// Create the renderer
-		m_pRenderer = std::make_unique<OpenGLRenderer>();
+		m_pRenderer = std::make_unique<OpenGLRenderer>(shadingPath);
 		// Don't start the app if something went wrong in the graphics initialization
 		if (!m_pRenderer->Create())
 		{
@@ -65,9 +79,20 @@ void IApplication::Run()
 	// Check if Windows has messages for window and copy the newest one
 	::PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
 
+	if (m_bThreaded)
+	{
+		m_pRenderThread = std::make_unique<RenderThread>(*this, *m_pRenderer);
+		if (!m_pRenderThread->Start())
+		{
+			m_pRenderThread = nullptr;
+		}
+	}
+
 	while (msg.message != WM_QUIT)
 	{
-		if (IsActive())
+		PaceFrame();
+
+		if (IsActive() || m_pInputReplay)
 		{
 			// App is active, use PeekMessage not to block the execution
 			// while receiving messages from Windows
@@ -93,12 +118,13 @@ void IApplication::Run()
 			m_Timer.EndTimer();
 			m_Timer.BeginTimer();
 
-			OnUpdate(m_Timer.GetElapsedSeconds());
-			OnDraw(*m_pRenderer); // Use reference of renderer so the parameter will not be null
-			m_pRenderer->Flip(); // Display graphics that are produced inside OnDraw
+			RunFrame();
 		}
 	}
 
+	// Take the context back so that OnDestroy can release resources
+	m_pRenderThread = nullptr;
+	m_pFramePacer->Release();
 	OnDestroy();
 	m_pRenderer = nullptr;
 }
@@ -123,28 +149,37 @@ void IApplication::RandSeed()
 
 bool IApplication::IsKeyDown(uint32_t osKeyCode)
 {
+	if (m_pApp && m_pApp->m_pInputReplay)
+	{
+		return m_pApp->m_pInputReplay->IsKeyDown(osKeyCode);
+	}
+
 	// Check if a key is being pressed
 	return ::GetAsyncKeyState(osKeyCode);
 }
 
 void IApplication::Debug(const wchar_t* msg)
 {
-	// Output white debug message
-	::OutputDebugStringW(msg);
+	// Convert to UTF-8 for the logger
+	const int size = ::WideCharToMultiByte(CP_UTF8, 0, msg, -1, nullptr, 0, nullptr, nullptr);
+	std::string text(size > 0 ? size - 1 : 0, '\0');
+	if (size > 1)
+	{
+		::WideCharToMultiByte(CP_UTF8, 0, msg, -1, text.data(), size, nullptr, nullptr);
+	}
+	Logger::Info("%s", text);
 }
 
 
 void IApplication::Debug(const std::string& msg)
 {
-	// Output debug message as raw string data
-	::OutputDebugStringA(msg.c_str());
+	Logger::Info("%s", msg);
 }
 
 
 void IApplication::Debug(const char* msg)
 {
-	// Output ANSI version of debug message
-	::OutputDebugStringA(msg);
+	Logger::Info("%s", msg);
 }
 
 bool IApplication::OnEvent(UINT message, WPARAM wParam, LPARAM lParam)
@@ -180,26 +215,29 @@ bool IApplication::OnEvent(UINT message, WPARAM wParam, LPARAM lParam)
 		break;
 
 	case WM_KEYDOWN:
-		OnKeyDown((uint32_t)wParam);
+		DispatchInput({ InputEvent::Type::KeyDown, 0, (uint32_t)wParam, glm::vec2(0.0f), Timer::GetTicks() });
+		break;
+	case WM_KEYUP:
+		DispatchInput({ InputEvent::Type::KeyUp, 0, (uint32_t)wParam, glm::vec2(0.0f), Timer::GetTicks() });
 		break;
 
 	case WM_LBUTTONDOWN:
-		OnMouseBegin(0, glm::vec2(LOWORD(lParam), HIWORD(lParam)));
+		DispatchInput({ InputEvent::Type::MouseBegin, 0, 0, glm::vec2(LOWORD(lParam), HIWORD(lParam)), Timer::GetTicks() });
 		break;
 	case WM_MBUTTONDOWN:
-		OnMouseBegin(1, glm::vec2(LOWORD(lParam), HIWORD(lParam)));
+		DispatchInput({ InputEvent::Type::MouseBegin, 1, 0, glm::vec2(LOWORD(lParam), HIWORD(lParam)), Timer::GetTicks() });
 		break;
 	case WM_RBUTTONDOWN:
-		OnMouseBegin(2, glm::vec2(LOWORD(lParam), HIWORD(lParam)));
+		DispatchInput({ InputEvent::Type::MouseBegin, 2, 0, glm::vec2(LOWORD(lParam), HIWORD(lParam)), Timer::GetTicks() });
 		break;
 	case WM_LBUTTONUP:
-		OnMouseEnd(0, glm::vec2(LOWORD(lParam), HIWORD(lParam)));
+		DispatchInput({ InputEvent::Type::MouseEnd, 0, 0, glm::vec2(LOWORD(lParam), HIWORD(lParam)), Timer::GetTicks() });
 		break;
 	case WM_MBUTTONUP:
-		OnMouseEnd(1, glm::vec2(LOWORD(lParam), HIWORD(lParam)));
+		DispatchInput({ InputEvent::Type::MouseEnd, 1, 0, glm::vec2(LOWORD(lParam), HIWORD(lParam)), Timer::GetTicks() });
 		break;
 	case WM_RBUTTONUP:
-		OnMouseEnd(2, glm::vec2(LOWORD(lParam), HIWORD(lParam)));
+		DispatchInput({ InputEvent::Type::MouseEnd, 2, 0, glm::vec2(LOWORD(lParam), HIWORD(lParam)), Timer::GetTicks() });
 		break;
 
 	case WM_MOUSEMOVE:
@@ -210,7 +248,7 @@ bool IApplication::OnEvent(UINT message, WPARAM wParam, LPARAM lParam)
 
 		if (pointerIndex > -1)
 		{
-			OnMouseDrag(pointerIndex, glm::vec2(LOWORD(lParam), HIWORD(lParam)));
+			DispatchInput({ InputEvent::Type::MouseDrag, pointerIndex, 0, glm::vec2(LOWORD(lParam), HIWORD(lParam)), Timer::GetTicks() });
 		}
 		break;
 
@@ -0,0 +1,36 @@
+#include "../include/InputQueue.h"
+
+InputQueue::InputQueue() :
+	m_uHead(0),
+	m_uTail(0),
+	m_uDropped(0),
+	m_arrEvents{}
+{
+}
+
+bool InputQueue::Push(const InputEvent& event)
+{
+	const uint32_t tail = m_uTail.load(std::memory_order_relaxed);
+	if (tail - m_uHead.load(std::memory_order_acquire) >= kCapacity)
+	{
+		m_uDropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	m_arrEvents[tail & (kCapacity - 1)] = event;
+	m_uTail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool InputQueue::Pop(InputEvent& event)
+{
+	const uint32_t head = m_uHead.load(std::memory_order_relaxed);
+	if (head == m_uTail.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	event = m_arrEvents[head & (kCapacity - 1)];
+	m_uHead.store(head + 1, std::memory_order_release);
+	return true;
+}
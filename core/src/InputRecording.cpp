@@ -0,0 +1,218 @@
+#include "../include/InputRecording.h"
+#include "../include/Timer.h"
+#include "../include/IApplication.h"
+
+#include <algorithm>
+#include <numeric>
+
+// File starts with the magic and the format version
+constexpr uint32_t kRecordingMagic = 0x31504e49; // "INP1"
+constexpr uint32_t kRecordingVersion = 1;
+// A frame with more events than this is taken as a corrupt log
+constexpr uint32_t kMaxFrameEvents = 65536;
+
+template<typename T>
+static void WriteValue(std::ofstream& file, const T& value)
+{
+	file.write((const char*)&value, sizeof(T));
+}
+
+template<typename T>
+static bool ReadValue(std::ifstream& file, T& value)
+{
+	return (bool)file.read((char*)&value, sizeof(T));
+}
+
+InputRecorder::InputRecorder() :
+	m_uStartTicks(0),
+	m_uTickFrequency(Timer::GetTickFrequency()),
+	m_uFrames(0)
+{
+}
+
+InputRecorder::~InputRecorder()
+{
+	if (m_File.is_open())
+	{
+		m_File.flush();
+	}
+}
+
+bool InputRecorder::Open(const std::string_view& filename)
+{
+	m_File.open(std::string(filename), std::ios::binary | std::ios::trunc);
+	if (!m_File.is_open())
+	{
+		IApplication::Debug("InputRecorder: failed to create " + std::string(filename) + "\n");
+		return false;
+	}
+
+	WriteValue(m_File, kRecordingMagic);
+	WriteValue(m_File, kRecordingVersion);
+	m_arrEvents.clear();
+	m_uStartTicks = Timer::GetTicks();
+	m_uFrames = 0;
+	return true;
+}
+
+void InputRecorder::AddEvent(const InputEvent& event)
+{
+	m_arrEvents.push_back(event);
+}
+
+void InputRecorder::WriteFrame(float frametime)
+{
+	if (!m_File.is_open())
+	{
+		return;
+	}
+
+	WriteValue(m_File, frametime);
+	WriteValue(m_File, (uint32_t)m_arrEvents.size());
+	for (const auto& event : m_arrEvents)
+	{
+		// Microseconds since the recording started
+		const uint64_t ticks = event.uTimestamp > m_uStartTicks ? event.uTimestamp - m_uStartTicks : 0;
+		const uint64_t time = ticks * 1000000 / m_uTickFrequency;
+
+		WriteValue(m_File, (uint8_t)event.eType);
+		WriteValue(m_File, (int8_t)event.iButton);
+		WriteValue(m_File, event.uKey);
+		WriteValue(m_File, event.vPoint.x);
+		WriteValue(m_File, event.vPoint.y);
+		WriteValue(m_File, time);
+	}
+	m_arrEvents.clear();
+	++m_uFrames;
+}
+
+InputReplay::InputReplay() :
+	m_fFixedFrameTime(0.0f),
+	m_uStartTicks(0),
+	m_uTickFrequency(Timer::GetTickFrequency()),
+	m_uFrames(0)
+{
+}
+
+bool InputReplay::Open(const std::string_view& filename, float fixedFrameTime)
+{
+	m_File.open(std::string(filename), std::ios::binary);
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	if (!m_File.is_open() || !ReadValue(m_File, magic) || !ReadValue(m_File, version) ||
+		magic != kRecordingMagic || version != kRecordingVersion)
+	{
+		IApplication::Debug("InputReplay: " + std::string(filename) + " is not an input recording\n");
+		m_File.close();
+		return false;
+	}
+
+	m_fFixedFrameTime = std::max(fixedFrameTime, 0.0f);
+	m_uStartTicks = Timer::GetTicks();
+	m_uFrames = 0;
+	m_arrEvents.clear();
+	m_arrFrameTimes.clear();
+	m_arrKeysDown.clear();
+	return true;
+}
+
+bool InputReplay::ReadFrame(float measuredFrameTime, float& frametime)
+{
+	// The first frame's time includes startup, it is not part of the session
+	if (m_uFrames > 0)
+	{
+		m_arrFrameTimes.push_back(measuredFrameTime);
+	}
+	m_arrEvents.clear();
+
+	float recordedFrameTime = 0.0f;
+	uint32_t eventCount = 0;
+	if (!m_File.is_open() || !ReadValue(m_File, recordedFrameTime) || !ReadValue(m_File, eventCount) ||
+		eventCount > kMaxFrameEvents)
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < eventCount; ++i)
+	{
+		uint8_t type = 0;
+		int8_t button = 0;
+		uint64_t time = 0;
+		InputEvent event = {};
+		if (!ReadValue(m_File, type) || !ReadValue(m_File, button) || !ReadValue(m_File, event.uKey) ||
+			!ReadValue(m_File, event.vPoint.x) || !ReadValue(m_File, event.vPoint.y) || !ReadValue(m_File, time))
+		{
+			return false;
+		}
+		event.eType = (InputEvent::Type)type;
+		event.iButton = button;
+		event.uTimestamp = m_uStartTicks + time * m_uTickFrequency / 1000000;
+		m_arrEvents.push_back(event);
+	}
+
+	frametime = m_fFixedFrameTime > 0.0f ? m_fFixedFrameTime : recordedFrameTime;
+	++m_uFrames;
+	return true;
+}
+
+void InputReplay::TrackKeys(const InputEvent& event)
+{
+	auto it = std::find(m_arrKeysDown.begin(), m_arrKeysDown.end(), event.uKey);
+	if (event.eType == InputEvent::Type::KeyDown && it == m_arrKeysDown.end())
+	{
+		m_arrKeysDown.push_back(event.uKey);
+	}
+	else if (event.eType == InputEvent::Type::KeyUp && it != m_arrKeysDown.end())
+	{
+		m_arrKeysDown.erase(it);
+	}
+}
+
+bool InputReplay::IsKeyDown(uint32_t osKeyCode) const
+{
+	return std::find(m_arrKeysDown.begin(), m_arrKeysDown.end(), osKeyCode) != m_arrKeysDown.end();
+}
+
+bool InputReplay::WriteTimings(const std::string_view& filename) const
+{
+	std::ofstream file(std::string(filename), std::ios::trunc);
+	if (!file.is_open())
+	{
+		IApplication::Debug("InputReplay: failed to create " + std::string(filename) + "\n");
+		return false;
+	}
+
+	for (const float time : m_arrFrameTimes)
+	{
+		file << time * 1000.0f << "\n";
+	}
+
+	const InputReplayStats stats = GetStats();
+	file << "# frames " << stats.uFrames <<
+		" mean " << stats.fMeanSeconds * 1000.0f <<
+		" median " << stats.fMedianSeconds * 1000.0f <<
+		" p95 " << stats.fP95Seconds * 1000.0f <<
+		" p99 " << stats.fP99Seconds * 1000.0f <<
+		" max " << stats.fMaxSeconds * 1000.0f << " ms\n";
+	return true;
+}
+
+InputReplayStats InputReplay::GetStats() const
+{
+	InputReplayStats stats = {};
+	stats.uFrames = (uint32_t)m_arrFrameTimes.size();
+	if (m_arrFrameTimes.empty())
+	{
+		return stats;
+	}
+
+	std::vector<float> sorted(m_arrFrameTimes);
+	std::sort(sorted.begin(), sorted.end());
+	const auto percentile = [&](float p) { return sorted[(size_t)(p * (float)(sorted.size() - 1) + 0.5f)]; };
+	stats.fMeanSeconds = std::accumulate(sorted.begin(), sorted.end(), 0.0f) / (float)sorted.size();
+	stats.fMedianSeconds = percentile(0.5f);
+	stats.fP95Seconds = percentile(0.95f);
+	stats.fP99Seconds = percentile(0.99f);
+	stats.fMaxSeconds = sorted.back();
+	return stats;
+}
@@ -0,0 +1,119 @@
+#include "../include/JobPool.h"
+
+JobPool::JobPool(uint32_t threadCount) :
+	m_pJob(nullptr),
+	m_uCount(0),
+	m_uGeneration(0),
+	m_uNextIndex(0),
+	m_uIndicesDone(0),
+	m_uActiveWorkers(0),
+	m_bQuit(false)
+{
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		m_arrThreads.emplace_back(&JobPool::WorkerThread, this);
+	}
+}
+
+JobPool::~JobPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bQuit = true;
+	}
+	m_WorkCondition.notify_all();
+	for (auto& thread : m_arrThreads)
+	{
+		thread.join();
+	}
+}
+
+void JobPool::Run(uint32_t count, const JobFunction& job)
+{
+	if (!count)
+	{
+		return;
+	}
+
+	// Nothing to share, skip the locking
+	if (count == 1 || m_arrThreads.empty())
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	// Workers are busy with a run from another thread, which already keeps the cores busy
+	std::unique_lock<std::mutex> run(m_RunMutex, std::try_to_lock);
+	if (!run.owns_lock())
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	{
+		// A worker woken late for the previous run may still be taking indices
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this] { return m_uActiveWorkers == 0; });
+		m_pJob = &job;
+		m_uCount = count;
+		m_uNextIndex = 0;
+		m_uIndicesDone = 0;
+		++m_uGeneration;
+	}
+	m_WorkCondition.notify_all();
+
+	// Calling thread works too
+	RunJobs();
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_DoneCondition.wait(lock, [this] { return m_uIndicesDone == m_uCount; });
+}
+
+uint32_t JobPool::GetDefaultThreadCount()
+{
+	const uint32_t cores = std::thread::hardware_concurrency();
+	return (cores > 1) ? cores - 1 : 0;
+}
+
+void JobPool::RunJobs()
+{
+	const uint32_t count = m_uCount;
+	for (uint32_t index = m_uNextIndex++; index < count; index = m_uNextIndex++)
+	{
+		(*m_pJob)(index);
+		if (++m_uIndicesDone == count)
+		{
+			std::lock_guard<std::mutex> guard(m_Mutex);
+			m_DoneCondition.notify_all();
+		}
+	}
+}
+
+void JobPool::WorkerThread()
+{
+	uint64_t generation = 0;
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	for (;;)
+	{
+		m_WorkCondition.wait(lock, [&] { return m_bQuit || m_uGeneration != generation; });
+		if (m_bQuit)
+		{
+			return;
+		}
+		generation = m_uGeneration;
+		++m_uActiveWorkers;
+		lock.unlock();
+
+		RunJobs();
+
+		lock.lock();
+		--m_uActiveWorkers;
+		m_DoneCondition.notify_all();
+	}
+}
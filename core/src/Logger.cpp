@@ -0,0 +1,525 @@
+#include "../include/Logger.h"
+#include "../include/Timer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined (_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+// Size of each thread's ring, a power of two
+constexpr size_t kRingBytes = 256 * 1024;
+// Records start at multiples of this, so a padding record always fits at the end of the ring
+constexpr size_t kRecordAlignment = 32;
+// Longest record, longer string arguments are truncated
+constexpr size_t kMaxRecordBytes = kRingBytes / 4;
+// How often the logger thread wakes up to write, in milliseconds
+constexpr uint32_t kWriteInterval = 10;
+// Identical messages beyond this count within the window are suppressed
+constexpr uint32_t kRepeatLimit = 5;
+constexpr float kRepeatWindowSeconds = 1.0f;
+
+// Fixed part of a record in a ring, followed by the arguments
+struct RECORD
+{
+	uint32_t		size; // Whole record including arguments, multiple of kRecordAlignment
+	bool			padding; // Filler up to the end of the ring, skipped
+	LogLevel		level;
+	uint8_t			argCount;
+	uint64_t		timestamp;
+	const char*		format;
+};
+
+static_assert(sizeof(RECORD) <= kRecordAlignment, "Logger: record header must fit in the alignment");
+
+static size_t AlignRecord(size_t size)
+{
+	return (size + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+}
+
+static std::string_view LevelPrefix(LogLevel level)
+{
+	switch (level)
+	{
+	case LogLevel::Warning:
+		return "Warning: ";
+	case LogLevel::Error:
+		return "Error: ";
+	default:
+		return {};
+	}
+}
+
+void ConsoleLogSink::Write(const std::string_view& text)
+{
+	fwrite(text.data(), 1, text.size(), m_pStream);
+}
+
+void ConsoleLogSink::Flush()
+{
+	fflush(m_pStream);
+}
+
+FileLogSink::FileLogSink() :
+	m_pFile(nullptr)
+{
+}
+
+FileLogSink::~FileLogSink()
+{
+	if (m_pFile)
+	{
+		fclose(m_pFile);
+	}
+}
+
+bool FileLogSink::Open(const std::string_view& filename, bool append)
+{
+	if (m_pFile)
+	{
+		fclose(m_pFile);
+	}
+	m_pFile = fopen(std::string(filename).c_str(), append ? "ab" : "wb");
+	return m_pFile != nullptr;
+}
+
+void FileLogSink::Write(const std::string_view& text)
+{
+	if (m_pFile)
+	{
+		fwrite(text.data(), 1, text.size(), m_pFile);
+	}
+}
+
+void FileLogSink::Flush()
+{
+	if (m_pFile)
+	{
+		fflush(m_pFile);
+	}
+}
+
+#if defined (_WIN32)
+void DebugOutputLogSink::Write(const std::string_view& text)
+{
+	::OutputDebugStringA(std::string(text).c_str());
+}
+#endif
+
+Logger& Logger::Get()
+{
+	static Logger logger;
+	return logger;
+}
+
+Logger::Logger() :
+	m_eLevel((LogLevel)LOG_MIN_LEVEL),
+	m_bQuit(false),
+	m_uFlushRequest(0),
+	m_uFlushDone(0),
+	m_uTickFrequency(Timer::GetTickFrequency()),
+	m_uWritten(0),
+	m_uSuppressed(0)
+{
+#if defined (_WIN32)
+	m_arrSinks.push_back(std::make_unique<DebugOutputLogSink>());
+#else
+	m_arrSinks.push_back(std::make_unique<ConsoleLogSink>(stderr));
+#endif
+	m_Thread = std::thread(&Logger::ThreadMain, this);
+}
+
+Logger::~Logger()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bQuit = true;
+	}
+	m_WakeCondition.notify_all();
+	m_Thread.join();
+}
+
+void Logger::AddSink(std::unique_ptr<LogSink> sink)
+{
+	std::lock_guard<std::mutex> lock(m_SinkMutex);
+	m_arrSinks.push_back(std::move(sink));
+}
+
+void Logger::ClearSinks()
+{
+	std::lock_guard<std::mutex> lock(m_SinkMutex);
+	m_arrSinks.clear();
+}
+
+void Logger::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	const uint64_t request = ++m_uFlushRequest;
+	m_WakeCondition.notify_all();
+	m_FlushCondition.wait(lock, [&] { return m_bQuit || m_uFlushDone >= request; });
+}
+
+LoggerStats Logger::GetStats() const
+{
+	LoggerStats stats = {};
+	stats.uWritten = m_uWritten.load(std::memory_order_relaxed);
+	stats.uSuppressed = m_uSuppressed.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(m_BufferMutex);
+	for (const auto& buffer : m_arrBuffers)
+	{
+		stats.uDropped += buffer->dropped.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void Logger::Push(LogLevel level, const char* format, const ARG* args, uint32_t argCount)
+{
+	THREADBUFFER* buffer = GetThreadBuffer();
+
+	// Measure the record, truncating strings that would not fit
+	size_t size = sizeof(RECORD);
+	for (uint32_t i = 0; i < argCount; ++i)
+	{
+		size += 1 + (args[i].type == ArgType::String ? sizeof(uint32_t) + args[i].str.size() : sizeof(uint64_t));
+	}
+	size_t excess = size > kMaxRecordBytes ? size - kMaxRecordBytes : 0;
+	size = AlignRecord(size - excess);
+
+	// Records do not wrap, skip the end of the ring with a padding record if needed
+	const uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+	const uint64_t head = buffer->head.load(std::memory_order_acquire);
+	const size_t offset = (size_t)(tail & (kRingBytes - 1));
+	const size_t padding = kRingBytes - offset < size ? kRingBytes - offset : 0;
+	if (tail + padding + size - head > kRingBytes)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	uint8_t* data = buffer->data.data();
+	if (padding)
+	{
+		RECORD* filler = (RECORD*)(data + offset);
+		filler->size = (uint32_t)padding;
+		filler->padding = true;
+	}
+
+	uint8_t* dst = data + ((tail + padding) & (kRingBytes - 1));
+	RECORD* record = (RECORD*)dst;
+	record->size = (uint32_t)size;
+	record->padding = false;
+	record->level = level;
+	record->argCount = (uint8_t)std::min(argCount, 255u);
+	record->timestamp = Timer::GetTicks();
+	record->format = format;
+	dst += sizeof(RECORD);
+
+	for (uint32_t i = 0; i < record->argCount; ++i)
+	{
+		*dst++ = (uint8_t)args[i].type;
+		if (args[i].type == ArgType::String)
+		{
+			const size_t cut = std::min(excess, args[i].str.size());
+			const uint32_t length = (uint32_t)(args[i].str.size() - cut);
+			excess -= cut;
+			memcpy(dst, &length, sizeof(length));
+			memcpy(dst + sizeof(length), args[i].str.data(), length);
+			dst += sizeof(length) + length;
+		}
+		else
+		{
+			memcpy(dst, &args[i].u, sizeof(uint64_t));
+			dst += sizeof(uint64_t);
+		}
+	}
+
+	buffer->tail.store(tail + padding + size, std::memory_order_release);
+	if (level >= LogLevel::Error)
+	{
+		// Errors may precede a crash, do not leave them waiting for the next interval
+		m_WakeCondition.notify_one();
+	}
+}
+
+Logger::THREADBUFFER* Logger::GetThreadBuffer()
+{
+	// Hands the ring back for reuse when the thread exits
+	struct OWNER
+	{
+		THREADBUFFER*	buffer = nullptr;
+		~OWNER()
+		{
+			if (buffer)
+			{
+				buffer->owned.store(false, std::memory_order_release);
+			}
+		}
+	};
+	thread_local OWNER owner;
+
+	if (!owner.buffer)
+	{
+		std::lock_guard<std::mutex> lock(m_BufferMutex);
+		for (auto& buffer : m_arrBuffers)
+		{
+			bool expected = false;
+			if (buffer->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			{
+				owner.buffer = buffer.get();
+				break;
+			}
+		}
+
+		if (!owner.buffer)
+		{
+			auto buffer = std::make_unique<THREADBUFFER>();
+			buffer->data.resize(kRingBytes);
+			buffer->head = 0;
+			buffer->tail = 0;
+			buffer->dropped = 0;
+			buffer->owned = true;
+			owner.buffer = buffer.get();
+			m_arrBuffers.push_back(std::move(buffer));
+		}
+	}
+	return owner.buffer;
+}
+
+void Logger::ThreadMain()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_WakeCondition.wait_for(lock, std::chrono::milliseconds(kWriteInterval));
+		const bool quit = m_bQuit;
+		const uint64_t request = m_uFlushRequest;
+		lock.unlock();
+
+		Drain();
+
+		lock.lock();
+		m_uFlushDone = request;
+		m_FlushCondition.notify_all();
+		if (quit)
+		{
+			break;
+		}
+	}
+}
+
+void Logger::Drain()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_BufferMutex);
+		for (auto& buffer : m_arrBuffers)
+		{
+			ReadBuffer(*buffer);
+		}
+	}
+
+	// Each ring is in order, merge them by time
+	std::stable_sort(m_arrMessages.begin(), m_arrMessages.end(), [](const MESSAGE& a, const MESSAGE& b)
+	{
+		return a.timestamp < b.timestamp;
+	});
+	WriteBatch(Timer::GetTicks());
+}
+
+void Logger::ReadBuffer(THREADBUFFER& buffer)
+{
+	const uint8_t* data = buffer.data.data();
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	const uint64_t tail = buffer.tail.load(std::memory_order_acquire);
+	while (head < tail)
+	{
+		const uint8_t* record = data + (head & (kRingBytes - 1));
+		const RECORD* header = (const RECORD*)record;
+		if (!header->padding)
+		{
+			MESSAGE message;
+			message.timestamp = header->timestamp;
+			message.level = header->level;
+			Format(record, message.text);
+			m_arrMessages.push_back(std::move(message));
+		}
+		head += header->size;
+	}
+	buffer.head.store(head, std::memory_order_release);
+}
+
+void Logger::Format(const uint8_t* record, std::string& text) const
+{
+	const RECORD* header = (const RECORD*)record;
+	const uint8_t* src = record + sizeof(RECORD);
+	uint32_t argsLeft = header->argCount;
+	text = LevelPrefix(header->level);
+
+	char spec[32];
+	char buffer[128];
+	for (const char* c = header->format; *c; ++c)
+	{
+		if (*c != '%')
+		{
+			text += *c;
+			continue;
+		}
+		if (c[1] == '%')
+		{
+			text += '%';
+			++c;
+			continue;
+		}
+
+		// Copy flags, width and precision, drop the length modifier, the argument's own type decides it
+		const char* start = c++;
+		size_t length = 1;
+		spec[0] = '%';
+		while (*c && strchr("-+ #0123456789.", *c) && length < sizeof(spec) - 4)
+		{
+			spec[length++] = *c++;
+		}
+		while (*c && strchr("hljztL", *c))
+		{
+			++c;
+		}
+		if (!*c || argsLeft == 0)
+		{
+			// Malformed or missing argument, print the specifier as is
+			text.append(start, *c ? c - start + 1 : c - start);
+			if (!*c)
+			{
+				break;
+			}
+			continue;
+		}
+		const char conversion = *c;
+
+		--argsLeft;
+		const ArgType type = (ArgType)*src++;
+		if (type == ArgType::String)
+		{
+			uint32_t stringLength = 0;
+			memcpy(&stringLength, src, sizeof(stringLength));
+			const std::string_view str((const char*)src + sizeof(stringLength), stringLength);
+			src += sizeof(stringLength) + stringLength;
+			if (length == 1)
+			{
+				text += str;
+				continue;
+			}
+			spec[length++] = 's';
+			spec[length] = '\0';
+			const std::string copy(str);
+			const int written = snprintf(buffer, sizeof(buffer), spec, copy.c_str());
+			text.append(buffer, std::min((size_t)std::max(written, 0), sizeof(buffer) - 1));
+			continue;
+		}
+
+		uint64_t bits = 0;
+		memcpy(&bits, src, sizeof(bits));
+		src += sizeof(bits);
+
+		int written = 0;
+		if (type == ArgType::Double || strchr("fFeEgGaA", conversion))
+		{
+			double value = 0.0;
+			if (type == ArgType::Double)
+			{
+				memcpy(&value, &bits, sizeof(value));
+			}
+			else
+			{
+				value = type == ArgType::Int ? (double)(int64_t)bits : (double)bits;
+			}
+			spec[length++] = strchr("fFeEgGaA", conversion) ? conversion : 'g';
+			spec[length] = '\0';
+			written = snprintf(buffer, sizeof(buffer), spec, value);
+		}
+		else if (type == ArgType::Pointer || conversion == 'p')
+		{
+			spec[length++] = 'p';
+			spec[length] = '\0';
+			written = snprintf(buffer, sizeof(buffer), spec, (const void*)(uintptr_t)bits);
+		}
+		else if (conversion == 'c')
+		{
+			spec[length++] = 'c';
+			spec[length] = '\0';
+			written = snprintf(buffer, sizeof(buffer), spec, (int)bits);
+		}
+		else
+		{
+			spec[length++] = 'l';
+			spec[length++] = 'l';
+			spec[length++] = strchr("diuoxX", conversion) ? conversion : (type == ArgType::Int ? 'd' : 'u');
+			spec[length] = '\0';
+			written = snprintf(buffer, sizeof(buffer), spec, (long long)bits);
+		}
+		text.append(buffer, std::min((size_t)std::max(written, 0), sizeof(buffer) - 1));
+	}
+}
+
+bool Logger::RateLimit(const std::string& text, uint64_t now)
+{
+	const uint64_t window = (uint64_t)(m_uTickFrequency * kRepeatWindowSeconds);
+	REPEAT& repeat = m_mapRepeats[std::hash<std::string>()(text)];
+	if (repeat.count == 0 || now - repeat.windowStart > window)
+	{
+		repeat.windowStart = now;
+		repeat.count = 0;
+	}
+
+	if (++repeat.count > kRepeatLimit)
+	{
+		++repeat.suppressed;
+		m_uSuppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+void Logger::WriteBatch(uint64_t now)
+{
+	m_Batch.clear();
+	uint64_t written = 0;
+	for (const auto& message : m_arrMessages)
+	{
+		if (RateLimit(message.text, message.timestamp))
+		{
+			m_Batch += message.text;
+			++written;
+		}
+	}
+	m_arrMessages.clear();
+
+	// Report repeats of windows that have closed and forget them
+	const uint64_t window = (uint64_t)(m_uTickFrequency * kRepeatWindowSeconds);
+	for (auto it = m_mapRepeats.begin(); it != m_mapRepeats.end();)
+	{
+		if (now - it->second.windowStart <= window)
+		{
+			++it;
+			continue;
+		}
+		if (it->second.suppressed)
+		{
+			m_Batch += "Logger: suppressed " + std::to_string(it->second.suppressed) + " repeats of a message\n";
+		}
+		it = m_mapRepeats.erase(it);
+	}
+
+	if (m_Batch.empty())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_SinkMutex);
+	for (auto& sink : m_arrSinks)
+	{
+		sink->Write(m_Batch);
+		sink->Flush();
+	}
+	m_uWritten.fetch_add(written, std::memory_order_relaxed);
+}
@@ -1,15 +1,18 @@
 #include "../include/Material.h"
 
+#include <cstring>
+
 Material::Material() :
 	m_cAmbient(0.1f, 0.1f, 0.1f, 1.0f),
 	m_cDiffuse(1.0f),
 	m_cSpecular(1.0f),
 	m_cEmissive(0.0f),
-	m_fSpecularPower(50.0f)
+	m_fSpecularPower(50.0f),
+	m_BakedUniforms({})
 {
 }
 
-void Material::SetToProgram(GLuint program)
+void Material::SetToProgram(GLuint program) const
 {
 	OpenGLRenderer::SetUniformVec4(program, "materialAmbient", m_cAmbient);
 	OpenGLRenderer::SetUniformVec4(program, "materialDiffuse", m_cDiffuse);
@@ -17,3 +20,29 @@ void Material::SetToProgram(GLuint program)
 	OpenGLRenderer::SetUniformVec4(program, "materialEmissive", m_cEmissive);
 	OpenGLRenderer::SetUniformFloat(program, "specularPower", m_fSpecularPower);
 }
+
+const UniformBuffer* Material::GetUniformBuffer() const
+{
+	const MaterialUniforms uniforms = { m_cAmbient, m_cDiffuse, m_cSpecular, m_cEmissive, m_fSpecularPower, { 0.0f, 0.0f, 0.0f } };
+	if (m_pUniformBuffer && memcmp(&uniforms, &m_BakedUniforms, sizeof(uniforms)) == 0)
+	{
+		return m_pUniformBuffer.get();
+	}
+
+	if (m_pUniformBuffer && m_pUniformBuffer.use_count() == 1)
+	{
+		m_pUniformBuffer->SetData(&uniforms, sizeof(uniforms));
+	}
+	else
+	{
+		// A copy of this material still uses the old buffer
+		auto buffer = std::make_shared<UniformBuffer>();
+		if (!buffer->Create(sizeof(uniforms), &uniforms, GL_STATIC_DRAW))
+		{
+			return nullptr;
+		}
+		m_pUniformBuffer = buffer;
+	}
+	m_BakedUniforms = uniforms;
+	return m_pUniformBuffer.get();
+}
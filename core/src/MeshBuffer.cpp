@@ -0,0 +1,218 @@
+#include "../include/MeshBuffer.h"
+
+#include <algorithm>
+
+// Room for a few typical meshes before the first growth
+constexpr size_t kInitialVertexCapacity = 64 * 1024;
+constexpr size_t kInitialIndexCapacity = 256 * 1024;
+
+MeshBuffer::MeshBuffer() :
+	m_VertexBuffer(0),
+	m_IndexBuffer(0),
+	m_uVertexCount(0),
+	m_uVertexCapacity(0),
+	m_uIndexCount(0),
+	m_uIndexCapacity(0)
+{
+}
+
+MeshBuffer::~MeshBuffer()
+{
+	Clear();
+}
+
+const MeshRange* MeshBuffer::Add(const Geometry& geometry)
+{
+	auto found = m_mapMeshes.find(geometry.GetGeneration());
+	if (found != m_mapMeshes.end())
+	{
+		return &found->second;
+	}
+
+	if (!IsSupported() || !geometry.GetVertexCount())
+	{
+		return nullptr;
+	}
+
+	// Geometries without an index buffer are drawn as they are, so build the indices here
+	std::vector<GLuint> indices;
+	const size_t vertexCount = geometry.GetVertexCount();
+	size_t indexCount = geometry.GetIndexCount();
+	if (!geometry.GetIndexBuffer() || !indexCount)
+	{
+		if (!geometry.GetTriangleIndices(indices))
+		{
+			IApplication::Debug("MeshBuffer: only triangle lists and strips are supported\n");
+			return nullptr;
+		}
+		indexCount = indices.size();
+	}
+
+	if (!Reserve(m_VertexBuffer, m_uVertexCapacity, m_uVertexCount, m_uVertexCount + vertexCount, Geometry::VERTEX::GetStride(), kInitialVertexCapacity) ||
+		!Reserve(m_IndexBuffer, m_uIndexCapacity, m_uIndexCount, m_uIndexCount + indexCount, sizeof(GLuint), kInitialIndexCapacity))
+	{
+		return nullptr;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_VertexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(m_uVertexCount * Geometry::VERTEX::GetStride()), (GLsizeiptr)(vertexCount * Geometry::VERTEX::GetStride()), geometry.GetData());
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_IndexBuffer);
+	if (indices.empty())
+	{
+		// Copy the existing index buffer on the GPU
+		glBindBuffer(GL_COPY_READ_BUFFER, geometry.GetIndexBuffer());
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, (GLintptr)(m_uIndexCount * sizeof(GLuint)), (GLsizeiptr)(indexCount * sizeof(GLuint)));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	else
+	{
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(m_uIndexCount * sizeof(GLuint)), (GLsizeiptr)(indexCount * sizeof(GLuint)), indices.data());
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	MeshRange& range = m_mapMeshes[geometry.GetGeneration()];
+	range.uFirstIndex = (uint32_t)m_uIndexCount;
+	range.uIndexCount = (uint32_t)indexCount;
+	range.iBaseVertex = (int32_t)m_uVertexCount;
+
+	// Sphere around the bounding box, for culling
+	const Geometry::VERTEX* vertices = geometry.GetData();
+	glm::vec3 minimum(vertices[0].x, vertices[0].y, vertices[0].z);
+	glm::vec3 maximum(minimum);
+	for (size_t i = 1; i < vertexCount; ++i)
+	{
+		const glm::vec3 position(vertices[i].x, vertices[i].y, vertices[i].z);
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+	const glm::vec3 center((minimum + maximum) * 0.5f);
+	float radius = 0.0f;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		radius = std::max(radius, glm::length(glm::vec3(vertices[i].x, vertices[i].y, vertices[i].z) - center));
+	}
+	range.vBoundingSphere = glm::vec4(center, radius);
+
+	m_uVertexCount += vertexCount;
+	m_uIndexCount += indexCount;
+	return &range;
+}
+
+const MeshRange* MeshBuffer::Find(const Geometry& geometry) const
+{
+	auto found = m_mapMeshes.find(geometry.GetGeneration());
+	return (found != m_mapMeshes.end()) ? &found->second : nullptr;
+}
+
+void MeshBuffer::Remove(const Geometry& geometry)
+{
+	m_mapMeshes.erase(geometry.GetGeneration());
+}
+
+void MeshBuffer::Clear()
+{
+	if (m_VertexBuffer)
+	{
+		glDeleteBuffers(1, &m_VertexBuffer);
+		m_VertexBuffer = 0;
+	}
+	if (m_IndexBuffer)
+	{
+		glDeleteBuffers(1, &m_IndexBuffer);
+		m_IndexBuffer = 0;
+	}
+	m_uVertexCount = 0;
+	m_uVertexCapacity = 0;
+	m_uIndexCount = 0;
+	m_uIndexCapacity = 0;
+	m_mapMeshes.clear();
+}
+
+void MeshBuffer::Bind(GLuint program) const
+{
+	const GLint position = glGetAttribLocation(program, "position");
+	const GLint normal = glGetAttribLocation(program, "normal");
+	const GLint uv = glGetAttribLocation(program, "uv");
+
+	// Same layout as Geometry::SetAttribs, but offsets into the shared buffer
+	glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+	if (position != -1)
+	{
+		glEnableVertexAttribArray(position);
+		glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, Geometry::VERTEX::GetStride(), (const void*)0);
+	}
+	if (normal != -1)
+	{
+		glEnableVertexAttribArray(normal);
+		glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, Geometry::VERTEX::GetStride(), (const void*)(3 * sizeof(float)));
+	}
+	if (uv != -1)
+	{
+		glEnableVertexAttribArray(uv);
+		glVertexAttribPointer(uv, 2, GL_FLOAT, GL_FALSE, Geometry::VERTEX::GetStride(), (const void*)(6 * sizeof(float)));
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+}
+
+void MeshBuffer::Unbind(GLuint program) const
+{
+	const GLint position = glGetAttribLocation(program, "position");
+	const GLint normal = glGetAttribLocation(program, "normal");
+	const GLint uv = glGetAttribLocation(program, "uv");
+	if (position != -1)
+	{
+		glDisableVertexAttribArray(position);
+	}
+	if (normal != -1)
+	{
+		glDisableVertexAttribArray(normal);
+	}
+	if (uv != -1)
+	{
+		glDisableVertexAttribArray(uv);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+bool MeshBuffer::IsSupported()
+{
+	return glCopyBufferSubData && glBufferSubData;
+}
+
+bool MeshBuffer::Reserve(GLuint& buffer, size_t& capacity, size_t used, size_t required, size_t elementSize, size_t initialCapacity)
+{
+	if (buffer && required <= capacity)
+	{
+		return true;
+	}
+
+	const size_t newCapacity = std::max(capacity ? capacity * 2 : initialCapacity, required);
+
+	GLuint newBuffer = 0;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(newCapacity * elementSize), nullptr, GL_STATIC_DRAW);
+	if (glGetError() == GL_OUT_OF_MEMORY)
+	{
+		IApplication::Debug("MeshBuffer: out of memory\n");
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &newBuffer);
+		return false;
+	}
+
+	if (buffer)
+	{
+		// Keep existing meshes at the same offsets
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)(used * elementSize));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	buffer = newBuffer;
+	capacity = newCapacity;
+	return true;
+}
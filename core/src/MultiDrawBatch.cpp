@@ -0,0 +1,302 @@
+#include "../include/MultiDrawBatch.h"
+#include "../include/GeometryNode.h"
+
+#include <algorithm>
+
+MultiDrawBatch::MultiDrawBatch(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_pCulling(nullptr),
+	m_CommandBuffer(0),
+	m_TransformBuffer(0),
+	m_DrawIndexBuffer(0),
+	m_uDrawIndexCapacity(0),
+	m_InstanceBuffer(0),
+	m_CounterBuffer(0),
+	m_Stats({})
+{
+}
+
+MultiDrawBatch::~MultiDrawBatch()
+{
+	if (m_CommandBuffer)
+	{
+		glDeleteBuffers(1, &m_CommandBuffer);
+	}
+	if (m_TransformBuffer)
+	{
+		glDeleteBuffers(1, &m_TransformBuffer);
+	}
+	if (m_DrawIndexBuffer)
+	{
+		glDeleteBuffers(1, &m_DrawIndexBuffer);
+	}
+	if (m_InstanceBuffer)
+	{
+		glDeleteBuffers(1, &m_InstanceBuffer);
+	}
+	if (m_CounterBuffer)
+	{
+		glDeleteBuffers(1, &m_CounterBuffer);
+	}
+}
+
+void MultiDrawBatch::Clear()
+{
+	for (auto& bucket : m_arrBuckets)
+	{
+		bucket.arrCommands.clear();
+		bucket.arrTransforms.clear();
+		bucket.arrSpheres.clear();
+	}
+	m_Stats.uSkippedDraws = 0;
+}
+
+bool MultiDrawBatch::Add(const Geometry& geometry, const Material* material, const glm::mat4& modelMatrix)
+{
+	const MeshRange* range = m_Renderer.GetMeshBuffer().Add(geometry);
+	if (!range)
+	{
+		++m_Stats.uSkippedDraws;
+		return false;
+	}
+
+	auto found = m_mapBuckets.find(material);
+	if (found == m_mapBuckets.end())
+	{
+		found = m_mapBuckets.emplace(material, m_arrBuckets.size()).first;
+		m_arrBuckets.push_back({ material });
+	}
+
+	BUCKET& bucket = m_arrBuckets[found->second];
+	bucket.arrCommands.push_back({ range->uIndexCount, 1, range->uFirstIndex, range->iBaseVertex, 0 });
+	bucket.arrTransforms.push_back(modelMatrix);
+	bucket.arrSpheres.push_back(range->vBoundingSphere);
+	return true;
+}
+
+void MultiDrawBatch::AddNode(const Node& node)
+{
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&node);
+	if (geometryNode && geometryNode->GetGeometry() && !node.IsCulled())
+	{
+		Add(*geometryNode->GetGeometry(), geometryNode->GetMaterial().get(), node.GetWorldMatrix());
+	}
+
+	for (const auto& child : node.GetNodes())
+	{
+		AddNode(*child);
+	}
+}
+
+void MultiDrawBatch::Draw(GLuint program)
+{
+	m_Stats.uDraws = 0;
+	m_Stats.uMultiDrawCalls = 0;
+	m_Stats.bGpuCulled = false;
+	if (!IsSupported())
+	{
+		return;
+	}
+
+	const bool culled = m_pCulling && GpuCulling::IsSupported() && glClearBufferData;
+
+	// Lay out all buckets one after another, the command index is also the draw index
+	m_arrCommands.clear();
+	m_arrTransforms.clear();
+	m_arrInstances.clear();
+	for (size_t b = 0; b < m_arrBuckets.size(); ++b)
+	{
+		BUCKET& bucket = m_arrBuckets[b];
+		if (culled)
+		{
+			const GLuint bucketFirst = (GLuint)m_arrInstances.size();
+			for (size_t i = 0; i < bucket.arrCommands.size(); ++i)
+			{
+				const DRAWCOMMAND& command = bucket.arrCommands[i];
+				m_arrInstances.push_back({ bucket.arrTransforms[i], bucket.arrSpheres[i],
+					command.count, command.firstIndex, command.baseVertex, (GLuint)b, bucketFirst, { 0, 0, 0 } });
+			}
+			continue;
+		}
+
+		for (auto& command : bucket.arrCommands)
+		{
+			command.baseInstance = (GLuint)m_arrCommands.size();
+			m_arrCommands.push_back(command);
+		}
+		m_arrTransforms.insert(m_arrTransforms.end(), bucket.arrTransforms.begin(), bucket.arrTransforms.end());
+	}
+
+	const size_t drawCount = culled ? m_arrInstances.size() : m_arrCommands.size();
+	if (!drawCount)
+	{
+		return;
+	}
+
+	Reserve(drawCount);
+	m_Renderer.UpdateFrameUniforms();
+
+	if (culled)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_InstanceBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(drawCount * sizeof(GpuCulling::INSTANCE)), m_arrInstances.data(), GL_STREAM_DRAW);
+
+		// Slots left empty by culled draws must be no-op commands
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CommandBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(drawCount * sizeof(DRAWCOMMAND)), nullptr, GL_STREAM_DRAW);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_TransformBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(drawCount * sizeof(glm::mat4)), nullptr, GL_STREAM_DRAW);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CounterBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(m_arrBuckets.size() * sizeof(GLuint)), nullptr, GL_STREAM_DRAW);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		m_pCulling->Cull(m_InstanceBuffer, drawCount, m_CommandBuffer, m_TransformBuffer, m_CounterBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+		m_Stats.bGpuCulled = true;
+	}
+	else
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_TransformBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(m_arrTransforms.size() * sizeof(glm::mat4)), m_arrTransforms.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr)(m_arrCommands.size() * sizeof(DRAWCOMMAND)), m_arrCommands.data(), GL_STREAM_DRAW);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kDrawBlockBinding, m_TransformBuffer);
+
+	Submit(program, culled);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void MultiDrawBatch::Submit(GLuint program, bool culled)
+{
+	const MeshBuffer& meshBuffer = m_Renderer.GetMeshBuffer();
+	meshBuffer.Bind(program);
+
+	// Without gl_DrawID, baseInstance of each command selects its element of the instanced attribute
+	const GLint drawIndex = glGetAttribLocation(program, "drawIndex");
+	if (drawIndex != -1)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_DrawIndexBuffer);
+		glEnableVertexAttribArray(drawIndex);
+		glVertexAttribIPointer(drawIndex, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+		glVertexAttribDivisor(drawIndex, 1);
+	}
+	const GLint drawOffset = glGetUniformLocation(program, "drawOffset");
+
+	// With the count read from the GPU, empty slots after the visible draws are not even looked at
+	const bool indirectCount = culled && glMultiDrawElementsIndirectCountARB;
+	if (indirectCount)
+	{
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, m_CounterBuffer);
+	}
+
+	size_t first = 0;
+	for (size_t b = 0; b < m_arrBuckets.size(); ++b)
+	{
+		const BUCKET& bucket = m_arrBuckets[b];
+		const size_t count = bucket.arrCommands.size();
+		if (!count)
+		{
+			continue;
+		}
+
+		if (bucket.pMaterial)
+		{
+			m_Renderer.SetMaterial(program, *bucket.pMaterial);
+		}
+		if (drawOffset != -1)
+		{
+			// gl_DrawID starts from zero in every call
+			glUniform1i(drawOffset, (GLint)first);
+		}
+
+		const GLintptr offset = (GLintptr)(first * sizeof(DRAWCOMMAND));
+		if (indirectCount)
+		{
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, offset, (GLintptr)(b * sizeof(GLuint)), (GLsizei)count, 0);
+		}
+		else
+		{
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)offset, (GLsizei)count, 0);
+		}
+
+		first += count;
+		++m_Stats.uMultiDrawCalls;
+	}
+	m_Stats.uDraws = first;
+
+	if (indirectCount)
+	{
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+	}
+	if (drawIndex != -1)
+	{
+		glVertexAttribDivisor(drawIndex, 0);
+		glDisableVertexAttribArray(drawIndex);
+	}
+	meshBuffer.Unbind(program);
+}
+
+bool MultiDrawBatch::IsSupported()
+{
+	return MeshBuffer::IsSupported() && glMultiDrawElementsIndirect && glVertexAttribDivisor && glBindBufferBase;
+}
+
+const char* MultiDrawBatch::GetShaderSource()
+{
+	return R"(
+#extension GL_ARB_shader_draw_parameters : enable
+
+layout(std430, binding = 0) readonly buffer DrawBlock
+{
+	mat4 drawModelMatrix[];
+};
+
+#if __VERSION__ >= 460
+uniform int drawOffset;
+#define DRAW_INDEX (drawOffset + gl_DrawID)
+#elif defined(GL_ARB_shader_draw_parameters)
+uniform int drawOffset;
+#define DRAW_INDEX (drawOffset + gl_DrawIDARB)
+#else
+in uint drawIndex;
+#define DRAW_INDEX int(drawIndex)
+#endif
+
+mat4 GetDrawModelMatrix()
+{
+	return drawModelMatrix[DRAW_INDEX];
+}
+)";
+}
+
+void MultiDrawBatch::Reserve(size_t drawCount)
+{
+	if (!m_CommandBuffer)
+	{
+		glGenBuffers(1, &m_CommandBuffer);
+		glGenBuffers(1, &m_TransformBuffer);
+		glGenBuffers(1, &m_DrawIndexBuffer);
+		glGenBuffers(1, &m_InstanceBuffer);
+		glGenBuffers(1, &m_CounterBuffer);
+	}
+
+	if (drawCount > m_uDrawIndexCapacity)
+	{
+		m_uDrawIndexCapacity = std::max(drawCount, m_uDrawIndexCapacity * 2);
+		std::vector<GLuint> indices(m_uDrawIndexCapacity);
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			indices[i] = (GLuint)i;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, m_DrawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(indices.size() * sizeof(GLuint)), indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
@@ -1,24 +1,28 @@
 #include "../include/Node.h"
 
+#include "../glm-master/glm/gtc/quaternion.hpp"
+
 Node::Node() :
 	m_mModel(1.0f),
+	m_mPrevModel(1.0f),
+	m_bPrevModelValid(false),
 	m_pParent(nullptr),
-	m_vRotationAxis(0.0f, 0.0f, -1.0f),
-	m_fRotationAngle(0.0f),
-	m_fRotationSpeed(0.0f),
-	m_vVelocity(0.0f),
-	m_fRadius(1.0f)
+	m_Motion({ glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), 0.0f, 0.0f }),
+	m_fRadius(1.0f),
+	m_bOccluder(false),
+	m_bCulled(false)
 {
 }
 
 Node::Node(const std::string_view& name) :
 	m_mModel(1.0f),
+	m_mPrevModel(1.0f),
+	m_bPrevModelValid(false),
 	m_pParent(nullptr),
-	m_vRotationAxis(0.0f, 0.0f, -1.0f),
-	m_fRotationAngle(0.0f),
-	m_fRotationSpeed(0.0f),
-	m_vVelocity(0.0f),
+	m_Motion({ glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), 0.0f, 0.0f }),
 	m_fRadius(1.0f),
+	m_bOccluder(false),
+	m_bCulled(false),
 	m_strName(name)
 {
 }
@@ -29,19 +33,23 @@ Node::~Node()
 
 void Node::Update(float frametime)
 {
+	// Keep the previous state for interpolation between fixed steps
+	m_mPrevModel = m_mModel;
+	m_bPrevModelValid = true;
+
 	// Apply velocity by moving position by vector length per second
 	auto pos = GetPos();
-	pos += m_vVelocity * frametime;
+	pos += m_Motion.velocity * frametime;
 
 	// Update rotations
-	if (m_fRotationSpeed != 0.0f)
+	if (m_Motion.speed != 0.0f)
 	{
-		m_mModel = glm::rotate(glm::mat4(1.0f), m_fRotationAngle, m_vRotationAxis);
+		m_mModel = glm::rotate(glm::mat4(1.0f), m_Motion.angle, m_Motion.axis);
 
-		m_fRotationAngle += m_fRotationSpeed * frametime;
+		m_Motion.angle += m_Motion.speed * frametime;
 		constexpr float pi2 = glm::two_pi<float>();
-		while (m_fRotationAngle > pi2) m_fRotationAngle -= pi2;
-		while (m_fRotationAngle < -pi2) m_fRotationAngle += pi2;
+		while (m_Motion.angle > pi2) m_Motion.angle -= pi2;
+		while (m_Motion.angle < -pi2) m_Motion.angle += pi2;
 	}
 
 	// Set updated position back to the model matrix
@@ -54,6 +62,33 @@ void Node::Update(float frametime)
 	}
 }
 
+glm::mat4 Node::GetInterpolatedMatrix(float alpha) const
+{
+	if (alpha >= 1.0f || !m_bPrevModelValid)
+	{
+		return m_mModel;
+	}
+
+	// Blend scale, rotation and position separately so that rotating objects do not shrink halfway
+	const glm::vec3 prevScale(glm::length(glm::vec3(m_mPrevModel[0])), glm::length(glm::vec3(m_mPrevModel[1])), glm::length(glm::vec3(m_mPrevModel[2])));
+	const glm::vec3 scale(glm::length(glm::vec3(m_mModel[0])), glm::length(glm::vec3(m_mModel[1])), glm::length(glm::vec3(m_mModel[2])));
+	if (prevScale.x <= 0.0f || prevScale.y <= 0.0f || prevScale.z <= 0.0f || scale.x <= 0.0f || scale.y <= 0.0f || scale.z <= 0.0f)
+	{
+		return m_mModel;
+	}
+
+	const glm::quat prevRotation = glm::quat_cast(glm::mat3(glm::vec3(m_mPrevModel[0]) / prevScale.x, glm::vec3(m_mPrevModel[1]) / prevScale.y, glm::vec3(m_mPrevModel[2]) / prevScale.z));
+	const glm::quat rotation = glm::quat_cast(glm::mat3(glm::vec3(m_mModel[0]) / scale.x, glm::vec3(m_mModel[1]) / scale.y, glm::vec3(m_mModel[2]) / scale.z));
+
+	glm::mat4 m = glm::mat4_cast(glm::slerp(prevRotation, rotation, alpha));
+	const glm::vec3 blendedScale = glm::mix(prevScale, scale, alpha);
+	m[0] *= blendedScale.x;
+	m[1] *= blendedScale.y;
+	m[2] *= blendedScale.z;
+	m[3] = glm::vec4(glm::mix(glm::vec3(m_mPrevModel[3]), glm::vec3(m_mModel[3]), alpha), 1.0f);
+	return m;
+}
+
 void Node::Render(IRenderer& renderer, GLuint program)
 {
 	// Render child nodes
@@ -0,0 +1,442 @@
+#include "../include/OcclusionCuller.h"
+#include "../include/GeometryNode.h"
+#include "../include/Geometry.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+// Rows per band, bands are the unit of work for the threads
+constexpr int32_t kBandHeight = 8;
+// Vertices closer than this in clip space w are clipped away
+constexpr float kNearW = 1e-5f;
+
+OcclusionCuller::OcclusionCuller(JobPool& jobPool, int32_t width, int32_t height) :
+	m_iWidth((std::max(width, 4) + 3) & ~3),
+	m_iHeight(std::max(height, 1)),
+	m_iBandHeight(kBandHeight),
+	m_uBandCount(0),
+	m_JobPool(jobPool),
+	m_DebugTexture(0),
+	m_Stats({})
+{
+	m_uBandCount = (uint32_t)((m_iHeight + m_iBandHeight - 1) / m_iBandHeight);
+	m_arrDepth.assign((size_t)m_iWidth * m_iHeight, 1.0f);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	if (m_DebugTexture)
+	{
+		glDeleteTextures(1, &m_DebugTexture);
+	}
+}
+
+void OcclusionCuller::Cull(Node& root, const glm::mat4& viewProjection)
+{
+	m_Stats = {};
+	Timer timer;
+
+	timer.BeginTimer();
+	m_arrTriangles.clear();
+	CollectOccluders(root, viewProjection);
+	m_Stats.uOccluderTriangles = m_arrTriangles.size();
+	RasterizeBands();
+	timer.EndTimer();
+	m_Stats.fRasterizeSeconds = timer.GetElapsedSeconds();
+
+	timer.BeginTimer();
+	TestOccludees(root, viewProjection);
+	timer.EndTimer();
+	m_Stats.fTestSeconds = timer.GetElapsedSeconds();
+}
+
+void OcclusionCuller::ClearCulled(Node& root)
+{
+	root.SetCulled(false);
+	for (auto& child : root.GetNodes())
+	{
+		ClearCulled(*child);
+	}
+}
+
+void OcclusionCuller::Forget(const Geometry& geometry)
+{
+	m_mapMeshes.erase(&geometry);
+}
+
+GLuint OcclusionCuller::UpdateDebugTexture()
+{
+	// Stretch the used depth range over the whole gray scale, perspective depth is mostly close to 1
+	float nearest = 1.0f;
+	for (float depth : m_arrDepth)
+	{
+		nearest = std::min(nearest, depth);
+	}
+	const float scale = (nearest < 1.0f) ? 255.0f / (1.0f - nearest) : 0.0f;
+
+	m_arrDebugPixels.resize(m_arrDepth.size());
+	for (size_t i = 0; i < m_arrDepth.size(); ++i)
+	{
+		m_arrDebugPixels[i] = (m_arrDepth[i] >= 1.0f) ? 255 : (uint8_t)((m_arrDepth[i] - nearest) * scale);
+	}
+
+	if (!m_DebugTexture)
+	{
+		glGenTextures(1, &m_DebugTexture);
+		glBindTexture(GL_TEXTURE_2D, m_DebugTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else
+	{
+		glBindTexture(GL_TEXTURE_2D, m_DebugTexture);
+	}
+
+	// Rows are bottom up like OpenGL textures
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, m_iWidth, m_iHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_arrDebugPixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return m_DebugTexture;
+}
+
+OcclusionCuller::MESH* OcclusionCuller::GetMesh(const Geometry& geometry, bool occluder)
+{
+	auto found = m_mapMeshes.find(&geometry);
+	if (found == m_mapMeshes.end() || found->second.uGeneration != geometry.GetGeneration())
+	{
+		if (!geometry.GetVertexCount())
+		{
+			if (found != m_mapMeshes.end())
+			{
+				m_mapMeshes.erase(found);
+			}
+			return nullptr;
+		}
+
+		MESH& mesh = m_mapMeshes[&geometry];
+		mesh.uGeneration = geometry.GetGeneration();
+		mesh.arrIndices.clear();
+		const Geometry::VERTEX* vertices = geometry.GetData();
+		mesh.arrPositions.resize(geometry.GetVertexCount());
+		for (size_t i = 0; i < mesh.arrPositions.size(); ++i)
+		{
+			mesh.arrPositions[i] = glm::vec3(vertices[i].x, vertices[i].y, vertices[i].z);
+		}
+		mesh.vMin = mesh.arrPositions[0];
+		mesh.vMax = mesh.arrPositions[0];
+		for (const auto& position : mesh.arrPositions)
+		{
+			mesh.vMin = glm::min(mesh.vMin, position);
+			mesh.vMax = glm::max(mesh.vMax, position);
+		}
+		found = m_mapMeshes.find(&geometry);
+	}
+
+	MESH& mesh = found->second;
+	if (occluder && mesh.arrIndices.empty())
+	{
+		geometry.GetTriangleIndices(mesh.arrIndices);
+	}
+	return &mesh;
+}
+
+void OcclusionCuller::CollectOccluders(Node& node, const glm::mat4& viewProjection)
+{
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&node);
+	if (node.IsOccluder() && geometryNode && geometryNode->GetGeometry())
+	{
+		const MESH* mesh = GetMesh(*geometryNode->GetGeometry(), true);
+		if (mesh && !mesh->arrIndices.empty())
+		{
+			++m_Stats.uOccluders;
+
+			const glm::mat4 modelViewProjection(viewProjection * node.GetWorldMatrix());
+			std::vector<glm::vec4> clip(mesh->arrPositions.size());
+			for (size_t i = 0; i < clip.size(); ++i)
+			{
+				clip[i] = modelViewProjection * glm::vec4(mesh->arrPositions[i], 1.0f);
+			}
+
+			for (size_t i = 0; i + 2 < mesh->arrIndices.size(); i += 3)
+			{
+				AddOccluderTriangle(clip[mesh->arrIndices[i]], clip[mesh->arrIndices[i + 1]], clip[mesh->arrIndices[i + 2]]);
+			}
+		}
+	}
+
+	for (auto& child : node.GetNodes())
+	{
+		CollectOccluders(*child, viewProjection);
+	}
+}
+
+void OcclusionCuller::AddOccluderTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+	// Clip against the near plane z = -w, the rest is clipped by the screen bounds
+	const glm::vec4 input[3] = { a, b, c };
+	glm::vec4 polygon[4];
+	int32_t count = 0;
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		const glm::vec4& p = input[i];
+		const glm::vec4& q = input[(i + 1) % 3];
+		const float dp = p.z + p.w;
+		const float dq = q.z + q.w;
+		if (dp >= 0.0f)
+		{
+			polygon[count++] = p;
+		}
+		if ((dp >= 0.0f) != (dq >= 0.0f))
+		{
+			polygon[count++] = p + (q - p) * (dp / (dp - dq));
+		}
+	}
+	if (count < 3)
+	{
+		return;
+	}
+
+	glm::vec3 screen[4];
+	for (int32_t i = 0; i < count; ++i)
+	{
+		const float w = std::max(polygon[i].w, kNearW);
+		screen[i] = glm::vec3(
+			(polygon[i].x / w * 0.5f + 0.5f) * m_iWidth,
+			(polygon[i].y / w * 0.5f + 0.5f) * m_iHeight,
+			polygon[i].z / w * 0.5f + 0.5f);
+	}
+
+	SetupTriangle(screen[0], screen[1], screen[2]);
+	if (count == 4)
+	{
+		SetupTriangle(screen[0], screen[2], screen[3]);
+	}
+}
+
+void OcclusionCuller::SetupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+{
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+	if (std::abs(area) < 1e-6f)
+	{
+		return;
+	}
+
+	// Occluders are drawn from both sides, so turn every triangle counter-clockwise
+	const glm::vec3 p0 = v0;
+	const glm::vec3 p1 = (area > 0.0f) ? v1 : v2;
+	const glm::vec3 p2 = (area > 0.0f) ? v2 : v1;
+	area = std::abs(area);
+
+	TRIANGLE triangle;
+	triangle.iMinX = std::max((int32_t)std::floor(std::min({ p0.x, p1.x, p2.x })), 0);
+	triangle.iMaxX = std::min((int32_t)std::ceil(std::max({ p0.x, p1.x, p2.x })), m_iWidth - 1);
+	triangle.iMinY = std::max((int32_t)std::floor(std::min({ p0.y, p1.y, p2.y })), 0);
+	triangle.iMaxY = std::min((int32_t)std::ceil(std::max({ p0.y, p1.y, p2.y })), m_iHeight - 1);
+	if (triangle.iMinX > triangle.iMaxX || triangle.iMinY > triangle.iMaxY)
+	{
+		return;
+	}
+
+	const glm::vec3* edges[3][2] = { { &p1, &p2 }, { &p2, &p0 }, { &p0, &p1 } };
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		const glm::vec3& a = *edges[i][0];
+		const glm::vec3& b = *edges[i][1];
+		triangle.edge[i][0] = a.y - b.y;
+		triangle.edge[i][1] = b.x - a.x;
+		triangle.edge[i][2] = a.x * b.y - a.y * b.x;
+	}
+
+	// Depth is linear in screen space after the perspective divide
+	const float dzdx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) / area;
+	const float dzdy = ((p2.z - p0.z) * (p1.x - p0.x) - (p1.z - p0.z) * (p2.x - p0.x)) / area;
+	triangle.depth[0] = dzdx;
+	triangle.depth[1] = dzdy;
+	triangle.depth[2] = p0.z - dzdx * p0.x - dzdy * p0.y;
+
+	m_arrTriangles.push_back(triangle);
+}
+
+void OcclusionCuller::TestOccludees(Node& node, const glm::mat4& viewProjection)
+{
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&node);
+	if (geometryNode && geometryNode->GetGeometry())
+	{
+		const MESH* mesh = GetMesh(*geometryNode->GetGeometry(), false);
+		if (node.IsOccluder() || !mesh)
+		{
+			// Occluders are what the others are tested against
+			node.SetCulled(false);
+		}
+		else
+		{
+			++m_Stats.uOccludees;
+			const Visibility visibility = Classify(mesh->vMin, mesh->vMax, viewProjection * node.GetWorldMatrix());
+			node.SetCulled(visibility != Visibility::Visible);
+			if (visibility == Visibility::Occluded)
+			{
+				++m_Stats.uOccluded;
+			}
+			else if (visibility == Visibility::Outside)
+			{
+				++m_Stats.uOutsideFrustum;
+			}
+		}
+	}
+
+	for (auto& child : node.GetNodes())
+	{
+		TestOccludees(*child, viewProjection);
+	}
+}
+
+OcclusionCuller::Visibility OcclusionCuller::Classify(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelViewProjection) const
+{
+	glm::vec3 screenMin(FLT_MAX);
+	glm::vec3 screenMax(-FLT_MAX);
+	for (int32_t i = 0; i < 8; ++i)
+	{
+		const glm::vec4 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+		const glm::vec4 clip = modelViewProjection * corner;
+		if (clip.w <= kNearW)
+		{
+			// Box reaches behind the camera
+			return Visibility::Visible;
+		}
+		const glm::vec3 screen(
+			(clip.x / clip.w * 0.5f + 0.5f) * m_iWidth,
+			(clip.y / clip.w * 0.5f + 0.5f) * m_iHeight,
+			clip.z / clip.w * 0.5f + 0.5f);
+		screenMin = glm::min(screenMin, screen);
+		screenMax = glm::max(screenMax, screen);
+	}
+
+	if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x >= (float)m_iWidth || screenMin.y >= (float)m_iHeight ||
+		screenMax.z < 0.0f || screenMin.z > 1.0f)
+	{
+		return Visibility::Outside;
+	}
+
+	// Whole groups of 4 are tested, which only makes the test more conservative
+	const int32_t minX = std::max((int32_t)std::floor(screenMin.x), 0) & ~3;
+	const int32_t maxX = std::min((int32_t)std::ceil(screenMax.x), m_iWidth - 1);
+	const int32_t minY = std::max((int32_t)std::floor(screenMin.y), 0);
+	const int32_t maxY = std::min((int32_t)std::ceil(screenMax.y), m_iHeight - 1);
+	const float nearest = screenMin.z;
+
+#if defined (OCCLUSION_SSE)
+	const __m128 nearest4 = _mm_set1_ps(nearest);
+	for (int32_t y = minY; y <= maxY; ++y)
+	{
+		const float* row = &m_arrDepth[(size_t)y * m_iWidth];
+		for (int32_t x = minX; x <= maxX; x += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest4)))
+			{
+				return Visibility::Visible;
+			}
+		}
+	}
+#else
+	for (int32_t y = minY; y <= maxY; ++y)
+	{
+		const float* row = &m_arrDepth[(size_t)y * m_iWidth];
+		for (int32_t x = minX; x <= maxX; ++x)
+		{
+			if (row[x] >= nearest)
+			{
+				return Visibility::Visible;
+			}
+		}
+	}
+#endif
+
+	return Visibility::Occluded;
+}
+
+void OcclusionCuller::RasterizeBands()
+{
+	m_JobPool.Run(m_uBandCount, [this](uint32_t band) { RasterizeBand(band); });
+}
+
+void OcclusionCuller::RasterizeBand(uint32_t band)
+{
+	const int32_t bandMinY = (int32_t)band * m_iBandHeight;
+	const int32_t bandMaxY = std::min(bandMinY + m_iBandHeight, m_iHeight) - 1;
+	std::fill(m_arrDepth.begin() + (size_t)bandMinY * m_iWidth, m_arrDepth.begin() + (size_t)(bandMaxY + 1) * m_iWidth, 1.0f);
+
+	for (const auto& triangle : m_arrTriangles)
+	{
+		const int32_t minY = std::max(triangle.iMinY, bandMinY);
+		const int32_t maxY = std::min(triangle.iMaxY, bandMaxY);
+		if (minY > maxY)
+		{
+			continue;
+		}
+
+		// Rows are processed 4 pixels at a time from an aligned start
+		const int32_t minX = triangle.iMinX & ~3;
+		const int32_t maxX = triangle.iMaxX;
+
+#if defined (OCCLUSION_SSE)
+		const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 a0 = _mm_set1_ps(triangle.edge[0][0]);
+		const __m128 a1 = _mm_set1_ps(triangle.edge[1][0]);
+		const __m128 a2 = _mm_set1_ps(triangle.edge[2][0]);
+		const __m128 az = _mm_set1_ps(triangle.depth[0]);
+		const __m128 step0 = _mm_set1_ps(triangle.edge[0][0] * 4.0f);
+		const __m128 step1 = _mm_set1_ps(triangle.edge[1][0] * 4.0f);
+		const __m128 step2 = _mm_set1_ps(triangle.edge[2][0] * 4.0f);
+		const __m128 stepz = _mm_set1_ps(triangle.depth[0] * 4.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 x4 = _mm_add_ps(_mm_set1_ps((float)minX), offsets);
+
+		for (int32_t y = minY; y <= maxY; ++y)
+		{
+			const float py = (float)y + 0.5f;
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, x4), _mm_set1_ps(triangle.edge[0][1] * py + triangle.edge[0][2]));
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, x4), _mm_set1_ps(triangle.edge[1][1] * py + triangle.edge[1][2]));
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, x4), _mm_set1_ps(triangle.edge[2][1] * py + triangle.edge[2][2]));
+			__m128 z = _mm_add_ps(_mm_mul_ps(az, x4), _mm_set1_ps(triangle.depth[1] * py + triangle.depth[2]));
+
+			float* row = &m_arrDepth[(size_t)y * m_iWidth];
+			for (int32_t x = minX; x <= maxX; x += 4)
+			{
+				const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(inside))
+				{
+					const __m128 depth = _mm_loadu_ps(row + x);
+					const __m128 nearest = _mm_min_ps(depth, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, depth)));
+				}
+				e0 = _mm_add_ps(e0, step0);
+				e1 = _mm_add_ps(e1, step1);
+				e2 = _mm_add_ps(e2, step2);
+				z = _mm_add_ps(z, stepz);
+			}
+		}
+#else
+		for (int32_t y = minY; y <= maxY; ++y)
+		{
+			const float py = (float)y + 0.5f;
+			float* row = &m_arrDepth[(size_t)y * m_iWidth];
+			for (int32_t x = minX; x <= maxX; ++x)
+			{
+				const float px = (float)x + 0.5f;
+				if (triangle.edge[0][0] * px + triangle.edge[0][1] * py + triangle.edge[0][2] >= 0.0f &&
+					triangle.edge[1][0] * px + triangle.edge[1][1] * py + triangle.edge[1][2] >= 0.0f &&
+					triangle.edge[2][0] * px + triangle.edge[2][1] * py + triangle.edge[2][2] >= 0.0f)
+				{
+					row[x] = std::min(row[x], triangle.depth[0] * px + triangle.depth[1] * py + triangle.depth[2]);
+				}
+			}
+		}
+#endif
+	}
+}
@@ -1,9 +1,22 @@
 #include "../include/OpenGLRenderer.h"
+#include "../include/TextureManager.h"
+#include "../include/ShaderManager.h"
+#include "../include/UniformBuffer.h"
+#include "../include/Material.h"
+#include "../include/MeshBuffer.h"
+#include "../include/DeferredShading.h"
+#include "../include/GpuTimer.h"
+#include "../include/Node.h"
+#include "../include/ResourceWorker.h"
+#include "../include/Allocator.h"
 
 // Define and include stb image loader 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../include/stb_image.h"
 
+// Streaming buffer for per-object blocks, wraps around a few times per frame in heavy scenes
+constexpr size_t kObjectUniformBufferSize = 4 * 1024 * 1024;
+
 PFNGLBLENDEQUATIONSEPARATEPROC glBlendEquationSeparate = nullptr;
 PFNGLBLENDFUNCSEPARATEPROC glBlendFuncSeparate = nullptr;
 
@@ -73,13 +86,75 @@ PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus = nullptr;
 PFNGLCLEARDEPTHFPROC glClearDepthf = nullptr;
 PFNGLGENERATEMIPMAPPROC glGenerateMipmap = nullptr;
 
+// Program binary
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri = nullptr;
+
+// Parallel shader compile
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR = nullptr;
+PFNGLGETSTRINGIPROC glGetStringi = nullptr;
+
+// Uniform buffers
+PFNGLBUFFERSUBDATAPROC glBufferSubData = nullptr;
+PFNGLGETBUFFERSUBDATAPROC glGetBufferSubData = nullptr;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange = nullptr;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer = nullptr;
+PFNGLBUFFERSTORAGEPROC glBufferStorage = nullptr;
+PFNGLBINDBUFFERBASEPROC glBindBufferBase = nullptr;
+PFNGLBINDBUFFERRANGEPROC glBindBufferRange = nullptr;
+PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex = nullptr;
+PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding = nullptr;
+
+// Indirect drawing
+PFNGLCOPYBUFFERSUBDATAPROC glCopyBufferSubData = nullptr;
+PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor = nullptr;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect = nullptr;
+
+// Compute shaders
+PFNGLDISPATCHCOMPUTEPROC glDispatchCompute = nullptr;
+PFNGLMEMORYBARRIERPROC glMemoryBarrier = nullptr;
+PFNGLBINDIMAGETEXTUREPROC glBindImageTexture = nullptr;
+PFNGLCLEARBUFFERDATAPROC glClearBufferData = nullptr;
+PFNMYGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC glMultiDrawElementsIndirectCountARB = nullptr;
+
+// Shadow maps
+PFNGLFRAMEBUFFERTEXTURELAYERPROC glFramebufferTextureLayer = nullptr;
+PFNGLCOPYIMAGESUBDATAPROC glCopyImageSubData = nullptr;
+
+// Texture buffers
+PFNGLTEXBUFFERPROC glTexBuffer = nullptr;
+
+// Deferred shading
+PFNGLDRAWBUFFERSPROC glDrawBuffers = nullptr;
+
+// Timer queries
+PFNGLGENQUERIESPROC glGenQueries = nullptr;
+PFNGLDELETEQUERIESPROC glDeleteQueries = nullptr;
+PFNGLQUERYCOUNTERPROC glQueryCounter = nullptr;
+PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv = nullptr;
+PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v = nullptr;
+
+// Occlusion queries
+PFNGLBEGINQUERYPROC glBeginQuery = nullptr;
+PFNGLENDQUERYPROC glEndQuery = nullptr;
+PFNGLGETQUERYOBJECTUIVPROC glGetQueryObjectuiv = nullptr;
+
+// Fence sync
+PFNGLFENCESYNCPROC glFenceSync = nullptr;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync = nullptr;
+PFNGLDELETESYNCPROC glDeleteSync = nullptr;
+
 #if defined (_WIN32)
 #include "../include/GL/wglext.h"
 PFNGLBLENDEQUATIONPROC glBlendEquation = nullptr;
 PFNGLACTIVETEXTUREPROC glActiveTexture = nullptr;
 PFNGLCOMPRESSEDTEXIMAGE2D glCompressedTexImage2D = nullptr;
+PFNGLTEXIMAGE3DPROC glTexImage3D = nullptr;
 PFNGLBLENDCOLORPROC glBlendColor = nullptr;
 PFNWGLCHOOSEPIXELFORMATARBPROC wglChoosePixelFormatARB = nullptr;
+PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT = nullptr;
+PFNWGLGETEXTENSIONSSTRINGEXTPROC wglGetExtensionsStringEXT = nullptr;
 
 LRESULT CALLBACK InitWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -128,11 +203,35 @@ LRESULT CALLBACK InitWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPar
 #include <X11/Xlib.h>
 #include <GL/glx.h>
 //#include <GL/glu.h>
+
+// Swap control, optional
+PFNGLXSWAPINTERVALEXTPROC glXSwapIntervalEXT = nullptr;
+#endif
+
+struct OpenGLRenderer::SharedContext
+{
+#if defined (_WIN32)
+	HGLRC			hRC;
 #endif
 
-OpenGLRenderer::OpenGLRenderer() :
-	m_Context(nullptr)
+#if defined (_LINUX)
+	GLXContext		context;
+	GLXPbuffer		pbuffer; // Contexts need a drawable to be made current
+#endif
+};
+
+OpenGLRenderer::OpenGLRenderer(ShadingPath shadingPath) :
+	m_Context(nullptr),
+	m_pTextureManager(std::make_unique<TextureManager>()),
+	m_pShaderManager(std::make_unique<ShaderManager>(*this)),
+	m_pMeshBuffer(std::make_unique<MeshBuffer>()),
+	m_pFrameArena(std::make_unique<LinearArena>(MemoryTag::Frame)),
+	m_pSceneTimer(std::make_unique<GpuTimer>()),
+	m_bParallelShaderCompile(false),
+	m_pFrameData(std::make_unique<FrameUniforms>()),
+	m_bFrameUniformsValid(false)
 {
+	m_eShadingPath = shadingPath;
 #if defined (_WINDOWS)
 	m_hRC = nullptr;
 #endif
@@ -140,6 +239,17 @@ OpenGLRenderer::OpenGLRenderer() :
 
 OpenGLRenderer::~OpenGLRenderer()
 {
+	// Stop creating resources before releasing the ones already created
+	m_pResourceWorker = nullptr;
+	// Release textures, programs and buffers while the context is still alive
+	m_pDeferredShading = nullptr;
+	m_pSceneTimer = nullptr;
+	m_pShaderManager = nullptr;
+	m_pTextureManager = nullptr;
+	m_pMeshBuffer = nullptr;
+	m_pFrameUniforms = nullptr;
+	m_pObjectUniforms = nullptr;
+
 #if defined (_WINDOWS)
 	if (m_Context)
 	{
@@ -306,6 +416,37 @@ bool OpenGLRenderer::Create()
 	InitFunctions();
 #endif
 
+	// Let the driver compile shaders on as many threads as it wants
+	m_bParallelShaderCompile = glMaxShaderCompilerThreadsKHR &&
+		(HasExtension("GL_KHR_parallel_shader_compile") || HasExtension("GL_ARB_parallel_shader_compile"));
+	if (m_bParallelShaderCompile)
+	{
+		glMaxShaderCompilerThreadsKHR(0xffffffff);
+	}
+
+	// Shared uniform blocks need GL 3.1 or GL_ARB_uniform_buffer_object
+	m_pFrameUniforms = std::make_unique<UniformBuffer>();
+	m_pObjectUniforms = std::make_unique<StreamingUniformBuffer>();
+	if (!m_pFrameUniforms->Create(sizeof(FrameUniforms)) ||
+		!m_pObjectUniforms->Create(kObjectUniformBufferSize))
+	{
+		IApplication::Debug("OpenGLRenderer: uniform buffers not supported, using plain uniforms\n");
+		m_pFrameUniforms = nullptr;
+		m_pObjectUniforms = nullptr;
+	}
+
+	if (m_eShadingPath == ShadingPath::Deferred)
+	{
+		IApplication* app = IApplication::GetApp();
+		m_pDeferredShading = std::make_unique<DeferredShading>(*this);
+		if (!m_pDeferredShading->Create(app->GetWidth(), app->GetHeight()))
+		{
+			IApplication::Debug("OpenGLRenderer: deferred shading not supported, shading forward\n");
+			m_pDeferredShading = nullptr;
+			m_eShadingPath = ShadingPath::Forward;
+		}
+	}
+
 	// Set initial stage to OpenGL
 	SetDefaultSettings();
 	// Enable multisampling
@@ -319,6 +460,22 @@ bool OpenGLRenderer::Create()
 
 void OpenGLRenderer::Flip()
 {
+	// Hand off resources that the workers have finished
+	if (m_pResourceWorker)
+	{
+		m_pResourceWorker->Update();
+	}
+	// Upload reloaded textures and keep texture memory within the budget
+	m_pTextureManager->Update();
+	// Resolve programs that the driver has finished compiling
+	m_pShaderManager->Update();
+
+	// Object uniforms of this frame stay untouched until the GPU has drawn it
+	if (m_pObjectUniforms)
+	{
+		m_pObjectUniforms->NextFrame();
+	}
+
 	glFlush(); // Finalize all commands in the driver
 
 #if defined (_WIN32)
@@ -331,6 +488,166 @@ void OpenGLRenderer::Flip()
 	glXSwapBuffers(display, wnd);
 #endif
 
+	// Everything allocated for this frame is done with
+	m_pFrameArena->Reset();
+}
+
+bool OpenGLRenderer::MakeCurrent(bool current)
+{
+#if defined (_WIN32)
+	return wglMakeCurrent(current ? m_Context : nullptr, current ? m_hRC : nullptr) == TRUE;
+#endif
+
+#if defined (_LINUX)
+	Display* display = IApplication::GetApp()->GetDisplay();
+	if (current)
+	{
+		return glXMakeCurrent(display, (GLXDrawable)IApplication::GetApp()->GetWindow(), (GLXContext)m_Context);
+	}
+	return glXMakeCurrent(display, None, nullptr);
+#endif
+}
+
+bool OpenGLRenderer::SetSwapInterval(int32_t interval)
+{
+#if defined (_WIN32)
+	if (!wglSwapIntervalEXT)
+	{
+		return false;
+	}
+	if (interval < 0)
+	{
+		const char* extensions = wglGetExtensionsStringEXT ? wglGetExtensionsStringEXT() : nullptr;
+		if (!extensions || !strstr(extensions, "WGL_EXT_swap_control_tear"))
+		{
+			return false;
+		}
+	}
+	return wglSwapIntervalEXT(interval) == TRUE;
+#endif
+
+#if defined (_LINUX)
+	Display* display = IApplication::GetApp()->GetDisplay();
+	const char* extensions = glXQueryExtensionsString(display, DefaultScreen(display));
+	if (!glXSwapIntervalEXT || !extensions || !strstr(extensions, "GLX_EXT_swap_control"))
+	{
+		return false;
+	}
+	if (interval < 0 && !strstr(extensions, "GLX_EXT_swap_control_tear"))
+	{
+		return false;
+	}
+	glXSwapIntervalEXT(display, (GLXDrawable)IApplication::GetApp()->GetWindow(), interval);
+	return true;
+#endif
+}
+
+OpenGLRenderer::SharedContext* OpenGLRenderer::CreateSharedContext()
+{
+#if defined (_WIN32)
+	// Same pixel format as the window, so the context can be bound to the window's device context
+	HGLRC rc = wglCreateContext(m_Context);
+	if (!rc)
+	{
+		IApplication::Debug("OpenGLRenderer: wglCreateContext failed for shared context\n");
+		return nullptr;
+	}
+	if (!wglShareLists(m_hRC, rc))
+	{
+		IApplication::Debug("OpenGLRenderer: wglShareLists failed\n");
+		wglDeleteContext(rc);
+		return nullptr;
+	}
+
+	SharedContext* context = new SharedContext;
+	context->hRC = rc;
+	return context;
+#endif
+
+#if defined (_LINUX)
+	Display* display = IApplication::GetApp()->GetDisplay();
+	const int attributes[] = { GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT, GLX_RENDER_TYPE, GLX_RGBA_BIT, None };
+	int count = 0;
+	GLXFBConfig* configs = glXChooseFBConfig(display, DefaultScreen(display), attributes, &count);
+	if (!configs || count == 0)
+	{
+		IApplication::Debug("OpenGLRenderer: no pbuffer config for shared context\n");
+		return nullptr;
+	}
+
+	// Worker contexts never draw, a 1x1 pbuffer is enough to make them current
+	const int pbufferAttributes[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+	GLXContext glxContext = glXCreateNewContext(display, configs[0], GLX_RGBA_TYPE, (GLXContext)m_Context, True);
+	GLXPbuffer pbuffer = glxContext ? glXCreatePbuffer(display, configs[0], pbufferAttributes) : 0;
+	XFree(configs);
+	if (!pbuffer)
+	{
+		IApplication::Debug("OpenGLRenderer: failed to create shared context\n");
+		if (glxContext)
+		{
+			glXDestroyContext(display, glxContext);
+		}
+		return nullptr;
+	}
+
+	SharedContext* context = new SharedContext;
+	context->context = glxContext;
+	context->pbuffer = pbuffer;
+	return context;
+#endif
+}
+
+bool OpenGLRenderer::MakeSharedContextCurrent(SharedContext* context)
+{
+#if defined (_WIN32)
+	return wglMakeCurrent(context ? m_Context : nullptr, context ? context->hRC : nullptr) == TRUE;
+#endif
+
+#if defined (_LINUX)
+	Display* display = IApplication::GetApp()->GetDisplay();
+	if (context)
+	{
+		return glXMakeContextCurrent(display, context->pbuffer, context->pbuffer, context->context);
+	}
+	return glXMakeContextCurrent(display, None, None, nullptr);
+#endif
+}
+
+void OpenGLRenderer::DestroySharedContext(SharedContext* context)
+{
+	if (!context)
+	{
+		return;
+	}
+
+#if defined (_WIN32)
+	wglDeleteContext(context->hRC);
+#endif
+
+#if defined (_LINUX)
+	Display* display = IApplication::GetApp()->GetDisplay();
+	glXDestroyPbuffer(display, context->pbuffer);
+	glXDestroyContext(display, context->context);
+#endif
+
+	delete context;
+}
+
+bool OpenGLRenderer::StartResourceWorkers(uint32_t threadCount)
+{
+	if (m_pResourceWorker)
+	{
+		return true;
+	}
+
+	auto worker = std::make_unique<ResourceWorker>(*this);
+	if (!worker->Start(threadCount))
+	{
+		return false;
+	}
+	m_pResourceWorker = std::move(worker);
+	m_pTextureManager->SetResourceWorker(m_pResourceWorker.get());
+	return true;
 }
 
 void OpenGLRenderer::Clear(float r, float g, float b, float a, float depth, int32_t stencil)
@@ -353,6 +670,8 @@ bool OpenGLRenderer::SetTexture(uint32_t program, uint32_t texture, int32_t slot
 	// Activate correct texture slot in the GPU
 	glActiveTexture(GL_TEXTURE0 + slot);
 	glBindTexture(GL_TEXTURE_2D, texture);
+	// Let the texture manager know the texture is in use
+	m_pTextureManager->Touch(texture);
 	const GLint location = glGetUniformLocation(program, uniformName.data());
 	if (location >= 0)
 	{
@@ -365,21 +684,147 @@ bool OpenGLRenderer::SetTexture(uint32_t program, uint32_t texture, int32_t slot
 	}
 }
 
+void OpenGLRenderer::RenderScene(Node& root, GLuint program, const std::vector<PointLight>& lights)
+{
+	m_pSceneTimer->Begin();
+	if (m_eShadingPath == ShadingPath::Deferred)
+	{
+		m_pDeferredShading->Render(root, lights);
+	}
+	else
+	{
+		glUseProgram(program);
+		root.Render(*this, program);
+	}
+	m_pSceneTimer->End();
+}
+
+float OpenGLRenderer::GetSceneSeconds() const
+{
+	return m_pSceneTimer->GetElapsedSeconds();
+}
+
+void OpenGLRenderer::SetObjectTransform(GLuint program, const glm::mat4& modelMatrix)
+{
+	UpdateFrameUniforms();
+
+	if (GetUniformBlocks(program) & (1u << (uint32_t)UniformBlock::Object))
+	{
+		// The shader reads only the block, plain uniforms would leave the previous transform in place
+		const ObjectUniforms object = { modelMatrix, m_pFrameData->mViewProjection * modelMatrix };
+		if (!m_pObjectUniforms->Push(UniformBlock::Object, &object, sizeof(object)))
+		{
+			IApplication::Debug("OpenGLRenderer: failed to push object uniforms\n");
+		}
+		return;
+	}
+
+	SetUniformMatrix4(program, "modelMatrix", modelMatrix);
+	SetUniformMatrix4(program, "modelViewProjectionMatrix", m_mProjection * m_mView * modelMatrix);
+}
+
+void OpenGLRenderer::SetMaterial(GLuint program, const Material& material)
+{
+	if (GetUniformBlocks(program) & (1u << (uint32_t)UniformBlock::Material))
+	{
+		const UniformBuffer* buffer = material.GetUniformBuffer();
+		if (buffer)
+		{
+			buffer->BindRange(UniformBlock::Material, 0, sizeof(MaterialUniforms));
+			return;
+		}
+	}
+
+	material.SetToProgram(program);
+}
+
+void OpenGLRenderer::UpdateFrameUniforms()
+{
+	if (!m_pFrameUniforms)
+	{
+		return;
+	}
+
+	FrameUniforms& frame = *m_pFrameData;
+	if (m_bFrameUniformsValid &&
+		frame.mView == m_mView &&
+		frame.mProjection == m_mProjection &&
+		frame.mShadowBias == m_mShadowBias &&
+		glm::vec3(frame.vLightPosition) == m_vLightPosition)
+	{
+		return;
+	}
+
+	frame.mView = m_mView;
+	frame.mProjection = m_mProjection;
+	frame.mViewProjection = m_mProjection * m_mView;
+	frame.mShadowBias = m_mShadowBias;
+	frame.vLightPosition = glm::vec4(m_vLightPosition, 1.0f);
+	m_pFrameUniforms->SetData(&frame, sizeof(frame));
+	m_pFrameUniforms->Bind(UniformBlock::Frame);
+	m_bFrameUniformsValid = true;
+}
+
+uint32_t OpenGLRenderer::GetUniformBlocks(GLuint program)
+{
+	auto found = m_mapProgramBlocks.find(program);
+	if (found != m_mapProgramBlocks.end())
+	{
+		return found->second;
+	}
+
+	uint32_t blocks = 0;
+	if (m_pFrameUniforms)
+	{
+		static const char* names[(size_t)UniformBlock::Count] = { "FrameBlock", "MaterialBlock", "ObjectBlock" };
+		for (uint32_t i = 0; i < (uint32_t)UniformBlock::Count; ++i)
+		{
+			const GLuint index = glGetUniformBlockIndex(program, names[i]);
+			if (index != GL_INVALID_INDEX)
+			{
+				glUniformBlockBinding(program, index, i);
+				blocks |= 1u << i;
+			}
+		}
+	}
+
+	m_mapProgramBlocks[program] = blocks;
+	return blocks;
+}
+
+void OpenGLRenderer::ReleaseProgram(GLuint program)
+{
+	m_mapProgramBlocks.erase(program);
+	glDeleteProgram(program);
+}
+
 GLuint OpenGLRenderer::CreateTexture(const std::string_view& filename)
 {
-	GLuint textureHandle = 0;
+	return m_pTextureManager->Acquire(filename);
+}
+
+void OpenGLRenderer::ReleaseTexture(GLuint texture)
+{
+	m_pTextureManager->Release(texture);
+}
 
+bool OpenGLRenderer::LoadImageData(const std::string_view& filename, std::vector<uint8_t>& pixels, int32_t& width, int32_t& height)
+{
 	int32_t textureWidth = 0;
 	int32_t textureHeight = 0;
 	int32_t bitsPerPixel = 0;
 
+	// Copy the name so that it is zero terminated for stb image loader
+	const std::string name(filename);
+
 	// Load initialized data into a pointer with stb image loader
-	uint8_t* imgdata = stbi_load(filename.data(), &textureWidth, &textureHeight, &bitsPerPixel, STBI_rgb_alpha);
+	uint8_t* imgdata = stbi_load(name.c_str(), &textureWidth, &textureHeight, &bitsPerPixel, STBI_rgb_alpha);
 	if (!imgdata || !textureWidth || !textureHeight || !bitsPerPixel)
 	{
 		IApplication::Debug("Failed to load image");
-		IApplication::Debug(filename.data());
-		return 0;
+		IApplication::Debug(name);
+		stbi_image_free(imgdata);
+		return false;
 	}
 
 	// Multiply color values of all pixels with alpha when loading the data for faster blending
@@ -396,49 +841,17 @@ GLuint OpenGLRenderer::CreateTexture(const std::string_view& filename)
 		}
 	}
 
-	GLint internalFormat = GL_RGBA;
-	GLenum format = GL_RGBA;
-	// Store possible error into a variable for debugging purposes
-	GLenum err = glGetError();
-
-	glGenTextures(1, &textureHandle);
-
-	// Activate first texture slot
-	glActiveTexture(GL_TEXTURE0);
-	// Make texture operations apply to current texture
-	glBindTexture(GL_TEXTURE_2D, textureHandle);
-	// Transfer image data to GPU memory
-	glTexImage2D(GL_TEXTURE_2D,
-		0,						// Texture level
-		internalFormat,			// Format for pixels in GPU memory
-		textureWidth,
-		textureHeight,
-		0,						// Border
-		format,					// Format of incoming data
-		GL_UNSIGNED_BYTE,		// Type of the incoming data
-		imgdata);
+	pixels.assign(imgdata, imgdata + imgdatabytes);
+	width = textureWidth;
+	height = textureHeight;
 
-	delete[] imgdata;
-
-	err = glGetError();
-
-	// Set default values for texture filtering and wrapping
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Smaller than original size
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Bigger than original size
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // Texture coordinate x
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Texture coordinate y
-
-	return textureHandle;
+	stbi_image_free(imgdata);
+	return true;
 }
 
 GLuint OpenGLRenderer::CreateVertexShader(const char* vertexShader)
 {
-	// Create the vertex shader object
-	GLuint shaderHandle = glCreateShader(GL_VERTEX_SHADER);
-	// Load source code to the empty shader object
-	glShaderSource(shaderHandle, 1, (const char**)&vertexShader, nullptr);
-	// Compile the source code
-	glCompileShader(shaderHandle);
+	GLuint shaderHandle = SubmitShader(GL_VERTEX_SHADER, vertexShader);
 
 	// Check if compilation was succesful by getting compile status
 	GLint shaderCompiled = 0;
@@ -456,26 +869,17 @@ GLuint OpenGLRenderer::CreateVertexShader(const char* vertexShader)
 
 GLuint OpenGLRenderer::CreateVertexShaderFromFile(const std::string_view& filename)
 {
-	// Open file with binary mode
-	std::ifstream f(filename.data(), std::ios::binary);
-	// Read bytes from the file to vector of characters
-	std::vector<char> bytes(
-		(std::istreambuf_iterator<char>(f)),
-		(std::istreambuf_iterator<char>()));
-	// Add terminating zero for charbuffer incase file does not contain it
-	bytes.push_back(0);
-
-	return CreateVertexShader(bytes.data());
+	std::string text;
+	if (!LoadTextFile(filename, text))
+	{
+		return 0;
+	}
+	return CreateVertexShader(text.c_str());
 }
 
 GLuint OpenGLRenderer::CreateFragmentShader(const char* fragmentShader)
 {
-	// Create the fragment shader object
-	GLuint shaderHandle = glCreateShader(GL_FRAGMENT_SHADER);
-	// Load the source code to the empty shader object
-	glShaderSource(shaderHandle, 1, (const char**)&fragmentShader, nullptr);
-	// Compile the source code
-	glCompileShader(shaderHandle);
+	GLuint shaderHandle = SubmitShader(GL_FRAGMENT_SHADER, fragmentShader);
 
 	// Check if compilation succeeded
 	GLint shaderCompiled;
@@ -494,24 +898,74 @@ GLuint OpenGLRenderer::CreateFragmentShader(const char* fragmentShader)
 
 GLuint OpenGLRenderer::CreateFragmentShaderFromFile(const std::string_view& filename)
 {
-	// Load contents of the file to array of chars
-	std::ifstream f(filename.data(), std::ios::binary);
-	std::vector<char> bytes(
-		(std::istreambuf_iterator<char>(f)),
-		(std::istreambuf_iterator<char>()));
-	// Add terminating zero for charbuffer incase file does not contain it
-	bytes.push_back(0);
+	std::string text;
+	if (!LoadTextFile(filename, text))
+	{
+		return 0;
+	}
+	return CreateFragmentShader(text.c_str());
+}
+
+bool OpenGLRenderer::LoadTextFile(const std::string_view& filename, std::string& text)
+{
+	// Open file with binary mode at the end to get its size
+	std::ifstream f(std::string(filename), std::ios::binary | std::ios::ate);
+	if (!f)
+	{
+		IApplication::Debug("Failed to open file ");
+		IApplication::Debug(std::string(filename) + "\n");
+		return false;
+	}
 
-	return CreateFragmentShader(bytes.data());
+	// Read the whole file with a single call
+	const std::streamsize size = f.tellg();
+	text.resize((size_t)size);
+	f.seekg(0);
+	f.read(&text[0], size);
+	return f.good();
 }
 
-GLuint OpenGLRenderer::CreateProgram(GLuint vertexShader, GLuint fragmentShader)
+GLuint OpenGLRenderer::CreateProgram(GLuint vertexShader, GLuint fragmentShader, bool retrievableBinary)
 {
-	// Create the shader program
+	GLuint programHandle = SubmitProgram(vertexShader, fragmentShader, retrievableBinary);
+
+	GLint linked = 0;
+	glGetProgramiv(programHandle, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		IApplication::Debug("Failed to link program:");
+		PrintProgramError(programHandle);
+
+		glDeleteProgram(programHandle);
+		programHandle = 0;
+	}
+
+	return programHandle;
+}
+
+GLuint OpenGLRenderer::CreateComputeProgram(const char* computeShader)
+{
+	if (!glDispatchCompute)
+	{
+		return 0;
+	}
+
+	GLuint shaderHandle = SubmitShader(GL_COMPUTE_SHADER, computeShader);
+	GLint shaderCompiled = 0;
+	glGetShaderiv(shaderHandle, GL_COMPILE_STATUS, &shaderCompiled);
+	if (!shaderCompiled)
+	{
+		IApplication::Debug("Failed to compile compute shader:");
+		PrintShaderError(shaderHandle);
+		glDeleteShader(shaderHandle);
+		return 0;
+	}
+
 	GLuint programHandle = glCreateProgram();
-	glAttachShader(programHandle, fragmentShader);
-	glAttachShader(programHandle, vertexShader);
+	glAttachShader(programHandle, shaderHandle);
 	glLinkProgram(programHandle);
+	glDetachShader(programHandle, shaderHandle);
+	glDeleteShader(shaderHandle);
 
 	GLint linked = 0;
 	glGetProgramiv(programHandle, GL_LINK_STATUS, &linked);
@@ -519,7 +973,6 @@ GLuint OpenGLRenderer::CreateProgram(GLuint vertexShader, GLuint fragmentShader)
 	{
 		IApplication::Debug("Failed to link program:");
 		PrintProgramError(programHandle);
-
 		glDeleteProgram(programHandle);
 		programHandle = 0;
 	}
@@ -527,6 +980,78 @@ GLuint OpenGLRenderer::CreateProgram(GLuint vertexShader, GLuint fragmentShader)
 	return programHandle;
 }
 
+GLuint OpenGLRenderer::SubmitShader(GLenum type, const char* source)
+{
+	// Create the shader object
+	GLuint shaderHandle = glCreateShader(type);
+	// Load source code to the empty shader object
+	glShaderSource(shaderHandle, 1, (const char**)&source, nullptr);
+	// Compile the source code, status is not queried so the driver can continue in the background
+	glCompileShader(shaderHandle);
+	return shaderHandle;
+}
+
+GLuint OpenGLRenderer::SubmitProgram(GLuint vertexShader, GLuint fragmentShader, bool retrievableBinary)
+{
+	// Create the shader program
+	GLuint programHandle = glCreateProgram();
+	if (retrievableBinary && glProgramParameteri)
+	{
+		// Ask driver to keep the binary for glGetProgramBinary
+		glProgramParameteri(programHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glAttachShader(programHandle, fragmentShader);
+	glAttachShader(programHandle, vertexShader);
+	glLinkProgram(programHandle);
+	return programHandle;
+}
+
+bool OpenGLRenderer::IsProgramCompleted(GLuint program) const
+{
+	if (!m_bParallelShaderCompile)
+	{
+		// Without the extension any status query waits for the driver anyway
+		return true;
+	}
+
+	GLint completed = 0;
+	glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed != 0;
+}
+
+bool OpenGLRenderer::HasExtension(const char* name)
+{
+	// Compatibility contexts still have the full extension string
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	if (extensions)
+	{
+		const size_t length = strlen(name);
+		for (const char* p = strstr(extensions, name); p; p = strstr(p + length, name))
+		{
+			if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == 0))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	if (glGetStringi)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension && strcmp(extension, name) == 0)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
 void OpenGLRenderer::PrintShaderError(GLuint shader)
 {
 	GLint infologLength = 0;
@@ -584,8 +1109,15 @@ bool OpenGLRenderer::InitFunctions()
 	glBlendEquation = (PFNGLBLENDEQUATIONPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBlendEquation");
 	glActiveTexture = (PFNGLACTIVETEXTUREPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glActiveTexture");
 	glCompressedTexImage2D = (PFNGLCOMPRESSEDTEXIMAGE2D)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glCompressedTexImage2D");
+	glTexImage3D = (PFNGLTEXIMAGE3DPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glTexImage3D");
 	glBlendColor = (PFNGLBLENDCOLORPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBlendColor");
 	wglChoosePixelFormatARB = (PFNWGLCHOOSEPIXELFORMATARBPROC)wglGetProcAddress("wglChoosePixelFormatARB");
+	wglSwapIntervalEXT = (PFNWGLSWAPINTERVALEXTPROC)wglGetProcAddress("wglSwapIntervalEXT");
+	wglGetExtensionsStringEXT = (PFNWGLGETEXTENSIONSSTRINGEXTPROC)wglGetProcAddress("wglGetExtensionsStringEXT");
+#endif
+#if defined (_LINUX)
+	// Swap control, optional
+	glXSwapIntervalEXT = (PFNGLXSWAPINTERVALEXTPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glXSwapIntervalEXT");
 #endif
 
 	glBlendEquationSeparate = (PFNGLBLENDEQUATIONSEPARATEPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBlendEquationSeparate");
@@ -661,6 +1193,73 @@ bool OpenGLRenderer::InitFunctions()
 	glClearDepthf = (PFNGLCLEARDEPTHFPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glClearDepthf");
 	glGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGenerateMipmap");
 
+	// Program binary, optional
+	glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGetProgramBinary");
+	glProgramBinary = (PFNGLPROGRAMBINARYPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glProgramBinary");
+	glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glProgramParameteri");
+
+	// Parallel shader compile, optional. ARB and KHR versions have the same signature.
+	glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glMaxShaderCompilerThreadsKHR");
+	if (!glMaxShaderCompilerThreadsKHR)
+	{
+		glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glMaxShaderCompilerThreadsARB");
+	}
+	glGetStringi = (PFNGLGETSTRINGIPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGetStringi");
+
+	// Uniform buffers, optional
+	glBufferSubData = (PFNGLBUFFERSUBDATAPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBufferSubData");
+	glGetBufferSubData = (PFNGLGETBUFFERSUBDATAPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGetBufferSubData");
+	glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glMapBufferRange");
+	glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glUnmapBuffer");
+	glBufferStorage = (PFNGLBUFFERSTORAGEPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBufferStorage");
+	glBindBufferBase = (PFNGLBINDBUFFERBASEPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBindBufferBase");
+	glBindBufferRange = (PFNGLBINDBUFFERRANGEPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBindBufferRange");
+	glGetUniformBlockIndex = (PFNGLGETUNIFORMBLOCKINDEXPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGetUniformBlockIndex");
+	glUniformBlockBinding = (PFNGLUNIFORMBLOCKBINDINGPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glUniformBlockBinding");
+
+	// Indirect drawing, optional
+	glCopyBufferSubData = (PFNGLCOPYBUFFERSUBDATAPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glCopyBufferSubData");
+	glVertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glVertexAttribDivisor");
+	glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glMultiDrawElementsIndirect");
+
+	// Compute shaders, optional. Indirect count is core in 4.6 and has the same signature as the ARB version.
+	glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glDispatchCompute");
+	glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glMemoryBarrier");
+	glBindImageTexture = (PFNGLBINDIMAGETEXTUREPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBindImageTexture");
+	glClearBufferData = (PFNGLCLEARBUFFERDATAPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glClearBufferData");
+	glMultiDrawElementsIndirectCountARB = (PFNMYGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glMultiDrawElementsIndirectCount");
+	if (!glMultiDrawElementsIndirectCountARB)
+	{
+		glMultiDrawElementsIndirectCountARB = (PFNMYGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glMultiDrawElementsIndirectCountARB");
+	}
+
+	// Shadow maps, layer copies are optional
+	glFramebufferTextureLayer = (PFNGLFRAMEBUFFERTEXTURELAYERPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glFramebufferTextureLayer");
+	glCopyImageSubData = (PFNGLCOPYIMAGESUBDATAPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glCopyImageSubData");
+
+	// Texture buffers, optional
+	glTexBuffer = (PFNGLTEXBUFFERPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glTexBuffer");
+
+	// Deferred shading, optional
+	glDrawBuffers = (PFNGLDRAWBUFFERSPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glDrawBuffers");
+
+	// Timer queries, optional
+	glGenQueries = (PFNGLGENQUERIESPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGenQueries");
+	glDeleteQueries = (PFNGLDELETEQUERIESPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glDeleteQueries");
+	glQueryCounter = (PFNGLQUERYCOUNTERPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glQueryCounter");
+	glGetQueryObjectiv = (PFNGLGETQUERYOBJECTIVPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGetQueryObjectiv");
+	glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGetQueryObjectui64v");
+
+	// Occlusion queries, optional
+	glBeginQuery = (PFNGLBEGINQUERYPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glBeginQuery");
+	glEndQuery = (PFNGLENDQUERYPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glEndQuery");
+	glGetQueryObjectuiv = (PFNGLGETQUERYOBJECTUIVPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glGetQueryObjectuiv");
+
+	// Fence sync, optional
+	glFenceSync = (PFNGLFENCESYNCPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glFenceSync");
+	glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glClientWaitSync");
+	glDeleteSync = (PFNGLDELETESYNCPROC)GL_GETPROCADDRESS((GL_GETPROCADDRESS_PARAM_TYPE)"glDeleteSync");
+
 	// Check that functions were loaded properly
 	if (!glCreateProgram)
 	{
@@ -0,0 +1,623 @@
+#include "../include/RenderGraph.h"
+#include "../include/Allocator.h"
+
+#include <algorithm>
+
+// Target id used for an index that is not set
+constexpr uint32_t kUnused = 0xffffffffu;
+
+RenderGraph::RenderGraph(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_bCompiled(false),
+	m_BoundFramebuffer(0),
+	m_uFrame(0),
+	m_Stats({})
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	Release();
+}
+
+void RenderGraph::Reset()
+{
+	m_arrTargets.clear();
+	m_arrPasses.clear();
+	m_arrOrder.clear();
+	m_arrPhysical.clear();
+	m_bCompiled = false;
+}
+
+uint32_t RenderGraph::CreateTarget(const std::string_view& name, const RenderTargetDesc& desc)
+{
+	TARGET target = {};
+	target.strName = name;
+	target.desc = desc;
+	target.iPhysical = -1;
+	m_arrTargets.push_back(target);
+	m_bCompiled = false;
+	return (uint32_t)m_arrTargets.size() - 1;
+}
+
+uint32_t RenderGraph::ImportTexture(const std::string_view& name, GLuint texture, const RenderTargetDesc& desc)
+{
+	const uint32_t id = CreateTarget(name, desc);
+	m_arrTargets[id].handle = texture;
+	m_arrTargets[id].bImported = true;
+	return id;
+}
+
+uint32_t RenderGraph::ImportBackbuffer(int32_t width, int32_t height)
+{
+	const uint32_t id = ImportTexture("Backbuffer", 0, { width, height, GL_RGBA8, false });
+	m_arrTargets[id].bBackbuffer = true;
+	return id;
+}
+
+uint32_t RenderGraph::AddPass(const std::string_view& name, ExecuteFunction execute)
+{
+	PASS pass = {};
+	pass.strName = name;
+	pass.execute = std::move(execute);
+	m_arrPasses.push_back(std::move(pass));
+	m_bCompiled = false;
+	return (uint32_t)m_arrPasses.size() - 1;
+}
+
+void RenderGraph::Read(uint32_t pass, uint32_t target)
+{
+	m_arrPasses[pass].arrReads.push_back(target);
+	m_arrTargets[target].arrReaders.push_back(pass);
+	m_bCompiled = false;
+}
+
+void RenderGraph::Write(uint32_t pass, uint32_t target)
+{
+	m_arrPasses[pass].arrWrites.push_back(target);
+	m_arrTargets[target].arrWriters.push_back(pass);
+	m_bCompiled = false;
+}
+
+void RenderGraph::SetSideEffect(uint32_t pass)
+{
+	m_arrPasses[pass].bSideEffect = true;
+	m_bCompiled = false;
+}
+
+bool RenderGraph::Compile()
+{
+	m_bCompiled = false;
+	m_arrOrder.clear();
+	m_arrPhysical.clear();
+	m_Stats = {};
+
+	// A transient target must be written before anything can read it
+	for (const auto& target : m_arrTargets)
+	{
+		if (target.bImported)
+		{
+			continue;
+		}
+		const uint32_t firstWriter = target.arrWriters.empty() ? kUnused : *std::min_element(target.arrWriters.begin(), target.arrWriters.end());
+		for (uint32_t reader : target.arrReaders)
+		{
+			if (firstWriter == kUnused || firstWriter > reader)
+			{
+				IApplication::Debug("RenderGraph: pass " + m_arrPasses[reader].strName + " reads " + target.strName + " before it is written\n");
+				return false;
+			}
+		}
+	}
+
+	CullPasses();
+	if (!SortPasses())
+	{
+		return false;
+	}
+	AliasTargets();
+
+	m_bCompiled = true;
+	return true;
+}
+
+void RenderGraph::Execute()
+{
+	if (!m_bCompiled)
+	{
+		return;
+	}
+
+	GLint prevFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+	m_BoundFramebuffer = (GLuint)prevFramebuffer;
+
+	for (uint32_t id : m_arrOrder)
+	{
+		PASS& pass = m_arrPasses[id];
+		BindOutputs(pass);
+		if (pass.execute)
+		{
+			pass.execute(*this);
+		}
+	}
+
+	if (m_BoundFramebuffer != (GLuint)prevFramebuffer)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, prevFramebuffer);
+	}
+
+	++m_uFrame;
+	ReleaseUnusedTargets();
+}
+
+GLuint RenderGraph::GetTexture(uint32_t target) const
+{
+	const TARGET& t = m_arrTargets[target];
+	if (t.bImported)
+	{
+		return t.handle;
+	}
+	return (t.iPhysical >= 0) ? m_arrPhysical[t.iPhysical].handle : 0;
+}
+
+void RenderGraph::Release()
+{
+	for (const auto& framebuffer : m_mapFramebuffers)
+	{
+		glDeleteFramebuffers(1, &framebuffer.second);
+	}
+	m_mapFramebuffers.clear();
+
+	for (const auto& pooled : m_arrPool)
+	{
+		if (pooled.desc.bRenderbuffer)
+		{
+			glDeleteRenderbuffers(1, &pooled.handle);
+		}
+		else
+		{
+			glDeleteTextures(1, &pooled.handle);
+		}
+	}
+	m_arrPool.clear();
+	m_arrPhysical.clear();
+	m_bCompiled = false;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Passes are referenced by the targets they write, targets by the passes reading them
+	for (auto& pass : m_arrPasses)
+	{
+		pass.uRefCount = (uint32_t)pass.arrWrites.size();
+		pass.bCulled = false;
+	}
+	// Each target becomes unreferenced at most once
+	ArenaVector<uint32_t> unreferenced(m_Renderer.GetFrameArena());
+	unreferenced.reserve(m_arrTargets.size());
+	for (uint32_t t = 0; t < (uint32_t)m_arrTargets.size(); ++t)
+	{
+		TARGET& target = m_arrTargets[t];
+		target.uRefCount = (uint32_t)target.arrReaders.size() + (target.bImported ? 1 : 0);
+		if (target.uRefCount == 0)
+		{
+			unreferenced.push_back(t);
+		}
+	}
+
+	// Remove writers of unread targets, which may leave their inputs unread too
+	while (!unreferenced.empty())
+	{
+		const TARGET& target = m_arrTargets[unreferenced.back()];
+		unreferenced.pop_back();
+		for (uint32_t writer : target.arrWriters)
+		{
+			PASS& pass = m_arrPasses[writer];
+			if (pass.bCulled || pass.bSideEffect || --pass.uRefCount > 0)
+			{
+				continue;
+			}
+			pass.bCulled = true;
+			for (uint32_t read : pass.arrReads)
+			{
+				if (--m_arrTargets[read].uRefCount == 0)
+				{
+					unreferenced.push_back(read);
+				}
+			}
+		}
+	}
+
+	// Passes without outputs or side effects do nothing visible
+	for (auto& pass : m_arrPasses)
+	{
+		if (pass.arrWrites.empty() && !pass.bSideEffect)
+		{
+			pass.bCulled = true;
+		}
+		if (pass.bCulled)
+		{
+			++m_Stats.uCulledPasses;
+		}
+	}
+}
+
+bool RenderGraph::SortPasses()
+{
+	// Edges follow the declaration order: readers after earlier writers, writers
+	// after earlier readers and writers of the same target
+	const size_t passCount = m_arrPasses.size();
+	LinearArena& arena = m_Renderer.GetFrameArena();
+	ArenaVector<ArenaVector<uint32_t>> edges(passCount, ArenaVector<uint32_t>(arena), arena);
+	ArenaVector<uint32_t> dependencies(passCount, 0, arena);
+	auto addEdge = [&](uint32_t from, uint32_t to)
+	{
+		if (from != to && !m_arrPasses[from].bCulled && !m_arrPasses[to].bCulled)
+		{
+			edges[from].push_back(to);
+			++dependencies[to];
+		}
+	};
+	for (const auto& target : m_arrTargets)
+	{
+		for (uint32_t writer : target.arrWriters)
+		{
+			for (uint32_t reader : target.arrReaders)
+			{
+				if (writer < reader)
+				{
+					addEdge(writer, reader);
+				}
+				else
+				{
+					addEdge(reader, writer);
+				}
+			}
+			for (uint32_t other : target.arrWriters)
+			{
+				if (writer < other)
+				{
+					addEdge(writer, other);
+				}
+			}
+		}
+	}
+
+	ArenaVector<uint32_t> ready(arena);
+	ready.reserve(passCount);
+	size_t activeCount = 0;
+	for (uint32_t p = 0; p < (uint32_t)passCount; ++p)
+	{
+		if (!m_arrPasses[p].bCulled)
+		{
+			++activeCount;
+			if (dependencies[p] == 0)
+			{
+				ready.push_back(p);
+			}
+		}
+	}
+
+	while (!ready.empty())
+	{
+		// Prefer a pass rendering into the same targets as the previous one to save a
+		// framebuffer switch, otherwise keep the declaration order
+		auto next = std::min_element(ready.begin(), ready.end());
+		if (!m_arrOrder.empty())
+		{
+			const auto& prevWrites = m_arrPasses[m_arrOrder.back()].arrWrites;
+			auto same = std::find_if(ready.begin(), ready.end(), [&](uint32_t p) { return m_arrPasses[p].arrWrites == prevWrites; });
+			if (same != ready.end())
+			{
+				next = same;
+			}
+		}
+		const uint32_t id = *next;
+		ready.erase(next);
+		m_arrOrder.push_back(id);
+
+		for (uint32_t to : edges[id])
+		{
+			if (--dependencies[to] == 0)
+			{
+				ready.push_back(to);
+			}
+		}
+	}
+
+	if (m_arrOrder.size() != activeCount)
+	{
+		IApplication::Debug("RenderGraph: passes form a cycle\n");
+		m_arrOrder.clear();
+		return false;
+	}
+	m_Stats.uPasses = m_arrOrder.size();
+	return true;
+}
+
+void RenderGraph::AliasTargets()
+{
+	for (auto& target : m_arrTargets)
+	{
+		target.uFirstUse = kUnused;
+		target.uLastUse = 0;
+		target.iPhysical = -1;
+	}
+	for (uint32_t i = 0; i < (uint32_t)m_arrOrder.size(); ++i)
+	{
+		const PASS& pass = m_arrPasses[m_arrOrder[i]];
+		for (const auto* list : { &pass.arrReads, &pass.arrWrites })
+		{
+			for (uint32_t t : *list)
+			{
+				TARGET& target = m_arrTargets[t];
+				target.uFirstUse = std::min(target.uFirstUse, i);
+				target.uLastUse = std::max(target.uLastUse, i);
+			}
+		}
+	}
+
+	ArenaVector<uint32_t> transients(m_Renderer.GetFrameArena());
+	transients.reserve(m_arrTargets.size());
+	for (uint32_t t = 0; t < (uint32_t)m_arrTargets.size(); ++t)
+	{
+		const TARGET& target = m_arrTargets[t];
+		if (!target.bImported && target.uFirstUse != kUnused)
+		{
+			transients.push_back(t);
+			m_Stats.uUnaliasedBytes += (size_t)target.desc.iWidth * target.desc.iHeight * GetPixelSize(target.desc.eFormat);
+		}
+	}
+	m_Stats.uTransientTargets = transients.size();
+
+	// Reuse a physical target of the same format as soon as its previous user is done
+	std::sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b) { return m_arrTargets[a].uFirstUse < m_arrTargets[b].uFirstUse; });
+	for (uint32_t t : transients)
+	{
+		TARGET& target = m_arrTargets[t];
+		int32_t physical = -1;
+		for (int32_t i = 0; i < (int32_t)m_arrPhysical.size(); ++i)
+		{
+			if (m_arrPhysical[i].desc == target.desc && m_arrPhysical[i].uLastUse < target.uFirstUse)
+			{
+				physical = i;
+				break;
+			}
+		}
+		if (physical < 0)
+		{
+			physical = (int32_t)m_arrPhysical.size();
+			m_arrPhysical.push_back({ target.desc, 0, 0 });
+			m_Stats.uTransientBytes += (size_t)target.desc.iWidth * target.desc.iHeight * GetPixelSize(target.desc.eFormat);
+		}
+		m_arrPhysical[physical].uLastUse = target.uLastUse;
+		target.iPhysical = physical;
+	}
+	m_Stats.uPhysicalTargets = m_arrPhysical.size();
+
+	for (auto& pooled : m_arrPool)
+	{
+		pooled.bInUse = false;
+	}
+	for (auto& physical : m_arrPhysical)
+	{
+		physical.handle = AcquireTarget(physical.desc);
+	}
+}
+
+GLuint RenderGraph::AcquireTarget(const RenderTargetDesc& desc)
+{
+	for (auto& pooled : m_arrPool)
+	{
+		if (!pooled.bInUse && pooled.desc == desc)
+		{
+			pooled.bInUse = true;
+			pooled.uLastFrame = m_uFrame;
+			return pooled.handle;
+		}
+	}
+
+	GLuint handle = 0;
+	if (desc.bRenderbuffer)
+	{
+		glGenRenderbuffers(1, &handle);
+		glBindRenderbuffer(GL_RENDERBUFFER, handle);
+		glRenderbufferStorage(GL_RENDERBUFFER, desc.eFormat, desc.iWidth, desc.iHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	}
+	else
+	{
+		// Pixel transfer format only has to be valid, no data is uploaded
+		const bool depth = IsDepthFormat(desc.eFormat);
+		const bool stencil = desc.eFormat == GL_DEPTH24_STENCIL8 || desc.eFormat == GL_DEPTH32F_STENCIL8;
+		const GLenum format = stencil ? GL_DEPTH_STENCIL : (depth ? GL_DEPTH_COMPONENT : GL_RGBA);
+		const GLenum type = stencil ? GL_UNSIGNED_INT_24_8 : (depth ? GL_UNSIGNED_INT : GL_UNSIGNED_BYTE);
+
+		glGenTextures(1, &handle);
+		glBindTexture(GL_TEXTURE_2D, handle);
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.eFormat, desc.iWidth, desc.iHeight, 0, format, (desc.eFormat == GL_DEPTH32F_STENCIL8) ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : type, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	m_arrPool.push_back({ desc, handle, m_uFrame, true });
+	return handle;
+}
+
+void RenderGraph::ReleaseUnusedTargets()
+{
+	for (size_t i = 0; i < m_arrPool.size();)
+	{
+		const POOLTARGET& pooled = m_arrPool[i];
+		if (pooled.bInUse || m_uFrame - pooled.uLastFrame <= kPoolFrames)
+		{
+			++i;
+			continue;
+		}
+
+		// Framebuffers using the target go with it
+		const GLuint key = pooled.handle * 2 + (pooled.desc.bRenderbuffer ? 1 : 0);
+		for (auto it = m_mapFramebuffers.begin(); it != m_mapFramebuffers.end();)
+		{
+			if (std::find(it->first.begin(), it->first.end(), key) != it->first.end())
+			{
+				glDeleteFramebuffers(1, &it->second);
+				it = m_mapFramebuffers.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		if (pooled.desc.bRenderbuffer)
+		{
+			glDeleteRenderbuffers(1, &pooled.handle);
+		}
+		else
+		{
+			glDeleteTextures(1, &pooled.handle);
+		}
+		m_arrPool[i] = m_arrPool.back();
+		m_arrPool.pop_back();
+	}
+}
+
+bool RenderGraph::BindOutputs(const PASS& pass)
+{
+	if (pass.arrWrites.empty())
+	{
+		return false;
+	}
+
+	GLuint framebuffer = 0;
+	const TARGET& first = m_arrTargets[pass.arrWrites.front()];
+	if (!first.bBackbuffer)
+	{
+		framebuffer = GetFramebuffer(pass.arrWrites);
+		if (!framebuffer)
+		{
+			return false;
+		}
+	}
+
+	if (framebuffer != m_BoundFramebuffer)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		m_BoundFramebuffer = framebuffer;
+		++m_Stats.uFramebufferBinds;
+	}
+	glViewport(0, 0, first.desc.iWidth, first.desc.iHeight);
+	return true;
+}
+
+GLuint RenderGraph::GetFramebuffer(const std::vector<uint32_t>& targets)
+{
+	// Key holds the attachments in order, the lowest bit tells renderbuffers apart
+	std::vector<GLuint> key;
+	key.reserve(targets.size());
+	for (uint32_t t : targets)
+	{
+		const TARGET& target = m_arrTargets[t];
+		key.push_back(GetTexture(t) * 2 + (target.desc.bRenderbuffer ? 1 : 0));
+	}
+
+	auto found = m_mapFramebuffers.find(key);
+	if (found != m_mapFramebuffers.end())
+	{
+		return found->second;
+	}
+
+	GLuint framebuffer = 0;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	m_BoundFramebuffer = framebuffer;
+
+	std::vector<GLenum> drawBuffers;
+	for (uint32_t t : targets)
+	{
+		const TARGET& target = m_arrTargets[t];
+		GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)drawBuffers.size();
+		if (IsDepthFormat(target.desc.eFormat))
+		{
+			const bool stencil = target.desc.eFormat == GL_DEPTH24_STENCIL8 || target.desc.eFormat == GL_DEPTH32F_STENCIL8;
+			attachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		}
+		else
+		{
+			drawBuffers.push_back(attachment);
+		}
+
+		if (target.desc.bRenderbuffer)
+		{
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, GetTexture(t));
+		}
+		else
+		{
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, GetTexture(t), 0);
+		}
+	}
+
+	if (drawBuffers.empty())
+	{
+		glDrawBuffer(GL_NONE);
+	}
+	else if (glDrawBuffers)
+	{
+		glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		IApplication::Debug("RenderGraph: framebuffer of " + m_arrTargets[targets.front()].strName + " is incomplete\n");
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		m_BoundFramebuffer = 0;
+		glDeleteFramebuffers(1, &framebuffer);
+		return 0;
+	}
+
+	m_mapFramebuffers.emplace(key, framebuffer);
+	return framebuffer;
+}
+
+bool RenderGraph::IsDepthFormat(GLenum format)
+{
+	switch (format)
+	{
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH32F_STENCIL8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+size_t RenderGraph::GetPixelSize(GLenum format)
+{
+	switch (format)
+	{
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RGBA16:
+	case GL_RGBA16F:
+	case GL_RG32F:
+	case GL_DEPTH32F_STENCIL8:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		return 4;
+	}
+}
@@ -0,0 +1,180 @@
+#include "../include/RenderThread.h"
+#include "../include/FramePacer.h"
+
+#include <algorithm>
+
+RenderThread::RenderThread(IApplication& app, IRenderer& renderer, uint32_t slotCount) :
+	m_App(app),
+	m_Renderer(renderer),
+	m_arrPackets(std::clamp(slotCount, 2u, 3u)),
+	m_eState(State::Stopped),
+	m_bQuit(false),
+	m_uSubmitted(0),
+	m_uRendered(0),
+	m_Fence(nullptr),
+	m_Stats({})
+{
+}
+
+RenderThread::~RenderThread()
+{
+	Stop();
+}
+
+bool RenderThread::Start()
+{
+	Stop();
+
+	if (!m_Renderer.MakeCurrent(false))
+	{
+		IApplication::Debug("RenderThread: failed to release the context\n");
+		return false;
+	}
+
+	m_bQuit = false;
+	m_uSubmitted = 0;
+	m_uRendered = 0;
+	m_eState = State::Starting;
+	m_Thread = std::thread(&RenderThread::ThreadMain, this);
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_FreeCondition.wait(lock, [this] { return m_eState != State::Starting; });
+	if (m_eState != State::Running)
+	{
+		lock.unlock();
+		Stop();
+		return false;
+	}
+	return true;
+}
+
+void RenderThread::Stop()
+{
+	if (!m_Thread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bQuit = true;
+	}
+	m_SubmitCondition.notify_all();
+	m_Thread.join();
+
+	m_eState = State::Stopped;
+	m_Renderer.MakeCurrent(true);
+}
+
+FramePacket& RenderThread::BeginFrame()
+{
+	const uint64_t slotCount = m_arrPackets.size();
+	Timer timer;
+	timer.BeginTimer();
+	{
+		// The packet m_uRendered is still being drawn, it is freed when the thread is done with it
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_FreeCondition.wait(lock, [&] { return m_bQuit || m_uSubmitted - m_uRendered < slotCount; });
+	}
+	timer.EndTimer();
+	m_Stats.fUpdateWaitSeconds = timer.GetElapsedSeconds();
+
+	FramePacket& packet = m_arrPackets[m_uSubmitted % slotCount];
+	packet.Clear();
+	packet.uFrame = m_uSubmitted;
+	return packet;
+}
+
+void RenderThread::SubmitFrame()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_eState != State::Running)
+		{
+			return;
+		}
+		++m_uSubmitted;
+	}
+	m_SubmitCondition.notify_one();
+}
+
+RenderThreadStats RenderThread::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void RenderThread::ThreadMain()
+{
+	const bool current = m_Renderer.MakeCurrent(true);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_eState = current ? State::Running : State::Failed;
+	}
+	m_FreeCondition.notify_all();
+	if (!current)
+	{
+		IApplication::Debug("RenderThread: failed to make the context current\n");
+		return;
+	}
+
+	const uint64_t slotCount = m_arrPackets.size();
+	Timer timer;
+	while (true)
+	{
+		uint64_t frame = 0;
+		timer.BeginTimer();
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_SubmitCondition.wait(lock, [this] { return m_bQuit || m_uSubmitted > m_uRendered; });
+			if (m_bQuit)
+			{
+				break;
+			}
+			frame = m_uRendered;
+		}
+		timer.EndTimer();
+		const float renderWait = timer.GetElapsedSeconds();
+
+		m_App.GetFramePacer().ApplySwapInterval(m_Renderer);
+		m_App.OnRender(m_Renderer, m_arrPackets[frame % slotCount]);
+		m_Renderer.Flip();
+
+		timer.BeginTimer();
+		WaitForGpu();
+		timer.EndTimer();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			++m_uRendered;
+			m_Stats.uFrames = m_uRendered;
+			m_Stats.fRenderWaitSeconds = renderWait;
+			m_Stats.fGpuWaitSeconds = timer.GetElapsedSeconds();
+		}
+		m_FreeCondition.notify_one();
+	}
+
+	if (m_Fence)
+	{
+		glDeleteSync(m_Fence);
+		m_Fence = nullptr;
+	}
+	m_Renderer.MakeCurrent(false);
+}
+
+void RenderThread::WaitForGpu()
+{
+	if (!glFenceSync)
+	{
+		return;
+	}
+
+	// Wait for the frame before this one, so the GPU is never more than a frame behind
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (m_Fence)
+	{
+		glClientWaitSync(m_Fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+		glDeleteSync(m_Fence);
+	}
+	m_Fence = fence;
+}
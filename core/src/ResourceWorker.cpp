@@ -0,0 +1,248 @@
+#include "../include/ResourceWorker.h"
+
+#include <algorithm>
+
+ResourceWorker::ResourceWorker(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_uRunning(0),
+	m_bQuit(false),
+	m_uCompleted(0)
+{
+}
+
+ResourceWorker::~ResourceWorker()
+{
+	Stop();
+}
+
+bool ResourceWorker::Start(uint32_t threadCount)
+{
+	Stop();
+	if (!glFenceSync)
+	{
+		IApplication::Debug("ResourceWorker: fence sync not supported\n");
+		return false;
+	}
+
+	// Contexts are created here, sharing requires the renderer's context to be current
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		OpenGLRenderer::SharedContext* context = m_Renderer.CreateSharedContext();
+		if (!context)
+		{
+			break;
+		}
+		m_arrContexts.push_back(context);
+	}
+	if (m_arrContexts.empty())
+	{
+		IApplication::Debug("ResourceWorker: shared contexts not supported\n");
+		return false;
+	}
+
+	m_bQuit = false;
+	m_arrStates.assign(m_arrContexts.size(), WorkerState::Starting);
+	for (size_t i = 0; i < m_arrContexts.size(); ++i)
+	{
+		m_arrThreads.emplace_back(&ResourceWorker::ThreadMain, this, m_arrContexts[i], i);
+	}
+
+	// A thread that cannot make its context current would never take a job
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_IdleCondition.wait(lock, [this]
+		{
+			return std::none_of(m_arrStates.begin(), m_arrStates.end(), [](WorkerState state) { return state == WorkerState::Starting; });
+		});
+	}
+	for (size_t i = m_arrThreads.size(); i-- > 0;)
+	{
+		if (m_arrStates[i] == WorkerState::Failed)
+		{
+			m_arrThreads[i].join();
+			m_Renderer.DestroySharedContext(m_arrContexts[i]);
+			m_arrThreads.erase(m_arrThreads.begin() + i);
+			m_arrContexts.erase(m_arrContexts.begin() + i);
+		}
+	}
+	m_arrStates.clear();
+
+	if (m_arrThreads.empty())
+	{
+		IApplication::Debug("ResourceWorker: no worker could make its shared context current\n");
+		Stop();
+		return false;
+	}
+	return true;
+}
+
+void ResourceWorker::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bQuit = true;
+		m_arrTasks.clear();
+	}
+	m_Condition.notify_all();
+	for (auto& thread : m_arrThreads)
+	{
+		thread.join();
+	}
+	m_arrThreads.clear();
+
+	for (auto& handoff : m_arrHandoffs)
+	{
+		glDeleteSync(handoff.fence);
+	}
+	m_arrHandoffs.clear();
+
+	for (auto* context : m_arrContexts)
+	{
+		m_Renderer.DestroySharedContext(context);
+	}
+	m_arrContexts.clear();
+	m_IdleCondition.notify_all();
+}
+
+void ResourceWorker::Submit(Job job, Job onReady)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_arrTasks.push_back({ std::move(job), std::move(onReady) });
+	}
+	m_Condition.notify_one();
+}
+
+void ResourceWorker::Update()
+{
+	// Handoffs finish in about the order they were made, stop at the first that is not done
+	std::deque<HANDOFF> ready;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		while (!m_arrHandoffs.empty())
+		{
+			const GLenum status = glClientWaitSync(m_arrHandoffs.front().fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			{
+				break;
+			}
+			glDeleteSync(m_arrHandoffs.front().fence);
+			ready.push_back(std::move(m_arrHandoffs.front()));
+			m_arrHandoffs.pop_front();
+			++m_uCompleted;
+		}
+	}
+
+	// Callbacks may submit more jobs, so they run without the lock
+	for (auto& handoff : ready)
+	{
+		if (handoff.onReady)
+		{
+			handoff.onReady();
+		}
+	}
+	if (!ready.empty())
+	{
+		m_IdleCondition.notify_all();
+	}
+}
+
+void ResourceWorker::WaitIdle()
+{
+	for (;;)
+	{
+		Update();
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (m_arrThreads.empty())
+		{
+			// Nobody else will take the jobs, resources made on this context can be used at once
+			std::deque<TASK> tasks;
+			tasks.swap(m_arrTasks);
+			lock.unlock();
+			if (tasks.empty())
+			{
+				return;
+			}
+			for (auto& task : tasks)
+			{
+				task.job();
+				if (task.onReady)
+				{
+					task.onReady();
+				}
+			}
+			continue;
+		}
+		if (m_arrTasks.empty() && m_uRunning == 0 && m_arrHandoffs.empty())
+		{
+			return;
+		}
+		if (!m_arrHandoffs.empty())
+		{
+			// Jobs are done on the CPU, block on the oldest fence
+			GLsync fence = m_arrHandoffs.front().fence;
+			lock.unlock();
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			continue;
+		}
+		m_IdleCondition.wait(lock, [this] { return !m_arrHandoffs.empty() || (m_arrTasks.empty() && m_uRunning == 0); });
+	}
+}
+
+ResourceWorkerStats ResourceWorker::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ResourceWorkerStats stats = {};
+	stats.uThreads = (uint32_t)m_arrThreads.size();
+	stats.uQueued = m_arrTasks.size();
+	stats.uInFlight = m_uRunning + m_arrHandoffs.size();
+	stats.uCompleted = m_uCompleted;
+	return stats;
+}
+
+void ResourceWorker::ThreadMain(OpenGLRenderer::SharedContext* context, size_t index)
+{
+	const bool current = m_Renderer.MakeSharedContextCurrent(context);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_arrStates[index] = current ? WorkerState::Running : WorkerState::Failed;
+	}
+	m_IdleCondition.notify_all();
+	if (!current)
+	{
+		IApplication::Debug("ResourceWorker: failed to make a shared context current\n");
+		return;
+	}
+
+	for (;;)
+	{
+		TASK task;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this] { return m_bQuit || !m_arrTasks.empty(); });
+			if (m_bQuit)
+			{
+				break;
+			}
+			task = std::move(m_arrTasks.front());
+			m_arrTasks.pop_front();
+			++m_uRunning;
+		}
+
+		task.job();
+
+		// Flush so that the fence reaches the GPU and other contexts can wait for it
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_arrHandoffs.push_back({ fence, std::move(task.onReady) });
+			--m_uRunning;
+		}
+		m_IdleCondition.notify_all();
+	}
+
+	m_Renderer.MakeSharedContextCurrent(nullptr);
+}
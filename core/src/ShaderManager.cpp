@@ -0,0 +1,868 @@
+#include "../include/ShaderManager.h"
+
+#include <algorithm>
+#include <filesystem>
+
+// Identifies program binary cache files
+constexpr uint32_t kBinaryMagic = 0x4e494250; // "PBIN"
+constexpr uint32_t kBinaryVersion = 1;
+// Without GL_KHR_parallel_shader_compile the link status cannot be polled, so
+// it is queried this many frames after submission when the driver is likely done
+constexpr uint32_t kLinkWaitFrames = 3;
+
+struct BINARYHEADER
+{
+	uint32_t	uMagic;
+	uint32_t	uVersion;
+	uint64_t	uDriverHash; // Binaries are only valid for the driver that created them
+	uint64_t	uKey;
+	uint32_t	uFormat;
+	uint32_t	uLength;
+};
+
+ShaderManager::ShaderManager(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_uDriverHash(0),
+	m_Stats({})
+{
+}
+
+ShaderManager::~ShaderManager()
+{
+	Clear();
+}
+
+void ShaderManager::SetCacheDirectory(const std::string_view& directory)
+{
+	m_strCacheDirectory = directory;
+	if (!m_strCacheDirectory.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_strCacheDirectory, error);
+		if (error)
+		{
+			IApplication::Debug("ShaderManager: failed to create cache directory " + m_strCacheDirectory + "\n");
+		}
+	}
+}
+
+GLuint ShaderManager::GetProgram(const std::string_view& vertexFile, const std::string_view& fragmentFile, const std::vector<std::string>& defines)
+{
+	std::string vertexSource;
+	std::string fragmentSource;
+	if (!OpenGLRenderer::LoadTextFile(vertexFile, vertexSource) ||
+		!OpenGLRenderer::LoadTextFile(fragmentFile, fragmentSource))
+	{
+		return 0;
+	}
+
+	++m_Stats.uProgramRequests;
+	return PinProgram(BuildProgram(
+		Preprocess(vertexSource, GetDirectory(vertexFile), defines),
+		Preprocess(fragmentSource, GetDirectory(fragmentFile), defines)));
+}
+
+GLuint ShaderManager::GetProgramFromSource(const std::string_view& vertexSource, const std::string_view& fragmentSource, const std::vector<std::string>& defines)
+{
+	++m_Stats.uProgramRequests;
+	return PinProgram(BuildProgram(
+		Preprocess(vertexSource, "", defines),
+		Preprocess(fragmentSource, "", defines)));
+}
+
+std::shared_ptr<const ProgramFuture> ShaderManager::SubmitProgram(const std::string_view& vertexFile, const std::string_view& fragmentFile, const std::vector<std::string>& defines)
+{
+	// Files and defines identify the handle, so that reloads can replace its program
+	std::string name = std::string(vertexFile) + "|" + std::string(fragmentFile);
+	for (const auto& define : defines)
+	{
+		name += "|" + define;
+	}
+	auto found = m_mapReloadables.find(name);
+	if (found != m_mapReloadables.end())
+	{
+		return found->second.pFuture;
+	}
+
+	RELOADABLE reloadable;
+	reloadable.strVertexFile = vertexFile;
+	reloadable.strFragmentFile = fragmentFile;
+	reloadable.arrDefines = defines;
+	reloadable.arrDependencies = { reloadable.strVertexFile, reloadable.strFragmentFile };
+	reloadable.bChanged = false;
+	reloadable.uNewKey = 0;
+	reloadable.newProgram = 0;
+	reloadable.newVertexShader = 0;
+	reloadable.newFragmentShader = 0;
+	reloadable.uWaitedFrames = 0;
+
+	std::string vertexSource;
+	std::string fragmentSource;
+	if (!OpenGLRenderer::LoadTextFile(vertexFile, vertexSource) ||
+		!OpenGLRenderer::LoadTextFile(fragmentFile, fragmentSource))
+	{
+		reloadable.pFuture = TrackFuture(std::make_shared<ProgramFuture>());
+		reloadable.pFuture->m_eState = ProgramFuture::State::Failed;
+	}
+	else
+	{
+		++m_Stats.uProgramRequests;
+		reloadable.pFuture = SubmitSources(
+			Preprocess(vertexSource, GetDirectory(vertexFile), defines, &reloadable.arrDependencies),
+			Preprocess(fragmentSource, GetDirectory(fragmentFile), defines, &reloadable.arrDependencies));
+	}
+
+	if (m_pWatcher)
+	{
+		for (const auto& file : reloadable.arrDependencies)
+		{
+			m_pWatcher->AddFile(file);
+		}
+	}
+
+	auto future = reloadable.pFuture;
+	m_mapReloadables[name] = std::move(reloadable);
+	return future;
+}
+
+std::shared_ptr<const ProgramFuture> ShaderManager::SubmitProgramFromSource(const std::string_view& vertexSource, const std::string_view& fragmentSource, const std::vector<std::string>& defines)
+{
+	++m_Stats.uProgramRequests;
+	return SubmitSources(
+		Preprocess(vertexSource, "", defines),
+		Preprocess(fragmentSource, "", defines));
+}
+
+void ShaderManager::Update()
+{
+	// Only touch programs the driver reports finished so that nothing blocks
+	for (auto& pending : m_arrPending)
+	{
+		if (IsLinkFinished(pending.pFuture->m_Program, pending.uWaitedFrames))
+		{
+			Resolve(pending);
+		}
+	}
+	m_arrPending.erase(
+		std::remove_if(m_arrPending.begin(), m_arrPending.end(), [](const PENDINGPROGRAM& p) { return !p.pFuture->IsPending(); }),
+		m_arrPending.end());
+	m_Stats.uPendingPrograms = m_arrPending.size();
+
+	if (!m_arrRetiredPrograms.empty())
+	{
+		ReleaseRetiredPrograms();
+	}
+
+	if (!m_pWatcher)
+	{
+		return;
+	}
+
+	const std::vector<std::string> changed = m_pWatcher->Poll();
+	for (auto& it : m_mapReloadables)
+	{
+		RELOADABLE& reloadable = it.second;
+		for (const auto& file : changed)
+		{
+			if (std::find(reloadable.arrDependencies.begin(), reloadable.arrDependencies.end(), file) != reloadable.arrDependencies.end())
+			{
+				reloadable.bChanged = true;
+				break;
+			}
+		}
+
+		// Swap finished reloads, then start new ones. Only one reload is in flight per program.
+		if (reloadable.newProgram && IsLinkFinished(reloadable.newProgram, reloadable.uWaitedFrames))
+		{
+			FinishReload(reloadable);
+		}
+		if (reloadable.bChanged && !reloadable.newProgram && !reloadable.pFuture->IsPending())
+		{
+			StartReload(reloadable);
+		}
+	}
+}
+
+void ShaderManager::EnableHotReload(bool enable)
+{
+	if (!enable)
+	{
+		m_pWatcher = nullptr;
+		return;
+	}
+
+	if (!m_pWatcher)
+	{
+		m_pWatcher = std::make_unique<FileWatcher>();
+		for (const auto& it : m_mapReloadables)
+		{
+			for (const auto& file : it.second.arrDependencies)
+			{
+				m_pWatcher->AddFile(file);
+			}
+		}
+	}
+}
+
+void ShaderManager::Finish()
+{
+	for (auto& pending : m_arrPending)
+	{
+		Resolve(pending);
+	}
+	m_arrPending.clear();
+	m_Stats.uPendingPrograms = 0;
+}
+
+void ShaderManager::Clear()
+{
+	Finish();
+
+	for (auto& it : m_mapReloadables)
+	{
+		RELOADABLE& reloadable = it.second;
+		if (reloadable.newProgram)
+		{
+			m_Renderer.ReleaseProgram(reloadable.newProgram);
+			glDeleteShader(reloadable.newVertexShader);
+			glDeleteShader(reloadable.newFragmentShader);
+		}
+		// Handles stay with their owners but no longer refer to a valid program
+		reloadable.pFuture->m_Program = 0;
+		reloadable.pFuture->m_eState = ProgramFuture::State::Failed;
+	}
+	m_mapReloadables.clear();
+	for (auto& it : m_mapPrograms)
+	{
+		m_Renderer.ReleaseProgram(it.second);
+	}
+	for (auto& it : m_mapShaders)
+	{
+		glDeleteShader(it.second);
+	}
+	m_mapPrograms.clear();
+	m_mapShaders.clear();
+	m_setPinnedPrograms.clear();
+	m_arrFutures.clear();
+	m_arrRetiredPrograms.clear();
+	m_Stats.uPrograms = 0;
+	m_Stats.uShaders = 0;
+}
+
+std::string ShaderManager::Preprocess(const std::string_view& source, const std::string_view& directory, const std::vector<std::string>& defines, std::vector<std::string>* dependencies)
+{
+	std::string expanded;
+	std::unordered_set<std::string> included;
+	ExpandIncludes(source, std::string(directory), expanded, included, dependencies);
+
+	if (defines.empty())
+	{
+		return expanded;
+	}
+
+	std::string defineBlock;
+	for (const auto& define : defines)
+	{
+		// "NAME=VALUE" becomes "#define NAME VALUE"
+		std::string line = define;
+		const size_t equals = line.find('=');
+		if (equals != std::string::npos)
+		{
+			line[equals] = ' ';
+		}
+		defineBlock += "#define " + line + "\n";
+	}
+
+	// Defines must come after #version, which has to be the first directive
+	size_t insertAt = 0;
+	int32_t versionLine = 0;
+	const size_t version = expanded.find("#version");
+	if (version != std::string::npos)
+	{
+		const size_t end = expanded.find('\n', version);
+		insertAt = (end == std::string::npos) ? expanded.size() : end + 1;
+		versionLine = 1 + (int32_t)std::count(expanded.begin(), expanded.begin() + version, '\n');
+	}
+
+	// Keep compiler error line numbers pointing to the original source
+	defineBlock += "#line " + std::to_string(versionLine + 1) + "\n";
+	if (insertAt == expanded.size() && !expanded.empty() && expanded.back() != '\n')
+	{
+		expanded += '\n';
+		insertAt = expanded.size();
+	}
+	expanded.insert(insertAt, defineBlock);
+	return expanded;
+}
+
+uint64_t ShaderManager::Hash(const std::string_view& data, uint64_t hash)
+{
+	for (const char c : data)
+	{
+		hash ^= (uint8_t)c;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+bool ShaderManager::ExpandIncludes(const std::string_view& source, const std::string& directory, std::string& output, std::unordered_set<std::string>& included, std::vector<std::string>* dependencies)
+{
+	bool result = true;
+	int32_t lineNumber = 0;
+	size_t pos = 0;
+	while (pos < source.size())
+	{
+		size_t end = source.find('\n', pos);
+		if (end == std::string_view::npos)
+		{
+			end = source.size();
+		}
+		const std::string_view line = source.substr(pos, end - pos);
+		pos = end + 1;
+		++lineNumber;
+
+		const size_t first = line.find_first_not_of(" \t");
+		if (first == std::string_view::npos || line.compare(first, 8, "#include") != 0)
+		{
+			output.append(line.data(), line.size());
+			output += '\n';
+			continue;
+		}
+
+		// Parse #include "file"
+		const size_t open = line.find('"', first + 8);
+		const size_t close = (open == std::string_view::npos) ? open : line.find('"', open + 1);
+		if (close == std::string_view::npos)
+		{
+			IApplication::Debug("ShaderManager: malformed #include\n");
+			result = false;
+			continue;
+		}
+
+		const std::string name(line.substr(open + 1, close - open - 1));
+		const std::string path = directory.empty() ? name : directory + "/" + name;
+
+		// Every file is included only once
+		if (included.insert(path).second)
+		{
+			std::string text;
+			if (!OpenGLRenderer::LoadTextFile(path, text))
+			{
+				result = false;
+				continue;
+			}
+			if (dependencies)
+			{
+				dependencies->push_back(path);
+			}
+			result &= ExpandIncludes(text, GetDirectory(path), output, included, dependencies);
+		}
+
+		output += "#line " + std::to_string(lineNumber + 1) + "\n";
+	}
+	return result;
+}
+
+std::string ShaderManager::GetDirectory(const std::string_view& filename)
+{
+	const size_t slash = filename.find_last_of("/\\");
+	return (slash == std::string_view::npos) ? std::string() : std::string(filename.substr(0, slash));
+}
+
+uint64_t ShaderManager::GetProgramKey(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	return Hash(fragmentSource, Hash(std::string_view("\0", 1), Hash(vertexSource)));
+}
+
+GLuint ShaderManager::BuildProgram(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	const uint64_t key = GetProgramKey(vertexSource, fragmentSource);
+	auto found = m_mapPrograms.find(key);
+	if (found != m_mapPrograms.end())
+	{
+		return found->second;
+	}
+
+	// Same program may already be compiling in the background
+	for (auto& pending : m_arrPending)
+	{
+		if (pending.uKey == key && pending.pFuture->IsPending())
+		{
+			Resolve(pending);
+			return pending.pFuture->GetProgram();
+		}
+	}
+
+	Timer timer;
+	timer.BeginTimer();
+
+	// Warm start, skip the compilation completely
+	GLuint program = LoadBinary(key);
+	if (program)
+	{
+		timer.EndTimer();
+		m_Stats.fBinaryLoadSeconds += timer.GetElapsedSeconds();
+		++m_Stats.uBinaryCacheHits;
+	}
+	else
+	{
+		const GLuint vertexShader = GetShader(GL_VERTEX_SHADER, vertexSource);
+		const GLuint fragmentShader = GetShader(GL_FRAGMENT_SHADER, fragmentSource);
+		if (!vertexShader || !fragmentShader)
+		{
+			return 0;
+		}
+
+		const bool cacheEnabled = !m_strCacheDirectory.empty() && glGetProgramBinary;
+		program = m_Renderer.CreateProgram(vertexShader, fragmentShader, cacheEnabled);
+		if (!program)
+		{
+			return 0;
+		}
+
+		// Shaders are kept for other variants, detaching lets the driver free program copies
+		glDetachShader(program, vertexShader);
+		glDetachShader(program, fragmentShader);
+
+		timer.EndTimer();
+		m_Stats.fCompileSeconds += timer.GetElapsedSeconds();
+		++m_Stats.uBinaryCacheMisses;
+
+		if (cacheEnabled)
+		{
+			SaveBinary(key, program);
+		}
+	}
+
+	m_mapPrograms[key] = program;
+	m_Stats.uPrograms = m_mapPrograms.size();
+	return program;
+}
+
+std::shared_ptr<ProgramFuture> ShaderManager::SubmitSources(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	const uint64_t key = GetProgramKey(vertexSource, fragmentSource);
+
+	// Already linked
+	auto found = m_mapPrograms.find(key);
+	if (found != m_mapPrograms.end())
+	{
+		auto future = std::make_shared<ProgramFuture>();
+		future->m_eState = ProgramFuture::State::Ready;
+		future->m_Program = found->second;
+		return TrackFuture(future);
+	}
+
+	// Already submitted, share the handle
+	for (auto& pending : m_arrPending)
+	{
+		if (pending.uKey == key && pending.pFuture->IsPending())
+		{
+			return pending.pFuture;
+		}
+	}
+
+	auto future = std::make_shared<ProgramFuture>();
+
+	// Binaries load fast, no need to defer them
+	const GLuint binary = LoadBinary(key);
+	if (binary)
+	{
+		++m_Stats.uBinaryCacheHits;
+		m_mapPrograms[key] = binary;
+		m_Stats.uPrograms = m_mapPrograms.size();
+		future->m_eState = ProgramFuture::State::Ready;
+		future->m_Program = binary;
+		return TrackFuture(future);
+	}
+
+	PENDINGPROGRAM pending;
+	pending.pFuture = future;
+	pending.uKey = key;
+	pending.bCacheEnabled = !m_strCacheDirectory.empty() && glGetProgramBinary;
+	pending.uWaitedFrames = 0;
+	pending.vertexShader = SubmitShader(GL_VERTEX_SHADER, vertexSource);
+	pending.fragmentShader = SubmitShader(GL_FRAGMENT_SHADER, fragmentSource);
+	future->m_Program = m_Renderer.SubmitProgram(pending.vertexShader, pending.fragmentShader, pending.bCacheEnabled);
+
+	m_arrPending.push_back(pending);
+	m_Stats.uPendingPrograms = m_arrPending.size();
+	return TrackFuture(future);
+}
+
+GLuint ShaderManager::SubmitShader(GLenum type, const std::string& source)
+{
+	const uint64_t key = Hash(source, Hash(type == GL_VERTEX_SHADER ? "vertex" : "fragment"));
+	auto found = m_mapShaders.find(key);
+	if (found != m_mapShaders.end())
+	{
+		return found->second;
+	}
+
+	// Compile status is checked only if the program fails to link
+	const GLuint shader = m_Renderer.SubmitShader(type, source.c_str());
+	m_mapShaders[key] = shader;
+	m_Stats.uShaders = m_mapShaders.size();
+	return shader;
+}
+
+void ShaderManager::Resolve(PENDINGPROGRAM& pending)
+{
+	ProgramFuture& future = *pending.pFuture;
+	if (!future.IsPending())
+	{
+		return;
+	}
+
+	GLint linked = 0;
+	glGetProgramiv(future.m_Program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		// Report the stage that actually failed
+		GLint compiled = 0;
+		glGetShaderiv(pending.vertexShader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled)
+		{
+			IApplication::Debug("Failed to compile vertex shader:");
+			m_Renderer.PrintShaderError(pending.vertexShader);
+			ReleaseFailedShader(pending.vertexShader);
+		}
+		glGetShaderiv(pending.fragmentShader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled)
+		{
+			IApplication::Debug("Failed to compile fragment shader:");
+			m_Renderer.PrintShaderError(pending.fragmentShader);
+			ReleaseFailedShader(pending.fragmentShader);
+		}
+		IApplication::Debug("Failed to link program:");
+		m_Renderer.PrintProgramError(future.m_Program);
+
+		m_Renderer.ReleaseProgram(future.m_Program);
+		future.m_Program = 0;
+		future.m_eState = ProgramFuture::State::Failed;
+		++m_Stats.uFailedPrograms;
+		return;
+	}
+
+	glDetachShader(future.m_Program, pending.vertexShader);
+	glDetachShader(future.m_Program, pending.fragmentShader);
+	if (pending.bCacheEnabled)
+	{
+		SaveBinary(pending.uKey, future.m_Program);
+	}
+
+	++m_Stats.uBinaryCacheMisses;
+	m_mapPrograms[pending.uKey] = future.m_Program;
+	m_Stats.uPrograms = m_mapPrograms.size();
+	future.m_eState = ProgramFuture::State::Ready;
+}
+
+void ShaderManager::StartReload(RELOADABLE& reloadable)
+{
+	reloadable.bChanged = false;
+
+	std::string vertexSource;
+	std::string fragmentSource;
+	if (!OpenGLRenderer::LoadTextFile(reloadable.strVertexFile, vertexSource) ||
+		!OpenGLRenderer::LoadTextFile(reloadable.strFragmentFile, fragmentSource))
+	{
+		return;
+	}
+
+	// Includes may have changed too
+	std::vector<std::string> dependencies = { reloadable.strVertexFile, reloadable.strFragmentFile };
+	vertexSource = Preprocess(vertexSource, GetDirectory(reloadable.strVertexFile), reloadable.arrDefines, &dependencies);
+	fragmentSource = Preprocess(fragmentSource, GetDirectory(reloadable.strFragmentFile), reloadable.arrDefines, &dependencies);
+	reloadable.arrDependencies = dependencies;
+	for (const auto& file : dependencies)
+	{
+		m_pWatcher->AddFile(file);
+	}
+
+	const uint64_t key = GetProgramKey(vertexSource, fragmentSource);
+	auto found = m_mapPrograms.find(key);
+	if (found != m_mapPrograms.end())
+	{
+		// Same sources were compiled before, e.g. an edit was undone
+		const GLuint previous = reloadable.pFuture->m_Program;
+		reloadable.pFuture->m_Program = found->second;
+		reloadable.pFuture->m_eState = ProgramFuture::State::Ready;
+		ReleaseReplacedProgram(previous);
+		return;
+	}
+
+	// Compile next to the current program, which stays in use until the new one is ready
+	reloadable.uNewKey = key;
+	reloadable.uWaitedFrames = 0;
+	reloadable.newVertexShader = m_Renderer.SubmitShader(GL_VERTEX_SHADER, vertexSource.c_str());
+	reloadable.newFragmentShader = m_Renderer.SubmitShader(GL_FRAGMENT_SHADER, fragmentSource.c_str());
+	reloadable.newProgram = m_Renderer.SubmitProgram(reloadable.newVertexShader, reloadable.newFragmentShader, !m_strCacheDirectory.empty() && glGetProgramBinary);
+}
+
+void ShaderManager::FinishReload(RELOADABLE& reloadable)
+{
+	GLint linked = 0;
+	glGetProgramiv(reloadable.newProgram, GL_LINK_STATUS, &linked);
+	if (linked)
+	{
+		glDetachShader(reloadable.newProgram, reloadable.newVertexShader);
+		glDetachShader(reloadable.newProgram, reloadable.newFragmentShader);
+		if (!m_strCacheDirectory.empty() && glGetProgramBinary)
+		{
+			SaveBinary(reloadable.uNewKey, reloadable.newProgram);
+		}
+
+		const GLuint previous = reloadable.pFuture->m_Program;
+		m_mapPrograms[reloadable.uNewKey] = reloadable.newProgram;
+		m_Stats.uPrograms = m_mapPrograms.size();
+		reloadable.pFuture->m_Program = reloadable.newProgram;
+		reloadable.pFuture->m_eState = ProgramFuture::State::Ready;
+		ReleaseReplacedProgram(previous);
+		++m_Stats.uReloads;
+		IApplication::Debug("ShaderManager: reloaded " + reloadable.strVertexFile + " " + reloadable.strFragmentFile + "\n");
+	}
+	else
+	{
+		GLint compiled = 0;
+		glGetShaderiv(reloadable.newVertexShader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled)
+		{
+			IApplication::Debug("Failed to compile vertex shader:");
+			m_Renderer.PrintShaderError(reloadable.newVertexShader);
+		}
+		glGetShaderiv(reloadable.newFragmentShader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled)
+		{
+			IApplication::Debug("Failed to compile fragment shader:");
+			m_Renderer.PrintShaderError(reloadable.newFragmentShader);
+		}
+		IApplication::Debug("Failed to link program:");
+		m_Renderer.PrintProgramError(reloadable.newProgram);
+		IApplication::Debug("ShaderManager: keeping previous version of " + reloadable.strVertexFile + " " + reloadable.strFragmentFile + "\n");
+
+		m_Renderer.ReleaseProgram(reloadable.newProgram);
+		++m_Stats.uFailedReloads;
+	}
+
+	glDeleteShader(reloadable.newVertexShader);
+	glDeleteShader(reloadable.newFragmentShader);
+	reloadable.newProgram = 0;
+	reloadable.newVertexShader = 0;
+	reloadable.newFragmentShader = 0;
+}
+
+bool ShaderManager::IsLinkFinished(GLuint program, uint32_t& waitedFrames) const
+{
+	if (!m_Renderer.HasParallelShaderCompile())
+	{
+		return ++waitedFrames > kLinkWaitFrames;
+	}
+	return m_Renderer.IsProgramCompleted(program);
+}
+
+std::shared_ptr<ProgramFuture> ShaderManager::TrackFuture(std::shared_ptr<ProgramFuture> future)
+{
+	m_arrFutures.push_back(future);
+	return future;
+}
+
+GLuint ShaderManager::PinProgram(GLuint program)
+{
+	if (program)
+	{
+		m_setPinnedPrograms.insert(program);
+	}
+	return program;
+}
+
+void ShaderManager::ReleaseReplacedProgram(GLuint program)
+{
+	if (program && std::find(m_arrRetiredPrograms.begin(), m_arrRetiredPrograms.end(), program) == m_arrRetiredPrograms.end())
+	{
+		m_arrRetiredPrograms.push_back(program);
+		ReleaseRetiredPrograms();
+	}
+}
+
+void ShaderManager::ReleaseRetiredPrograms()
+{
+	m_arrFutures.erase(
+		std::remove_if(m_arrFutures.begin(), m_arrFutures.end(), [](const std::weak_ptr<ProgramFuture>& f) { return f.expired(); }),
+		m_arrFutures.end());
+
+	auto inUse = [this](GLuint program)
+	{
+		for (const auto& weak : m_arrFutures)
+		{
+			const auto future = weak.lock();
+			if (future && future->m_Program == program)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	for (auto retired = m_arrRetiredPrograms.begin(); retired != m_arrRetiredPrograms.end();)
+	{
+		const GLuint program = *retired;
+		// Plain handles cannot be tracked, those stay until Clear
+		if (m_setPinnedPrograms.count(program))
+		{
+			retired = m_arrRetiredPrograms.erase(retired);
+			continue;
+		}
+		if (inUse(program))
+		{
+			++retired;
+			continue;
+		}
+
+		for (auto it = m_mapPrograms.begin(); it != m_mapPrograms.end(); ++it)
+		{
+			if (it->second == program)
+			{
+				m_mapPrograms.erase(it);
+				break;
+			}
+		}
+		m_Renderer.ReleaseProgram(program);
+		retired = m_arrRetiredPrograms.erase(retired);
+	}
+	m_Stats.uPrograms = m_mapPrograms.size();
+}
+
+void ShaderManager::ReleaseFailedShader(GLuint shader)
+{
+	// Forget the shader so that fixing the source compiles it again
+	for (auto it = m_mapShaders.begin(); it != m_mapShaders.end(); ++it)
+	{
+		if (it->second == shader)
+		{
+			glDeleteShader(shader);
+			m_mapShaders.erase(it);
+			m_Stats.uShaders = m_mapShaders.size();
+			return;
+		}
+	}
+}
+
+GLuint ShaderManager::GetShader(GLenum type, const std::string& source)
+{
+	const uint64_t key = Hash(source, Hash(type == GL_VERTEX_SHADER ? "vertex" : "fragment"));
+	auto found = m_mapShaders.find(key);
+	if (found != m_mapShaders.end())
+	{
+		return found->second;
+	}
+
+	const GLuint shader = (type == GL_VERTEX_SHADER) ?
+		m_Renderer.CreateVertexShader(source.c_str()) :
+		m_Renderer.CreateFragmentShader(source.c_str());
+	if (shader)
+	{
+		m_mapShaders[key] = shader;
+		m_Stats.uShaders = m_mapShaders.size();
+	}
+	return shader;
+}
+
+GLuint ShaderManager::LoadBinary(uint64_t key)
+{
+	if (m_strCacheDirectory.empty() || !glProgramBinary)
+	{
+		return 0;
+	}
+
+	std::ifstream f(GetBinaryFilename(key), std::ios::binary);
+	if (!f)
+	{
+		return 0;
+	}
+
+	BINARYHEADER header;
+	f.read((char*)&header, sizeof(header));
+	if (!f ||
+		header.uMagic != kBinaryMagic ||
+		header.uVersion != kBinaryVersion ||
+		header.uDriverHash != GetDriverHash() ||
+		header.uKey != key)
+	{
+		return 0;
+	}
+
+	std::vector<char> binary(header.uLength);
+	f.read(binary.data(), header.uLength);
+	if (!f)
+	{
+		return 0;
+	}
+
+	const GLuint program = glCreateProgram();
+	glProgramBinary(program, header.uFormat, binary.data(), (GLsizei)header.uLength);
+
+	// Driver may still reject the binary, fall back to compiling from source
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		m_Renderer.ReleaseProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ShaderManager::SaveBinary(uint64_t key, GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	BINARYHEADER header;
+	header.uMagic = kBinaryMagic;
+	header.uVersion = kBinaryVersion;
+	header.uDriverHash = GetDriverHash();
+	header.uKey = key;
+	header.uFormat = format;
+	header.uLength = (uint32_t)length;
+
+	std::ofstream f(GetBinaryFilename(key), std::ios::binary);
+	f.write((const char*)&header, sizeof(header));
+	f.write(binary.data(), length);
+	if (!f)
+	{
+		IApplication::Debug("ShaderManager: failed to write program binary\n");
+	}
+}
+
+std::string ShaderManager::GetBinaryFilename(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return m_strCacheDirectory + "/" + name;
+}
+
+uint64_t ShaderManager::GetDriverHash()
+{
+	if (m_uDriverHash == 0)
+	{
+		// Any driver or GL version change invalidates the cached binaries
+		const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+		uint64_t hash = Hash("");
+		for (const GLenum name : names)
+		{
+			const char* str = (const char*)glGetString(name);
+			hash = Hash(str ? str : "", hash);
+			hash = Hash("\n", hash);
+		}
+		m_uDriverHash = hash;
+	}
+	return m_uDriverHash;
+}
@@ -0,0 +1,638 @@
+#include "../include/ShadowMap.h"
+#include "../include/CameraNode.h"
+#include "../include/GeometryNode.h"
+#include "../include/Geometry.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// Depth-only program, positions are the only input
+static const char* kDepthVertexShader = R"(
+#version 330
+in vec3 position;
+uniform mat4 modelViewProjection;
+
+void main()
+{
+	gl_Position = modelViewProjection * vec4(position, 1.0);
+}
+)";
+
+static const char* kDepthFragmentShader = R"(
+#version 330
+
+void main()
+{
+}
+)";
+
+// Near plane of spot light shadows
+constexpr float kSpotNearPlane = 0.1f;
+// Cascade radius is rounded up to this step so that it does not flicker with the camera rotation
+constexpr float kRadiusStep = 1.0f / 16.0f;
+// Cascade centers move in steps of this many texels, so that the matrix and the static layer
+// stay the same while the camera moves within a step
+constexpr float kCenterStepTexels = 16.0f;
+
+ShadowMap::ShadowMap(OpenGLRenderer& renderer) :
+	m_Renderer(renderer),
+	m_iSize(0),
+	m_uCascadeCount(0),
+	m_bSpotLight(false),
+	m_vLightDirection(glm::normalize(glm::vec3(-0.3f, -1.0f, -0.2f))),
+	m_vLightPosition(0.0f),
+	m_fSpotAngle(glm::quarter_pi<float>()),
+	m_fSpotRange(100.0f),
+	m_fShadowDistance(100.0f),
+	m_fSplitLambda(0.75f),
+	m_fSlopeBias(2.0f),
+	m_fConstantBias(4.0f),
+	m_DepthTexture(0),
+	m_StaticTexture(0),
+	m_Framebuffer(0),
+	m_Program(0),
+	m_iPositionLocation(-1),
+	m_iMatrixLocation(-1),
+	m_PositionBuffer(0),
+	m_IndexBuffer(0),
+	m_bStreamDirty(false),
+	m_Stats({})
+{
+	for (auto& cascade : m_arrCascades)
+	{
+		cascade = {};
+	}
+}
+
+ShadowMap::~ShadowMap()
+{
+	Release();
+}
+
+bool ShadowMap::Create(int32_t size, uint32_t cascadeCount)
+{
+	Release();
+	if (!glGenFramebuffers || !glFramebufferTextureLayer)
+	{
+		IApplication::Debug("ShadowMap: framebuffer texture layers are not supported\n");
+		return false;
+	}
+
+	m_iSize = size;
+	m_uCascadeCount = std::clamp(cascadeCount, 1u, kMaxCascades);
+
+	auto createDepthArray = [this](bool compare)
+	{
+		GLuint texture = 0;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, m_iSize, m_iSize, (GLsizei)m_uCascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (compare)
+		{
+			// Hardware 2x2 percentage closer filtering with sampler2DArrayShadow
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		return texture;
+	};
+
+	m_DepthTexture = createDepthArray(true);
+	if (glCopyImageSubData)
+	{
+		m_StaticTexture = createDepthArray(false);
+	}
+
+	GLint prevFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+	glGenFramebuffers(1, &m_Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_DepthTexture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFramebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		IApplication::Debug("ShadowMap: depth framebuffer is incomplete\n");
+		Release();
+		return false;
+	}
+
+	const GLuint vertexShader = m_Renderer.CreateVertexShader(kDepthVertexShader);
+	const GLuint fragmentShader = m_Renderer.CreateFragmentShader(kDepthFragmentShader);
+	if (vertexShader && fragmentShader)
+	{
+		m_Program = m_Renderer.CreateProgram(vertexShader, fragmentShader);
+	}
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	if (!m_Program)
+	{
+		Release();
+		return false;
+	}
+	m_iPositionLocation = glGetAttribLocation(m_Program, "position");
+	m_iMatrixLocation = glGetUniformLocation(m_Program, "modelViewProjection");
+
+	glGenBuffers(1, &m_PositionBuffer);
+	glGenBuffers(1, &m_IndexBuffer);
+	InvalidateStatic();
+	return true;
+}
+
+void ShadowMap::Release()
+{
+	if (m_DepthTexture)
+	{
+		glDeleteTextures(1, &m_DepthTexture);
+		m_DepthTexture = 0;
+	}
+	if (m_StaticTexture)
+	{
+		glDeleteTextures(1, &m_StaticTexture);
+		m_StaticTexture = 0;
+	}
+	if (m_Framebuffer)
+	{
+		glDeleteFramebuffers(1, &m_Framebuffer);
+		m_Framebuffer = 0;
+	}
+	if (m_Program)
+	{
+		m_Renderer.ReleaseProgram(m_Program);
+		m_Program = 0;
+	}
+	if (m_PositionBuffer)
+	{
+		glDeleteBuffers(1, &m_PositionBuffer);
+		m_PositionBuffer = 0;
+	}
+	if (m_IndexBuffer)
+	{
+		glDeleteBuffers(1, &m_IndexBuffer);
+		m_IndexBuffer = 0;
+	}
+
+	m_arrPositions.clear();
+	m_arrIndices.clear();
+	m_mapMeshes.clear();
+	m_bStreamDirty = false;
+}
+
+void ShadowMap::SetDirectionalLight(const glm::vec3& direction)
+{
+	const glm::vec3 normalized = glm::normalize(direction);
+	if (m_bSpotLight || normalized != m_vLightDirection)
+	{
+		m_bSpotLight = false;
+		m_vLightDirection = normalized;
+		InvalidateStatic();
+	}
+}
+
+void ShadowMap::SetSpotLight(const glm::vec3& position, const glm::vec3& direction, float angle, float range)
+{
+	const glm::vec3 normalized = glm::normalize(direction);
+	if (!m_bSpotLight || position != m_vLightPosition || normalized != m_vLightDirection || angle != m_fSpotAngle || range != m_fSpotRange)
+	{
+		m_bSpotLight = true;
+		m_vLightPosition = position;
+		m_vLightDirection = normalized;
+		m_fSpotAngle = angle;
+		m_fSpotRange = range;
+		InvalidateStatic();
+	}
+}
+
+void ShadowMap::InvalidateStatic()
+{
+	for (auto& cascade : m_arrCascades)
+	{
+		cascade.bStaticValid = false;
+	}
+}
+
+void ShadowMap::InvalidateStatic(const Node& caster)
+{
+	// Cascades that drew the caster at its old place, and those that reach its new place
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&caster);
+	const CASTER_MESH* mesh = (geometryNode && geometryNode->GetGeometry()) ? GetMesh(*geometryNode->GetGeometry()) : nullptr;
+	const glm::mat4 model = caster.GetWorldMatrix();
+	for (uint32_t i = 0; i < GetCascadeCount(); ++i)
+	{
+		CASCADE& cascade = m_arrCascades[i];
+		if (cascade.bStaticValid &&
+			(cascade.setStaticCasters.count(&caster) || (mesh && IsInside(*mesh, model, cascade))))
+		{
+			cascade.bStaticValid = false;
+		}
+	}
+
+	for (const auto& child : caster.GetNodes())
+	{
+		InvalidateStatic(*child);
+	}
+}
+
+void ShadowMap::Forget(const Geometry& geometry)
+{
+	m_mapMeshes.erase(&geometry);
+}
+
+bool ShadowMap::Render(const CameraNode& camera, const Node* staticCasters, const Node* dynamicCasters)
+{
+	m_Stats = {};
+	if (!m_Program)
+	{
+		return false;
+	}
+
+	UpdateCascades(camera);
+
+	GLint prevFramebuffer = 0;
+	GLint prevProgram = 0;
+	GLint prevViewport[4] = {};
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
+	glGetIntegerv(GL_VIEWPORT, prevViewport);
+	const GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+	// Casters between the light and the near plane are flattened onto it instead of clipped
+	glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+	glViewport(0, 0, m_iSize, m_iSize);
+	glUseProgram(m_Program);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(m_fSlopeBias, m_fConstantBias);
+
+	for (uint32_t i = 0; i < GetCascadeCount(); ++i)
+	{
+		CASCADE& cascade = m_arrCascades[i];
+		const bool staticDirty = !cascade.bStaticValid || cascade.mStaticViewProjection != cascade.mViewProjection;
+
+		m_arrDynamicDraws.clear();
+		if (dynamicCasters)
+		{
+			CollectDraws(*dynamicCasters, cascade, m_arrDynamicDraws);
+		}
+		const bool hasDynamic = !m_arrDynamicDraws.empty();
+
+		if (!staticDirty && !hasDynamic && !cascade.bHadDynamic)
+		{
+			++m_Stats.uCascadesCached;
+			continue;
+		}
+
+		if (staticDirty)
+		{
+			m_arrStaticDraws.clear();
+			if (staticCasters)
+			{
+				CollectDraws(*staticCasters, cascade, m_arrStaticDraws);
+			}
+			m_Stats.uStaticDraws += m_arrStaticDraws.size();
+
+			cascade.setStaticCasters.clear();
+			for (const auto& draw : m_arrStaticDraws)
+			{
+				cascade.setStaticCasters.insert(draw.pNode);
+			}
+		}
+
+		// New geometries are uploaded before anything is drawn from the stream
+		UploadStream();
+
+		if (m_StaticTexture)
+		{
+			// Static casters are kept in their own layer and copied under the dynamic ones
+			if (staticDirty)
+			{
+				DrawLayer(m_StaticTexture, i, cascade, m_arrStaticDraws, true);
+			}
+			glCopyImageSubData(m_StaticTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i,
+				m_DepthTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, m_iSize, m_iSize, 1);
+			DrawLayer(m_DepthTexture, i, cascade, m_arrDynamicDraws, false);
+		}
+		else
+		{
+			// Without copies everything is drawn again whenever anything changes
+			if (!staticDirty)
+			{
+				m_arrStaticDraws.clear();
+				if (staticCasters)
+				{
+					CollectDraws(*staticCasters, cascade, m_arrStaticDraws);
+				}
+				m_Stats.uStaticDraws += m_arrStaticDraws.size();
+			}
+			DrawLayer(m_DepthTexture, i, cascade, m_arrStaticDraws, true);
+			DrawLayer(m_DepthTexture, i, cascade, m_arrDynamicDraws, false);
+		}
+
+		m_Stats.uDynamicDraws += m_arrDynamicDraws.size();
+		cascade.mStaticViewProjection = cascade.mViewProjection;
+		cascade.bStaticValid = true;
+		cascade.bHadDynamic = hasDynamic;
+		++m_Stats.uCascadesRendered;
+	}
+
+	if (m_iPositionLocation != -1)
+	{
+		glDisableVertexAttribArray(m_iPositionLocation);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_CLAMP);
+	if (cullFace)
+	{
+		glEnable(GL_CULL_FACE);
+	}
+	glUseProgram(prevProgram);
+	glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFramebuffer);
+	return true;
+}
+
+void ShadowMap::Apply(GLuint program, int32_t slot) const
+{
+	glActiveTexture(GL_TEXTURE0 + slot);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_DepthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	const GLint location = glGetUniformLocation(program, "shadowMap");
+	if (location != -1)
+	{
+		glUniform1i(location, slot);
+	}
+
+	// Bias maps clip space to texture coordinates
+	glm::mat4 matrices[kMaxCascades];
+	glm::vec4 splits(0.0f);
+	const uint32_t count = GetCascadeCount();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		matrices[i] = m_Renderer.GetShadowBiasMatrix() * m_arrCascades[i].mViewProjection;
+		splits[i] = m_arrCascades[i].fSplitFar;
+	}
+
+	const GLint matrixLocation = glGetUniformLocation(program, "shadowMatrices");
+	if (matrixLocation != -1)
+	{
+		glUniformMatrix4fv(matrixLocation, (GLsizei)count, GL_FALSE, &matrices[0][0][0]);
+	}
+	OpenGLRenderer::SetUniformVec4(program, "shadowSplits", splits);
+	OpenGLRenderer::SetUniformInt(program, "shadowCascadeCount", (int32_t)count);
+}
+
+const char* ShadowMap::GetShaderSource()
+{
+	return R"(
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform vec4 shadowSplits;
+uniform int shadowCascadeCount;
+
+float GetShadow(vec3 worldPosition, float viewDepth)
+{
+	int cascade = 0;
+	while (cascade < shadowCascadeCount - 1 && viewDepth > shadowSplits[cascade])
+	{
+		++cascade;
+	}
+	if (viewDepth > shadowSplits[cascade])
+	{
+		return 1.0;
+	}
+
+	vec4 coord = shadowMatrices[cascade] * vec4(worldPosition, 1.0);
+	coord.xyz /= coord.w;
+	if (any(greaterThan(abs(coord.xy - 0.5), vec2(0.5))))
+	{
+		return 1.0;
+	}
+	return texture(shadowMap, vec4(coord.xy, float(cascade), coord.z));
+}
+)";
+}
+
+void ShadowMap::UpdateCascades(const CameraNode& camera)
+{
+	auto extractPlanes = [](CASCADE& cascade)
+	{
+		const glm::mat4 m = glm::transpose(cascade.mViewProjection);
+		cascade.arrPlanes[0] = m[3] + m[0];
+		cascade.arrPlanes[1] = m[3] - m[0];
+		cascade.arrPlanes[2] = m[3] + m[1];
+		cascade.arrPlanes[3] = m[3] - m[1];
+		cascade.arrPlanes[4] = m[3] + m[2];
+		cascade.arrPlanes[5] = m[3] - m[2];
+		for (auto& plane : cascade.arrPlanes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+	};
+
+	const glm::vec3 up = (std::abs(m_vLightDirection.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	if (m_bSpotLight)
+	{
+		CASCADE& cascade = m_arrCascades[0];
+		const glm::mat4 view = glm::lookAt(m_vLightPosition, m_vLightPosition + m_vLightDirection, up);
+		const glm::mat4 projection = glm::perspective(m_fSpotAngle * 2.0f, 1.0f, kSpotNearPlane, m_fSpotRange);
+		cascade.mViewProjection = projection * view;
+		cascade.fSplitFar = FLT_MAX;
+		extractPlanes(cascade);
+		return;
+	}
+
+	const glm::vec4 parameters = camera.GetProjectionParameters();
+	const glm::mat4 view = camera.GetViewMatrix();
+	const float nearPlane = parameters.z;
+	const float farPlane = std::max(std::min(parameters.w, m_fShadowDistance), nearPlane * 2.0f);
+
+	float splitNear = nearPlane;
+	for (uint32_t i = 0; i < m_uCascadeCount; ++i)
+	{
+		// Blend of logarithmic and uniform splits
+		const float p = (float)(i + 1) / (float)m_uCascadeCount;
+		const float logarithmic = nearPlane * std::pow(farPlane / nearPlane, p);
+		const float uniform = nearPlane + (farPlane - nearPlane) * p;
+		const float splitFar = m_fSplitLambda * logarithmic + (1.0f - m_fSplitLambda) * uniform;
+
+		// Bounding sphere of the slice keeps the same size when the camera turns
+		const glm::mat4 inverse = glm::inverse(glm::perspective(parameters.x, parameters.y, splitNear, splitFar) * view);
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int32_t c = 0; c < 8; ++c)
+		{
+			const glm::vec4 corner = inverse * glm::vec4((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f, 1.0f);
+			corners[c] = glm::vec3(corner) / corner.w;
+			center += corners[c];
+		}
+		center /= 8.0f;
+		float radius = 0.0f;
+		for (const auto& corner : corners)
+		{
+			radius = std::max(radius, glm::length(corner - center));
+		}
+		radius = std::ceil(radius / kRadiusStep) * kRadiusStep;
+
+		// Extent is grown by one center step so that the slice stays covered wherever the center is rounded to
+		const float stepFraction = std::min(2.0f * kCenterStepTexels / (float)m_iSize, 0.25f);
+		const float extent = radius / (1.0f - stepFraction);
+		const float step = extent * stepFraction;
+
+		// Snap the center in light space to whole steps, which are whole texels. Edges do not
+		// shimmer and the matrix is exactly the same until the camera crosses a step.
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), m_vLightDirection, up);
+		const glm::vec3 lightCenter = glm::round(glm::vec3(lightView * glm::vec4(center, 1.0f)) / step) * step;
+		lightView[3] -= glm::vec4(lightCenter, 0.0f);
+		const glm::mat4 lightProjection = glm::ortho(-extent, extent, -extent, extent, -extent, extent);
+
+		CASCADE& cascade = m_arrCascades[i];
+		cascade.mViewProjection = lightProjection * lightView;
+		cascade.fSplitFar = splitFar;
+		extractPlanes(cascade);
+		splitNear = splitFar;
+	}
+}
+
+const ShadowMap::CASTER_MESH* ShadowMap::GetMesh(const Geometry& geometry)
+{
+	auto found = m_mapMeshes.find(&geometry);
+	if (found != m_mapMeshes.end() && found->second.uGeneration == geometry.GetGeneration())
+	{
+		return &found->second;
+	}
+
+	std::vector<GLuint> indices;
+	if (!geometry.GetVertexCount() || !geometry.GetTriangleIndices(indices) || indices.empty())
+	{
+		return nullptr;
+	}
+
+	const GLuint baseVertex = (GLuint)m_arrPositions.size();
+	const Geometry::VERTEX* vertices = geometry.GetData();
+	glm::vec3 boundsMin(vertices[0].x, vertices[0].y, vertices[0].z);
+	glm::vec3 boundsMax(boundsMin);
+	for (size_t i = 0; i < geometry.GetVertexCount(); ++i)
+	{
+		const glm::vec3 position(vertices[i].x, vertices[i].y, vertices[i].z);
+		boundsMin = glm::min(boundsMin, position);
+		boundsMax = glm::max(boundsMax, position);
+		m_arrPositions.push_back(position);
+	}
+
+	const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = 0.0f;
+	for (size_t i = baseVertex; i < m_arrPositions.size(); ++i)
+	{
+		radius = std::max(radius, glm::length(m_arrPositions[i] - center));
+	}
+
+	CASTER_MESH mesh;
+	mesh.uFirstIndex = (uint32_t)m_arrIndices.size();
+	mesh.uIndexCount = (uint32_t)indices.size();
+	mesh.vBoundingSphere = glm::vec4(center, radius);
+	mesh.uGeneration = geometry.GetGeneration();
+	for (GLuint index : indices)
+	{
+		m_arrIndices.push_back(baseVertex + index);
+	}
+	m_bStreamDirty = true;
+
+	// A changed geometry gets a new copy, the old one stays unused in the stream
+	CASTER_MESH& cached = m_mapMeshes[&geometry];
+	cached = mesh;
+	return &cached;
+}
+
+void ShadowMap::UploadStream()
+{
+	if (m_bStreamDirty)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_PositionBuffer);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(m_arrPositions.size() * sizeof(glm::vec3)), m_arrPositions.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(m_arrIndices.size() * sizeof(GLuint)), m_arrIndices.data(), GL_STATIC_DRAW);
+		m_bStreamDirty = false;
+	}
+
+	// Tightly packed positions, a third of the full vertex size
+	glBindBuffer(GL_ARRAY_BUFFER, m_PositionBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+	if (m_iPositionLocation != -1)
+	{
+		glEnableVertexAttribArray(m_iPositionLocation);
+		glVertexAttribPointer(m_iPositionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+	}
+}
+
+bool ShadowMap::IsInside(const CASTER_MESH& mesh, const glm::mat4& model, const CASCADE& cascade) const
+{
+	const glm::vec3 center(model * glm::vec4(glm::vec3(mesh.vBoundingSphere), 1.0f));
+	const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+	const float radius = mesh.vBoundingSphere.w * scale;
+
+	// Near plane is skipped, depth clamp keeps casters between the light and the cascade
+	for (int32_t p = 0; p < 6; ++p)
+	{
+		if (p != 4 && glm::dot(glm::vec3(cascade.arrPlanes[p]), center) + cascade.arrPlanes[p].w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void ShadowMap::CollectDraws(const Node& node, const CASCADE& cascade, std::vector<DRAW>& draws)
+{
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&node);
+	if (geometryNode && geometryNode->GetGeometry())
+	{
+		const CASTER_MESH* mesh = GetMesh(*geometryNode->GetGeometry());
+		if (mesh)
+		{
+			const glm::mat4 model = node.GetWorldMatrix();
+			if (IsInside(*mesh, model, cascade))
+			{
+				draws.push_back({ mesh, &node, model });
+			}
+			else
+			{
+				++m_Stats.uCulledDraws;
+			}
+		}
+	}
+
+	for (const auto& child : node.GetNodes())
+	{
+		CollectDraws(*child, cascade, draws);
+	}
+}
+
+void ShadowMap::DrawLayer(GLuint texture, uint32_t layer, const CASCADE& cascade, const std::vector<DRAW>& draws, bool clear)
+{
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, (GLint)layer);
+	if (clear)
+	{
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	for (const auto& draw : draws)
+	{
+		const glm::mat4 modelViewProjection = cascade.mViewProjection * draw.mModel;
+		glUniformMatrix4fv(m_iMatrixLocation, 1, GL_FALSE, &modelViewProjection[0][0]);
+		glDrawElements(GL_TRIANGLES, (GLsizei)draw.pMesh->uIndexCount, GL_UNSIGNED_INT, (const void*)(draw.pMesh->uFirstIndex * sizeof(GLuint)));
+	}
+}
@@ -0,0 +1,56 @@
+#include "../include/SystemScheduler.h"
+#include "../include/Timer.h"
+
+SystemScheduler::SystemScheduler(JobPool& jobPool) :
+	m_JobPool(jobPool)
+{
+}
+
+SystemScheduler::~SystemScheduler()
+{
+}
+
+void SystemScheduler::AddSystem(const std::string_view& name, uint32_t mask, SystemFunction function)
+{
+	m_arrSystems.push_back({ std::string(name), mask, std::move(function) });
+}
+
+void SystemScheduler::AddDefaultSystems()
+{
+	const uint32_t transform = ComponentBit(ComponentType::Transform);
+	AddSystem("Integrate", transform | ComponentBit(ComponentType::Velocity), &World::IntegrateSystem);
+	AddSystem("Rotate", transform | ComponentBit(ComponentType::Rotation), &World::RotateSystem);
+	AddSystem("LocalTransform", transform, &World::LocalTransformSystem);
+	AddSystem("WorldTransform", transform, &World::WorldTransformSystem);
+}
+
+void SystemScheduler::Run(World& world, float frametime)
+{
+	m_arrTimings.resize(m_arrSystems.size());
+	Timer timer;
+	for (size_t i = 0; i < m_arrSystems.size(); ++i)
+	{
+		timer.BeginTimer();
+		RunSystem(m_arrSystems[i], world, frametime);
+		timer.EndTimer();
+
+		SystemTiming& timing = m_arrTimings[i];
+		timing.strName = m_arrSystems[i].name;
+		timing.uChunks = m_arrChunks.size();
+		timing.uEntities = 0;
+		for (const auto* chunk : m_arrChunks)
+		{
+			timing.uEntities += chunk->uCount;
+		}
+		timing.fSeconds = timer.GetElapsedSeconds();
+	}
+}
+
+void SystemScheduler::RunSystem(const SYSTEM& system, World& world, float frametime)
+{
+	world.GetChunks(system.mask, m_arrChunks);
+	m_JobPool.Run((uint32_t)m_arrChunks.size(), [&](uint32_t chunk)
+	{
+		system.function(world, *m_arrChunks[chunk], frametime);
+	});
+}
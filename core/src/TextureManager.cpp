@@ -0,0 +1,598 @@
+#include "../include/TextureManager.h"
+#include "../include/ResourceWorker.h"
+
+#include <algorithm>
+
+// Textures are not shrunk below this size, smaller ones are evicted completely
+constexpr int32_t kMinDropSize = 32;
+
+TextureManager::TextureManager(size_t budgetBytes) :
+	m_uBudgetBytes(budgetBytes),
+	m_uResidentBytes(0),
+	m_uPeakBytes(0),
+	m_uPendingFreeBytes(0),
+	m_uMipDrops(0),
+	m_uEvictions(0),
+	m_uReloads(0),
+	m_uFrame(0),
+	m_pResourceWorker(nullptr),
+	m_bRunning(true)
+{
+	m_LoaderThread = std::thread(&TextureManager::LoaderThread, this);
+}
+
+TextureManager::~TextureManager()
+{
+	// Stop the background loader before releasing anything it could touch
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bRunning = false;
+	}
+	m_Condition.notify_all();
+	if (m_LoaderThread.joinable())
+	{
+		m_LoaderThread.join();
+	}
+
+	for (auto& it : m_mapTextures)
+	{
+		glDeleteTextures(1, &it.second.handle);
+	}
+	if (!m_arrOrphans.empty())
+	{
+		glDeleteTextures((GLsizei)m_arrOrphans.size(), m_arrOrphans.data());
+	}
+}
+
+GLuint TextureManager::Acquire(const std::string_view& filename)
+{
+	const std::string name(filename);
+
+	// Share the texture if the same file is already loaded
+	auto found = m_mapFilenames.find(name);
+	if (found != m_mapFilenames.end())
+	{
+		TEXTURE& texture = m_mapTextures[found->second];
+		++texture.uRefCount;
+		MarkUsed(texture);
+		return texture.handle;
+	}
+
+	if (m_pResourceWorker)
+	{
+		return AcquireAsync(name);
+	}
+
+	std::vector<uint8_t> pixels;
+	int32_t width = 0;
+	int32_t height = 0;
+	if (!OpenGLRenderer::LoadImageData(name, pixels, width, height))
+	{
+		return 0;
+	}
+
+	TEXTURE texture;
+	texture.strFilename = name;
+	texture.handle = 0;
+	texture.iWidth = width;
+	texture.iHeight = height;
+	texture.iDroppedLevels = 0;
+	texture.iTargetDroppedLevels = 0;
+	texture.uPendingFreeBytes = 0;
+	texture.uRefCount = 1;
+	texture.uLastUsedFrame = m_uFrame;
+	texture.uBytes = 0;
+	texture.bEvicted = false;
+	texture.bLoading = false;
+	texture.bUploading = false;
+
+	glGenTextures(1, &texture.handle);
+	Upload(texture, pixels.data(), width, height);
+
+	const GLuint handle = texture.handle;
+	m_mapFilenames[name] = handle;
+	m_mapTextures[handle] = std::move(texture);
+	MarkUsed(m_mapTextures[handle]);
+
+	// New texture may push us over the budget
+	EnforceBudget();
+
+	return handle;
+}
+
+void TextureManager::Release(GLuint texture)
+{
+	auto it = m_mapTextures.find(texture);
+	if (it == m_mapTextures.end())
+	{
+		return;
+	}
+
+	if (--it->second.uRefCount > 0)
+	{
+		return;
+	}
+
+	m_uResidentBytes -= it->second.uBytes;
+	m_uPendingFreeBytes -= it->second.uPendingFreeBytes;
+	if (it->second.bUploading)
+	{
+		// The worker may still be writing into the texture, UploadReady deletes it
+		m_arrOrphans.push_back(it->second.handle);
+	}
+	else
+	{
+		glDeleteTextures(1, &it->second.handle);
+	}
+
+	auto lru = m_mapLRU.find(texture);
+	if (lru != m_mapLRU.end())
+	{
+		m_listLRU.erase(lru->second);
+		m_mapLRU.erase(lru);
+	}
+	m_mapFilenames.erase(it->second.strFilename);
+	m_mapTextures.erase(it);
+}
+
+void TextureManager::Touch(GLuint texture)
+{
+	auto it = m_mapTextures.find(texture);
+	if (it == m_mapTextures.end())
+	{
+		// Not a managed texture, e.g. a render target
+		return;
+	}
+
+	TEXTURE& tex = it->second;
+	MarkUsed(tex);
+
+	// Restore missing resolution in the background
+	if ((tex.bEvicted || tex.iDroppedLevels > 0) && !tex.bLoading)
+	{
+		tex.iTargetDroppedLevels = 0;
+		QueueLoad(tex);
+	}
+}
+
+void TextureManager::Update()
+{
+	// Take the finished loads out of the queue so the loader can continue
+	std::deque<LOADREQUEST> completed;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		completed.swap(m_arrCompleted);
+	}
+
+	for (auto& request : completed)
+	{
+		auto it = m_mapTextures.find(request.handle);
+		// Texture may have been released, or the handle reused, while loading
+		if (it == m_mapTextures.end() || !it->second.bLoading || it->second.strFilename != request.strFilename)
+		{
+			continue;
+		}
+
+		TEXTURE& texture = it->second;
+		texture.bLoading = false;
+		CancelDrop(texture);
+		if (request.arrPixels.empty())
+		{
+			IApplication::Debug("TextureManager: failed to reload " + request.strFilename + "\n");
+			texture.iTargetDroppedLevels = texture.iDroppedLevels;
+			continue;
+		}
+
+		// Shrinking replaces the whole mip chain, which frees the dropped levels
+		const int32_t width = glm::max(request.iWidth >> request.iDroppedLevels, 1);
+		const int32_t height = glm::max(request.iHeight >> request.iDroppedLevels, 1);
+		Upload(texture, request.arrPixels.data(), width, height);
+		texture.iWidth = request.iWidth;
+		texture.iHeight = request.iHeight;
+		texture.iDroppedLevels = request.iDroppedLevels;
+		texture.iTargetDroppedLevels = request.iDroppedLevels;
+		if (request.iDroppedLevels == 0)
+		{
+			++m_uReloads;
+		}
+	}
+
+	EnforceBudget();
+	++m_uFrame;
+}
+
+void TextureManager::SetBudget(size_t budgetBytes)
+{
+	m_uBudgetBytes = budgetBytes;
+	EnforceBudget();
+}
+
+bool TextureManager::IsFullyResident(GLuint texture) const
+{
+	auto it = m_mapTextures.find(texture);
+	return it != m_mapTextures.end() && !it->second.bEvicted && !it->second.bUploading && it->second.iDroppedLevels == 0;
+}
+
+TextureStats TextureManager::GetStats() const
+{
+	TextureStats stats = {};
+	stats.uTextureCount = m_mapTextures.size();
+	for (const auto& it : m_mapTextures)
+	{
+		if (it.second.bUploading)
+		{
+			++stats.uPendingLoads;
+		}
+		else if (it.second.bEvicted)
+		{
+			++stats.uEvictedCount;
+		}
+		else
+		{
+			++stats.uResidentCount;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		stats.uPendingLoads += m_arrRequests.size() + m_arrCompleted.size();
+	}
+
+	stats.uResidentBytes = m_uResidentBytes;
+	stats.uPeakBytes = m_uPeakBytes;
+	stats.uPendingFreeBytes = m_uPendingFreeBytes;
+	stats.uBudgetBytes = m_uBudgetBytes;
+	stats.uMipDrops = m_uMipDrops;
+	stats.uEvictions = m_uEvictions;
+	stats.uReloads = m_uReloads;
+	return stats;
+}
+
+size_t TextureManager::CalculateSize(int32_t width, int32_t height)
+{
+	// Sum all levels of the mip chain down to 1x1
+	size_t bytes = 0;
+	for (;;)
+	{
+		bytes += (size_t)width * (size_t)height * 4;
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+		width = glm::max(width / 2, 1);
+		height = glm::max(height / 2, 1);
+	}
+	return bytes;
+}
+
+void TextureManager::Upload(TEXTURE& texture, const uint8_t* pixels, int32_t width, int32_t height)
+{
+	UploadPixels(texture.handle, pixels, width, height);
+
+	m_uResidentBytes -= texture.uBytes;
+	texture.uBytes = CalculateSize(width, height);
+	m_uResidentBytes += texture.uBytes;
+	m_uPeakBytes = glm::max(m_uPeakBytes, m_uResidentBytes);
+
+	texture.iDroppedLevels = 0;
+	texture.bEvicted = false;
+}
+
+void TextureManager::UploadPixels(GLuint handle, const uint8_t* pixels, int32_t width, int32_t height)
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, handle);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	// Eviction limits the chain to level 0, mipmaps are only generated up to the max level
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+GLuint TextureManager::AcquireAsync(const std::string& filename)
+{
+	TEXTURE texture;
+	texture.strFilename = filename;
+	texture.handle = 0;
+	texture.iWidth = 0;
+	texture.iHeight = 0;
+	texture.iDroppedLevels = 0;
+	texture.iTargetDroppedLevels = 0;
+	texture.uPendingFreeBytes = 0;
+	texture.uRefCount = 1;
+	texture.uLastUsedFrame = m_uFrame;
+	texture.uBytes = 0;
+	texture.bEvicted = false;
+	texture.bLoading = false;
+	texture.bUploading = true;
+
+	// Names are shared between the contexts, the worker creates the texture behind this one
+	glGenTextures(1, &texture.handle);
+	const GLuint handle = texture.handle;
+	m_mapFilenames[filename] = handle;
+	m_mapTextures[handle] = std::move(texture);
+	MarkUsed(m_mapTextures[handle]);
+
+	// Size is written by the worker and read in the ready callback, after the fence
+	auto size = std::make_shared<glm::ivec2>(0, 0);
+	m_pResourceWorker->Submit(
+		[handle, filename, size]()
+		{
+			std::vector<uint8_t> pixels;
+			if (OpenGLRenderer::LoadImageData(filename, pixels, size->x, size->y))
+			{
+				UploadPixels(handle, pixels.data(), size->x, size->y);
+			}
+			else
+			{
+				*size = glm::ivec2(0, 0);
+			}
+		},
+		[this, handle, filename, size]()
+		{
+			UploadReady(handle, filename, size->x, size->y);
+		});
+
+	return handle;
+}
+
+void TextureManager::UploadReady(GLuint handle, const std::string& filename, int32_t width, int32_t height)
+{
+	auto orphan = std::find(m_arrOrphans.begin(), m_arrOrphans.end(), handle);
+	if (orphan != m_arrOrphans.end())
+	{
+		glDeleteTextures(1, &handle);
+		m_arrOrphans.erase(orphan);
+		return;
+	}
+
+	auto it = m_mapTextures.find(handle);
+	if (it == m_mapTextures.end() || !it->second.bUploading || it->second.strFilename != filename)
+	{
+		return;
+	}
+
+	TEXTURE& texture = it->second;
+	texture.bUploading = false;
+	if (width == 0 || height == 0)
+	{
+		// Handle has been given out already, keep it valid with a single transparent texel
+		IApplication::Debug("TextureManager: failed to load " + filename + "\n");
+		const uint8_t texel[4] = { 0, 0, 0, 0 };
+		UploadPixels(handle, texel, 1, 1);
+		width = 1;
+		height = 1;
+	}
+
+	texture.iWidth = width;
+	texture.iHeight = height;
+	m_uResidentBytes -= texture.uBytes;
+	texture.uBytes = CalculateSize(width, height);
+	m_uResidentBytes += texture.uBytes;
+	m_uPeakBytes = glm::max(m_uPeakBytes, m_uResidentBytes);
+
+	// Budget is enforced at the next Update
+}
+
+void TextureManager::MarkUsed(TEXTURE& texture)
+{
+	texture.uLastUsedFrame = m_uFrame;
+
+	// Move texture to the most recently used end of the list
+	auto it = m_mapLRU.find(texture.handle);
+	if (it != m_mapLRU.end())
+	{
+		m_listLRU.splice(m_listLRU.end(), m_listLRU, it->second);
+	}
+	else
+	{
+		m_mapLRU[texture.handle] = m_listLRU.insert(m_listLRU.end(), texture.handle);
+	}
+}
+
+void TextureManager::EnforceBudget()
+{
+	if (m_uBudgetBytes == 0)
+	{
+		return;
+	}
+
+	// Degrade the least recently used textures first. Each pass drops one level
+	// from every candidate, so old textures lose resolution before being evicted.
+	// Drops are only queued here, the bytes they free count against the budget right away.
+	std::vector<GLuint> shrinks;
+	bool progress = true;
+	while (m_uResidentBytes - m_uPendingFreeBytes > m_uBudgetBytes && progress)
+	{
+		progress = false;
+		for (GLuint handle : m_listLRU)
+		{
+			TEXTURE& texture = m_mapTextures[handle];
+
+			// Never take away textures that are needed for the current frame
+			if (texture.uLastUsedFrame >= m_uFrame)
+			{
+				break;
+			}
+			if (texture.bEvicted || texture.bUploading || texture.bLoading)
+			{
+				continue;
+			}
+
+			const bool queued = texture.iTargetDroppedLevels != texture.iDroppedLevels;
+			if (DropTopLevel(texture))
+			{
+				if (!queued)
+				{
+					shrinks.push_back(handle);
+				}
+			}
+			else
+			{
+				Evict(texture);
+			}
+			progress = true;
+
+			if (m_uResidentBytes - m_uPendingFreeBytes <= m_uBudgetBytes)
+			{
+				break;
+			}
+		}
+	}
+
+	for (GLuint handle : shrinks)
+	{
+		TEXTURE& texture = m_mapTextures[handle];
+		if (!texture.bEvicted)
+		{
+			QueueLoad(texture);
+		}
+	}
+}
+
+bool TextureManager::DropTopLevel(TEXTURE& texture)
+{
+	const int32_t droppedLevels = texture.iTargetDroppedLevels + 1;
+	const int32_t width = glm::max(texture.iWidth >> droppedLevels, 1);
+	const int32_t height = glm::max(texture.iHeight >> droppedLevels, 1);
+	if (width < kMinDropSize || height < kMinDropSize)
+	{
+		return false;
+	}
+
+	// The loader thread builds the smaller chain from the source image, reading it back from the GPU would stall
+	const size_t freeBytes = texture.uBytes - CalculateSize(width, height);
+	m_uPendingFreeBytes += freeBytes - texture.uPendingFreeBytes;
+	texture.uPendingFreeBytes = freeBytes;
+	texture.iTargetDroppedLevels = droppedLevels;
+	++m_uMipDrops;
+	return true;
+}
+
+void TextureManager::CancelDrop(TEXTURE& texture)
+{
+	m_uPendingFreeBytes -= texture.uPendingFreeBytes;
+	texture.uPendingFreeBytes = 0;
+	texture.iTargetDroppedLevels = texture.iDroppedLevels;
+}
+
+void TextureManager::Evict(TEXTURE& texture)
+{
+	CancelDrop(texture);
+
+	// Release every level of the chain, a level specified with zero size holds no memory
+	const int32_t width = glm::max(texture.iWidth >> texture.iDroppedLevels, 1);
+	const int32_t height = glm::max(texture.iHeight >> texture.iDroppedLevels, 1);
+	int32_t levels = 1;
+	while ((glm::max(width, height) >> levels) > 0)
+	{
+		++levels;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture.handle);
+	for (int32_t level = 1; level < levels; ++level)
+	{
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	// Keep the handle valid with a single transparent texel so that
+	// users can keep binding it until the reload completes
+	const uint8_t texel[4] = { 0, 0, 0, 0 };
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	m_uResidentBytes -= texture.uBytes;
+	texture.uBytes = 4;
+	m_uResidentBytes += texture.uBytes;
+
+	texture.iDroppedLevels = 0;
+	texture.iTargetDroppedLevels = 0;
+	texture.bEvicted = true;
+	++m_uEvictions;
+}
+
+void TextureManager::QueueLoad(TEXTURE& texture)
+{
+	texture.bLoading = true;
+
+	LOADREQUEST request;
+	request.handle = texture.handle;
+	request.strFilename = texture.strFilename;
+	request.iWidth = 0;
+	request.iHeight = 0;
+	request.iDroppedLevels = texture.iTargetDroppedLevels;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_arrRequests.push_back(std::move(request));
+	}
+	m_Condition.notify_one();
+}
+
+void TextureManager::LoaderThread()
+{
+	for (;;)
+	{
+		LOADREQUEST request;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this] { return !m_bRunning || !m_arrRequests.empty(); });
+			if (!m_bRunning)
+			{
+				return;
+			}
+			request = std::move(m_arrRequests.front());
+			m_arrRequests.pop_front();
+		}
+
+		// Decoding does not need the OpenGL context, only the upload does
+		if (!OpenGLRenderer::LoadImageData(request.strFilename, request.arrPixels, request.iWidth, request.iHeight))
+		{
+			request.arrPixels.clear();
+		}
+		else
+		{
+			int32_t width = request.iWidth;
+			int32_t height = request.iHeight;
+			for (int32_t level = 0; level < request.iDroppedLevels; ++level)
+			{
+				Downsample(request.arrPixels, width, height);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_arrCompleted.push_back(std::move(request));
+	}
+}
+
+void TextureManager::Downsample(std::vector<uint8_t>& pixels, int32_t& width, int32_t& height)
+{
+	// Box filter in place, same level sizes as glGenerateMipmap
+	const int32_t newWidth = glm::max(width / 2, 1);
+	const int32_t newHeight = glm::max(height / 2, 1);
+	for (int32_t y = 0; y < newHeight; ++y)
+	{
+		const int32_t y0 = glm::min(y * 2, height - 1);
+		const int32_t y1 = glm::min(y * 2 + 1, height - 1);
+		for (int32_t x = 0; x < newWidth; ++x)
+		{
+			const int32_t x0 = glm::min(x * 2, width - 1);
+			const int32_t x1 = glm::min(x * 2 + 1, width - 1);
+			for (int32_t c = 0; c < 4; ++c)
+			{
+				const uint32_t sum =
+					pixels[((size_t)y0 * width + x0) * 4 + c] + pixels[((size_t)y0 * width + x1) * 4 + c] +
+					pixels[((size_t)y1 * width + x0) * 4 + c] + pixels[((size_t)y1 * width + x1) * 4 + c];
+				pixels[((size_t)y * newWidth + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+			}
+		}
+	}
+	pixels.resize((size_t)newWidth * (size_t)newHeight * 4);
+	width = newWidth;
+	height = newHeight;
+}
@@ -78,3 +78,19 @@ uint64_t Timer::GetTicks()
 
 	return ret;
 }
+
+
+uint64_t Timer::GetTickFrequency()
+{
+	uint64_t ret = 0;
+
+#if defined (_WIN32)
+	::QueryPerformanceFrequency((LARGE_INTEGER*)&ret);
+
+#elif defined (_LINUX)
+	// GetTicks returns nanoseconds
+	ret = 1000000000llu;
+#endif
+
+	return ret;
+}
@@ -0,0 +1,433 @@
+#include "../include/TransformBatch.h"
+#include "../include/Node.h"
+#include "../include/Timer.h"
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+namespace
+{
+#if defined (TRANSFORM_SSE)
+	// Nodes ahead of the current group to prefetch while gathering
+	constexpr size_t kPrefetchDistance = 16;
+
+	/**
+	 * Sine and cosine of four angles, Cephes polynomials after reducing the
+	 * angle to [-pi/4, pi/4]. Accurate to a few ulps for angles well within
+	 * the range a rotation angle is wrapped to.
+	 */
+	inline void SinCos4(__m128 x, __m128& sine, __m128& cosine)
+	{
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+		__m128 signSin = _mm_and_ps(x, signMask);
+		x = _mm_andnot_ps(signMask, x);
+
+		// Octant of the angle, rounded up to even
+		__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+		j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+		const __m128 y = _mm_cvtepi32_ps(j);
+
+		const __m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+		signSin = _mm_xor_ps(signSin, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)));
+		const __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+
+		// Extended precision subtraction of the octant
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-0.78515625f)));
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-2.4187564849853515625e-4f)));
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-3.77489497744594108e-8f)));
+		const __m128 z = _mm_mul_ps(x, x);
+
+		__m128 polyCos = _mm_set1_ps(2.443315711809948e-5f);
+		polyCos = _mm_add_ps(_mm_mul_ps(polyCos, z), _mm_set1_ps(-1.388731625493765e-3f));
+		polyCos = _mm_add_ps(_mm_mul_ps(polyCos, z), _mm_set1_ps(4.166664568298827e-2f));
+		polyCos = _mm_mul_ps(_mm_mul_ps(polyCos, z), z);
+		polyCos = _mm_sub_ps(polyCos, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+		polyCos = _mm_add_ps(polyCos, _mm_set1_ps(1.0f));
+
+		__m128 polySin = _mm_set1_ps(-1.9515295891e-4f);
+		polySin = _mm_add_ps(_mm_mul_ps(polySin, z), _mm_set1_ps(8.3321608736e-3f));
+		polySin = _mm_add_ps(_mm_mul_ps(polySin, z), _mm_set1_ps(-1.6666654611e-1f));
+		polySin = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(polySin, z), x), x);
+
+		sine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(polyMask, polySin), _mm_andnot_ps(polyMask, polyCos)), signSin);
+		cosine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(polyMask, polyCos), _mm_andnot_ps(polyMask, polySin)), signCos);
+	}
+#endif
+}
+
+TransformBatch::TransformBatch() :
+	m_Stats()
+{
+}
+
+TransformBatch::~TransformBatch()
+{
+}
+
+void TransformBatch::Build(Node& root)
+{
+	m_arrNodes.clear();
+
+	// Children are visited after their parent like in Node::Update, the order does not matter otherwise
+	m_arrNodes.push_back(&root);
+	for (size_t i = 0; i < m_arrNodes.size(); ++i)
+	{
+		for (const auto& child : m_arrNodes[i]->GetNodes())
+		{
+			m_arrNodes.push_back(child.get());
+		}
+	}
+}
+
+void TransformBatch::Update(float frametime)
+{
+	const size_t count = m_arrNodes.size();
+	m_Stats = {};
+	m_Stats.uNodes = count;
+
+	float* const position[3] = { m_arrPosition[0], m_arrPosition[1], m_arrPosition[2] };
+	const float* const velocity[3] = { m_arrVelocity[0], m_arrVelocity[1], m_arrVelocity[2] };
+	const float* const axis[3] = { m_arrAxis[0], m_arrAxis[1], m_arrAxis[2] };
+	float* rotation[9];
+	for (size_t i = 0; i < 9; ++i)
+	{
+		rotation[i] = m_arrRotation[i];
+	}
+
+	// Work in blocks that stay in the cache, so nodes are still there when written back
+	Timer timer;
+	for (size_t base = 0; base < count; base += kBlockSize)
+	{
+		const size_t blockCount = std::min(count - base, kBlockSize);
+		Node* const* nodes = m_arrNodes.data() + base;
+
+		timer.BeginTimer();
+		Gather(nodes, blockCount);
+		timer.EndTimer();
+		m_Stats.fGatherSeconds += timer.GetElapsedSeconds();
+
+		timer.BeginTimer();
+		Integrate(blockCount, frametime, position, velocity, axis, m_arrAngle, m_arrSpeed, rotation);
+		timer.EndTimer();
+		m_Stats.fIntegrateSeconds += timer.GetElapsedSeconds();
+
+		timer.BeginTimer();
+		m_Stats.uRotating += Scatter(nodes, blockCount);
+		timer.EndTimer();
+		m_Stats.fScatterSeconds += timer.GetElapsedSeconds();
+	}
+}
+
+TransformBenchmark TransformBatch::Benchmark(size_t nodeCount, uint32_t iterations)
+{
+	// Two identical flat scenes, three of four nodes spinning and all of them moving
+	auto createScene = [nodeCount]()
+	{
+		auto root = Node::Create();
+		for (size_t i = 0; i < nodeCount; ++i)
+		{
+			auto node = Node::Create();
+			const float f = (float)i;
+			node->RotateAxisAngle(glm::vec3(std::sin(f), std::cos(f * 0.7f), 0.5f), f * 0.01f);
+			node->SetRotationSpeed((i % 4) ? 0.5f + (float)(i % 7) * 0.25f : 0.0f);
+			node->SetPos((float)(i % 100), (float)(i / 100 % 100), -(float)(i / 10000));
+			node->SetVelocity(glm::vec3(0.1f, 0.0f, -0.05f) * (float)(i % 3));
+			root->AddNode(node);
+		}
+		return root;
+	};
+	auto nodeScene = createScene();
+	auto batchScene = createScene();
+
+	TransformBenchmark result = {};
+	result.uNodes = nodeCount;
+	result.uIterations = iterations;
+#if defined (TRANSFORM_SSE)
+	result.bSimd = true;
+#endif
+
+	constexpr float frametime = 1.0f / 60.0f;
+	Timer timer;
+	timer.BeginTimer();
+	for (uint32_t i = 0; i < iterations; ++i)
+	{
+		nodeScene->Update(frametime);
+	}
+	timer.EndTimer();
+	result.fNodeSeconds = timer.GetElapsedSeconds();
+
+	TransformBatch batch;
+	batch.Build(*batchScene);
+	timer.BeginTimer();
+	for (uint32_t i = 0; i < iterations; ++i)
+	{
+		batch.Update(frametime);
+	}
+	timer.EndTimer();
+	result.fBatchSeconds = timer.GetElapsedSeconds();
+
+	const auto& nodes = nodeScene->GetNodes();
+	const auto& batchNodes = batchScene->GetNodes();
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		const glm::mat4& a = nodes[i]->GetMatrix();
+		const glm::mat4& b = batchNodes[i]->GetMatrix();
+		for (int c = 0; c < 4; ++c)
+		{
+			for (int r = 0; r < 4; ++r)
+			{
+				result.fMaxError = std::max(result.fMaxError, std::abs(a[c][r] - b[c][r]));
+			}
+		}
+	}
+	return result;
+}
+
+void TransformBatch::Integrate(size_t count, float frametime, float* const position[3], const float* const velocity[3], const float* const axis[3], float* angle, const float* speed, float* const rotation[9])
+{
+	constexpr float pi2 = glm::two_pi<float>();
+
+#if defined (TRANSFORM_SSE)
+	const __m128 dt = _mm_set1_ps(frametime);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 twoPi = _mm_set1_ps(pi2);
+	const __m128 minusTwoPi = _mm_set1_ps(-pi2);
+	for (size_t i = 0; i < count; i += 4)
+	{
+		for (size_t c = 0; position && c < 3; ++c)
+		{
+			_mm_store_ps(position[c] + i, _mm_add_ps(_mm_load_ps(position[c] + i), _mm_mul_ps(_mm_load_ps(velocity[c] + i), dt)));
+		}
+
+		// Same formula as glm::rotate on an identity matrix
+		__m128 x = _mm_load_ps(axis[0] + i);
+		__m128 y = _mm_load_ps(axis[1] + i);
+		__m128 z = _mm_load_ps(axis[2] + i);
+		const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z))));
+		x = _mm_mul_ps(x, invLength);
+		y = _mm_mul_ps(y, invLength);
+		z = _mm_mul_ps(z, invLength);
+
+		__m128 a = _mm_load_ps(angle + i);
+		__m128 s, c;
+		SinCos4(a, s, c);
+		const __m128 k = _mm_sub_ps(one, c);
+		const __m128 tx = _mm_mul_ps(k, x);
+		const __m128 ty = _mm_mul_ps(k, y);
+		const __m128 tz = _mm_mul_ps(k, z);
+		const __m128 sx = _mm_mul_ps(s, x);
+		const __m128 sy = _mm_mul_ps(s, y);
+		const __m128 sz = _mm_mul_ps(s, z);
+		_mm_store_ps(rotation[0] + i, _mm_add_ps(c, _mm_mul_ps(tx, x)));
+		_mm_store_ps(rotation[1] + i, _mm_add_ps(_mm_mul_ps(tx, y), sz));
+		_mm_store_ps(rotation[2] + i, _mm_sub_ps(_mm_mul_ps(tx, z), sy));
+		_mm_store_ps(rotation[3] + i, _mm_sub_ps(_mm_mul_ps(ty, x), sz));
+		_mm_store_ps(rotation[4] + i, _mm_add_ps(c, _mm_mul_ps(ty, y)));
+		_mm_store_ps(rotation[5] + i, _mm_add_ps(_mm_mul_ps(ty, z), sx));
+		_mm_store_ps(rotation[6] + i, _mm_add_ps(_mm_mul_ps(tz, x), sy));
+		_mm_store_ps(rotation[7] + i, _mm_sub_ps(_mm_mul_ps(tz, y), sx));
+		_mm_store_ps(rotation[8] + i, _mm_add_ps(c, _mm_mul_ps(tz, z)));
+
+		// Advance and wrap by one turn, which covers any sane speed
+		const __m128 w = _mm_load_ps(speed + i);
+		a = _mm_add_ps(a, _mm_mul_ps(w, dt));
+		a = _mm_sub_ps(a, _mm_and_ps(_mm_cmpgt_ps(a, twoPi), twoPi));
+		a = _mm_add_ps(a, _mm_and_ps(_mm_cmplt_ps(a, minusTwoPi), twoPi));
+		_mm_store_ps(angle + i, a);
+
+		// Angles set far outside of a turn need more, nodes that do not rotate keep their angle anyway
+		const __m128 outside = _mm_or_ps(_mm_cmpgt_ps(a, twoPi), _mm_cmplt_ps(a, minusTwoPi));
+		if (_mm_movemask_ps(_mm_andnot_ps(_mm_cmpeq_ps(w, _mm_setzero_ps()), outside)))
+		{
+			for (size_t j = i; j < i + 4; ++j)
+			{
+				while (angle[j] > pi2) angle[j] -= pi2;
+				while (angle[j] < -pi2) angle[j] += pi2;
+			}
+		}
+	}
+#else
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (size_t c = 0; position && c < 3; ++c)
+		{
+			position[c][i] += velocity[c][i] * frametime;
+		}
+		if (speed[i] == 0.0f)
+		{
+			continue;
+		}
+
+		const glm::vec3 a = glm::normalize(glm::vec3(axis[0][i], axis[1][i], axis[2][i]));
+		const float s = std::sin(angle[i]);
+		const float c = std::cos(angle[i]);
+		const glm::vec3 t = (1.0f - c) * a;
+		rotation[0][i] = c + t.x * a.x;
+		rotation[1][i] = t.x * a.y + s * a.z;
+		rotation[2][i] = t.x * a.z - s * a.y;
+		rotation[3][i] = t.y * a.x - s * a.z;
+		rotation[4][i] = c + t.y * a.y;
+		rotation[5][i] = t.y * a.z + s * a.x;
+		rotation[6][i] = t.z * a.x + s * a.y;
+		rotation[7][i] = t.z * a.y - s * a.x;
+		rotation[8][i] = c + t.z * a.z;
+
+		angle[i] += speed[i] * frametime;
+		while (angle[i] > pi2) angle[i] -= pi2;
+		while (angle[i] < -pi2) angle[i] += pi2;
+	}
+#endif
+}
+
+void TransformBatch::Gather(Node* const* nodes, size_t count)
+{
+#if defined (TRANSFORM_SSE)
+	// Node::MOTION is loaded as two groups of 4 floats: velocity and axis x, then axis yz, angle and speed
+	static_assert(sizeof(Node::MOTION) == 8 * sizeof(float), "TransformBatch: Node::MOTION must be 8 packed floats");
+	static_assert(offsetof(Node::MOTION, velocity) == 0, "TransformBatch: unexpected Node::MOTION layout");
+	static_assert(offsetof(Node::MOTION, axis) == 3 * sizeof(float), "TransformBatch: unexpected Node::MOTION layout");
+	static_assert(offsetof(Node::MOTION, angle) == 6 * sizeof(float), "TransformBatch: unexpected Node::MOTION layout");
+	static_assert(offsetof(Node::MOTION, speed) == 7 * sizeof(float), "TransformBatch: unexpected Node::MOTION layout");
+
+	// Velocity, axis, angle and speed of a missing node in the last group, the axis must not be zero
+	alignas(16) static const float padding[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+	for (size_t i = 0; i < count; i += 4)
+	{
+		// Nodes are scattered in memory, fetch a few groups ahead including the lines Scatter writes
+		for (size_t j = i + kPrefetchDistance; j < std::min(i + kPrefetchDistance + 4, count); ++j)
+		{
+			const Node& node = *nodes[j];
+			_mm_prefetch((const char*)&node.m_mModel, _MM_HINT_T0);
+			_mm_prefetch((const char*)&node.m_mPrevModel, _MM_HINT_T0);
+			_mm_prefetch((const char*)&node.m_mPrevModel[3], _MM_HINT_T0);
+			_mm_prefetch((const char*)&node.m_Motion, _MM_HINT_T0);
+			_mm_prefetch((const char*)&node.m_Motion + sizeof(Node::MOTION) - 1, _MM_HINT_T0);
+		}
+
+		// Load the position column and the 8 motion floats of 4 nodes and transpose them into lanes
+		__m128 position[4], motionLow[4], motionHigh[4];
+		for (size_t j = 0; j < 4; ++j)
+		{
+			if (i + j < count)
+			{
+				const Node& node = *nodes[i + j];
+				const float* motion = reinterpret_cast<const float*>(&node.m_Motion);
+				position[j] = _mm_loadu_ps(&node.m_mModel[3][0]);
+				motionLow[j] = _mm_loadu_ps(motion);
+				motionHigh[j] = _mm_loadu_ps(motion + 4);
+			}
+			else
+			{
+				position[j] = _mm_setzero_ps();
+				motionLow[j] = _mm_load_ps(padding);
+				motionHigh[j] = _mm_load_ps(padding + 4);
+			}
+		}
+		_MM_TRANSPOSE4_PS(position[0], position[1], position[2], position[3]);
+		_MM_TRANSPOSE4_PS(motionLow[0], motionLow[1], motionLow[2], motionLow[3]);
+		_MM_TRANSPOSE4_PS(motionHigh[0], motionHigh[1], motionHigh[2], motionHigh[3]);
+
+		_mm_store_ps(m_arrPosition[0] + i, position[0]);
+		_mm_store_ps(m_arrPosition[1] + i, position[1]);
+		_mm_store_ps(m_arrPosition[2] + i, position[2]);
+		_mm_store_ps(m_arrVelocity[0] + i, motionLow[0]);
+		_mm_store_ps(m_arrVelocity[1] + i, motionLow[1]);
+		_mm_store_ps(m_arrVelocity[2] + i, motionLow[2]);
+		_mm_store_ps(m_arrAxis[0] + i, motionLow[3]);
+		_mm_store_ps(m_arrAxis[1] + i, motionHigh[0]);
+		_mm_store_ps(m_arrAxis[2] + i, motionHigh[1]);
+		_mm_store_ps(m_arrAngle + i, motionHigh[2]);
+		_mm_store_ps(m_arrSpeed + i, motionHigh[3]);
+	}
+#else
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Node& node = *nodes[i];
+		const glm::vec4& pos = node.m_mModel[3];
+		m_arrPosition[0][i] = pos.x;
+		m_arrPosition[1][i] = pos.y;
+		m_arrPosition[2][i] = pos.z;
+		const Node::MOTION& motion = node.m_Motion;
+		m_arrVelocity[0][i] = motion.velocity.x;
+		m_arrVelocity[1][i] = motion.velocity.y;
+		m_arrVelocity[2][i] = motion.velocity.z;
+		m_arrAxis[0][i] = motion.axis.x;
+		m_arrAxis[1][i] = motion.axis.y;
+		m_arrAxis[2][i] = motion.axis.z;
+		m_arrAngle[i] = motion.angle;
+		m_arrSpeed[i] = motion.speed;
+	}
+#endif
+}
+
+size_t TransformBatch::Scatter(Node* const* nodes, size_t count)
+{
+	size_t rotating = 0;
+#if defined (TRANSFORM_SSE)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (size_t i = 0; i < count; i += 4)
+	{
+		// Transpose the rotation lanes back into matrix columns of 4 nodes
+		__m128 column0[4] = { _mm_load_ps(m_arrRotation[0] + i), _mm_load_ps(m_arrRotation[1] + i), _mm_load_ps(m_arrRotation[2] + i), zero };
+		__m128 column1[4] = { _mm_load_ps(m_arrRotation[3] + i), _mm_load_ps(m_arrRotation[4] + i), _mm_load_ps(m_arrRotation[5] + i), zero };
+		__m128 column2[4] = { _mm_load_ps(m_arrRotation[6] + i), _mm_load_ps(m_arrRotation[7] + i), _mm_load_ps(m_arrRotation[8] + i), zero };
+		__m128 column3[4] = { _mm_load_ps(m_arrPosition[0] + i), _mm_load_ps(m_arrPosition[1] + i), _mm_load_ps(m_arrPosition[2] + i), one };
+		_MM_TRANSPOSE4_PS(column0[0], column0[1], column0[2], column0[3]);
+		_MM_TRANSPOSE4_PS(column1[0], column1[1], column1[2], column1[3]);
+		_MM_TRANSPOSE4_PS(column2[0], column2[1], column2[2], column2[3]);
+		_MM_TRANSPOSE4_PS(column3[0], column3[1], column3[2], column3[3]);
+
+		const size_t groupCount = std::min(count - i, (size_t)4);
+		for (size_t j = 0; j < groupCount; ++j)
+		{
+			Node& node = *nodes[i + j];
+			node.m_mPrevModel = node.m_mModel;
+			node.m_bPrevModelValid = true;
+
+			// Like Node::Update, only rotating nodes get a new matrix and angle
+			float* m = &node.m_mModel[0][0];
+			if (node.m_Motion.speed != 0.0f)
+			{
+				_mm_storeu_ps(m, column0[j]);
+				_mm_storeu_ps(m + 4, column1[j]);
+				_mm_storeu_ps(m + 8, column2[j]);
+				_mm_storeu_ps(m + 12, column3[j]);
+				node.m_Motion.angle = m_arrAngle[i + j];
+				++rotating;
+			}
+			else
+			{
+				node.SetPos(m_arrPosition[0][i + j], m_arrPosition[1][i + j], m_arrPosition[2][i + j]);
+			}
+		}
+	}
+#else
+	for (size_t i = 0; i < count; ++i)
+	{
+		Node& node = *nodes[i];
+		node.m_mPrevModel = node.m_mModel;
+		node.m_bPrevModelValid = true;
+
+		// Like Node::Update, only rotating nodes get a new matrix and angle
+		if (node.m_Motion.speed != 0.0f)
+		{
+			glm::mat4& m = node.m_mModel;
+			m[0] = glm::vec4(m_arrRotation[0][i], m_arrRotation[1][i], m_arrRotation[2][i], 0.0f);
+			m[1] = glm::vec4(m_arrRotation[3][i], m_arrRotation[4][i], m_arrRotation[5][i], 0.0f);
+			m[2] = glm::vec4(m_arrRotation[6][i], m_arrRotation[7][i], m_arrRotation[8][i], 0.0f);
+			m[3][3] = 1.0f;
+			node.m_Motion.angle = m_arrAngle[i];
+			++rotating;
+		}
+		node.SetPos(m_arrPosition[0][i], m_arrPosition[1][i], m_arrPosition[2][i]);
+	}
+#endif
+	return rotating;
+}
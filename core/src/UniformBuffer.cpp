@@ -0,0 +1,280 @@
+#include "../include/UniformBuffer.h"
+
+#include <cstring>
+
+// Blocks are copied as is, so they must match the std140 layout of the shader declarations
+static_assert(sizeof(FrameUniforms) == 4 * 64 + 16, "FrameUniforms does not match std140 layout");
+static_assert(sizeof(MaterialUniforms) == 5 * 16, "MaterialUniforms does not match std140 layout");
+static_assert(sizeof(ObjectUniforms) == 2 * 64, "ObjectUniforms does not match std140 layout");
+
+UniformBuffer::UniformBuffer() :
+	m_Buffer(0),
+	m_uSize(0)
+{
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	Release();
+}
+
+bool UniformBuffer::Create(size_t size, const void* data, GLenum usage)
+{
+	Release();
+	if (!IsSupported())
+	{
+		return false;
+	}
+
+	glGenBuffers(1, &m_Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, data, usage);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_uSize = size;
+	return true;
+}
+
+void UniformBuffer::Release()
+{
+	if (m_Buffer)
+	{
+		glDeleteBuffers(1, &m_Buffer);
+		m_Buffer = 0;
+		m_uSize = 0;
+	}
+}
+
+void UniformBuffer::SetData(const void* data, size_t size, size_t offset)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)offset, (GLsizeiptr)size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::Bind(UniformBlock block) const
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, (GLuint)block, m_Buffer);
+}
+
+void UniformBuffer::BindRange(UniformBlock block, size_t offset, size_t size) const
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, (GLuint)block, m_Buffer, (GLintptr)offset, (GLsizeiptr)size);
+}
+
+bool UniformBuffer::IsSupported()
+{
+	return glBindBufferRange && glBindBufferBase && glGetUniformBlockIndex && glUniformBlockBinding && glBufferSubData;
+}
+
+const char* UniformBuffer::GetShaderSource()
+{
+	return R"(
+layout(std140) uniform FrameBlock
+{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+	mat4 viewProjectionMatrix;
+	mat4 shadowBiasMatrix;
+	vec4 lightPosition;
+};
+
+layout(std140) uniform MaterialBlock
+{
+	vec4 materialAmbient;
+	vec4 materialDiffuse;
+	vec4 materialSpecular;
+	vec4 materialEmissive;
+	float specularPower;
+};
+
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix;
+	mat4 modelViewProjectionMatrix;
+};
+)";
+}
+
+
+StreamingUniformBuffer::StreamingUniformBuffer() :
+	m_Buffer(0),
+	m_uSize(0),
+	m_uOffset(0),
+	m_uAlignment(256),
+	m_uOrphans(0),
+	m_uGrowths(0),
+	m_pMapped(nullptr),
+	m_uRegion(0),
+	m_uRegionSize(0),
+	m_arrFences()
+{
+}
+
+StreamingUniformBuffer::~StreamingUniformBuffer()
+{
+	Release();
+}
+
+bool StreamingUniformBuffer::Create(size_t size)
+{
+	Release();
+	if (!UniformBuffer::IsSupported() || !glMapBufferRange || !glUnmapBuffer)
+	{
+		return false;
+	}
+
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment > 0)
+	{
+		m_uAlignment = (size_t)alignment;
+	}
+
+	if (CreatePersistent(size))
+	{
+		return true;
+	}
+
+	glGenBuffers(1, &m_Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_uSize = size;
+	m_uOffset = 0;
+	return true;
+}
+
+bool StreamingUniformBuffer::CreatePersistent(size_t size)
+{
+	if (!glBufferStorage || !glFenceSync || !glClientWaitSync || !glDeleteSync)
+	{
+		return false;
+	}
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &m_Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+	glBufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr)size, nullptr, flags);
+	m_pMapped = static_cast<uint8_t*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)size, flags));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	if (!m_pMapped)
+	{
+		glDeleteBuffers(1, &m_Buffer);
+		m_Buffer = 0;
+		return false;
+	}
+
+	// Regions start at aligned offsets so that the first block of a frame needs no padding
+	m_uRegionSize = size / kRegionCount / m_uAlignment * m_uAlignment;
+	m_uSize = size;
+	m_uRegion = 0;
+	m_uOffset = 0;
+	return true;
+}
+
+void StreamingUniformBuffer::Release()
+{
+	for (GLsync& fence : m_arrFences)
+	{
+		if (fence)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (m_Buffer)
+	{
+		if (m_pMapped)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			m_pMapped = nullptr;
+		}
+		glDeleteBuffers(1, &m_Buffer);
+		m_Buffer = 0;
+		m_uSize = 0;
+		m_uOffset = 0;
+		m_uRegion = 0;
+		m_uRegionSize = 0;
+	}
+}
+
+bool StreamingUniformBuffer::Push(UniformBlock block, const void* data, size_t size)
+{
+	if (!m_Buffer || size > m_uSize)
+	{
+		return false;
+	}
+
+	size_t offset = (m_uOffset + m_uAlignment - 1) / m_uAlignment * m_uAlignment;
+
+	// Next region may still be drawn by the GPU. Move to a larger buffer instead of
+	// waiting, the draws already issued keep the old one alive until they finish.
+	while (m_pMapped && offset + size > (m_uRegion + 1) * m_uRegionSize)
+	{
+		const size_t grownSize = m_uSize * 2;
+		if (!Create(grownSize))
+		{
+			IApplication::Debug("StreamingUniformBuffer: failed to grow to " + std::to_string(grownSize) + " bytes\n");
+			return false;
+		}
+		++m_uGrowths;
+		offset = m_uOffset;
+	}
+
+	if (m_pMapped)
+	{
+		memcpy(m_pMapped + offset, data, size);
+		glBindBufferRange(GL_UNIFORM_BUFFER, (GLuint)block, m_Buffer, (GLintptr)offset, (GLsizeiptr)size);
+		m_uOffset = offset + size;
+		return true;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+
+	if (offset + size > m_uSize)
+	{
+		// Orphan the storage instead of waiting for draws that still read it
+		glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)m_uSize, nullptr, GL_STREAM_DRAW);
+		offset = 0;
+		++m_uOrphans;
+	}
+
+	// Range has not been used since the last orphan, so the write does not need to synchronize
+	void* dst = glMapBufferRange(GL_UNIFORM_BUFFER, (GLintptr)offset, (GLsizeiptr)size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!dst)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		return false;
+	}
+	memcpy(dst, data, size);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, (GLuint)block, m_Buffer, (GLintptr)offset, (GLsizeiptr)size);
+	m_uOffset = offset + size;
+	return true;
+}
+
+void StreamingUniformBuffer::NextFrame()
+{
+	if (!m_pMapped)
+	{
+		return;
+	}
+
+	m_arrFences[m_uRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_uRegion = (m_uRegion + 1) % kRegionCount;
+	GLsync& fence = m_arrFences[m_uRegion];
+	if (fence)
+	{
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+	m_uOffset = m_uRegion * m_uRegionSize;
+}
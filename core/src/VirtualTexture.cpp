@@ -0,0 +1,828 @@
+#include "../include/VirtualTexture.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Identifies page files written by BuildPageFile
+constexpr uint32_t kPageFileMagic = 0x50545456; // "VTTP"
+constexpr uint32_t kPageFileVersion = 1;
+constexpr uint32_t kInvalidKey = 0xffffffff;
+
+VirtualTexture::VirtualTexture() :
+	m_Header({}),
+	m_vImageScale(1.0f),
+	m_CacheTexture(0),
+	m_IndirectionTexture(0),
+	m_FeedbackFramebuffer(0),
+	m_FeedbackColor(0),
+	m_FeedbackDepth(0),
+	m_iCachePages(0),
+	m_iFeedbackWidth(0),
+	m_iFeedbackHeight(0),
+	m_arrFeedbackBuffers(),
+	m_arrFeedbackFences(),
+	m_uFeedbackBuffer(0),
+	m_PrevFramebuffer(0),
+	m_PrevViewport{ 0, 0, 0, 0 },
+	m_bIndirectionDirty(false),
+	m_uFrame(0),
+	m_uRequestedPages(0),
+	m_uUploadedPages(0),
+	m_uEvictedPages(0),
+	m_bRunning(false)
+{
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	Destroy();
+}
+
+bool VirtualTexture::BuildPageFile(const std::string_view& imageFile, const std::string_view& pageFile, int32_t pageSize, int32_t border)
+{
+	std::ifstream image(std::string(imageFile), std::ios::binary);
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t channels = 0;
+	if (image && ReadNetpbmHeader(image, width, height, channels))
+	{
+		std::vector<uint8_t> source((size_t)width * channels);
+		return BuildPageFile(width, height, [&](int32_t y, uint8_t* row)
+		{
+			if (!image.read((char*)source.data(), source.size()))
+			{
+				IApplication::Debug("VirtualTexture: image ends early\n");
+				return false;
+			}
+			for (int32_t x = 0; x < width; ++x)
+			{
+				// Premultiply like OpenGLRenderer::LoadImageData
+				const uint8_t* src = &source[(size_t)x * channels];
+				const int32_t alpha = (channels == 4) ? src[3] : 255;
+				row[x * 4] = (uint8_t)(src[0] * alpha / 255);
+				row[x * 4 + 1] = (uint8_t)(src[1] * alpha / 255);
+				row[x * 4 + 2] = (uint8_t)(src[2] * alpha / 255);
+				row[x * 4 + 3] = (uint8_t)alpha;
+			}
+			return true;
+		}, pageFile, pageSize, border);
+	}
+	image.close();
+
+	// Compressed formats can not be decoded a row at a time
+	std::vector<uint8_t> pixels;
+	if (!OpenGLRenderer::LoadImageData(imageFile, pixels, width, height))
+	{
+		return false;
+	}
+	return BuildPageFile(pixels.data(), width, height, pageFile, pageSize, border);
+}
+
+bool VirtualTexture::BuildPageFile(const uint8_t* pixels, int32_t width, int32_t height, const std::string_view& pageFile, int32_t pageSize, int32_t border)
+{
+	if (!pixels)
+	{
+		return false;
+	}
+	return BuildPageFile(width, height, [pixels, width](int32_t y, uint8_t* row)
+	{
+		memcpy(row, pixels + (size_t)y * width * 4, (size_t)width * 4);
+		return true;
+	}, pageFile, pageSize, border);
+}
+
+bool VirtualTexture::BuildPageFile(int32_t width, int32_t height, const RowReader& readRow, const std::string_view& pageFile, int32_t pageSize, int32_t border)
+{
+	if (!readRow || width <= 0 || height <= 0 || pageSize <= 0 || border < 0)
+	{
+		return false;
+	}
+
+	// Pad the page grid into a power of two square so every level halves cleanly
+	const int32_t pagesNeeded = glm::max((width + pageSize - 1) / pageSize, (height + pageSize - 1) / pageSize);
+	int32_t pages = 1;
+	int32_t levels = 1;
+	while (pages < pagesNeeded)
+	{
+		pages *= 2;
+		++levels;
+	}
+	if (pages > 4096)
+	{
+		IApplication::Debug("VirtualTexture: image is too large for the page key format\n");
+		return false;
+	}
+
+	HEADER header;
+	header.uMagic = kPageFileMagic;
+	header.uVersion = kPageFileVersion;
+	header.iWidth = width;
+	header.iHeight = height;
+	header.iPageSize = pageSize;
+	header.iBorder = border;
+	header.iPages = pages;
+	header.iLevels = levels;
+
+	// Lower levels read back the pages of the level above, so the file is opened for both
+	std::fstream f(std::string(pageFile), std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+	if (!f)
+	{
+		IApplication::Debug("VirtualTexture: failed to create page file\n");
+		return false;
+	}
+	f.write((const char*)&header, sizeof(header));
+
+	const int32_t paddedSize = pageSize + border * 2;
+	const size_t pageBytes = (size_t)paddedSize * (size_t)paddedSize * 4;
+	std::vector<uint8_t> page(pageBytes);
+	std::vector<uint8_t> source((size_t)width * 4);
+	std::vector<uint8_t> rows[2];
+	size_t levelOffset = sizeof(HEADER);
+
+	for (int32_t l = 0; l < levels; ++l)
+	{
+		const int32_t count = glm::max(pages >> l, 1);
+		const int32_t levelSize = count * pageSize;
+		const size_t prevOffset = levelOffset - ((l > 0) ? (size_t)(count * 2) * (count * 2) * pageBytes : 0);
+
+		// Band of rows around one row of pages, row y lives in slot y % bandRows
+		const int32_t bandRows = pageSize + border * 2;
+		std::vector<uint8_t> band((size_t)bandRows * levelSize * 4);
+		int32_t nextRow = 0;
+
+		// Interior texels of a row of the level above, taken from its pages
+		auto readPrevRow = [&](int32_t y, std::vector<uint8_t>& row)
+		{
+			const int32_t prevCount = count * 2;
+			row.resize((size_t)prevCount * pageSize * 4);
+			for (int32_t px = 0; px < prevCount; ++px)
+			{
+				const size_t texel = (size_t)(border + y % pageSize) * paddedSize + border;
+				f.seekg((std::streamoff)(prevOffset + ((size_t)(y / pageSize) * prevCount + px) * pageBytes + texel * 4));
+				f.read((char*)&row[(size_t)px * pageSize * 4], (size_t)pageSize * 4);
+			}
+			return !!f;
+		};
+
+		auto fetchRow = [&](int32_t y)
+		{
+			uint8_t* dst = &band[(size_t)(y % bandRows) * levelSize * 4];
+			if (l == 0)
+			{
+				// Texels outside of the source are padding
+				memset(dst, 0, (size_t)levelSize * 4);
+				if (y < height)
+				{
+					if (!readRow(y, source.data()))
+					{
+						return false;
+					}
+					memcpy(dst, source.data(), source.size());
+				}
+				return true;
+			}
+
+			// Box filter two rows of the level above
+			if (!readPrevRow(y * 2, rows[0]) || !readPrevRow(y * 2 + 1, rows[1]))
+			{
+				return false;
+			}
+			for (int32_t x = 0; x < levelSize * 4; ++x)
+			{
+				const int32_t c = x % 4;
+				const int32_t s = (x - c) * 2 + c;
+				dst[x] = (uint8_t)((rows[0][s] + rows[0][s + 4] + rows[1][s] + rows[1][s + 4] + 2) / 4);
+			}
+			return true;
+		};
+
+		// Write pages of this level, border texels are taken from the neighbours
+		for (int32_t py = 0; py < count; ++py)
+		{
+			const int32_t lastRow = glm::min((py + 1) * pageSize + border, levelSize) - 1;
+			for (; nextRow <= lastRow; ++nextRow)
+			{
+				if (!fetchRow(nextRow))
+				{
+					IApplication::Debug("VirtualTexture: failed to read image rows\n");
+					return false;
+				}
+			}
+
+			for (int32_t px = 0; px < count; ++px)
+			{
+				uint8_t* dst = page.data();
+				for (int32_t y = 0; y < paddedSize; ++y)
+				{
+					const int32_t sy = glm::clamp(py * pageSize - border + y, 0, levelSize - 1);
+					const uint8_t* row = &band[(size_t)(sy % bandRows) * levelSize * 4];
+					for (int32_t x = 0; x < paddedSize; ++x)
+					{
+						const int32_t sx = glm::clamp(px * pageSize - border + x, 0, levelSize - 1);
+						memcpy(dst, row + (size_t)sx * 4, 4);
+						dst += 4;
+					}
+				}
+				f.seekp((std::streamoff)(levelOffset + ((size_t)py * count + px) * pageBytes));
+				f.write((const char*)page.data(), page.size());
+			}
+		}
+
+		levelOffset += (size_t)count * count * pageBytes;
+	}
+
+	return f.good();
+}
+
+bool VirtualTexture::ReadNetpbmHeader(std::istream& f, int32_t& width, int32_t& height, int32_t& channels)
+{
+	// Header tokens are separated by whitespace and may be followed by comments
+	auto token = [&f]()
+	{
+		std::string text;
+		while (f)
+		{
+			const int c = f.get();
+			if (c == '#')
+			{
+				std::string comment;
+				std::getline(f, comment);
+			}
+			else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			{
+				if (!text.empty())
+				{
+					break;
+				}
+			}
+			else if (c != EOF)
+			{
+				text += (char)c;
+			}
+		}
+		return text;
+	};
+
+	const std::string magic = token();
+	int32_t maxValue = 0;
+	if (magic == "P6")
+	{
+		width = std::atoi(token().c_str());
+		height = std::atoi(token().c_str());
+		maxValue = std::atoi(token().c_str());
+		channels = 3;
+	}
+	else if (magic == "P7")
+	{
+		for (std::string key = token(); f && key != "ENDHDR"; key = token())
+		{
+			if (key == "WIDTH") width = std::atoi(token().c_str());
+			else if (key == "HEIGHT") height = std::atoi(token().c_str());
+			else if (key == "DEPTH") channels = std::atoi(token().c_str());
+			else if (key == "MAXVAL") maxValue = std::atoi(token().c_str());
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	// Only 8 bit RGB and RGBA are streamed, anything else goes through the image loader
+	return f && width > 0 && height > 0 && maxValue == 255 && (channels == 3 || channels == 4);
+}
+
+bool VirtualTexture::Create(const std::string_view& pageFile, int32_t cachePages, int32_t feedbackWidth, int32_t feedbackHeight)
+{
+	Destroy();
+
+	m_strPageFile = pageFile;
+	std::ifstream f(m_strPageFile, std::ios::binary);
+	f.read((char*)&m_Header, sizeof(m_Header));
+	if (!f || m_Header.uMagic != kPageFileMagic || m_Header.uVersion != kPageFileVersion)
+	{
+		IApplication::Debug("VirtualTexture: invalid page file " + m_strPageFile + "\n");
+		return false;
+	}
+
+	const int32_t virtualSize = m_Header.iPages * m_Header.iPageSize;
+	m_vImageScale = glm::vec2((float)m_Header.iWidth / virtualSize, (float)m_Header.iHeight / virtualSize);
+	m_iCachePages = cachePages;
+	m_iFeedbackWidth = feedbackWidth;
+	m_iFeedbackHeight = feedbackHeight;
+
+	// Physical page cache
+	const int32_t cacheSize = cachePages * GetPaddedPageSize();
+	glGenTextures(1, &m_CacheTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_CacheTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheSize, cacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Indirection table, one texel per page on every level
+	m_arrIndirection.resize(m_Header.iLevels);
+	glGenTextures(1, &m_IndirectionTexture);
+	glBindTexture(GL_TEXTURE_2D, m_IndirectionTexture);
+	for (int32_t l = 0; l < m_Header.iLevels; ++l)
+	{
+		const int32_t count = GetPageCount(l);
+		m_arrIndirection[l].assign((size_t)count * count * 4, 0);
+		glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, count, count, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_arrIndirection[l].data());
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_Header.iLevels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	// Low resolution feedback buffer
+	glGenFramebuffers(1, &m_FeedbackFramebuffer);
+	glGenRenderbuffers(1, &m_FeedbackColor);
+	glGenRenderbuffers(1, &m_FeedbackDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_FeedbackColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, feedbackWidth, feedbackHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_FeedbackDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLint prevFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_FeedbackFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_FeedbackColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_FeedbackDepth);
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFramebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		IApplication::Debug("VirtualTexture: feedback framebuffer is incomplete\n");
+		Destroy();
+		return false;
+	}
+
+	const size_t feedbackSize = (size_t)feedbackWidth * feedbackHeight * 4;
+	if (glFenceSync && glMapBufferRange && glUnmapBuffer)
+	{
+		glGenBuffers(kFeedbackBuffers, m_arrFeedbackBuffers);
+		for (GLuint buffer : m_arrFeedbackBuffers)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackSize, nullptr, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		m_uFeedbackBuffer = 0;
+	}
+	else
+	{
+		m_arrFeedback.resize(feedbackSize);
+	}
+
+	m_arrSlots.assign((size_t)cachePages * cachePages, SLOT{ kInvalidKey, 0 });
+
+	m_bRunning = true;
+	m_LoaderThread = std::thread(&VirtualTexture::LoaderThread, this);
+
+	// The single page of the coarsest level is always resident as the last fallback
+	RequestPage(MakeKey(0, 0, m_Header.iLevels - 1));
+
+	return true;
+}
+
+void VirtualTexture::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bRunning = false;
+		m_arrRequests.clear();
+		m_arrCompleted.clear();
+	}
+	m_Condition.notify_all();
+	if (m_LoaderThread.joinable())
+	{
+		m_LoaderThread.join();
+	}
+
+	if (m_CacheTexture)
+	{
+		glDeleteTextures(1, &m_CacheTexture);
+		m_CacheTexture = 0;
+	}
+	if (m_IndirectionTexture)
+	{
+		glDeleteTextures(1, &m_IndirectionTexture);
+		m_IndirectionTexture = 0;
+	}
+	if (m_FeedbackFramebuffer)
+	{
+		glDeleteFramebuffers(1, &m_FeedbackFramebuffer);
+		m_FeedbackFramebuffer = 0;
+	}
+	if (m_FeedbackColor)
+	{
+		glDeleteRenderbuffers(1, &m_FeedbackColor);
+		m_FeedbackColor = 0;
+	}
+	if (m_FeedbackDepth)
+	{
+		glDeleteRenderbuffers(1, &m_FeedbackDepth);
+		m_FeedbackDepth = 0;
+	}
+	for (uint32_t i = 0; i < kFeedbackBuffers; ++i)
+	{
+		if (m_arrFeedbackFences[i])
+		{
+			glDeleteSync(m_arrFeedbackFences[i]);
+			m_arrFeedbackFences[i] = nullptr;
+		}
+		if (m_arrFeedbackBuffers[i])
+		{
+			glDeleteBuffers(1, &m_arrFeedbackBuffers[i]);
+			m_arrFeedbackBuffers[i] = 0;
+		}
+	}
+
+	m_arrSlots.clear();
+	m_mapResident.clear();
+	m_setPending.clear();
+	m_arrIndirection.clear();
+	m_arrFeedback.clear();
+	m_arrVisiblePages.clear();
+}
+
+void VirtualTexture::BeginFeedback()
+{
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_PrevFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, m_PrevViewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_FeedbackFramebuffer);
+	glViewport(0, 0, m_iFeedbackWidth, m_iFeedbackHeight);
+
+	// Zero alpha marks pixels without virtual texture
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::EndFeedback()
+{
+	if (m_arrFeedbackBuffers[0])
+	{
+		// Copy into a buffer without waiting, it is mapped when it comes around again
+		GLsync& fence = m_arrFeedbackFences[m_uFeedbackBuffer];
+		if (fence)
+		{
+			glDeleteSync(fence);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_arrFeedbackBuffers[m_uFeedbackBuffer]);
+		glReadPixels(0, 0, m_iFeedbackWidth, m_iFeedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_uFeedbackBuffer = (m_uFeedbackBuffer + 1) % kFeedbackBuffers;
+	}
+	else
+	{
+		glReadPixels(0, 0, m_iFeedbackWidth, m_iFeedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, m_arrFeedback.data());
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_PrevFramebuffer);
+	glViewport(m_PrevViewport[0], m_PrevViewport[1], m_PrevViewport[2], m_PrevViewport[3]);
+
+	if (!m_arrFeedbackBuffers[0])
+	{
+		ReadFeedback(m_arrFeedback.data());
+		return;
+	}
+
+	// Oldest buffer, read kFeedbackBuffers - 1 frames ago
+	GLsync& fence = m_arrFeedbackFences[m_uFeedbackBuffer];
+	const GLenum status = fence ? glClientWaitSync(fence, 0, 0) : GL_TIMEOUT_EXPIRED;
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+	{
+		// Keep the pages of the last feedback in use until the GPU catches up
+		for (uint32_t key : m_arrVisiblePages)
+		{
+			RequestPage(key);
+		}
+		return;
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+
+	const size_t feedbackSize = (size_t)m_iFeedbackWidth * m_iFeedbackHeight * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_arrFeedbackBuffers[m_uFeedbackBuffer]);
+	const uint8_t* pixels = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)feedbackSize, GL_MAP_READ_BIT));
+	if (pixels)
+	{
+		ReadFeedback(pixels);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTexture::ReadFeedback(const uint8_t* pixels)
+{
+	// Collect unique pages and their parents so that coarser fallbacks are available
+	std::unordered_set<uint32_t> visible;
+	uint32_t previous = kInvalidKey;
+	const size_t feedbackSize = (size_t)m_iFeedbackWidth * m_iFeedbackHeight * 4;
+	for (size_t i = 0; i < feedbackSize; i += 4)
+	{
+		const uint8_t* p = &pixels[i];
+		if (p[3] == 0)
+		{
+			continue;
+		}
+
+		const int32_t x = p[0] | ((p[2] & 0x0f) << 8);
+		const int32_t y = p[1] | ((p[2] >> 4) << 8);
+		const int32_t level = glm::min(p[3] - 1, m_Header.iLevels - 1);
+		const uint32_t key = MakeKey(x, y, level);
+
+		// Neighbouring pixels usually hit the same page
+		if (key == previous)
+		{
+			continue;
+		}
+		previous = key;
+
+		for (int32_t l = level; l < m_Header.iLevels; ++l)
+		{
+			if (!visible.insert(MakeKey(x >> (l - level), y >> (l - level), l)).second)
+			{
+				break;
+			}
+		}
+	}
+	m_uRequestedPages = visible.size();
+
+	// Load coarse levels first so that fallbacks appear as early as possible
+	m_arrVisiblePages.assign(visible.begin(), visible.end());
+	std::sort(m_arrVisiblePages.begin(), m_arrVisiblePages.end(), [](uint32_t a, uint32_t b) { return KeyLevel(a) > KeyLevel(b); });
+	for (uint32_t key : m_arrVisiblePages)
+	{
+		RequestPage(key);
+	}
+}
+
+void VirtualTexture::Update()
+{
+	std::deque<PAGE> completed;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		completed.swap(m_arrCompleted);
+	}
+
+	const int32_t paddedSize = GetPaddedPageSize();
+	for (auto& page : completed)
+	{
+		m_setPending.erase(page.uKey);
+		if (page.arrPixels.empty() || m_mapResident.count(page.uKey))
+		{
+			continue;
+		}
+
+		const int32_t slot = FindFreeSlot();
+		if (slot < 0)
+		{
+			// Every slot is needed by the current frame
+			continue;
+		}
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, m_CacheTexture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0,
+			(slot % m_iCachePages) * paddedSize,
+			(slot / m_iCachePages) * paddedSize,
+			paddedSize, paddedSize,
+			GL_RGBA, GL_UNSIGNED_BYTE, page.arrPixels.data());
+
+		m_arrSlots[slot].uKey = page.uKey;
+		m_arrSlots[slot].uLastUsedFrame = m_uFrame;
+		m_mapResident[page.uKey] = slot;
+		m_bIndirectionDirty = true;
+		++m_uUploadedPages;
+	}
+
+	if (m_bIndirectionDirty)
+	{
+		UpdateIndirection();
+	}
+	++m_uFrame;
+}
+
+void VirtualTexture::SetToProgram(IRenderer& renderer, GLuint program, int32_t slot, bool feedback) const
+{
+	renderer.SetTexture(program, m_CacheTexture, slot, "vtCache");
+	renderer.SetTexture(program, m_IndirectionTexture, slot + 1, "vtIndirection");
+
+	OpenGLRenderer::SetUniformVec4(program, "vtParams", glm::vec4(
+		(float)m_Header.iPages,
+		(float)m_Header.iLevels,
+		(float)m_Header.iPageSize,
+		(float)m_Header.iBorder));
+
+	// Feedback buffer is smaller than the screen, so its derivatives select too detailed levels
+	float lodBias = 0.0f;
+	if (feedback && IApplication::GetApp())
+	{
+		lodBias = glm::log2(glm::max((float)IApplication::GetApp()->GetWidth() / m_iFeedbackWidth, 1.0f));
+	}
+	OpenGLRenderer::SetUniformFloat(program, "vtLodBias", lodBias);
+}
+
+const char* VirtualTexture::GetShaderSource()
+{
+	return R"(
+uniform sampler2D vtCache;
+uniform sampler2D vtIndirection;
+uniform vec4 vtParams; // pages at level 0, levels, page size, border
+uniform float vtLodBias;
+
+float vtMipLevel(vec2 uv)
+{
+	vec2 texel = uv * vtParams.x * vtParams.z;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias;
+	return clamp(lod, 0.0, vtParams.y - 1.0);
+}
+
+vec4 vtSample(vec2 uv)
+{
+	vec4 entry = floor(textureLod(vtIndirection, uv, floor(vtMipLevel(uv))) * 255.0 + 0.5);
+	if (entry.a == 0.0)
+	{
+		return vec4(0.0);
+	}
+	float pages = max(vtParams.x / exp2(entry.b), 1.0);
+	vec2 inPage = fract(uv * pages);
+	float padded = vtParams.z + 2.0 * vtParams.w;
+	vec2 texel = entry.rg * padded + vtParams.w + inPage * vtParams.z;
+	return textureLod(vtCache, texel / vec2(textureSize(vtCache, 0)), 0.0);
+}
+
+vec4 vtFeedback(vec2 uv)
+{
+	float level = floor(vtMipLevel(uv));
+	float pages = max(vtParams.x / exp2(level), 1.0);
+	ivec2 page = ivec2(clamp(floor(fract(uv) * pages), vec2(0.0), vec2(pages - 1.0)));
+	return vec4(
+		float(page.x & 255),
+		float(page.y & 255),
+		float((page.x >> 8) | ((page.y >> 8) << 4)),
+		level + 1.0) / 255.0;
+}
+)";
+}
+
+VirtualTextureStats VirtualTexture::GetStats() const
+{
+	VirtualTextureStats stats;
+	stats.uRequestedPages = m_uRequestedPages;
+	stats.uResidentPages = m_mapResident.size();
+	stats.uPendingPages = m_setPending.size();
+	stats.uUploadedPages = m_uUploadedPages;
+	stats.uEvictedPages = m_uEvictedPages;
+	return stats;
+}
+
+size_t VirtualTexture::GetPageOffset(uint32_t key) const
+{
+	const size_t pageBytes = (size_t)GetPaddedPageSize() * GetPaddedPageSize() * 4;
+	size_t offset = sizeof(HEADER);
+	for (int32_t l = 0; l < KeyLevel(key); ++l)
+	{
+		const size_t count = GetPageCount(l);
+		offset += count * count * pageBytes;
+	}
+	const size_t count = GetPageCount(KeyLevel(key));
+	offset += ((size_t)KeyY(key) * count + KeyX(key)) * pageBytes;
+	return offset;
+}
+
+void VirtualTexture::RequestPage(uint32_t key)
+{
+	auto resident = m_mapResident.find(key);
+	if (resident != m_mapResident.end())
+	{
+		m_arrSlots[resident->second].uLastUsedFrame = m_uFrame;
+		return;
+	}
+
+	if (!m_setPending.insert(key).second)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_arrRequests.push_back(key);
+	}
+	m_Condition.notify_one();
+}
+
+int32_t VirtualTexture::FindFreeSlot()
+{
+	const int32_t topLevel = m_Header.iLevels - 1;
+	int32_t oldest = -1;
+	for (int32_t i = 0; i < (int32_t)m_arrSlots.size(); ++i)
+	{
+		const SLOT& slot = m_arrSlots[i];
+		if (slot.uKey == kInvalidKey)
+		{
+			return i;
+		}
+		// Pages of this frame and the coarsest fallback page stay resident
+		if (slot.uLastUsedFrame >= m_uFrame || KeyLevel(slot.uKey) == topLevel)
+		{
+			continue;
+		}
+		if (oldest < 0 || slot.uLastUsedFrame < m_arrSlots[oldest].uLastUsedFrame)
+		{
+			oldest = i;
+		}
+	}
+
+	if (oldest >= 0)
+	{
+		m_mapResident.erase(m_arrSlots[oldest].uKey);
+		m_arrSlots[oldest].uKey = kInvalidKey;
+		++m_uEvictedPages;
+	}
+	return oldest;
+}
+
+void VirtualTexture::UpdateIndirection()
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_IndirectionTexture);
+
+	// Walk from the coarsest level down, missing pages inherit the parent's entry
+	for (int32_t l = m_Header.iLevels - 1; l >= 0; --l)
+	{
+		const int32_t count = GetPageCount(l);
+		std::vector<uint8_t>& entries = m_arrIndirection[l];
+		for (int32_t y = 0; y < count; ++y)
+		{
+			for (int32_t x = 0; x < count; ++x)
+			{
+				uint8_t* entry = &entries[((size_t)y * count + x) * 4];
+				auto resident = m_mapResident.find(MakeKey(x, y, l));
+				if (resident != m_mapResident.end())
+				{
+					entry[0] = (uint8_t)(resident->second % m_iCachePages);
+					entry[1] = (uint8_t)(resident->second / m_iCachePages);
+					entry[2] = (uint8_t)l;
+					entry[3] = 255;
+				}
+				else if (l + 1 < m_Header.iLevels)
+				{
+					const int32_t parentCount = GetPageCount(l + 1);
+					memcpy(entry, &m_arrIndirection[l + 1][((size_t)(y / 2) * parentCount + x / 2) * 4], 4);
+				}
+				else
+				{
+					memset(entry, 0, 4);
+				}
+			}
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, count, count, GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+	}
+
+	m_bIndirectionDirty = false;
+}
+
+void VirtualTexture::LoaderThread()
+{
+	std::ifstream f(m_strPageFile, std::ios::binary);
+	const size_t pageBytes = (size_t)GetPaddedPageSize() * GetPaddedPageSize() * 4;
+
+	for (;;)
+	{
+		PAGE page;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this] { return !m_bRunning || !m_arrRequests.empty(); });
+			if (!m_bRunning)
+			{
+				return;
+			}
+			page.uKey = m_arrRequests.front();
+			m_arrRequests.pop_front();
+		}
+
+		page.arrPixels.resize(pageBytes);
+		f.clear();
+		f.seekg((std::streamoff)GetPageOffset(page.uKey));
+		f.read((char*)page.arrPixels.data(), pageBytes);
+		if (!f)
+		{
+			page.arrPixels.clear();
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_arrCompleted.push_back(std::move(page));
+	}
+}
@@ -0,0 +1,627 @@
+#include "../include/World.h"
+#include "../include/GeometryNode.h"
+#include "../include/TransformBatch.h"
+
+#include <algorithm>
+#include <memory>
+
+// Arrays start on cache lines, so chunks never share a line between two arrays
+constexpr size_t kColumnAlignment = 64;
+
+template<typename T>
+static T* LayoutColumn(uint8_t* base, size_t& offset, bool present)
+{
+	if (!present)
+	{
+		return nullptr;
+	}
+	offset = (offset + kColumnAlignment - 1) & ~(kColumnAlignment - 1);
+	T* column = (T*)(base + offset);
+	offset += sizeof(T) * World::kChunkCapacity;
+	return column;
+}
+
+static void LayoutChunk(WorldChunk& chunk, uint8_t* base, size_t& size)
+{
+	const uint32_t mask = chunk.uMask;
+	const bool transform = (mask & ComponentBit(ComponentType::Transform)) != 0;
+	const bool velocity = (mask & ComponentBit(ComponentType::Velocity)) != 0;
+	const bool rotation = (mask & ComponentBit(ComponentType::Rotation)) != 0;
+	const bool renderable = (mask & ComponentBit(ComponentType::Renderable)) != 0;
+
+	size = 0;
+	chunk.pEntities = LayoutColumn<Entity>(base, size, true);
+	chunk.pPositionX = LayoutColumn<float>(base, size, transform);
+	chunk.pPositionY = LayoutColumn<float>(base, size, transform);
+	chunk.pPositionZ = LayoutColumn<float>(base, size, transform);
+	chunk.pLocal = LayoutColumn<glm::mat4>(base, size, transform);
+	chunk.pWorld = LayoutColumn<glm::mat4>(base, size, transform);
+	chunk.pVelocityX = LayoutColumn<float>(base, size, velocity);
+	chunk.pVelocityY = LayoutColumn<float>(base, size, velocity);
+	chunk.pVelocityZ = LayoutColumn<float>(base, size, velocity);
+	chunk.pRotationAxisX = LayoutColumn<float>(base, size, rotation);
+	chunk.pRotationAxisY = LayoutColumn<float>(base, size, rotation);
+	chunk.pRotationAxisZ = LayoutColumn<float>(base, size, rotation);
+	chunk.pRotationAngle = LayoutColumn<float>(base, size, rotation);
+	chunk.pRotationSpeed = LayoutColumn<float>(base, size, rotation);
+	chunk.pRadius = LayoutColumn<float>(base, size, (mask & ComponentBit(ComponentType::Bounds)) != 0);
+	chunk.pGeometry = LayoutColumn<std::shared_ptr<Geometry>>(base, size, renderable);
+	chunk.pMaterial = LayoutColumn<std::shared_ptr<Material>>(base, size, renderable);
+	chunk.pParent = LayoutColumn<Entity>(base, size, (mask & ComponentBit(ComponentType::Parent)) != 0);
+}
+
+World::CHUNK::CHUNK(uint32_t mask) :
+	memory(nullptr)
+{
+	uMask = mask;
+	uCount = 0;
+
+	// First pass measures, the second places the arrays into one allocation
+	size_t size = 0;
+	LayoutChunk(*this, nullptr, size);
+	memory = (uint8_t*)::operator new(size, std::align_val_t(kColumnAlignment));
+	LayoutChunk(*this, memory, size);
+
+	if (pGeometry)
+	{
+		std::uninitialized_default_construct_n(pGeometry, kChunkCapacity);
+		std::uninitialized_default_construct_n(pMaterial, kChunkCapacity);
+	}
+}
+
+World::CHUNK::~CHUNK()
+{
+	if (pGeometry)
+	{
+		std::destroy_n(pGeometry, kChunkCapacity);
+		std::destroy_n(pMaterial, kChunkCapacity);
+	}
+	::operator delete(memory, std::align_val_t(kColumnAlignment));
+}
+
+World::World() :
+	m_uEntityCount(0)
+{
+}
+
+World::~World()
+{
+}
+
+Entity World::Create(uint32_t mask)
+{
+	uint32_t index = 0;
+	if (!m_arrFreeRecords.empty())
+	{
+		index = m_arrFreeRecords.back();
+		m_arrFreeRecords.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)m_arrRecords.size();
+		m_arrRecords.push_back({ 0, 0, 0, 0, false });
+	}
+
+	RECORD& record = m_arrRecords[index];
+	record.alive = true;
+	const Entity entity = { index, record.generation };
+
+	uint32_t archetype = 0;
+	GetArchetype(mask, archetype);
+	AddRow(archetype, entity);
+	InitRow(*m_arrArchetypes[archetype]->chunks[record.chunk], record.row);
+
+	++m_uEntityCount;
+	return entity;
+}
+
+void World::Destroy(Entity entity)
+{
+	if (!IsAlive(entity))
+	{
+		return;
+	}
+
+	RECORD& record = m_arrRecords[entity.uIndex];
+	RemoveRow(record);
+	record.alive = false;
+	++record.generation;
+	m_arrFreeRecords.push_back(entity.uIndex);
+	--m_uEntityCount;
+}
+
+bool World::IsAlive(Entity entity) const
+{
+	return entity.uIndex < m_arrRecords.size() &&
+		m_arrRecords[entity.uIndex].alive &&
+		m_arrRecords[entity.uIndex].generation == entity.uGeneration;
+}
+
+void World::SetComponents(Entity entity, uint32_t mask)
+{
+	if (!IsAlive(entity) || GetComponents(entity) == mask)
+	{
+		return;
+	}
+
+	// Add to the new archetype first, the old row stays valid until copied
+	RECORD old = m_arrRecords[entity.uIndex];
+	uint32_t archetype = 0;
+	GetArchetype(mask, archetype);
+	AddRow(archetype, entity);
+
+	RECORD& record = m_arrRecords[entity.uIndex];
+	WorldChunk& target = *m_arrArchetypes[record.archetype]->chunks[record.chunk];
+	const WorldChunk& source = *m_arrArchetypes[old.archetype]->chunks[old.chunk];
+	InitRow(target, record.row);
+	CopyRow(source, old.row, target, record.row);
+
+	const RECORD moved = record;
+	RemoveRow(old);
+	m_arrRecords[entity.uIndex] = moved;
+}
+
+uint32_t World::GetComponents(Entity entity) const
+{
+	return IsAlive(entity) ? m_arrArchetypes[m_arrRecords[entity.uIndex].archetype]->mask : 0;
+}
+
+WorldChunk* World::GetChunk(Entity entity, uint32_t& row)
+{
+	if (!IsAlive(entity))
+	{
+		return nullptr;
+	}
+	const RECORD& record = m_arrRecords[entity.uIndex];
+	row = record.row;
+	return m_arrArchetypes[record.archetype]->chunks[record.chunk].get();
+}
+
+const WorldChunk* World::GetChunk(Entity entity, uint32_t& row) const
+{
+	return const_cast<World*>(this)->GetChunk(entity, row);
+}
+
+void World::SetPosition(Entity entity, const glm::vec3& position)
+{
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	if (chunk && chunk->pPositionX)
+	{
+		chunk->pPositionX[row] = position.x;
+		chunk->pPositionY[row] = position.y;
+		chunk->pPositionZ[row] = position.z;
+	}
+}
+
+void World::SetLocalMatrix(Entity entity, const glm::mat4& matrix)
+{
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	if (chunk && chunk->pLocal)
+	{
+		chunk->pLocal[row] = matrix;
+		chunk->pPositionX[row] = matrix[3][0];
+		chunk->pPositionY[row] = matrix[3][1];
+		chunk->pPositionZ[row] = matrix[3][2];
+	}
+}
+
+void World::SetVelocity(Entity entity, const glm::vec3& velocity)
+{
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	if (chunk && chunk->pVelocityX)
+	{
+		chunk->pVelocityX[row] = velocity.x;
+		chunk->pVelocityY[row] = velocity.y;
+		chunk->pVelocityZ[row] = velocity.z;
+	}
+}
+
+void World::SetRotation(Entity entity, const glm::vec3& axis, float angle, float speed)
+{
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	if (chunk && chunk->pRotationAxisX)
+	{
+		const glm::vec3 normalized = glm::normalize(axis);
+		chunk->pRotationAxisX[row] = normalized.x;
+		chunk->pRotationAxisY[row] = normalized.y;
+		chunk->pRotationAxisZ[row] = normalized.z;
+		chunk->pRotationAngle[row] = angle;
+		chunk->pRotationSpeed[row] = speed;
+	}
+}
+
+void World::SetRadius(Entity entity, float radius)
+{
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	if (chunk && chunk->pRadius)
+	{
+		chunk->pRadius[row] = radius;
+	}
+}
+
+void World::SetRenderable(Entity entity, const std::shared_ptr<Geometry>& geometry, const std::shared_ptr<Material>& material)
+{
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	if (chunk && chunk->pGeometry)
+	{
+		chunk->pGeometry[row] = geometry;
+		chunk->pMaterial[row] = material;
+	}
+}
+
+void World::SetParent(Entity entity, Entity parent)
+{
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	if (!chunk || !chunk->pParent)
+	{
+		return;
+	}
+
+	// Refuse to close a loop, resolving it would never end
+	for (Entity ancestor = parent; IsAlive(ancestor);)
+	{
+		if (ancestor == entity)
+		{
+			IApplication::Debug("World: parenting would create a cycle\n");
+			return;
+		}
+		uint32_t ancestorRow = 0;
+		const WorldChunk* ancestorChunk = GetChunk(ancestor, ancestorRow);
+		ancestor = ancestorChunk->pParent ? ancestorChunk->pParent[ancestorRow] : Entity();
+	}
+	chunk->pParent[row] = parent;
+}
+
+glm::mat4 World::GetWorldMatrix(Entity entity) const
+{
+	uint32_t row = 0;
+	const WorldChunk* chunk = GetChunk(entity, row);
+	return (chunk && chunk->pWorld) ? chunk->pWorld[row] : glm::mat4(1.0f);
+}
+
+glm::mat4 World::ResolveWorldMatrix(const WorldChunk& chunk, uint32_t row) const
+{
+	glm::mat4 world = chunk.pLocal[row];
+	Entity parent = chunk.pParent ? chunk.pParent[row] : Entity();
+	while (IsAlive(parent))
+	{
+		uint32_t parentRow = 0;
+		const WorldChunk* parentChunk = GetChunk(parent, parentRow);
+		if (!parentChunk->pLocal)
+		{
+			break;
+		}
+		world = parentChunk->pLocal[parentRow] * world;
+		parent = parentChunk->pParent ? parentChunk->pParent[parentRow] : Entity();
+	}
+	return world;
+}
+
+void World::ForEachChunk(uint32_t mask, const std::function<void(WorldChunk&)>& function)
+{
+	for (auto& archetype : m_arrArchetypes)
+	{
+		if ((archetype->mask & mask) != mask)
+		{
+			continue;
+		}
+		for (auto& chunk : archetype->chunks)
+		{
+			if (chunk->uCount > 0)
+			{
+				function(*chunk);
+			}
+		}
+	}
+}
+
+void World::ForEachChunk(uint32_t mask, const std::function<void(const WorldChunk&)>& function) const
+{
+	for (const auto& archetype : m_arrArchetypes)
+	{
+		if ((archetype->mask & mask) != mask)
+		{
+			continue;
+		}
+		for (const auto& chunk : archetype->chunks)
+		{
+			if (chunk->uCount > 0)
+			{
+				function(*chunk);
+			}
+		}
+	}
+}
+
+void World::GetChunks(uint32_t mask, std::vector<WorldChunk*>& chunks)
+{
+	chunks.clear();
+	ForEachChunk(mask, [&](WorldChunk& chunk) { chunks.push_back(&chunk); });
+}
+
+Entity World::Import(Node& root, Entity parent)
+{
+	const GeometryNode* geometryNode = dynamic_cast<const GeometryNode*>(&root);
+	uint32_t mask = ComponentBit(ComponentType::Transform) |
+		ComponentBit(ComponentType::Velocity) |
+		ComponentBit(ComponentType::Rotation) |
+		ComponentBit(ComponentType::Bounds);
+	if (geometryNode && geometryNode->GetGeometry())
+	{
+		mask |= ComponentBit(ComponentType::Renderable);
+	}
+	if (parent.IsValid())
+	{
+		mask |= ComponentBit(ComponentType::Parent);
+	}
+
+	const Entity entity = Create(mask);
+	SetLocalMatrix(entity, root.GetMatrix());
+	SetVelocity(entity, root.GetVelocity());
+	SetRadius(entity, root.GetRadius());
+	SetParent(entity, parent);
+	if (geometryNode && geometryNode->GetGeometry())
+	{
+		SetRenderable(entity, geometryNode->GetGeometry(), geometryNode->GetMaterial());
+	}
+
+	// Node keeps its axis normalized
+	uint32_t row = 0;
+	WorldChunk* chunk = GetChunk(entity, row);
+	chunk->pRotationAxisX[row] = root.GetRotationAxis().x;
+	chunk->pRotationAxisY[row] = root.GetRotationAxis().y;
+	chunk->pRotationAxisZ[row] = root.GetRotationAxis().z;
+	chunk->pRotationAngle[row] = root.GetRotationAngle();
+	chunk->pRotationSpeed[row] = root.GetRotationSpeed();
+	chunk->pWorld[row] = ResolveWorldMatrix(*chunk, row);
+
+	for (const auto& child : root.GetNodes())
+	{
+		Import(*child, entity);
+	}
+	return entity;
+}
+
+void World::IntegrateSystem(World& world, WorldChunk& chunk, float frametime)
+{
+	// Plain loops over separate arrays, the compiler vectorizes these
+	const uint32_t count = chunk.uCount;
+	float* __restrict x = chunk.pPositionX;
+	float* __restrict y = chunk.pPositionY;
+	float* __restrict z = chunk.pPositionZ;
+	const float* __restrict vx = chunk.pVelocityX;
+	const float* __restrict vy = chunk.pVelocityY;
+	const float* __restrict vz = chunk.pVelocityZ;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		x[i] += vx[i] * frametime;
+	}
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		y[i] += vy[i] * frametime;
+	}
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		z[i] += vz[i] * frametime;
+	}
+}
+
+void World::RotateSystem(World& world, WorldChunk& chunk, float frametime)
+{
+	const uint32_t count = chunk.uCount;
+	const uint32_t padded = (count + 3) & ~3u;
+
+	// Kernel works on groups of 4, rows past the last entity must not rotate
+	for (uint32_t i = count; i < padded; ++i)
+	{
+		chunk.pRotationAxisX[i] = 0.0f;
+		chunk.pRotationAxisY[i] = 0.0f;
+		chunk.pRotationAxisZ[i] = -1.0f;
+		chunk.pRotationAngle[i] = 0.0f;
+		chunk.pRotationSpeed[i] = 0.0f;
+	}
+
+	// Same kernel as TransformBatch, positions are moved by IntegrateSystem
+	alignas(16) float rotation[9][kChunkCapacity];
+	float* const rotationColumns[9] = { rotation[0], rotation[1], rotation[2], rotation[3], rotation[4], rotation[5], rotation[6], rotation[7], rotation[8] };
+	const float* const axis[3] = { chunk.pRotationAxisX, chunk.pRotationAxisY, chunk.pRotationAxisZ };
+	TransformBatch::Integrate(count, frametime, nullptr, nullptr, axis, chunk.pRotationAngle, chunk.pRotationSpeed, rotationColumns);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (chunk.pRotationSpeed[i] == 0.0f)
+		{
+			continue;
+		}
+		glm::mat4& local = chunk.pLocal[i];
+		local[0] = glm::vec4(rotation[0][i], rotation[1][i], rotation[2][i], 0.0f);
+		local[1] = glm::vec4(rotation[3][i], rotation[4][i], rotation[5][i], 0.0f);
+		local[2] = glm::vec4(rotation[6][i], rotation[7][i], rotation[8][i], 0.0f);
+		local[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+void World::LocalTransformSystem(World& world, WorldChunk& chunk, float frametime)
+{
+	const uint32_t count = chunk.uCount;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		chunk.pLocal[i][3] = glm::vec4(chunk.pPositionX[i], chunk.pPositionY[i], chunk.pPositionZ[i], 1.0f);
+	}
+}
+
+void World::WorldTransformSystem(World& world, WorldChunk& chunk, float frametime)
+{
+	const uint32_t count = chunk.uCount;
+	if (!chunk.pParent)
+	{
+		std::copy(chunk.pLocal, chunk.pLocal + count, chunk.pWorld);
+		return;
+	}
+
+	// Local matrices of all chunks are final by now, parents can be read from any of them
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		chunk.pWorld[i] = world.ResolveWorldMatrix(chunk, i);
+	}
+}
+
+World::ARCHETYPE& World::GetArchetype(uint32_t mask, uint32_t& index)
+{
+	auto found = m_mapArchetypes.find(mask);
+	if (found != m_mapArchetypes.end())
+	{
+		index = found->second;
+		return *m_arrArchetypes[index];
+	}
+
+	index = (uint32_t)m_arrArchetypes.size();
+	auto archetype = std::make_unique<ARCHETYPE>();
+	archetype->mask = mask;
+	archetype->count = 0;
+	m_arrArchetypes.push_back(std::move(archetype));
+	m_mapArchetypes[mask] = index;
+	return *m_arrArchetypes[index];
+}
+
+void World::AddRow(uint32_t archetypeIndex, Entity entity)
+{
+	ARCHETYPE& archetype = *m_arrArchetypes[archetypeIndex];
+	const uint32_t chunkIndex = (uint32_t)(archetype.count / kChunkCapacity);
+	if (chunkIndex == archetype.chunks.size())
+	{
+		archetype.chunks.push_back(std::make_unique<CHUNK>(archetype.mask));
+	}
+
+	CHUNK& chunk = *archetype.chunks[chunkIndex];
+	const uint32_t row = chunk.uCount++;
+	chunk.pEntities[row] = entity;
+	++archetype.count;
+
+	RECORD& record = m_arrRecords[entity.uIndex];
+	record.archetype = archetypeIndex;
+	record.chunk = chunkIndex;
+	record.row = row;
+}
+
+void World::RemoveRow(RECORD& record)
+{
+	// Move the last entity of the archetype into the hole
+	ARCHETYPE& archetype = *m_arrArchetypes[record.archetype];
+	const uint32_t lastChunkIndex = (uint32_t)((archetype.count - 1) / kChunkCapacity);
+	CHUNK& lastChunk = *archetype.chunks[lastChunkIndex];
+	CHUNK& chunk = *archetype.chunks[record.chunk];
+	const uint32_t lastRow = lastChunk.uCount - 1;
+
+	if (&lastChunk != &chunk || lastRow != record.row)
+	{
+		const Entity moved = lastChunk.pEntities[lastRow];
+		chunk.pEntities[record.row] = moved;
+		CopyRow(lastChunk, lastRow, chunk, record.row);
+
+		RECORD& movedRecord = m_arrRecords[moved.uIndex];
+		movedRecord.chunk = record.chunk;
+		movedRecord.row = record.row;
+	}
+
+	// Drop references held by the vacated row
+	if (lastChunk.pGeometry)
+	{
+		lastChunk.pGeometry[lastRow] = nullptr;
+		lastChunk.pMaterial[lastRow] = nullptr;
+	}
+	--lastChunk.uCount;
+	--archetype.count;
+
+	// Keep one spare chunk so that an entity going back and forth does not reallocate
+	while (archetype.chunks.size() > archetype.count / kChunkCapacity + 2)
+	{
+		archetype.chunks.pop_back();
+	}
+}
+
+void World::InitRow(WorldChunk& chunk, uint32_t row)
+{
+	if (chunk.pLocal)
+	{
+		chunk.pPositionX[row] = 0.0f;
+		chunk.pPositionY[row] = 0.0f;
+		chunk.pPositionZ[row] = 0.0f;
+		chunk.pLocal[row] = glm::mat4(1.0f);
+		chunk.pWorld[row] = glm::mat4(1.0f);
+	}
+	if (chunk.pVelocityX)
+	{
+		chunk.pVelocityX[row] = 0.0f;
+		chunk.pVelocityY[row] = 0.0f;
+		chunk.pVelocityZ[row] = 0.0f;
+	}
+	if (chunk.pRotationAxisX)
+	{
+		chunk.pRotationAxisX[row] = 0.0f;
+		chunk.pRotationAxisY[row] = 0.0f;
+		chunk.pRotationAxisZ[row] = -1.0f;
+		chunk.pRotationAngle[row] = 0.0f;
+		chunk.pRotationSpeed[row] = 0.0f;
+	}
+	if (chunk.pRadius)
+	{
+		chunk.pRadius[row] = 1.0f;
+	}
+	if (chunk.pGeometry)
+	{
+		chunk.pGeometry[row] = nullptr;
+		chunk.pMaterial[row] = nullptr;
+	}
+	if (chunk.pParent)
+	{
+		chunk.pParent[row] = Entity();
+	}
+}
+
+void World::CopyRow(const WorldChunk& source, uint32_t sourceRow, WorldChunk& target, uint32_t targetRow)
+{
+	// Only components both chunks have are copied
+	if (source.pLocal && target.pLocal)
+	{
+		target.pPositionX[targetRow] = source.pPositionX[sourceRow];
+		target.pPositionY[targetRow] = source.pPositionY[sourceRow];
+		target.pPositionZ[targetRow] = source.pPositionZ[sourceRow];
+		target.pLocal[targetRow] = source.pLocal[sourceRow];
+		target.pWorld[targetRow] = source.pWorld[sourceRow];
+	}
+	if (source.pVelocityX && target.pVelocityX)
+	{
+		target.pVelocityX[targetRow] = source.pVelocityX[sourceRow];
+		target.pVelocityY[targetRow] = source.pVelocityY[sourceRow];
+		target.pVelocityZ[targetRow] = source.pVelocityZ[sourceRow];
+	}
+	if (source.pRotationAxisX && target.pRotationAxisX)
+	{
+		target.pRotationAxisX[targetRow] = source.pRotationAxisX[sourceRow];
+		target.pRotationAxisY[targetRow] = source.pRotationAxisY[sourceRow];
+		target.pRotationAxisZ[targetRow] = source.pRotationAxisZ[sourceRow];
+		target.pRotationAngle[targetRow] = source.pRotationAngle[sourceRow];
+		target.pRotationSpeed[targetRow] = source.pRotationSpeed[sourceRow];
+	}
+	if (source.pRadius && target.pRadius)
+	{
+		target.pRadius[targetRow] = source.pRadius[sourceRow];
+	}
+	if (source.pGeometry && target.pGeometry)
+	{
+		target.pGeometry[targetRow] = source.pGeometry[sourceRow];
+		target.pMaterial[targetRow] = source.pMaterial[sourceRow];
+	}
+	if (source.pParent && target.pParent)
+	{
+		target.pParent[targetRow] = source.pParent[sourceRow];
+	}
+}